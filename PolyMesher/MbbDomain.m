@@ -9,11 +9,15 @@ function [x] = MbbDomain(Demand,Arg)
     case('Dist');  x = DistFnc(Arg,BdBox);
     case('BC');    x = BndryCnds(Arg{:},BdBox);
     case('BdBox'); x = BdBox;
+    case('Tree');  x = DistTree(BdBox);
     case('PFix');  x = FixedPoints(BdBox);
   end
 %----------------------------------------------- COMPUTE DISTANCE FUNCTIONS
 function Dist = DistFnc(P,BdBox)
   Dist = dRectangle(P,BdBox(1),BdBox(2),BdBox(3),BdBox(4));
+%------------------------------------------------- DISTANCE EXPRESSION TREE
+function Tree = DistTree(BdBox)
+  Tree = sdfOp('rectangle',BdBox(1),BdBox(2),BdBox(3),BdBox(4));
 %---------------------------------------------- SPECIFY BOUNDARY CONDITIONS
 function [x] = BndryCnds(Node,Element,BdBox)
   eps = 0.1*sqrt((BdBox(2)-BdBox(1))*(BdBox(4)-BdBox(3))/size(Node,1));
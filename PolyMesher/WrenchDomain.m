@@ -9,6 +9,7 @@ function [x] = WrenchDomain(Demand,Arg)
     case('Dist');  x = DistFnc(Arg,BdBox);
     case('BC');    x = BndryCnds(Arg{:},BdBox);
     case('BdBox'); x = BdBox;
+    case('Tree');  x = DistTree(BdBox);
     case('PFix');  x = FixedPoints(BdBox);
   end
 %----------------------------------------------- COMPUTE DISTANCE FUNCTIONS
@@ -25,6 +26,20 @@ function Dist = DistFnc(P,BdBox)
   d8 = dCircle(P,2,0,0.3);
   din = dUnion(d8,d7);
   Dist = dDiff(douter,din);
+%------------------------------------------------- DISTANCE EXPRESSION TREE
+function Tree = DistTree(BdBox)
+  d1 = sdfOp('line',0,0.3,0,-0.3);
+  d2 = sdfOp('line',0,-0.3,2,-0.5);
+  d3 = sdfOp('line',2,-0.5,2,0.5);
+  d4 = sdfOp('line',2,0.5,0,0.3);
+  d5 = sdfOp('circle',0,0,0.3);
+  d6 = sdfOp('circle',2,0,0.5);
+  douter = sdfOp('union',d6,sdfOp('union',d5,...
+           sdfOp('intersect',d4,sdfOp('intersect',d3,sdfOp('intersect',d2,d1)))));
+  d7 = sdfOp('circle',0,0,0.175);
+  d8 = sdfOp('circle',2,0,0.3);
+  din = sdfOp('union',d8,d7);
+  Tree = sdfOp('diff',douter,din);
 %---------------------------------------------- SPECIFY BOUNDARY CONDITIONS
 function [x] = BndryCnds(Node,Element,BdBox)
   eps = 0.1*sqrt((BdBox(2)-BdBox(1))*(BdBox(4)-BdBox(3))/size(Node,1));
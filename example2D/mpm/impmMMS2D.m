@@ -122,6 +122,11 @@ form  = 'cu' ;             % using cubic spline weight function
 di1 = ones(length(coords),1)*dmax1*mesh.deltax;
 di2 = ones(length(coords),1)*dmax2*mesh.deltax;
 
+% the compiled mex/MLSBasis.c gives the MLS shape functions of all grid
+% nodes (cell centres) as one sparse matrix, neighbours found by a cell list
+useMex = exist('MLSBasis','file') == 3;
+cellCenter = squeeze(mean(reshape(node(element',:),size(element,2),[],2),1));
+
 %% plot mesh, particles
 figure(1)
 hold on
@@ -161,6 +166,9 @@ neforce     = zeros(nodeCount,2);  % nodal external force vector
 cellDensity = zeros(elemCount,1);  % cell-centerd density
 cellStress  = zeros(elemCount,3);  % cell-centerd stress
 
+if useMex
+  cellDensity = MLSBasis(cellCenter,coords,di2,1,form)*density;
+else
 for e=1:elemCount
   esctr = element(e,:);
   enode = node(esctr,:);
@@ -171,6 +179,7 @@ for e=1:elemCount
   cellDensity(e) = cellDensity(e) + dot(phi,density(index));
   %cellStress(e)  = cellStress(e)  + dot(phi,s(index));
 end
+end
 
 %% Solver
 
@@ -229,6 +238,9 @@ while ( t < time )
   end
   
   % project velocity to grid nodes (MLS)
+  if useMex
+    nvelo0 = MLSBasis(node,coords,di1,1,form)*velo;
+  else
   for i=1:nodeCount
     pt    = node(i,:);
     index = defineSupport2D(coords,pt,di1);
@@ -237,6 +249,7 @@ while ( t < time )
     nvelo0(i,1) = nvelo0(i,1) + dot(phi,velo(index,1));
     nvelo0(i,2) = nvelo0(i,2) + dot(phi,velo(index,2));
   end
+  end
   
   % update nodal velocity
   nforce    = niforce + neforce;
@@ -287,6 +300,11 @@ while ( t < time )
   % project particle density/stress to grid centers (MLS)
   cellDensity(:) = 0;
   cellStress(:)  = 0;
+  if useMex
+    phi         = MLSBasis(cellCenter,coords,di2,1,form);
+    cellDensity = phi*density;
+    cellStress  = phi*stress;
+  else
   for e=1:elemCount
     esctr = element(e,:);
     enode = node(esctr,:);        
@@ -299,6 +317,7 @@ while ( t < time )
     cellStress(e,2)  = cellStress(e,2)  + dot(phi,stress(index,2));
     cellStress(e,3)  = cellStress(e,3)  + dot(phi,stress(index,3));
   end
+  end
   
   % update the element particle list  
   for p=1:pCount
@@ -16,6 +16,8 @@ addpath ../fem_util/
 addpath ../fem-functions/
 addpath ../post-processing/
 addpath mex/
+addpath ../../particleGen/
+addpath ../../util/
 
 %%
 clc
@@ -65,47 +67,22 @@ ppc    = 2; % # of particle per cell is ppc x ppc
 useGPs = 1; % particles at Gauss points
 useGPs = 0; % particles at geometric points regularly divide the elements
 
-if (useGPs==0)
-  dx = mesh.deltax/(ppc);
-  dy = mesh.deltay/(ppc);
+% particles above y = 100, Gauss points or regular sub-cell centres of the
+% cells, generated without growing arrays (generateMP, mex SeedParticles)
+if (useGPs)
+  place = 'gauss';
+else
+  place = 'regular';
 end
 
-[W,Q]=quadrature(  ppc, 'GAUSS', 2 ); % 2x2 Gaussian quadrature
-
-
-volume = []; mass   = []; coord  = [];
-
-for e=1:elemCount                 % start of element loop
-  sctr = element(e,:);          %  element scatter vector
-  pts  = node(sctr,:);
-  if (useGPs)
-    for q=1:size(W,1)                           % quadrature loop
-      pt=Q(q,:);                              % quadrature point
-      wt=W(q);                                % quadrature weight
-      [N,dNdxi]=lagrange_basis('Q4',pt);
-      J0 = pts'*dNdxi;
-      x  = N'*pts;      
-      if ( x(2) >= 100 )
-        volume  = [volume;wt*det(J0)];
-        mass    = [mass; wt*det(J0)*rho];
-        coord   = [coord;x];
-      end
-    end
-  else
-    x1 = pts(1,:); % first corner of the cell
-    for i=1:ppc
-      for j=1:ppc
-        x(1) = x1(1) + dx*0.5 + (j-1)*dx;
-        x(2) = x1(2) + dy*0.5 + (i-1)*dy;
-        if ( x(2) >= 100 )
-          volume  = [volume;dx*dy];
-          mass    = [mass; dx*dy*rho];
-          coord   = [coord;x];
-        end
-      end
-    end
-  end
-end
+geo.type = 'rectangle';
+geo.x    = [0 lx];
+geo.y    = [100 ly];
+res      = generateMP(geo,ppc,mesh,place);
+
+volume = res.volume;
+mass   = res.volume*rho;
+coord  = res.position;
 
 pCount = length(volume);
 
@@ -160,6 +160,34 @@ nmomentum = zeros(nodeCount,2);  % nodal momentum vector
 niforce   = zeros(nodeCount,2);  % nodal internal force vector
 neforce   = zeros(nodeCount,2);  % nodal external force vector
 
+%% native B-spline transfers (mex/ParticlesToNodesBspline.c, UpdateParticlesBspline.c)
+% the grid nodes are the control points of surf, numbered as in igaMesh
+
+useMex = ( exist('ParticlesToNodesBspline','file') == 3 && ...
+           exist('UpdateParticlesBspline','file')  == 3 );
+
+bGrid.deltax = deltax;
+bGrid.deltay = deltay;
+bGrid.numx   = igaMesh.noElemsU;
+bGrid.numy   = igaMesh.noElemsV;
+bGrid.degree = igaMesh.p;
+bGrid.xmin   = xMin;
+bGrid.ymin   = yMin;
+
+body.coord   = xp;
+body.mass    = Mp;
+body.volume  = Vp;
+body.volume0 = Vp0;
+body.velo    = vp;
+body.deform  = Fp;
+body.stress  = s;
+body.strain  = eps;
+body.C       = C;
+bodies       = {body};
+
+nvelo = zeros(nodeCount,2);  % nodal velocity vector
+nacce = zeros(nodeCount,2);  % nodal acceleration vector
+
 %% plot B-splines mesh, particles
 
 figure
@@ -195,116 +223,137 @@ vel   = cell(nsteps,1);
 istep = 1;
 
 while ( t < time )
-    % reset grid data
-    nmass(:)     = 0;
-    nmomentum(:) = 0;
-    niforce(:)   = 0;
-    % loop over computational cells or elements
-    for e=1:elemCount                
-        esctr  = igaMesh.globElems (e,:);     % element connectivity
-        pts    = igaMesh.controlPts(esctr,:); % element nodal coords
-        mpts   = mpoints{e};                  % particles inside element e        
-        % loop over particles
-        for p=1:length(mpts)
-            pid  = mpts(p);
-            x    = xp(pid,1);
-            y    = xp(pid,2);
-            xi   = (x-xMin)/L;
-            et   = (y-yMin)/w;
+    if ( useMex )
+        % MEX functions: P2G, nodal update and G2P over all particles at once
+        [nmass,nmomentum,niforce] = ParticlesToNodesBspline(bodies,bGrid);
+        nmomentum = nmomentum + niforce*dtime;
+        nvelo(:)  = 0;
+        nacce(:)  = 0;
+        act       = nmass > tol;
+        nvelo(act,:) = nmomentum(act,:)./[nmass(act) nmass(act)];
+        nacce(act,:) = niforce(act,:)  ./[nmass(act) nmass(act)];
+        UpdateParticlesBspline(bodies,bGrid,nvelo,nacce,dtime);
+        xp  = bodies{1}.coord;
+        vp  = bodies{1}.velo;
+        s   = bodies{1}.stress;
+        eps = bodies{1}.strain;
+        Vp  = bodies{1}.volume;
+        k   = 0.5*sum(Mp.*sum(vp.^2,2));
+        u   = 0.5*sum(Vp.*sum(s.*eps,2));
+    else
+        % reset grid data
+        nmass(:)     = 0;
+        nmomentum(:) = 0;
+        niforce(:)   = 0;
+        % loop over computational cells or elements
+        for e=1:elemCount                
+            esctr  = igaMesh.globElems (e,:);     % element connectivity
+            pts    = igaMesh.controlPts(esctr,:); % element nodal coords
+            mpts   = mpoints{e};                  % particles inside element e        
+            % loop over particles
+            for p=1:length(mpts)
+                pid  = mpts(p);
+                x    = xp(pid,1);
+                y    = xp(pid,2);
+                xi   = (x-xMin)/L;
+                et   = (y-yMin)/w;
             
-            [N, dNdxi, dNdeta] = BSPLINE2DBasisDers([xi;et],igaMesh.p,igaMesh.q,...
-                igaMesh.uKnot,igaMesh.vKnot);
+                [N, dNdxi, dNdeta] = BSPLINE2DBasisDers([xi;et],igaMesh.p,igaMesh.q,...
+                    igaMesh.uKnot,igaMesh.vKnot);
                         
-            jacob   = pts' * [dNdxi' dNdeta'];
-            J1      = det(jacob);
-            dNdx    = [dNdxi' dNdeta'] * inv(jacob);
+                jacob   = pts' * [dNdxi' dNdeta'];
+                J1      = det(jacob);
+                dNdx    = [dNdxi' dNdeta'] * inv(jacob);
                                     
-            % particle mass and momentum to node
-            stress = s(pid,:);
+                % particle mass and momentum to node
+                stress = s(pid,:);
             
-            for i=1:length(esctr)
-                id    = esctr(i);
-                dNIdx = dNdx(i,1);
-                dNIdy = dNdx(i,2);
-                nmass(id)       = nmass(id)       + N(i)*Mp(pid);
-                nmomentum(id,:) = nmomentum(id,:) + N(i)*Mp(pid)*vp(pid,:);
-                niforce(id,1)   = niforce(id,1) - Vp(pid)*(stress(1)*dNIdx + stress(3)*dNIdy);
-                niforce(id,2)   = niforce(id,2) - Vp(pid)*(stress(3)*dNIdx + stress(2)*dNIdy);
+                for i=1:length(esctr)
+                    id    = esctr(i);
+                    dNIdx = dNdx(i,1);
+                    dNIdy = dNdx(i,2);
+                    nmass(id)       = nmass(id)       + N(i)*Mp(pid);
+                    nmomentum(id,:) = nmomentum(id,:) + N(i)*Mp(pid)*vp(pid,:);
+                    niforce(id,1)   = niforce(id,1) - Vp(pid)*(stress(1)*dNIdx + stress(3)*dNIdy);
+                    niforce(id,2)   = niforce(id,2) - Vp(pid)*(stress(3)*dNIdx + stress(2)*dNIdy);
+                end
             end
         end
-    end
     
-    % debug
+        % debug
     
-    % update nodal momenta
+        % update nodal momenta
     
-    nmomentum = nmomentum + niforce*dtime;
+        nmomentum = nmomentum + niforce*dtime;
     
-    % update particle velocity and position and stresses
-    k = 0;
-    u = 0;
-    for e=1:elemCount
-        esctr  = igaMesh.globElems (e,:);     % element connectivity
-        pts    = igaMesh.controlPts(esctr,:); % element nodal coords        
-        mpts   = mpoints{e};        
-        % loop over particles
-        for p=1:length(mpts)
-            pid  = mpts(p);
-            x    = xp(pid,1);
-            y    = xp(pid,2);
-            xi   = (x-xMin)/L;
-            et   = (y-yMin)/w;
+        % update particle velocity and position and stresses
+        k = 0;
+        u = 0;
+        for e=1:elemCount
+            esctr  = igaMesh.globElems (e,:);     % element connectivity
+            pts    = igaMesh.controlPts(esctr,:); % element nodal coords        
+            mpts   = mpoints{e};        
+            % loop over particles
+            for p=1:length(mpts)
+                pid  = mpts(p);
+                x    = xp(pid,1);
+                y    = xp(pid,2);
+                xi   = (x-xMin)/L;
+                et   = (y-yMin)/w;
             
-            [N, dNdxi, dNdeta] = BSPLINE2DBasisDers([xi;et],igaMesh.p,igaMesh.q,...
-                igaMesh.uKnot,igaMesh.vKnot);
+                [N, dNdxi, dNdeta] = BSPLINE2DBasisDers([xi;et],igaMesh.p,igaMesh.q,...
+                    igaMesh.uKnot,igaMesh.vKnot);
                         
-            jacob   = pts' * [dNdxi' dNdeta'];
-            J1      = det(jacob);
-            dNdx    = [dNdxi' dNdeta'] * inv(jacob);
+                jacob   = pts' * [dNdxi' dNdeta'];
+                J1      = det(jacob);
+                dNdx    = [dNdxi' dNdeta'] * inv(jacob);
             
             
-            Lp = zeros(2,2);
-            for i=1:length(esctr)
-                id = esctr(i);
-                vI = [0 0];
-                if nmass(id) > tol
-                    vp(pid,:)  = vp(pid,:) + dtime * N(i)*niforce(id,:)  /nmass(id);
-                    xp(pid,:)  = xp(pid,:) + dtime * N(i)*nmomentum(id,:)/nmass(id);
-                    vI         = nmomentum(id,:)/nmass(id);  % nodal velocity
+                Lp = zeros(2,2);
+                for i=1:length(esctr)
+                    id = esctr(i);
+                    vI = [0 0];
+                    if nmass(id) > tol
+                        vp(pid,:)  = vp(pid,:) + dtime * N(i)*niforce(id,:)  /nmass(id);
+                        xp(pid,:)  = xp(pid,:) + dtime * N(i)*nmomentum(id,:)/nmass(id);
+                        vI         = nmomentum(id,:)/nmass(id);  % nodal velocity
+                    end
+                    Lp = Lp + vI'*dNdx(i,:);         % particle gradient velocity
                 end
-                Lp = Lp + vI'*dNdx(i,:);         % particle gradient velocity
-            end
             
-            F       = ([1 0;0 1] + Lp*dtime)*reshape(Fp(pid,:),2,2);
-            Fp(pid,:)= reshape(F,1,4);
-            Vp(pid) = det(F)*Vp0(pid);
-            dEps    = dtime * 0.5 * (Lp+Lp');
-            dsigma  = C * [dEps(1,1);dEps(2,2);2*dEps(1,2)] ;
-            s(pid,:)  = s(pid,:) + dsigma';
-            eps(pid,:)= eps(pid,:) + [dEps(1,1) dEps(2,2) 2*dEps(1,2)];
+                F       = ([1 0;0 1] + Lp*dtime)*reshape(Fp(pid,:),2,2);
+                Fp(pid,:)= reshape(F,1,4);
+                Vp(pid) = det(F)*Vp0(pid);
+                dEps    = dtime * 0.5 * (Lp+Lp');
+                dsigma  = C * [dEps(1,1);dEps(2,2);2*dEps(1,2)] ;
+                s(pid,:)  = s(pid,:) + dsigma';
+                eps(pid,:)= eps(pid,:) + [dEps(1,1) dEps(2,2) 2*dEps(1,2)];
             
-            k = k + 0.5*(vp(pid,1)^2+vp(pid,2)^2)*Mp(pid);
-            u = u + 0.5*Vp(pid)*s(pid,:)*eps(pid,:)';
+                k = k + 0.5*(vp(pid,1)^2+vp(pid,2)^2)*Mp(pid);
+                u = u + 0.5*Vp(pid)*s(pid,:)*eps(pid,:)';
+            end
         end
     end
-    
+
     % store time,velocty for plotting
     
     pos{istep} = xp;
     vel{istep} = vp;
     
-    % update the element particle list
-    
-    for p=1:pCount
-        x = xp(p,1);
-        y = xp(p,2);
-        e = floor(x/deltax) + 1 + igaMesh.noElemsU*floor(y/deltay);
-        pElems(p) = e;
-    end
+    % update the element particle list (MATLAB loops only)
     
-    for e=1:elemCount
-        id  = find(pElems==e);
-        mpoints{e}=id;
+    if ( ~useMex )
+        for p=1:pCount
+            x = xp(p,1);
+            y = xp(p,2);
+            e = floor(x/deltax) + 1 + igaMesh.noElemsU*floor(y/deltay);
+            pElems(p) = e;
+        end
+        
+        for e=1:elemCount
+            id  = find(pElems==e);
+            mpoints{e}=id;
+        end
     end
     
     % store time,velocty for plotting
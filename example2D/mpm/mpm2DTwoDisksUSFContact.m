@@ -52,6 +52,8 @@ vtkFileName1  = '../results/mpm2DTwoDisksReleaseGrid';
 
 plotNormal = 0;
 contact    = 1; %either 1 or 0 (free contact in MPM)
+friction   = 0; % Coulomb friction coefficient of the MEX contact, negative for no-slip
+useMex     = exist('ParticlesToNodesContact','file') == 3;
 
 tic;
 
@@ -162,6 +164,10 @@ bodies(2) = body2;
 
 bodyCount = 2;
 
+for ib=1:bodyCount
+    bodies(ib).C = C; % elasticity matrix, used by the MEX UpdateParticles
+end
+
 %% find elements to which particles belong to
 % two data structures are used
 % 1. particle -> element
@@ -265,6 +271,17 @@ istep = 1;
 while ( t < time )
     disp(['time step ',num2str(t)])
     
+    if useMex && contact
+        % P2G, contact detection/correction and G2P on compact per-body nodal
+        % layers (only the active nodes of each body are stored)
+        [nvelo,nacce,contactNodes,layer] = ParticlesToNodesContact(bodies,grid,dtime,friction);
+        UpdateParticles(bodies,grid,nvelo,nacce,dtime,layer); % MEX function
+        k = 0; u = 0;
+        for ib=1:bodyCount
+            k = k + 0.5*sum(bodies(ib).mass.*sum(bodies(ib).velo.^2,2));
+            u = u + 0.5*sum(bodies(ib).volume.*sum(bodies(ib).stress.*bodies(ib).strain,2));
+        end
+    else
     nvelo(:)     = 0;
     nmassS(:)     = 0;
     nmomentumS(:) = 0;
@@ -486,9 +503,11 @@ while ( t < time )
             end
         end
     end
+    end % useMex
     
-    % update the element particle list
+    % update the element particle list (not used by the compact MEX layers)
     
+    if ~(useMex && contact)
     for ib=1:length(bodies)
         body      = bodies(ib);
         elems     = ones(length(body.volume),1);
@@ -509,6 +528,7 @@ while ( t < time )
         
         bodies(ib).mpoints  = mpoints;
     end
+    end % ~(useMex && contact)
     
     % store time,velocty for plotting
     
@@ -1,4 +1,14 @@
 %
+% Dam break: collapse of a water column l x 2l in a tank 5l x 3l, modelled
+% as a weakly compressible fluid: Tait pressure from the volume ratio J
+% (the only kinematic state of the particles, no deformation gradient),
+% deviatoric viscous stress and artificial bulk viscosity.
+%
+% Uses the compiled mex/FluidMPM.c when it is available, on a quadratic
+% B-spline grid (the linear basis suffers from cell crossing at the free
+% surface); the vectorised linear MPM with the MUSL update below otherwise.
+% Set refine = 20 for about 10^6 particles.
+%
 % Vinh Phu Nguyen
 % Cardiff University, Wales, UK
 % February 2014.
@@ -6,8 +16,6 @@
 %%
 
 
-addpath ../../fem_util/
-addpath ../../fem-functions/
 addpath ../../postProcessing/
 addpath ../../constitutiveModels/
 addpath ../../grid/
@@ -25,16 +33,17 @@ opts = struct('Color','rgb','Bounds','tight','FontMode','fixed','FontSize',20);
 
 %% Material properties
 
-rho = 1000;
-g   = 9.81;
-K_f     = 2e6;
-lambda  = 0.001;
+rho     = 1000;
+g       = 9.81;
+B       = 2e6;         % Tait constant, p = B((rho/rho0)^gamma - 1)
 gamma   = 7;
+K_f     = gamma*B;     % bulk modulus rho0*c0^2
+mu      = 0.001;       % dynamic viscosity
+q1      = 0.06;        % artificial bulk viscosity, linear
+q2      = 1.5;         % and quadratic coefficients
 
 CFL = 0.4;
 
-identity = [1 0; 0 1];
-
 vtkFileName  = 'dam-break';
 interval     = 50;
 
@@ -45,102 +54,79 @@ l  = 0.057;
 Lx = 5*l;
 Ly = 3*l;
 
-noX0 = 90;      % number of elements along X direction
-noY0 = 40;      % number of elements along Y direction
+refine = 1;
+noX0   = 90*refine;      % number of elements along X direction
+noY0   = 40*refine;      % number of elements along Y direction
 
 ghostCell = 0;
 
 [mesh]=buildGrid2D(Lx,Ly,noX0,noY0, ghostCell);
 
-%% generate material points
+useMex = ( exist('FluidMPM','file') == 3 );
 
-noParticle = 2;
+bGrid.deltax = mesh.deltax;
+bGrid.deltay = mesh.deltay;
+bGrid.numx   = noX0;
+bGrid.numy   = noY0;
+bGrid.degree = 1;
+if ( useMex ), bGrid.degree = 2; end
 
-[W,Q]=quadrature( noParticle, 'GAUSS', 2 ); % 2x2 Gaussian quadrature
-
-volume = [];
-mass   = [];
-coord  = [];
-
-
-for e=1:mesh.elemCount                 % start of element loop
-    sctr = mesh.element(e,:);          %  element scatter vector
-    pts  = mesh.node(sctr,:);
-    
-    for q=1:size(W,1)                           % quadrature loop
-        pt=Q(q,:);                              % quadrature point
-        wt=W(q);                                % quadrature weight
-        [N,dNdxi]=lagrange_basis('Q4',pt);
-        J0 = pts'*dNdxi;
-        x  = N'*pts;
-        if ( x(1) < l  ) && ( x(2) < 2*l )
-            volume  = [volume;wt*det(J0)];
-            mass    = [mass; wt*det(J0)*rho];
-            coord   = [coord;x];
-        end
-    end
-end
+% walls: control points on the left, right and bottom of the tank (the
+% nodes of mesh for the linear basis)
+nx        = noX0 + bGrid.degree;
+ny        = noY0 + bGrid.degree;
+nodeCount = nx*ny;
+[I,J]     = ndgrid(1:nx,1:ny);
+lNodes    = find(I == 1);
+rNodes    = find(I == nx);
+bNodes    = find(J == 1);
 
-pCount = length(volume);
+%% generate material points: noParticle x noParticle Gauss points per cell
 
-Mp  = mass;                           % mass
-Vp  = volume;                         % volume
-Fp  = repmat([1 0 0 1],pCount,1);     % gradient deformation
-s   = zeros(pCount,3);                % stress
-eps = zeros(pCount,3);                % strain
-vp  = zeros(pCount,2);                % velocity
-xp  = coord;
-rhop  = zeros(pCount,1);                % density
-IntE  = zeros(pCount,1);                % density
-Vp0 = Vp;
-rhop(:) = rho;
-
-%% find elements to which particles belong to
-% two data structures are used
-% 1. particle -> element
-% 2. element  -> particles
-
-pElems  = ones(pCount,1);
-mpoints = cell(mesh.elemCount,1);
-
-for p=1:pCount
-    x = xp(p,1);
-    y = xp(p,2);
-    e = floor(x/mesh.deltax) + 1 + noX0*floor(y/mesh.deltay);
-    pElems(p) = e;
-end
-
-for e=1:mesh.elemCount
-    id  = find(pElems==e);
-    mpoints{e}=id;
-end
+noParticle = 2;
 
-activeElems = unique(pElems);
-activeNodes = unique(mesh.element(activeElems,:));
+[W,Q]   = quadrature( noParticle, 'GAUSS', 2 ); % 2x2 Gaussian quadrature
+[ex,ey] = ndgrid(0:noX0-1,0:noY0-1);            % cell origins
+x       = bsxfun(@plus,ex(:),(Q(:,1)'+1)/2)*mesh.deltax;
+y       = bsxfun(@plus,ey(:),(Q(:,2)'+1)/2)*mesh.deltay;
+w       = repmat(W',numel(ex),1)*mesh.deltax*mesh.deltay/4;
+inside  = ( x < l ) & ( y < 2*l );
 
-%% node quantities
+xp      = [x(inside) y(inside)];
+Vp0     = w(inside);
+Mp      = Vp0*rho;
+pCount  = length(Vp0);
 
-nmass     = zeros(mesh.nodeCount,1);  % nodal mass vector
-nmomentum = zeros(mesh.nodeCount,2);  % nodal momentum vector
-niforce   = zeros(mesh.nodeCount,2);  % nodal internal force vector
-neforce   = zeros(mesh.nodeCount,2);  % nodal external force vector
-nvelo     = zeros(mesh.nodeCount,2);  % nodal external force vector
+vp  = zeros(pCount,2);                % velocity
+s   = zeros(pCount,3);                % Cauchy stress
+Jp  = ones(pCount,1);                 % volume ratio
+pp  = zeros(pCount,1);                % pressure
+
+body.coord   = xp;
+body.mass    = Mp;
+body.volume0 = Vp0;
+body.velo    = vp;
+body.J       = Jp;
+body.stress  = s;
+body.pressure= pp;
+body.bulk    = K_f;
+body.gamma   = gamma;
+body.viscosity = mu;
+body.artificialViscosity = [q1 q2];
+body.gravity = g;
+
+disp([num2str(toc),'   ',num2str(pCount),' PARTICLES '])
 
 %% plot mesh, particles
 
 hold on
 set(gca,'FontSize',14)
 plot_mesh(mesh.node,mesh.element,'Q4','k-',1.);
-%plot_mesh(node,element(pElems,:),'Q4','cy-',2.1);
 plot(xp(:,1),xp(:,2),'k.','markersize',8);
-%plot(mesh.node(mesh.lNodes,1),mesh.node(mesh.lNodes,2),'r*','markersize',20);
-%plot(mesh.node(mesh.rNodes,1),mesh.node(mesh.rNodes,2),'r*','markersize',20);
-%plot(mesh.node(mesh.bNodes,1),mesh.node(mesh.bNodes,2),'r*','markersize',20);
 axis off
 
 ta = [];           % time
 ka = [];           % kinetic energy
-sa = [];           % strain energy
 
 %% Solver
 
@@ -148,197 +134,95 @@ disp([num2str(toc),'   SOLVING '])
 
 tol   = 1e-12; % mass tolerance
 
-c     = sqrt(K_f/rho);
-maxV  = mesh.deltax/c;
-dtime = CFL*maxV;
+hmin  = min(mesh.deltax,mesh.deltay);
+cmax  = sqrt(K_f/rho);
 time  = 0.5;
 t     = 0;
-
-
-nsteps = floor(time/dtime);
-
-pos   = cell(nsteps,1);
-vel   = cell(nsteps,1);
 istep = 1;
 
-while ( t < dtime )
-    disp(['time step ',num2str(t)])
-    % reset grid data
-    nmass(:)     = 0;
-    nmomentum(:) = 0;
-    niforce(:)   = 0;
-    neforce(:)   = 0;
-    nvelo(:)     = 0;
-    % loop over computational cells or elements
-    for ie=1:length(activeElems)
-        e     = activeElems(ie);
-        esctr = mesh.element(e,:);
-        enode = mesh.node(esctr,:);     % element node coords
-        mpts  = mpoints{e};        % particles inside element e
-        % loop over particles
-        for p=1:length(mpts)
-            pid  = mpts(p);
-            % particle mass and momentum to node
-            stress = s(pid,:);
-            pt(1)       = (2*xp(pid,1)-(enode(1,1)+enode(2,1)))*mesh.dxInv;
-            pt(2)       = (2*xp(pid,2)-(enode(2,2)+enode(3,2)))*mesh.dyInv;
-            
-            [N,dNdxi]   = lagrange_basis('Q4',pt);	% element shape functions
-            J0          = enode'*dNdxi;              % element Jacobian matrix
-            dNdx        = dNdxi*inv(J0);
-            for i=1:length(esctr)
-                id    = esctr(i);
-                dNIdx = dNdx(i,1);
-                dNIdy = dNdx(i,2);
-                nmass(id)       = nmass(id)       + N(i)*Mp(pid);
-                nmomentum(id,:) = nmomentum(id,:) + N(i)*Mp(pid)*vp(pid,:);
-                niforce(id,1)   = niforce(id,1) - Vp(pid)*(stress(1)*dNIdx + stress(3)*dNIdy);
-                niforce(id,2)   = niforce(id,2) - Vp(pid)*(stress(3)*dNIdx + stress(2)*dNIdy);
-                neforce(id,2)  =  neforce(id,2) - N(i)*Mp(pid)*g;
-            end
-        end
-    end
-    
-    % update nodal momenta
-    nforce = niforce + neforce;
-    nmomentum(activeNodes,:) = nmomentum(activeNodes,:) + nforce(activeNodes,:)*dtime;
-    
-    % Dirichlet boundary conditions
-    nmomentum(mesh.lNodes,1) = 0; nforce(mesh.lNodes,1) = 0;
-    nmomentum(mesh.rNodes,1) = 0; nforce(mesh.rNodes,1) = 0;
-    nmomentum(mesh.bNodes,2) = 0; nforce(mesh.bNodes,2) = 0;
-    
-    %% update particle velocity
-    % use the updated particle velocity to get grid velocities which are used
-    % later to compute velocity gradient and F and stresses
-    
-    for ie=1:length(activeElems)
-        e     = activeElems(ie);
-        esctr = mesh.element(e,:);
-        enode = mesh.node(esctr,:);
-        mpts  = mpoints{e};
-        
-        % loop over particles
-        for p=1:length(mpts)
-            pid  = mpts(p);
-            pt(1)= (2*xp(pid,1)-(enode(1,1)+enode(2,1)))*mesh.dxInv;
-            pt(2)= (2*xp(pid,2)-(enode(2,2)+enode(3,2)))*mesh.dyInv;
-            
-            [N,dNdxi]=lagrange_basis('Q4',pt);   % element shape functions
-            J0       = enode'*dNdxi;             % element Jacobian matrix
-            invJ0    = inv(J0);
-            dNdx     = dNdxi*invJ0;
-            
-            for i=1:length(esctr)
-                id = esctr(i);
-                vp(pid,:)  = vp(pid,:) + dtime * N(i)*nforce(id,:)/nmass(id);
-            end
-            
-            for i=1:length(esctr)
-                id = esctr(i);
-                nvelo(id,:)  = nvelo(id,:) + N(i)*vp(pid,:)*Mp(pid);
-            end
-        end
-    end
-    
-    nvelo(activeNodes,1) = nvelo(activeNodes,1) ./ nmass(activeNodes);
-    nvelo(activeNodes,2) = nvelo(activeNodes,2) ./ nmass(activeNodes);
-    
-    nvelo(mesh.lNodes,1) = 0;
-    nvelo(mesh.rNodes,1) = 0;
-    nvelo(mesh.bNodes,2) = 0;
-    
-    %% update particle  position and stresses
-    k = 0;
-    u = 0;
-     for ie=1:length(activeElems)
-        e     = activeElems(ie);
-        esctr = mesh.element(e,:);
-        enode = mesh.node(esctr,:);
-        mpts  = mpoints{e};
-        
-        % loop over particles
-        for p=1:length(mpts)
-            pid  = mpts(p);
-            pt(1)= (2*xp(pid,1)-(enode(1,1)+enode(2,1)))*mesh.dxInv;
-            pt(2)= (2*xp(pid,2)-(enode(2,2)+enode(3,2)))*mesh.dyInv;
-            
-            [N,dNdxi]=lagrange_basis('Q4',pt);   % element shape functions
-            J0       = enode'*dNdxi;             % element Jacobian matrix
-            dNdx        = dNdxi*inv(J0);
-            Lp = zeros(2,2);
-            for i=1:length(esctr)
-                id = esctr(i);
-                vI = nvelo(id,:);
-                xp(pid,:)  = xp(pid,:) + dtime * N(i)*nmomentum(id,:)/nmass(id);
-                Lp = Lp + vI'*dNdx(i,:);         % particle gradient velocity
-            end
-            
-            F       = ([1 0;0 1] + Lp*dtime)*reshape(Fp(pid,:),2,2);
-            Fp(pid,:)= reshape(F,1,4);
-            Vp(pid) = det(F)*Vp0(pid);
-            D        = 0.5 * (Lp+Lp');
-            deps    = dtime * D;
-            eps(pid,:)= eps(pid,:) + [deps(1,1) deps(2,2) 2*deps(1,2)];
-            devD    = D - 0.5*(D(1,1)+D(2,2))*identity;
-            
-            temp        = deps(1,1) + deps(2,2);
-            rhop(pid)   = rhop(pid) / (1+temp); % updated density
-            rhop(pid)   = rho / det(F); % updated density
-            p           = K_f*((rhop(pid)/rho)^gamma-1);
-            shear       = 2 * lambda * devD;
-            stress      = shear - p * identity;
-            s(pid,:)    = [stress(1,1) stress(2,2) stress(1,2)];
-%             IntE(pid)   = IntE(pid) + s(pid,:)*[deps(1,1); deps(2,2); 2*deps(1,2)]/rhop(pid);
-%             p           = (gamma-1)*rhop(pid)*IntE(pid);
-%             s(pid,:) = -p*[1; 1; 0] + 2 * lambda * [deps(1,1); deps(2,2); 2*deps(1,2)] ...
-%                 - 2/3 * lambda * temp*[1; 1; 0];
-            
-            k = k + 0.5*(vp(pid,1)^2+vp(pid,2)^2)*Mp(pid);
-            u = u + 0.5*Vp(pid)*s(pid,:)*eps(pid,:)';
-        end
-    end
-    
-    % store time,velocty for plotting
-    
-    pos{istep} = xp;
-    vel{istep} = vp;
-    
-    % update the element particle list
-    
-    for p=1:pCount
-        x = xp(p,1);
-        y = xp(p,2);
-        e = floor(x/mesh.deltax) + 1 + noX0*floor(y/mesh.deltay);
-        pElems(p) = e;
-    end
-    
-    for e=1:mesh.elemCount
-        id  = find(pElems==e);
-        mpoints{e}=id;
+nvelo = zeros(nodeCount,2);
+nacce = zeros(nodeCount,2);
+
+while ( t < time )
+    % stable time step of the sound speed and velocity of the last step
+    dtime = CFL*hmin/cmax;
+    if ( useMex )
+        % MEX function: P2G, nodal update and G2P with one basis evaluation
+        [nmass,nmomentum,nforce,cache] = FluidMPM('p2g',body,bGrid);
+        nmomentum = nmomentum + nforce*dtime;
+        nvelo(:)  = 0;
+        nacce(:)  = 0;
+        act       = nmass > tol;
+        nvelo(act,:) = nmomentum(act,:)./[nmass(act) nmass(act)];
+        nacce(act,:) = nforce(act,:)   ./[nmass(act) nmass(act)];
+        % Dirichlet boundary conditions (slip walls)
+        nvelo([lNodes;rNodes],1) = 0; nacce([lNodes;rNodes],1) = 0;
+        nvelo(bNodes,2)          = 0; nacce(bNodes,2)          = 0;
+        cmax = FluidMPM('g2p',body,bGrid,cache,nvelo,nacce,dtime);
+        xp   = body.coord;
+        vp   = body.velo;
+        s    = body.stress;
+    else
+        % linear basis of all particles as sparse matrices, rows the particles
+        ix   = min(max(floor(xp(:,1)/mesh.deltax),0),noX0-1);
+        iy   = min(max(floor(xp(:,2)/mesh.deltay),0),noY0-1);
+        xi   = xp(:,1)/mesh.deltax - ix;
+        et   = xp(:,2)/mesh.deltay - iy;
+        n1   = ix + 1 + nx*iy;
+        cols = [n1 n1+1 n1+nx+1 n1+nx];
+        rows = repmat((1:pCount)',1,4);
+        Nmat = sparse(rows,cols,[(1-xi).*(1-et) xi.*(1-et) xi.*et (1-xi).*et],pCount,nodeCount);
+        dNx  = sparse(rows,cols,[-(1-et) 1-et et -et]/mesh.deltax,pCount,nodeCount);
+        dNy  = sparse(rows,cols,[-(1-xi) -xi xi 1-xi]/mesh.deltay,pCount,nodeCount);
+        % particles to nodes
+        Vp        = Vp0.*Jp;
+        nmass     = Nmat'*Mp;
+        nmomentum = Nmat'*[Mp.*vp(:,1) Mp.*vp(:,2)];
+        nforce    = -[dNx'*(Vp.*s(:,1)) + dNy'*(Vp.*s(:,3)), ...
+                      dNx'*(Vp.*s(:,3)) + dNy'*(Vp.*s(:,2))];
+        nforce(:,2) = nforce(:,2) - g*nmass;
+        % update nodal momenta, Dirichlet boundary conditions
+        nmomentum = nmomentum + nforce*dtime;
+        nmomentum([lNodes;rNodes],1) = 0; nforce([lNodes;rNodes],1) = 0;
+        nmomentum(bNodes,2)          = 0; nforce(bNodes,2)          = 0;
+        minv      = zeros(nodeCount,1);
+        act       = nmass > tol;
+        minv(act) = 1./nmass(act);
+        minv      = [minv minv];
+        % particle velocities and positions, then the nodal velocities of the
+        % updated particle momenta (MUSL) for the velocity gradient
+        vp    = vp + dtime*Nmat*(nforce.*minv);
+        xp    = xp + dtime*Nmat*(nmomentum.*minv);
+        nvelo = (Nmat'*[Mp.*vp(:,1) Mp.*vp(:,2)]).*minv;
+        nvelo([lNodes;rNodes],1) = 0;
+        nvelo(bNodes,2)          = 0;
+        Lxx   = dNx*nvelo(:,1);  Lxy = dNy*nvelo(:,1);
+        Lyx   = dNx*nvelo(:,2);  Lyy = dNy*nvelo(:,2);
+        % volume ratio, Tait pressure, viscous and artificial bulk stresses
+        Jp    = Jp.*((1+dtime*Lxx).*(1+dtime*Lyy) - dtime^2*Lxy.*Lyx);
+        pp    = K_f/gamma*(Jp.^(-gamma) - 1);
+        c     = sqrt(K_f*Jp.^(1-gamma)/rho);
+        trD   = Lxx + Lyy;
+        q     = (trD < 0).*rho./Jp*hmin.*(q1*c.*abs(trD) + q2*hmin*trD.^2);
+        s     = [-(pp+q) + 2*mu*(Lxx-trD/3), -(pp+q) + 2*mu*(Lyy-trD/3), mu*(Lxy+Lyx)];
+        cmax  = max(c + sqrt(sum(vp.^2,2)));
     end
-    
-    activeElems = unique(pElems);
-    activeNodes = unique(mesh.element(activeElems,:));
-    
+
     if (  mod(istep-1,interval) == 0 )
-        xp = pos{istep};
+        disp(['time step ',num2str(t)])
         vtkFile = sprintf('../../results/mpm/dam-break/%s%d',vtkFileName,istep-1);
-        
         stress = [s sum(s,2)/3];
         data.stress = stress; data.pstrain=zeros(pCount,1);data.velo=vp;
         VTKParticles(xp,vtkFile,data);
     end
-    
-    
-    % store time,velocty for plotting
-    
+
+    % store time,kinetic energy for plotting
+
     ta = [ta;t];
-    ka = [ka;k];
-    sa = [sa;u];
-    
+    ka = [ka;0.5*sum(Mp.*sum(vp.^2,2))];
+
     % advance to the next time step
-    
+
     t = t + dtime;
     istep = istep + 1;
 end
@@ -348,10 +232,10 @@ end
 
 disp([num2str(toc),'   POST-PROCESSING '])
 
+figure
 hold on
 plot_mesh(mesh.node,mesh.element,'Q4','k-',1.);
-%plot_mesh(node,element(pElems,:),'Q4','cy-',2.1);
-plot(xp(:,1),xp(:,2),'k.','markersize',20);
+plot(xp(:,1),xp(:,2),'k.','markersize',8);
 axis off
 
 disp([num2str(toc),'   DONE '])
@@ -139,6 +139,14 @@ wire.up     = up;
 wire.volume = Mp;
 wire.color  = 3*ones(pCount,1);
 
+% wire elements (FEM), sub-cycled against the grid (multi-rate)
+fem.element = wGrid.element;
+fem.estress = estress;
+fem.estrain = estrain;
+fem.le      = (L0/(pCount-1))*ones(pCount-1,1);
+fem.E       = youngW;
+fem.A       = A;
+
 % put all MPM bodies in one variable
 bodies    = cell(3,1);
 bodies{1} = body1;
@@ -207,8 +215,12 @@ disp([num2str(toc),'   SOLVING '])
 
 tol   = 1e-14; % mass tolerance
 
-c     = sqrt(youngW/rhoW);
-dtime = 0.3*bGrid.deltax/c;
+% multi-rate time stepping: the master step is the stable step of the
+% grid and the disks, the stiffer wire is sub-cycled with its own one
+cD    = sqrt(youngD/rhoD);
+cW    = sqrt(youngW/rhoW);
+dtD   = 0.3*bGrid.deltax/cD;
+[dtime,nsub] = multiRateSchedule([dtD 0.3*min(fem.le)/cW],dtD);
 time  = 1.3;
 t     = 0.;
 
@@ -232,6 +244,8 @@ k1 = 0; p1 = 0; k2 = 0; p2 = 0; k3 = 0; p3 = 0;
 
 while ( t < time )
   disp(['time step ',num2str(t)])
+  % wire sub-steps for its current element lengths
+  [dtime,nsub] = multiRateSchedule([dtD 0.3*min(fem.le)/cW],dtD);
   
   nmass(:)      = 0;
   nmomentum0(:) = 0;
@@ -300,35 +314,28 @@ while ( t < time )
         xxp    = body.coord(pid,:);
         Mp     = body.mass(pid);
         vp     = body.velo(pid,:);
-        forces = body.fp(pid,:);
         
         pt(1)= (2*xxp(1)-(enode(1,1)+enode(2,1)))/deltax;
         pt(2)= (2*xxp(2)-(enode(2,2)+enode(3,2)))/deltay;
         [N,dNdxi]=lagrange_basis('Q4',pt);   % element shape functions
-        J0       = enode'*dNdxi;             % element Jacobian matrix
-        %invJ0    = inv(J0);
-        dNdx     = dNdxi/J0;
-        % store grid basis functions and gradients
-        gBasis(ib,pid,:) = N;
-        gGradX(ib,pid,:) = dNdx(:,1);
-        gGradY(ib,pid,:) = dNdx(:,2);
         % loop over nodes of current element "ie"
+        % (the wire forces are added at every sub-step)
         for i=1:length(esctr)
           id               = esctr(i);
           Ni               = N(i);
           nmass(id)        = nmass(id)         + Ni*Mp;
           nmomentum0(id,:) = nmomentum0(id,:)  + Ni*Mp*vp;
-          niforce(id,:)    = niforce(id,:)     + Ni*forces;
         end
       end
     end
   end
-  % update nodal momenta
-  nmomentum                 = nmomentum0 + niforce*dtime;
-  nmomentum(bGrid.tNodes,:) = 0;
-  nmomentum(bGrid.bNodes,:) = 0;
+  % update nodal momenta: disk forces held over the master step, wire
+  % forces at every sub-step, which also move the wire particles
+  [nmomentum,nmomentumInt,bodies{3},fem,p3] = subcycleFEMParticles(nmass,nmomentum0,niforce,...
+      bodies{3},bodies(1:mpmBodyCount),fem,bGrid,dtime,nsub(2),[bGrid.tNodes(:);bGrid.bNodes(:)],tol);
   
-  %% update particle velocity and positions for all particles (MPM and FEM)
+  %% update particle velocity and positions for the MPM particles, map
+  %% back the momenta of all particles (MPM and FEM)
   for ib=1:bodyCount
     body      = bodies{ib};
     elems     = body.elements;
@@ -348,18 +355,20 @@ while ( t < time )
         vp   = body.velo(pid,:);        
         % retrieve the grid functions/grads
         %N    = gBasis(ib,pid,:);
-        for i=1:length(esctr)
-          id      = esctr(i);
-          x       = xp0 - node(id,:);
-          [N,~]   = getMPM2D(x,deltax,deltay);
-          if nmass(id) > tol
-            massInv  = (1/nmass(id))*N;
-            vp       = vp +  (nmomentum(id,:)-nmomentum0(id,:))*massInv;
-            xp       = xp + dtime * nmomentum(id,:)*massInv;
+        if ( ib <= mpmBodyCount )
+          for i=1:length(esctr)
+            id      = esctr(i);
+            x       = xp0 - node(id,:);
+            [N,~]   = getMPM2D(x,deltax,deltay);
+            if nmass(id) > tol
+              massInv  = (1/nmass(id))*N;
+              vp       = vp +  (nmomentum(id,:)-nmomentum0(id,:))*massInv;
+              xp       = xp + nmomentumInt(id,:)*massInv;
+            end
           end
-        end        
-        bodies{ib}.velo(pid,:)  = vp;
-        bodies{ib}.coord(pid,:) = xp;
+          bodies{ib}.velo(pid,:)  = vp;
+          bodies{ib}.coord(pid,:) = xp;
+        end
         % mapped back bGrid momenta (used to compute L,,epsilon and stress)
         for i=1:length(esctr)
           id      = esctr(i);          
@@ -431,62 +440,11 @@ while ( t < time )
   p2 = 0.5*dot( bodies{2}.volume,...
                 dot( bodies{2}.stress,bodies{2}.strain,2 ) );
 
-  % update FEM particles forces, step1,
-  for ib=mpmBodyCount+1:bodyCount
-    body      = bodies{ib};
-    elems     = body.elements;
-    mpoints   = body.mpoints; 
-    up        = body.up; up(:) = 0.;
-    % loop over computational cells or elements
-    for ie=1:length(elems)
-      e     = elems(ie);
-      esctr = element(e,:);      % element connectivity
-      enode = node(esctr,:);     % element node coords
-      mpts  = mpoints{e};        % particles inside element e      
-      % loop over particles
-      for p=1:length(mpts)
-        pid  = mpts(p);                                
-        % retrieve the grid functions/grads        
-        N    = gBasis(ib,pid,:);       
-        for i=1:length(esctr)
-          id = esctr(i);
-          if nmass(id) > 0
-            vI  = nmomentumS(id,:)/nmass(id);  % nodal velocity            
-            up(pid,:) = up(pid,:) + dtime*vI*N(i); % particle increment displacement
-          end
-        end                                 
-      end
-    end
-    bodies{ib}.up = up;
-  end
-  % update FEM particles forces, assume only one set of FEM particles
-  fp = bodies{3}.fp; fp(:)=0; p3 = 0;
-  for e=1:size(wGrid.element,1)
-      esctr    = wGrid.element(e,:);
-      nodes    = bodies{bodyCount}.coord(esctr,:);
-      ll       = norm(nodes(1,:)-nodes(2,:));
-      cosTheta = (nodes(2,1)-nodes(1,1))/ll;
-      sinTheta = (nodes(2,2)-nodes(1,2))/ll;
-      Q        = [cosTheta  sinTheta;-sinTheta cosTheta];
-      Qinv     = [cosTheta -sinTheta;sinTheta cosTheta];
-      incDisp  = bodies{bodyCount}.up(esctr,:);
-      deltaU1  = Q*incDisp(1,:)';
-      deltaU2  = Q*incDisp(2,:)';            
-      incStrain = (1/ll)*(-deltaU1(1)+deltaU2(1));      
-      %if incStrain < 0, incStrain=0.; end
-      %if incStrain < 0, disp('negative inc. strain'); end
-      estrain(e) = estrain(e) + incStrain;
-      sig        = estress(e) + youngW*incStrain;
-      %if strain(e) < 0, disp('NEGATIVE STRAIN');sig=0;end      
-      %if sig < 0, sig = 0; end
-      estress(e) = sig;
-      le(e)      = ll;
-      force      = sig*A;
-      fp(esctr(1),:)  = fp(esctr(1),:) + (Qinv*[force;0])';
-      fp(esctr(2),:)  = fp(esctr(2),:) - (Qinv*[force;0])';
-      p3 = p3 + estrain(e)*sig*0.5*ll;
-  end
-  bodies{3}.fp = fp;
+  % wire forces, element stresses and strains were updated by the sub-steps
+  estress = fem.estress;
+  estrain = fem.estrain;
+  le      = fem.le;
+  bodies{3}.coord0 = bodies{3}.coord;
   bodies{3}.stress = zeros(length(wire.coord),3);
   
   % update the element particle list  
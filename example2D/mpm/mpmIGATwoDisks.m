@@ -93,6 +93,13 @@ for gp=1:size(W,1)
   [shapes(gp,:), derivs(gp,:,:)] = getShapeGradBernstein2D(mesh1.p,mesh1.q,Q(gp,1),Q(gp,2));
 end
 
+% Gauss points of all elements for the native Bezier extraction path
+% (mex/BezierBasis.c), ordered as the rows of reshape(body.stress,[],3)
+useMex  = ( exist('BezierBasis','file') == 3 );
+gpElems = repmat((1:mesh1.elemCount)',noGpEle,1);
+gpXi    = kron(Q,ones(mesh1.elemCount,1));
+gpWt    = kron(W,ones(mesh1.elemCount,1));
+
 
 pCount         = mesh1.nodeCount;
 body1.coord    = mesh1.node;
@@ -377,6 +384,30 @@ while ( t < time )
   % update FEM particles forces(step2)
   u = 0;
   for ib=1:bodyCount
+    if ( useMex )
+      % basis of all Gauss points at once, dEps = B*deltaU and f = B'*sigma
+      % as the loops below but vectorized over the Gauss points
+      mesh   = bodies{ib}.mesh;
+      up     = bodies{ib}.up;
+      [R,dRdx,detJ] = BezierBasis(mesh,gpElems,gpXi);
+      sctr   = mesh.element(gpElems,:);
+      ux     = up(:,1); ux = ux(sctr);
+      uy     = up(:,2); uy = uy(sctr);
+      dRx    = dRdx(:,:,1);
+      dRy    = dRdx(:,:,2);
+      dEps   = [sum(dRx.*ux,2) sum(dRy.*uy,2) sum(dRy.*ux+dRx.*uy,2)];
+      sig    = reshape(bodies{ib}.stress,[],3) + dEps*C';
+      epsi   = reshape(bodies{ib}.strain,[],3) + dEps;
+      dV     = detJ.*gpWt;
+      fx     = bsxfun(@times,dRx,sig(:,1).*dV) + bsxfun(@times,dRy,sig(:,3).*dV);
+      fy     = bsxfun(@times,dRy,sig(:,2).*dV) + bsxfun(@times,dRx,sig(:,3).*dV);
+      bodies{ib}.stress = reshape(sig, size(bodies{ib}.stress));
+      bodies{ib}.strain = reshape(epsi,size(bodies{ib}.strain));
+      bodies{ib}.fp     = [accumarray(sctr(:),fx(:),[mesh.nodeCount 1]) ...
+                           accumarray(sctr(:),fy(:),[mesh.nodeCount 1])];
+      u = u + 0.5*sum(dV.*sum(sig.*epsi,2));
+      continue;
+    end
     mesh = bodies{ib}.mesh;
     up   = bodies{ib}.up;
     f    = zeros(mesh.nodeCount*2,1);
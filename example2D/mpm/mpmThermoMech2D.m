@@ -181,6 +181,35 @@ nvelo   = zeros(nodeCount,2);
 nvelo0  = zeros(nodeCount,2);  
 ntemp   = zeros(nodeCount,1);  
 ntemp0  = zeros(nodeCount,1);  
+nacce   = zeros(nodeCount,2);
+
+%% native coupled transfers (mex/ThermoMechMPM.c)
+% the grid is the linear (degree 1) B-spline grid of buildGrid2D
+
+useMex = ( exist('ThermoMechMPM','file') == 3 );
+
+bGrid.deltax = mesh.deltax;
+bGrid.deltay = mesh.deltay;
+bGrid.numx   = mesh.numx;
+bGrid.numy   = mesh.numy;
+bGrid.degree = 1;
+
+body.coord        = coords;
+body.mass         = mass;
+body.volume       = volume;
+body.volume0      = volume0;
+body.velo         = velo;
+body.deform       = deform;
+body.stress       = stress;
+body.strain       = zeros(pCount,3);
+body.C            = C;
+body.temp         = temp;
+body.capacity     = CC;
+body.conductivity = k;
+body.expansion    = alpha;
+body.flux         = Q;
+body.tempFixed    = NaN(pCount,1);  % Dirichlet temperature of the heated particles
+body.tempFixed(idx) = 1.;
 
 %% Solver
 
@@ -189,8 +218,17 @@ disp([num2str(toc),'   SOLVING '])
 tol   = 1e-16; % mass tolerance
 
 c     = sqrt(E/rho);
-dtime = min(0.1*mesh.deltax/cv,0.1*mesh.deltax^2/2/k);
-time  = 50*dtime;
+dtMech  = 0.1*mesh.deltax/cv;
+dtTherm = 0.1*mesh.deltax^2/2/k;
+dtime   = min(dtMech,dtTherm);
+time    = 50*dtime;
+
+% with the MEX function the mechanical time step is the master step and the
+% heat equation is sub-cycled with its own stable time step (multi-rate)
+if ( useMex )
+  [dtime,nsub]     = multiRateSchedule([dtMech dtTherm],dtMech);
+  thermal.substeps = nsub(2);
+end
 t     = 0;
 
 istep = 1;
@@ -200,6 +238,26 @@ ta     = 0:dtime:time;
 
 while ( t < time )
     disp(['time step ',num2str(t)])
+    if ( useMex )
+        % MEX function: mechanical and thermal P2G in one sweep, thermal
+        % sub-steps on the grid, G2P with the same basis evaluation
+        [nmass,nmomentum0,nforce,ntemp0,ntemp,cache] = ThermoMechMPM('p2g',body,bGrid,dtime,thermal);
+        nmomentum = nmomentum0 + nforce*dtime;
+        nvelo(:)  = 0;
+        nacce(:)  = 0;
+        act       = nmass > tol;
+        nvelo(act,:) = nmomentum(act,:)./[nmass(act) nmass(act)];
+        nacce(act,:) = nforce(act,:)   ./[nmass(act) nmass(act)];
+        % Dirichlet BCs
+        nvelo(idx2,1) = 0; nacce(idx2,1) = 0;
+        nvelo(idx1,2) = 0; nacce(idx1,2) = 0;
+        ThermoMechMPM('g2p',body,bGrid,cache,nvelo,nacce,ntemp0,ntemp,dtime);
+        coords = body.coord;
+        velo   = body.velo;
+        stress = body.stress;
+        temp   = body.temp;
+        Q      = body.flux;
+    else
     % reset grid data
     nmass(:)        = 0;
     nmassT(:)       = 0;
@@ -371,6 +429,7 @@ while ( t < time )
     
     activeElems = unique(pElems);
     activeNodes = unique(element(activeElems,:));
+    end
     
     t     = t + dtime;
     istep = istep + 1;
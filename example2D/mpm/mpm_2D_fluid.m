@@ -6,8 +6,9 @@ close all
 clear all
 clc
 
-addpath('A:\Numerical Study\MPM\mpm codes-w\MPM-Matlab\fem_util')
-addpath('A:\Numerical Study\MPM\mpm codes-w\MPM-Matlab\fem-functions')
+addpath ../../grid/
+addpath ../../util/
+addpath ../../constitutiveModels/
 
 
 
@@ -22,8 +23,9 @@ G   = E/2/(1+nu);
 rho = 1000;
 g   = 9.8;
 
-K_f     = 2e6;
-lambda  = 0.001;
+K_f     = 2e6;      % Tait constant, p = K_f((rho/rho0)^gamma - 1)
+gamma   = 7;
+lambda  = 0.001;    % dynamic viscosity
 
 
 stressState ='PLANE_STRAIN'; % either 'PLANE_STRAIN' or "PLANE_STRESS
@@ -375,12 +377,14 @@ for tstep = 1 : steps
 
 %                 p = B * ((rhop(pid)/1000)^7) - 1;
                 
+                % weakly compressible fluid, as mex/FluidMPM.c: Tait pressure
+                % from J and deviatoric viscous stress of the rate D = deps/dt
+                J           = det(F);
                 temp        = deps(1,1) + deps(2,2);
-                rhop(pid)   = rhop(pid) / (1+temp);
-                IntE(pid)   = IntE(pid) + sigp(pid,:)*[deps(1,1); deps(2,2); 2*deps(1,2)]/rhop(pid);
-                p           = (1.4-1)*rhop(pid)*IntE(pid);
-                sigp(pid,:) = -p*[1; 1; 0] + 2 * lambda * [deps(1,1); deps(2,2); 2*deps(1,2)] ...
-                                           - 2/3 * lambda * temp*[1; 1; 0];
+                rhop(pid)   = rho/J;
+                p           = K_f*(J^(-gamma) - 1);
+                sigp(pid,:) = -p*[1 1 0] + 2*lambda/dt*[deps(1,1) deps(2,2) deps(1,2)] ...
+                                         - 2/3*lambda/dt*temp*[1 1 0];
             end
 
             
@@ -0,0 +1,207 @@
+% This file implements the Total Lagrangian Material Point Method (TLMPM)
+% for the generalized vortex problem (MMS), the 2D counterpart of
+% example1D/TLMPM_MMS_1D.m.
+%
+% The basis functions and their gradients are evaluated once, at the
+% initial particle positions, and kept as a sparse particle-node operator;
+% every time step is then a set of sparse products (P2G, G2P) with the
+% first Piola-Kirchhoff stress, without basis evaluation nor particle
+% search. Uses the compiled mex/TLMPM.c when it is available (grid.degree
+% 1 to 3, linear here), the sparse matrices N, dNdX below otherwise.
+%
+% Problem: ring Ri < r < Ro of neo-Hookean material, body force of
+% vortexBodyForces.m, whose exact solution is a rotation of angle
+% G sin(pi t) h(r) of every circle.
+%
+% 19 October 2026.
+%
+
+%%
+addpath ../../grid/
+addpath ../../basis/
+addpath ../../particleGen/
+addpath ../../constitutiveModels/
+addpath ../../util/
+addpath ../../postProcessing/
+addpath ../cpdi/
+
+%%
+clc
+clear all
+colordef white
+
+opts = struct('Color','rgb','Bounds','tight','FontMode','fixed','FontSize',20);
+
+%% Material properties
+%
+E      = 1000;    % Young's modulus
+nu     = 0.3;     % Poisson ratio
+rho    = 1000;    % density
+K      = E/3/(1-2*nu);    % bulk modulus
+mu     = E/2/(1+nu);% shear modulus
+lambda = K - 2/3*mu;
+G      = 1;
+Ri     = 0.75;
+Ro     = 1.25;
+
+tic;
+
+disp([num2str(toc),'   INITIALISATION '])
+
+%% Computational grid
+lx        = 3;
+ly        = 3;
+ghostCell = 0;
+numx2     = 40;      % number of elements along X direction
+numy2     = 40;      % number of elements along Y direction
+[mesh]    = buildGrid2D(lx,ly,numx2,numy2, ghostCell);
+
+mesh.node(:,1) = mesh.node(:,1) - lx/2;
+mesh.node(:,2) = mesh.node(:,2) - ly/2;
+
+element   = mesh.element;
+node      = mesh.node;
+elemCount = mesh.elemCount;
+nodeCount = mesh.nodeCount;
+deltax    = mesh.deltax;
+deltay    = mesh.deltay;
+
+% find nodes not in the ring
+
+rI  = sqrt(node(:,1).^2 + node(:,2).^2);
+idx = find( rI > Ro | rI < Ri );
+
+%% particles: 2x2 per cell, from the signed distance of the ring
+
+ring      = sdfOp('diff',sdfOp('circle',0,0,Ro),sdfOp('circle',0,0,Ri));
+[xp,vp]   = sdfParticles(ring,[-lx/2 lx/2 -ly/2 ly/2],[deltax/2 deltay/2]);
+
+pCount    = size(xp,1);
+xp0       = xp;                          % reference positions
+volume0   = vp;
+mass      = vp*rho;
+velo      = zeros(pCount,2);
+deform    = repmat([1 0 0 1],pCount,1);  % F, column-wise [F11 F21 F12 F22]
+stress    = zeros(pCount,4);             % 1st PK stress, same layout
+
+%% particle-node operator, once in the reference configuration
+
+useMex = ( exist('TLMPM','file') == 3 );
+
+grid.deltax = deltax;
+grid.deltay = deltay;
+grid.numx   = numx2;
+grid.numy   = numy2;
+grid.degree = 1;
+grid.xmin   = -lx/2;
+grid.ymin   = -ly/2;
+
+if ( useMex )
+  op = TLMPM('build',xp0,grid);
+else
+  % N(p,I), dNdX(p,I) as sparse matrices, rows the particles
+  ii = zeros(4*pCount,1); jj = ii; nn = ii; gx = ii; gy = ii; k = 0;
+  for p=1:pCount
+    e     = point2ElemIndex(xp0(p,:),mesh);
+    esctr = element(e,:);
+    for i=1:length(esctr)
+      id        = esctr(i);
+      [N,dNdx]  = getMPM2D(xp0(p,:) - node(id,:),deltax,deltay);
+      k         = k + 1;
+      ii(k)     = p;  jj(k) = id;
+      nn(k)     = N;  gx(k) = dNdx(1);  gy(k) = dNdx(2);
+    end
+  end
+  Nmat  = sparse(ii,jj,nn,pCount,nodeCount);
+  dNx   = sparse(ii,jj,gx,pCount,nodeCount);
+  dNy   = sparse(ii,jj,gy,pCount,nodeCount);
+  NmatT = Nmat';
+end
+
+%% plot mesh, particles
+
+figure
+hold on
+plot_mesh(node,element,'Q4','k-',1.); % background grid
+plot(xp(:,1),xp(:,2),'k.','markersize',10);
+plot(node(idx,1),node(idx,2),'b*','markersize',10);
+axis on
+
+%% Solver
+
+disp([num2str(toc),'   SOLVING '])
+
+c     = sqrt(E/rho);
+dtime = 0.05*(deltax/c);
+time  = 1;
+t     = 0;
+istep = 1;
+
+while ( t < time )
+    % body force per unit mass at the reference positions
+    [bx,by] = vortexBodyForces(xp0(:,1),xp0(:,2),t,mu,rho,G,Ri,Ro);
+    % particles to nodes: mass, momentum, -V0 P dN/dX + m N b
+    if ( useMex )
+      [nmass,nmomentum0,nforce] = TLMPM('p2g',op,mass,velo,stress,volume0,[bx by]);
+    else
+      nmass      = NmatT*mass;
+      nmomentum0 = NmatT*(mass.*velo);
+      vP         = [volume0 volume0].*stress;
+      nforce     = -[dNx'*vP(:,1) + dNy'*vP(:,3), dNx'*vP(:,2) + dNy'*vP(:,4)] ...
+                   + NmatT*[mass.*bx mass.*by];
+    end
+    % update nodal momenta
+    nmomentum = nmomentum0 + nforce*dtime;
+    % zero Dirichlet boundary conditions
+    nmomentum0(idx,:) = 0;
+    nmomentum (idx,:) = 0;
+    % nodes to particles: FLIP velocity, positions, and the nodal velocities
+    % of the updated particle momenta (double mapping)
+    if ( useMex )
+      [velo,xp,nvelo] = TLMPM('g2p',op,nmass,nmomentum0,nmomentum,velo,xp,mass,dtime);
+    else
+      act        = nmass > 0;
+      minv       = zeros(nodeCount,1);
+      minv(act)  = 1./nmass(act);
+      velo       = velo + Nmat*((nmomentum - nmomentum0).*[minv minv]);
+      xp         = xp   + dtime*Nmat*(nmomentum.*[minv minv]);
+      nvelo      = (NmatT*(mass.*velo)).*[minv minv];
+    end
+    nvelo(idx,:) = 0;
+    % deformation gradient and 1st PK stress (neo-Hookean)
+    if ( useMex )
+      [deform,stress] = TLMPM('deform',op,nvelo,deform,dtime,lambda,mu);
+    else
+      deform(:,1) = deform(:,1) + dtime*(dNx*nvelo(:,1));
+      deform(:,2) = deform(:,2) + dtime*(dNx*nvelo(:,2));
+      deform(:,3) = deform(:,3) + dtime*(dNy*nvelo(:,1));
+      deform(:,4) = deform(:,4) + dtime*(dNy*nvelo(:,2));
+      J           = deform(:,1).*deform(:,4) - deform(:,2).*deform(:,3);
+      % F^-T = [F22 -F12; -F21 F11]/J, column-wise
+      FinvT       = [deform(:,4) -deform(:,3) -deform(:,2) deform(:,1)]./[J J J J];
+      stress      = mu*(deform - FinvT) + lambda*[log(J) log(J) log(J) log(J)].*FinvT;
+    end
+    % advance to the next time step
+    t     = t + dtime;
+    istep = istep + 1;
+end
+
+%% post processing: displacement error against the exact solution
+
+r0    = sqrt(xp0(:,1).^2 + xp0(:,2).^2);
+R     = (Ri+Ro)/2;
+h     = 1 - 8*((r0 - R)/(Ri-Ro)).^2 + 16*((r0 - R)/(Ri-Ro)).^4;
+alpha = G*sin(pi*t)*h;
+xex   = [cos(alpha).*xp0(:,1) - sin(alpha).*xp0(:,2), ...
+         sin(alpha).*xp0(:,1) + cos(alpha).*xp0(:,2)];
+uErr  = sqrt(sum(volume0.*sum((xp-xex).^2,2))/sum(volume0));
+
+disp([num2str(toc),'   DONE '])
+disp(['displacement error (L2): ',num2str(uErr)])
+
+figure
+hold on
+plot_mesh(node,element,'Q4','k-',1.); % background grid
+plot(xp(:,1),xp(:,2),'r.','markersize',10);
+plot(xex(:,1),xex(:,2),'bo','markersize',4);
+axis on
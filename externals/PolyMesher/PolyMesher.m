@@ -8,10 +8,12 @@
 %      "Implementation of fluid flow topology optimization in PolyTop",   %
 %      Struct Multidisc Optim, 2013, DOI XX.XXXX/XXXXXX-XXX-XXX-X         %
 %-------------------------------------------------------------------------%
-function [Node,Element,Supp,Load,P] = PolyMesher(Domain,NElem,MaxIter,P)
-if ~exist('P','var'), P=PolyMshr_RndPtSet(NElem,Domain); end
+function [Node,Element,Supp,Load,P] = PolyMesher(Domain,NElem,MaxIter,P,Tol)
+if ~exist('P','var') || isempty(P), P=PolyMshr_RndPtSet(NElem,Domain); end
+if ~exist('Tol','var') || isempty(Tol), Tol=5e-6; end %Early exit tolerance
 NElem = size(P,1);
-Tol=5e-6; It=0; Err=1; c=1.5;
+It=0; Err=1; c=1.5;
+Native = exist('PolyLloyd','file') == 3;  %Compiled Voronoi cells (mex)
 BdBox = Domain('BdBox'); PFix = Domain('PFix');
 Area = (BdBox(2)-BdBox(1))*(BdBox(4)-BdBox(3));
 Pc = P; figure;
@@ -20,13 +22,21 @@ while(It<=MaxIter && Err>Tol)
   P = Pc; %Lloyd's update
   R_P = PolyMshr_Rflct(P,NElem,Domain,Alpha);   %Generate the reflections
   [P,R_P] = PolyMshr_FixedPoints(P,R_P,PFix); % Fixed Points 
-  [Node,Element] = voronoin([P;R_P]);           %Construct Voronoi diagram
-  [Pc,A] = PolyMshr_CntrdPly(Element,Node,NElem);
+  if Native
+    [Pc,A] = PolyLloyd('cells',P,R_P);          %Centroids of Voronoi cells
+  else
+    [Node,Element] = voronoin([P;R_P]);         %Construct Voronoi diagram
+    [Pc,A] = PolyMshr_CntrdPly(Element,Node,NElem);
+  end
   Area = sum(abs(A));
   Err = sqrt(sum((A.^2).*sum((Pc-P).*(Pc-P),2)))*NElem/Area^1.5;
   fprintf('It: %3d   Error: %1.3e\n',It,Err); It=It+1;
-  if NElem<=2000, PolyMshr_PlotMsh(Node,Element,NElem); end; 
+  if NElem<=2000
+    if Native, [Node,Element] = voronoin([P;R_P]); end
+    PolyMshr_PlotMsh(Node,Element,NElem);
+  end
 end
+if Native, [Node,Element] = voronoin([P;R_P]); end %Diagram of the last seeds
 [Node,Element] = PolyMshr_ExtrNds(NElem,Node,Element);  %Extract node list
 [Node,Element] = PolyMshr_CllpsEdgs(Node,Element,0.1);  %Remove small edges
 [Node,Element] = PolyMshr_RsqsNds(Node,Element);        %Reoder Nodes
@@ -62,24 +72,31 @@ d = Domain('Dist',P);
 NBdrySegs = size(d,2)-1;          %Number of constituent bdry segments
 n1 = (Domain('Dist',P+repmat([eps,0],NElem,1))-d)/eps;
 n2 = (Domain('Dist',P+repmat([0,eps],NElem,1))-d)/eps;
-I = abs(d(:,1:NBdrySegs))<Alpha;  %Logical index of seeds near the bdry
-P1 = repmat(P(:,1),1,NBdrySegs);  %[NElem x NBdrySegs] extension of P(:,1)
-P2 = repmat(P(:,2),1,NBdrySegs);  %[NElem x NBdrySegs] extension of P(:,2)
-R_P(:,1) = P1(I)-2*n1(I).*d(I);  
-R_P(:,2) = P2(I)-2*n2(I).*d(I);
+if exist('PolyLloyd','file') == 3
+  [R_P,dI] = PolyLloyd('reflect',P,d,n1,n2,Alpha);
+else
+  I = abs(d(:,1:NBdrySegs))<Alpha;  %Logical index of seeds near the bdry
+  P1 = repmat(P(:,1),1,NBdrySegs);  %[NElem x NBdrySegs] extension of P(:,1)
+  P2 = repmat(P(:,2),1,NBdrySegs);  %[NElem x NBdrySegs] extension of P(:,2)
+  R_P(:,1) = P1(I)-2*n1(I).*d(I);  
+  R_P(:,2) = P2(I)-2*n2(I).*d(I);
+  dI = d(I);
+end
 d_R_P = Domain('Dist',R_P);
-J = abs(d_R_P(:,end))>=eta*abs(d(I)) & d_R_P(:,end)>0;
+J = abs(d_R_P(:,end))>=eta*abs(dI) & d_R_P(:,end)>0;
 R_P=R_P(J,:); R_P=unique(R_P,'rows');
 %---------------------------------------------- COMPUTE CENTROID OF POLYGON
 function [Pc,A] = PolyMshr_CntrdPly(Element,Node,NElem)
-Pc=zeros(NElem,2); A=zeros(NElem,1);
-for el = 1:NElem
-  vx=Node(Element{el},1); vy=Node(Element{el},2); nv=length(Element{el}); 
-  vxS=vx([2:nv 1]); vyS=vy([2:nv 1]); %Shifted vertices
-  temp = vx.*vyS - vy.*vxS;
-  A(el) = 0.5*sum(temp);
-  Pc(el,:) = 1/(6*A(el,1))*[sum((vx+vxS).*temp),sum((vy+vyS).*temp)];
-end
+nv = cellfun(@numel,Element(1:NElem)); nv = nv(:);
+v  = [Element{1:NElem}]'; %All vertices, element by element
+el = repelem((1:NElem)',nv);
+first = cumsum([1;nv(1:end-1)]);
+vS = (2:numel(v)+1)'; vS(first+nv-1) = first; vS = v(vS); %Shifted vertices
+vx=Node(v,1); vy=Node(v,2); vxS=Node(vS,1); vyS=Node(vS,2);
+temp = vx.*vyS - vy.*vxS;
+A  = 0.5*accumarray(el,temp,[NElem 1]);
+Pc = [accumarray(el,(vx+vxS).*temp,[NElem 1]), ...
+      accumarray(el,(vy+vyS).*temp,[NElem 1])]./(6*[A A]);
 %------------------------------------------------------- EXTRACT MESH NODES
 function [Node,Element] = PolyMshr_ExtrNds(NElem,Node0,Element0)
 map = unique([Element0{1:NElem}]);
@@ -2,8 +2,15 @@ function [stiffMat] = computeStiffnessMatrix(mesh,material)
 %
 % This function computes the stiffness matrix for a FE mesh stored in 'mesh'. 
 % Only 2D problems.
+% Uses the compiled assembly mex/FEMAssemble.c (T3,Q4,H4,B8) when available.
 % Vinh Phu Nguyen
 
+if exist('FEMAssemble','file') == 3
+  [I,J,V]  = FEMAssemble(mesh,material);
+  stiffMat = sparse(I,J,V,mesh.dofCount,mesh.dofCount);
+  return
+end
+
 stiffMat  = zeros(mesh.dofCount,mesh.dofCount);
 
 for e=1:mesh.elemCount
@@ -4,8 +4,16 @@ function [geoMat, stiffMat, fint] = computeTangentMatrix(mesh,material,ndisp)
 % and geometry tangent matrix for a FE mesh stored in 'mesh'. 
 % Only for neo-Hookean materials.
 % Only 2D problems.
+% Uses the compiled assembly mex/FEMAssemble.c (T3,Q4,H4,B8) when available.
 % Vinh Phu Nguyen
 
+if exist('FEMAssemble','file') == 3
+  [I,J,Vmat,Vgeo,fint] = FEMAssemble(mesh,material,ndisp);
+  stiffMat = sparse(I,J,Vmat,mesh.dofCount,mesh.dofCount);
+  geoMat   = sparse(I,J,Vgeo,mesh.dofCount,mesh.dofCount);
+  return
+end
+
 identity  = [1 0;0 1]; 
 
 fint      = zeros(mesh.dofCount,1);
@@ -50,14 +58,8 @@ for e=1:mesh.elemCount
     H                    = H + dNdx*sig*dNdx'*detJ*mesh.W(p);
   end
   
-  Kgeo(1,1:2:2*nn) = H(1,:);
-  Kgeo(1,2:2:2*nn) = H(1,:);
-  Kgeo(2,1:2:2*nn) = H(2,:);
-  Kgeo(2,2:2:2*nn) = H(2,:);
-  Kgeo(3,1:2:2*nn) = H(3,:);
-  Kgeo(3,2:2:2*nn) = H(3,:);
-  Kgeo(4,1:2:2*nn) = H(4,:);
-  Kgeo(4,2:2:2*nn) = H(4,:);
+  Kgeo(1:2:2*nn,1:2:2*nn) = H;
+  Kgeo(2:2:2*nn,2:2:2*nn) = H;
   
   geoMat(sctr,sctr)  = geoMat(sctr,sctr) + Kgeo;
 end
@@ -123,6 +123,36 @@ end
 % make the consistent mass matrix a diagonal (lumped) mass matrix
 nmassd = 1./sum(nmass,1)'; % already inversed
 
+% with the compiled mex/PageMatrix.c the internal forces of all Gauss points
+% are computed at once, as pages (nn x 2 x noGPs x elemCount) of small
+% matrices, instead of one enode'*dNdxi, inv(F) ... per Gauss point.
+% In the Total Lagrangian formulation dNdx and the weights are computed once.
+useMex = exist('PageMatrix','file') == 3;
+if useMex
+  nn      = size(elements,2);
+  conn    = elements';
+  Nq      = zeros(nn,noGPs);
+  gpdNdxi = zeros(nn,2,noGPs);
+  for p=1:noGPs
+    [Nq(:,p),gpdNdxi(:,:,p)] = lagrange_basis(elemType,Q(p,:));
+  end
+  gpdNdxi = repmat(gpdNdxi,[1 1 1 elemCount]);
+  enodes  = reshape(permute(reshape(nodes(conn,:),nn,elemCount,2),[1 3 2]),nn,2,1,elemCount);
+  J0      = PageMatrix('mtimes',repmat(enodes,[1 1 noGPs 1]),gpdNdxi,'TN');
+  [invJ0,detJ] = PageMatrix('inv',J0);
+  gpdNdx  = PageMatrix('mtimes',gpdNdxi,invJ0);      % nn x 2 x noGPs x elemCount
+  gpWt    = reshape(repmat(W(:),elemCount,1).*detJ,1,1,noGPs,elemCount);
+  eforce  = rho*g*Nq*reshape(gpWt,noGPs,elemCount);  % gravity, constant in TL
+  neforceMex = [zeros(nodeCount,1) accumarray(conn(:),eforce(:),[nodeCount 1])];
+  % check against the interpreted code on a single page (plain 2-D matrices)
+  [invJ1,detJ1] = PageMatrix('inv',J0(:,:,1));
+  dNdx1         = PageMatrix('mtimes',gpdNdxi(:,:,1),invJ1);
+  if norm(invJ1-inv(J0(:,:,1))) > 1e-10*norm(invJ1) || abs(detJ1-det(J0(:,:,1))) > 1e-10*abs(detJ1) || ...
+     norm(dNdx1-gpdNdxi(:,:,1)/J0(:,:,1)) > 1e-10*norm(dNdx1)
+    error('femTLVibratingCantilever: PageMatrix does not match inv, det and mtimes');
+  end
+end
+
 % initialise nodal velocities and displacements
 % for i=1:nodeCount
 %   nvelo(i,1) = mmsV1(nodes(i,1),0);
@@ -142,6 +172,17 @@ while ( t < time )
   disp(['time step ',num2str(t)]);
   niforce(:)   = 0;
   neforce(:)   = 0;
+  if useMex
+    ue   = reshape(permute(reshape(ndisp(conn,:),nn,elemCount,2),[3 1 2]),2,nn,1,elemCount);
+    F    = bsxfun(@plus,PageMatrix('mtimes',repmat(ue,[1 1 noGPs 1]),gpdNdx),identity);
+    [invF,detF] = PageMatrix('inv',F);
+    P    = mu*PageMatrix('mtimes',invF,bsxfun(@minus,PageMatrix('mtimes',F,F,'NT'),identity)) + ...
+           bsxfun(@times,reshape(lambda*log(detF),1,1,noGPs,elemCount),invF);
+    fe   = squeeze(sum(bsxfun(@times,PageMatrix('mtimes',gpdNdx,P),-gpWt),3)); % nn x 2 x elemCount
+    niforce(:,1) = accumarray(conn(:),reshape(fe(:,1,:),[],1),[nodeCount 1]);
+    niforce(:,2) = accumarray(conn(:),reshape(fe(:,2,:),[],1),[nodeCount 1]);
+    neforce      = neforceMex;
+  else
   % loop over elements
   for e=1:elemCount
     esctr  = elements(e,:);
@@ -170,6 +211,7 @@ while ( t < time )
       neforce(esctr,2) = neforce(esctr,2) + rho*wt*N*g;                  
     end
   end
+  end
   
   % update nodal velocity
   nforce    = niforce + neforce;
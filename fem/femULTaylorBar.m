@@ -95,6 +95,8 @@ time  = 3;
 t     = 0.;
 istep = 0;
 interval = 10;
+vtkFiles = {};
+vtkTimes = [];
 
 nmass     = zeros(nodeCount,nodeCount);  % lumped mass matrix
 nacce     = zeros(nodeCount,2);  % nodal  acceleration
@@ -202,8 +204,12 @@ while ( t < time )
   if (  mod(istep-1,interval) == 0 )   
     vtuFile = sprintf('%s%d','femULTaylorBar',istep-1);
     VTKPostProcess(nodes,elements,2,'Quad4',vtuFile,sigma,ndisp);
+    vtkFiles{end+1} = [vtuFile '.vtu'];
+    vtkTimes(end+1) = t;
   end
 end
+
+VTKTimeSeries('femULTaylorBar',vtkFiles,vtkTimes);
 %%
 disp([num2str(toc),'   DONE ']);
 
@@ -8,6 +8,7 @@ function [x] = TwoCirclesDomain(Demand,Arg)
   switch(Demand)
     case('Dist');  x = DistFnc(Arg,BdBox); 
     case('BdBox'); x = BdBox;
+    case('Tree');  x = DistTree(BdBox);
     case('PFix');  x = FixedPoints(BdBox);
     case('BC');    x = BndryCnds(Arg{:},BdBox);
   end
@@ -16,6 +17,11 @@ function Dist = DistFnc(P,BdBox)
   d1   = dCircle(P,0.06,0.06,0.03);
   d2   = dCircle(P,0.06,0.06,0.04);
   Dist = dDiff(d2,d1);
+%------------------------------------------------- DISTANCE EXPRESSION TREE
+function Tree = DistTree(BdBox)
+  d1   = sdfOp('circle',0.06,0.06,0.03);
+  d2   = sdfOp('circle',0.06,0.06,0.04);
+  Tree = sdfOp('diff',d2,d1);
 %---------------------------------------------- SPECIFY BOUNDARY CONDITIONS
 function [x] = BndryCnds(Node,Element,BdBox)
   x = cell(2,1); %No boundary conditions specified for this problem
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" BezierBasis.c
+ */
+
+static const mxArray* getMeshField (const mxArray* mesh, const char* name, const char* alt)
+/*
+ * generateIGA2DMesh and buildIGA3DMesh name some fields differently.
+ */
+{
+   const mxArray* f = mxGetField(mesh, 0, name);
+   if ( f == NULL && alt != NULL ) f = mxGetField(mesh, 0, alt);
+   if ( f == NULL ) mexErrMsgTxt("BezierBasis: mesh lacks element, node, weights or bezierExtractor");
+   return f;
+}
+
+static void computeBernsteinBasis1D (int p, double xi, double* B, double* dB)
+/*
+ * Bernstein polynomials of degree p on [-1,1] and their derivatives, as
+ * getShapeGradBernstein.m (de Casteljau-like recursion, no factorials).
+ */
+{
+   double t = 0.5*(1.+xi), s = 0.5*(1.-xi), Bm[16];
+   int    k, i;
+
+   B[0] = 1.;
+   for(k = 1; k <= p; k++){
+      if ( k == p ) for(i = 0; i < p; i++) Bm[i] = B[i];
+      B[k] = t*B[k-1];
+      for(i = k-1; i > 0; i--) B[i] = s*B[i] + t*B[i-1];
+      B[0] = s*B[0];
+   }
+   if ( p == 0 ){ dB[0] = 0.; return; }
+   for(i = 0; i <= p; i++)
+      dB[i] = 0.5*p*( ( i > 0 ? Bm[i-1] : 0. ) - ( i < p ? Bm[i] : 0. ) );
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	NURBS basis functions of an IGA mesh through Bezier extraction.
+	//
+	// We expect the function to be called as :
+        // [R,dRdx,detJ] = BezierBasis(mesh,elems,xi)
+	// mesh:  IGA mesh from generateIGA2DMesh (element, node, weights,
+        //        bezierExtractor, p, q) or buildIGA3DMesh (globElems, controlPts,
+        //        weights, C, p, q, r).
+        // elems: npt x 1 element of every point (one-based).
+        // xi:    npt x nsd parent coordinates of the points in [-1,1]^nsd.
+        //
+        // R:     npt x nn NURBS basis functions, column a belonging to node
+        //        mesh.element(elems(i),a) of point i.
+        // dRdx:  npt x nn x nsd derivatives wrt the physical coordinates of the
+        //        current mesh.node.
+        // detJ:  npt x 1 determinant of dx/dxi (parent to physical space).
+        //
+        // The points are bucketed by element and the elements processed in
+        // parallel. For the k points of an element the Bernstein basis and its
+        // derivatives form a nb x (nsd+1)k matrix that is multiplied once by
+        // diag(w_e)*C_e (small dense GEMM), C_e being the stored extraction
+        // operator, instead of one matrix-vector product per point and function.
+        */
+   const mxArray *mesh, *conp, *nodep, *extp;
+   const double  *conn, *node, *wgt, *ext, *elems, *xi;
+   double        *R, *dRdx, *detJ;
+   mwSize         npt, nn, nb, nel, nodeCount, ipt;
+   int            nsd, deg[3] = {0, 0, 0}, i;
+   mwSize        *start, *order, kmax = 0;
+   long           e;
+
+   if ( nrhs != 3 || !mxIsStruct(prhs[0]) )
+      mexErrMsgTxt("BezierBasis: expected (mesh, elems, xi)");
+
+   mesh   = prhs[0];
+   conp   = getMeshField(mesh, "element", "globElems");
+   nodep  = getMeshField(mesh, "node", "controlPts");
+   extp   = getMeshField(mesh, "bezierExtractor", "C");
+   conn   = mxGetPr(conp);
+   node   = mxGetPr(nodep);
+   wgt    = mxGetPr(getMeshField(mesh, "weights", NULL));
+   ext    = mxGetPr(extp);
+   nel    = mxGetM(conp);
+   nn     = mxGetN(conp);
+   nodeCount = mxGetM(nodep);
+   nsd    = (int) mxGetN(nodep);
+   if ( nsd != 2 && nsd != 3 ) mexErrMsgTxt("BezierBasis: 2D or 3D meshes only");
+   deg[0] = (int) mxGetScalar(getMeshField(mesh, "p", NULL));
+   deg[1] = (int) mxGetScalar(getMeshField(mesh, "q", NULL));
+   if ( nsd == 3 ) deg[2] = (int) mxGetScalar(getMeshField(mesh, "r", NULL));
+   nb = 1;
+   for(i = 0; i < nsd; i++){
+      if ( deg[i] < 0 || deg[i] > 15 ) mexErrMsgTxt("BezierBasis: degree must be below 16");
+      nb *= deg[i]+1;
+   }
+   if ( mxGetNumberOfElements(extp) != nn*nb*nel )
+      mexErrMsgTxt("BezierBasis: the extraction operators must be nn x nb x elemCount");
+
+   elems = mxGetPr(prhs[1]);
+   xi    = mxGetPr(prhs[2]);
+   npt   = mxGetNumberOfElements(prhs[1]);
+   if ( mxGetM(prhs[2]) != npt || (int) mxGetN(prhs[2]) != nsd )
+      mexErrMsgTxt("BezierBasis: xi must be npt x nsd");
+
+   {
+      mwSize dims[3] = {npt, nn, (mwSize) nsd};
+      plhs[0] = mxCreateDoubleMatrix(npt, nn, mxREAL);
+      plhs[1] = mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+      plhs[2] = mxCreateDoubleMatrix(npt, 1, mxREAL);
+   }
+   R    = mxGetPr(plhs[0]);
+   dRdx = mxGetPr(plhs[1]);
+   detJ = mxGetPr(plhs[2]);
+
+   /* bucket the points by element (counting sort) */
+
+   start = (mwSize*) mxCalloc(nel+1, sizeof(mwSize));
+   order = (mwSize*) mxMalloc((npt+1)*sizeof(mwSize));
+   for(ipt = 0; ipt < npt; ipt++){
+      long el = (long) elems[ipt] - 1;
+      if ( el < 0 || el >= (long) nel ) mexErrMsgTxt("BezierBasis: element index out of range");
+      start[el+1]++;
+   }
+   for(e = 0; e < (long) nel; e++) start[e+1] += start[e];
+   {
+      mwSize* fill = (mwSize*) mxMalloc((nel+1)*sizeof(mwSize));
+      memcpy(fill, start, (nel+1)*sizeof(mwSize));
+      for(ipt = 0; ipt < npt; ipt++) order[fill[(long) elems[ipt] - 1]++] = ipt;
+      mxFree(fill);
+   }
+
+   for(e = 0; e < (long) nel; e++)
+      if ( start[e+1] - start[e] > kmax ) kmax = start[e+1] - start[e];
+
+   #pragma omp parallel
+   {
+      mwSize  cap = (nsd+1)*kmax;
+      double *Bm, *Nw, *we, *xe;
+      double  B1[3][16], dB1[3][16];
+      int    *sctr;
+
+      Bm   = (double*) malloc((nb*cap + nn*cap + nn + nsd*nn + 1)*sizeof(double));
+      Nw   = Bm + nb*cap;
+      we   = Nw + nn*cap;
+      xe   = we + nn;
+      sctr = (int*) malloc((nn+1)*sizeof(int));
+
+      #pragma omp for schedule(dynamic,8)
+      for(e = 0; e < (long) nel; e++){
+         mwSize        k = start[e+1] - start[e], ncol = (nsd+1)*k, j, c, a, ip;
+         const double *Ce = ext + (mwSize) e*nn*nb;
+         if ( k == 0 ) continue;
+
+         for(a = 0; a < nn; a++){
+            sctr[a] = (int) conn[e + a*nel] - 1;
+            we[a]   = wgt[sctr[a]];
+            for(i = 0; i < nsd; i++) xe[a + i*nn] = node[sctr[a] + i*nodeCount];
+         }
+
+         /* Bernstein basis (column ip) and derivatives (columns k*(d+1)+ip) */
+         for(ip = 0; ip < k; ip++){
+            mwSize pt = order[start[e]+ip];
+            int    ix, iy, iz, d;
+            for(d = 0; d < nsd; d++)
+               computeBernsteinBasis1D (deg[d], xi[pt + d*npt], B1[d], dB1[d]);
+            c = 0;
+            for(iz = 0; iz <= ( nsd == 3 ? deg[2] : 0 ); iz++)
+               for(iy = 0; iy <= deg[1]; iy++)
+                  for(ix = 0; ix <= deg[0]; ix++){
+                     double bz = ( nsd == 3 ) ? B1[2][iz] : 1.;
+                     Bm[c + nb*ip]         =  B1[0][ix]* B1[1][iy]*bz;
+                     Bm[c + nb*(k+ip)]     = dB1[0][ix]* B1[1][iy]*bz;
+                     Bm[c + nb*(2*k+ip)]   =  B1[0][ix]*dB1[1][iy]*bz;
+                     if ( nsd == 3 )
+                        Bm[c + nb*(3*k+ip)] = B1[0][ix]*B1[1][iy]*dB1[2][iz];
+                     c++;
+                  }
+         }
+
+         /* Nw = diag(we) * Ce * Bm, nn x nb times nb x (nsd+1)k */
+         for(j = 0; j < ncol; j++){
+            double *nwj = Nw + nn*j;
+            for(a = 0; a < nn; a++) nwj[a] = 0.;
+            for(c = 0; c < nb; c++){
+               double        bcj = Bm[c + nb*j];
+               const double *cc  = Ce + nn*c;
+               if ( bcj == 0. ) continue;
+               for(a = 0; a < nn; a++) nwj[a] += cc[a]*bcj;
+            }
+            for(a = 0; a < nn; a++) nwj[a] *= we[a];
+         }
+
+         /* rational basis, Jacobian and physical derivatives of each point */
+         for(ip = 0; ip < k; ip++){
+            mwSize  pt = order[start[e]+ip];
+            double  wb = 0., dwb[3] = {0., 0., 0.}, J[3][3], Jinv[3][3], det;
+            double *nw0 = Nw + nn*ip;
+            int     d, d2;
+
+            for(a = 0; a < nn; a++){
+               wb += nw0[a];
+               for(d = 0; d < nsd; d++) dwb[d] += Nw[a + nn*((d+1)*k+ip)];
+            }
+            memset(J, 0, sizeof(J));
+            for(a = 0; a < nn; a++){
+               double Ra = nw0[a]/wb;
+               R[pt + a*npt] = Ra;
+               for(d = 0; d < nsd; d++){
+                  double dRa = ( Nw[a + nn*((d+1)*k+ip)] - Ra*dwb[d] )/wb;   /* dR_a/dxi_d */
+                  dRdx[pt + a*npt + d*npt*nn] = dRa;
+                  for(i = 0; i < nsd; i++) J[i][d] += xe[a + i*nn]*dRa;   /* dx_i/dxi_d */
+               }
+            }
+            if ( nsd == 3 ){
+               det = J[0][0]*(J[1][1]*J[2][2] - J[1][2]*J[2][1])
+                   - J[0][1]*(J[1][0]*J[2][2] - J[1][2]*J[2][0])
+                   + J[0][2]*(J[1][0]*J[2][1] - J[1][1]*J[2][0]);
+               Jinv[0][0] =  (J[1][1]*J[2][2] - J[1][2]*J[2][1])/det;
+               Jinv[0][1] = -(J[0][1]*J[2][2] - J[0][2]*J[2][1])/det;
+               Jinv[0][2] =  (J[0][1]*J[1][2] - J[0][2]*J[1][1])/det;
+               Jinv[1][0] = -(J[1][0]*J[2][2] - J[1][2]*J[2][0])/det;
+               Jinv[1][1] =  (J[0][0]*J[2][2] - J[0][2]*J[2][0])/det;
+               Jinv[1][2] = -(J[0][0]*J[1][2] - J[0][2]*J[1][0])/det;
+               Jinv[2][0] =  (J[1][0]*J[2][1] - J[1][1]*J[2][0])/det;
+               Jinv[2][1] = -(J[0][0]*J[2][1] - J[0][1]*J[2][0])/det;
+               Jinv[2][2] =  (J[0][0]*J[1][1] - J[0][1]*J[1][0])/det;
+            }
+            else{
+               det = J[0][0]*J[1][1] - J[0][1]*J[1][0];
+               Jinv[0][0] =  J[1][1]/det; Jinv[0][1] = -J[0][1]/det;
+               Jinv[1][0] = -J[1][0]/det; Jinv[1][1] =  J[0][0]/det;
+            }
+            detJ[pt] = det;
+
+            /* dR/dx = dR/dxi * dxi/dx */
+            for(a = 0; a < nn; a++){
+               double g[3];
+               for(d = 0; d < nsd; d++) g[d] = dRdx[pt + a*npt + d*npt*nn];
+               for(d = 0; d < nsd; d++){
+                  double s = 0.;
+                  for(d2 = 0; d2 < nsd; d2++) s += g[d2]*Jinv[d2][d];
+                  dRdx[pt + a*npt + d*npt*nn] = s;
+               }
+            }
+         }
+      }
+      free(Bm);
+      free(sctr);
+   }
+
+   mxFree(start);
+   mxFree(order);
+}
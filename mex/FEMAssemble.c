@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "matrix.h"
+#include "mex.h"
+#include "element.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" FEMAssemble.c element.c
+ */
+
+#define MAX_NDOF  (3*ELEM_MAX_NODE)
+#define MAX_NSTR  6
+
+static void buildBMatrix (int nsd, int nn, const double* dNdx, double* B)
+/*
+ * Strain-displacement matrix B (nstr x ndof, row-major) for interleaved dofs.
+ * 2D: [xx yy xy], 3D: [xx yy zz xy yz zx] (engineering shear strains).
+ */
+{
+   int ndof = nsd*nn, a;
+
+   memset(B, 0, (nsd == 2 ? 3 : 6)*ndof*sizeof(double));
+   for(a = 0; a < nn; a++){
+      double dx = dNdx[a*nsd], dy = dNdx[a*nsd+1];
+      if ( nsd == 2 ){
+         B[0*ndof+2*a]   = dx;
+         B[1*ndof+2*a+1] = dy;
+         B[2*ndof+2*a]   = dy;
+         B[2*ndof+2*a+1] = dx;
+      }
+      else{
+         double dz = dNdx[a*nsd+2];
+         B[0*ndof+3*a]   = dx;
+         B[1*ndof+3*a+1] = dy;
+         B[2*ndof+3*a+2] = dz;
+         B[3*ndof+3*a]   = dy; B[3*ndof+3*a+1] = dx;
+         B[4*ndof+3*a+1] = dz; B[4*ndof+3*a+2] = dy;
+         B[5*ndof+3*a]   = dz; B[5*ndof+3*a+2] = dx;
+      }
+   }
+}
+
+static void addBtDB (int nstr, int ndof, const double* B, const double* D, double wt, double* ke)
+/*
+ * ke += B'*D*B*wt, D is nstr x nstr (row-major).
+ */
+{
+   double DB[MAX_NSTR*MAX_NDOF];
+   int    i, j, k;
+
+   for(i = 0; i < nstr; i++){
+      for(j = 0; j < ndof; j++){
+         double s = 0.;
+         for(k = 0; k < nstr; k++) s += D[i*nstr+k]*B[k*ndof+j];
+         DB[i*ndof+j] = s*wt;
+      }
+   }
+   for(i = 0; i < ndof; i++){
+      for(j = 0; j < ndof; j++){
+         double s = 0.;
+         for(k = 0; k < nstr; k++) s += B[k*ndof+i]*DB[k*ndof+j];
+         ke[i*ndof+j] += s;
+      }
+   }
+}
+
+static void computeNeoHookeanStress (int nsd, const double* F, double mu, double lambda,
+                                     double* sig, double* D)
+/*
+ * Cauchy stress and spatial tangent as in fem/computeTangentMatrix.m
+ * sig = (mu*(F*F'-I) + lambda*log(J)*I)/J
+ * D   = lambda*m*m' + mu'*diag(2,..,2,1,..,1), mu' = mu - lambda*log(J)
+ */
+{
+   double detF, invF[9], lnJ, mup;
+   int    i, j, k, nstr = (nsd == 2) ? 3 : 6;
+
+   detF = invertMatrix (nsd, F, invF);
+   lnJ  = log(detF);
+   for(i = 0; i < nsd; i++){
+      for(j = 0; j < nsd; j++){
+         double s = 0.;
+         for(k = 0; k < nsd; k++) s += F[i*nsd+k]*F[j*nsd+k];
+         sig[i*nsd+j] = ( mu*(s - (i==j)) + (i==j)*lambda*lnJ )/detF;
+      }
+   }
+
+   mup = mu - lambda*lnJ;
+   memset(D, 0, nstr*nstr*sizeof(double));
+   for(i = 0; i < nsd; i++){
+      for(j = 0; j < nsd; j++) D[i*nstr+j] = lambda;
+      D[i*nstr+i] += 2.*mup;
+   }
+   for(i = nsd; i < nstr; i++) D[i*nstr+i] = mup;
+}
+
+static mwIndex findEntry (const mwIndex* ir, const mwIndex* jc, mwIndex row, mwIndex col)
+/*
+ * Position of entry (row,col) in a compressed column matrix (rows sorted).
+ */
+{
+   mwIndex lo = jc[col], hi = jc[col+1];
+   while ( lo < hi ){
+      mwIndex mid = lo + (hi-lo)/2;
+      if      ( ir[mid] < row ) lo = mid + 1;
+      else if ( ir[mid] > row ) hi = mid;
+      else return mid;
+   }
+   return (mwIndex) -1;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Assemble FE stiffness/tangent matrices over all elements in parallel.
+	//
+	// We expect the function to be called as :
+        // [I,J,V]              = FEMAssemble(mesh,material)                 linear elastic
+        // [I,J,Vmat,Vgeo,fint] = FEMAssemble(mesh,material,ndisp)           neo-Hookean
+        // [K]                  = FEMAssemble(mesh,material,[],Kpattern)
+        // [Kmat,Kgeo,fint]     = FEMAssemble(mesh,material,ndisp,Kpattern)
+        // mesh:     node, element, elemType ('T3','Q4','H4','B8'), W, Q, dofCount
+        // material: D (linear) or mu, lambda (neo-Hookean)
+        // ndisp:    nodal displacements (interleaved dofs), see computeTangentMatrix.m
+        // Kpattern: sparse matrix whose pattern contains all element couplings,
+        //           e.g. sparse(I,J,1,n,n) from a first triplet call. Since the
+        //           tangents are symmetric its compressed column storage is also
+        //           the CSR pattern; values are written in place of a copy.
+        //           A coupling missing from the pattern is an error.
+        // Triplets are returned with one dense element block per element so that
+        // sparse(I,J,V,n,n) gives the global matrix.
+        */
+   const mxArray *mesh, *material, *pattern;
+   double  *node, *elem, *W, *Q, *D = NULL, *ndisp = NULL;
+   double   mu = 0., lambda = 0.;
+   int      elemType, nsd, nn, ndofe, nstr, ngp;
+   mwSize   elemCount, nodeCount, dofCount, blk;
+   int      nonlinear;
+   char     typeName[8];
+   double  *Iv = NULL, *Jv = NULL, *Vmat, *Vgeo = NULL, *fint = NULL;
+   mwIndex *ir = NULL, *jc = NULL;
+   long     e;
+   int      missing = 0;
+
+   if ( nrhs < 2 ) mexErrMsgTxt("FEMAssemble: expected at least (mesh,material)");
+
+   mesh     = prhs[0];
+   material = prhs[1];
+   nonlinear= ( nrhs > 2 && !mxIsEmpty(prhs[2]) );
+   pattern  = ( nrhs > 3 && mxIsSparse(prhs[3]) ) ? prhs[3] : NULL;
+
+   mxGetString(mxGetField(mesh, 0, "elemType"), typeName, sizeof(typeName));
+   elemType = getElementType (typeName);
+   if ( elemType == ELEM_UNKNOWN ) mexErrMsgTxt("FEMAssemble: element type not supported");
+
+   nsd       = getElementDimension (elemType);
+   nn        = getElementNodeCount (elemType);
+   ndofe     = nsd*nn;
+   nstr      = (nsd == 2) ? 3 : 6;
+   blk       = ndofe*ndofe;
+
+   node      = mxGetPr(mxGetField(mesh, 0, "node"));
+   elem      = mxGetPr(mxGetField(mesh, 0, "element"));
+   W         = mxGetPr(mxGetField(mesh, 0, "W"));
+   Q         = mxGetPr(mxGetField(mesh, 0, "Q"));
+   ngp       = (int) mxGetNumberOfElements(mxGetField(mesh, 0, "W"));
+   nodeCount = mxGetM(mxGetField(mesh, 0, "node"));
+   elemCount = mxGetM(mxGetField(mesh, 0, "element"));
+   dofCount  = nodeCount*nsd;
+   if ( mxGetField(mesh, 0, "dofCount") ) dofCount = (mwSize) mxGetScalar(mxGetField(mesh, 0, "dofCount"));
+
+   if ( nonlinear ){
+      mu     = mxGetScalar(mxGetField(material, 0, "mu"));
+      lambda = mxGetScalar(mxGetField(material, 0, "lambda"));
+      ndisp  = mxGetPr(prhs[2]);
+   }
+   else{
+      D      = mxGetPr(mxGetField(material, 0, "D"));
+      if ( mxGetM(mxGetField(material, 0, "D")) != (size_t) nstr )
+         mexErrMsgTxt("FEMAssemble: material.D has wrong size for this element");
+   }
+
+   /* outputs */
+
+   if ( pattern ){
+      plhs[0] = mxDuplicateArray(pattern);
+      memset(mxGetPr(plhs[0]), 0, mxGetNzmax(plhs[0])*sizeof(double));
+      Vmat    = mxGetPr(plhs[0]);
+      ir      = mxGetIr(plhs[0]);
+      jc      = mxGetJc(plhs[0]);
+      if ( nonlinear ){
+         plhs[1] = mxDuplicateArray(plhs[0]);
+         Vgeo    = mxGetPr(plhs[1]);
+         plhs[2] = mxCreateDoubleMatrix(dofCount,1,mxREAL);
+         fint    = mxGetPr(plhs[2]);
+      }
+   }
+   else{
+      plhs[0] = mxCreateDoubleMatrix(blk*elemCount,1,mxREAL);
+      plhs[1] = mxCreateDoubleMatrix(blk*elemCount,1,mxREAL);
+      plhs[2] = mxCreateDoubleMatrix(blk*elemCount,1,mxREAL);
+      Iv      = mxGetPr(plhs[0]);
+      Jv      = mxGetPr(plhs[1]);
+      Vmat    = mxGetPr(plhs[2]);
+      if ( nonlinear ){
+         plhs[3] = mxCreateDoubleMatrix(blk*elemCount,1,mxREAL);
+         plhs[4] = mxCreateDoubleMatrix(dofCount,1,mxREAL);
+         Vgeo    = mxGetPr(plhs[3]);
+         fint    = mxGetPr(plhs[4]);
+      }
+   }
+
+   #pragma omp parallel for schedule(static)
+   for(e = 0; e < (long) elemCount; e++){                  /* loop over elements */
+      int    sctr[MAX_NDOF], conn[ELEM_MAX_NODE];
+      double enode[3*ELEM_MAX_NODE], ue[3*ELEM_MAX_NODE];
+      double ke[MAX_NDOF*MAX_NDOF], kg[MAX_NDOF*MAX_NDOF], fe[MAX_NDOF];
+      double H[ELEM_MAX_NODE*ELEM_MAX_NODE];
+      double N[ELEM_MAX_NODE], dNdxi[3*ELEM_MAX_NODE], dNdx[3*ELEM_MAX_NODE];
+      double B[MAX_NSTR*MAX_NDOF], Dgp[MAX_NSTR*MAX_NSTR];
+      double invJ[9], detJ, wt, xi[3];
+      int    a, b, i, j, k, p;
+
+      for(a = 0; a < nn; a++){
+         conn[a] = (int) elem[e + a*elemCount] - 1;
+         for(i = 0; i < nsd; i++){
+            enode[a*nsd+i] = node[conn[a] + i*nodeCount];
+            sctr[a*nsd+i]  = nsd*conn[a] + i;
+            if ( nonlinear ) ue[a*nsd+i] = ndisp[nsd*conn[a] + i];
+         }
+      }
+
+      memset(ke, 0, blk*sizeof(double));
+      if ( nonlinear ){
+         memset(fe, 0, ndofe*sizeof(double));
+         memset(H,  0, nn*nn*sizeof(double));
+      }
+
+      for(p = 0; p < ngp; p++){                             /* loop over Gauss points */
+         for(i = 0; i < nsd; i++) xi[i] = Q[p + i*ngp];
+         lagrangeBasis (elemType, xi, N, dNdxi);
+         detJ = computeJacobian (nsd, nn, enode, dNdxi, invJ);
+         computeShapeGradient (nsd, nn, dNdxi, invJ, dNdx);
+         wt   = detJ*W[p];
+         buildBMatrix (nsd, nn, dNdx, B);
+
+         if ( !nonlinear ){
+            /* D is a column-major Matlab matrix, symmetric for elasticity */
+            addBtDB (nstr, ndofe, B, D, wt, ke);
+         }
+         else{
+            double A[9], F[9], sig[9], sv[MAX_NSTR];
+
+            /* F = inv(I - ue*dNdx) */
+            for(i = 0; i < nsd; i++){
+               for(j = 0; j < nsd; j++){
+                  double s = 0.;
+                  for(a = 0; a < nn; a++) s += ue[a*nsd+i]*dNdx[a*nsd+j];
+                  A[i*nsd+j] = (i==j) - s;
+               }
+            }
+            invertMatrix (nsd, A, F);
+            computeNeoHookeanStress (nsd, F, mu, lambda, sig, Dgp);
+            addBtDB (nstr, ndofe, B, Dgp, wt, ke);
+
+            if ( nsd == 2 ){
+               sv[0] = sig[0]; sv[1] = sig[3]; sv[2] = sig[1];
+            }
+            else{
+               sv[0] = sig[0]; sv[1] = sig[4]; sv[2] = sig[8];
+               sv[3] = sig[1]; sv[4] = sig[5]; sv[5] = sig[2];
+            }
+            for(j = 0; j < ndofe; j++){
+               double s = 0.;
+               for(k = 0; k < nstr; k++) s += B[k*ndofe+j]*sv[k];
+               fe[j] += s*wt;
+            }
+            /* H = H + dNdx*sig*dNdx'*wt */
+            for(a = 0; a < nn; a++){
+               double sa[3];
+               for(j = 0; j < nsd; j++){
+                  double s = 0.;
+                  for(k = 0; k < nsd; k++) s += dNdx[a*nsd+k]*sig[k*nsd+j];
+                  sa[j] = s;
+               }
+               for(b = 0; b < nn; b++){
+                  double s = 0.;
+                  for(j = 0; j < nsd; j++) s += sa[j]*dNdx[b*nsd+j];
+                  H[a*nn+b] += s*wt;
+               }
+            }
+         }
+      }
+
+      if ( nonlinear ){
+         /* geometric stiffness: H(a,b) on each displacement component */
+         memset(kg, 0, blk*sizeof(double));
+         for(a = 0; a < nn; a++)
+            for(b = 0; b < nn; b++)
+               for(i = 0; i < nsd; i++)
+                  kg[(a*nsd+i)*ndofe + b*nsd+i] = H[a*nn+b];
+         for(i = 0; i < ndofe; i++){
+            #pragma omp atomic
+            fint[sctr[i]] += fe[i];
+         }
+      }
+
+      if ( pattern ){
+         for(i = 0; i < ndofe; i++){
+            for(j = 0; j < ndofe; j++){
+               mwIndex pos = findEntry (ir, jc, sctr[i], sctr[j]);
+               if ( pos == (mwIndex) -1 ){
+                  #pragma omp atomic write
+                  missing = 1;
+                  continue;
+               }
+               #pragma omp atomic
+               Vmat[pos] += ke[i*ndofe+j];
+               if ( nonlinear ){
+                  #pragma omp atomic
+                  Vgeo[pos] += kg[i*ndofe+j];
+               }
+            }
+         }
+      }
+      else{
+         mwSize off = (mwSize) e*blk;
+         for(i = 0; i < ndofe; i++){
+            for(j = 0; j < ndofe; j++){
+               Iv  [off + i*ndofe + j] = sctr[i] + 1;
+               Jv  [off + i*ndofe + j] = sctr[j] + 1;
+               Vmat[off + i*ndofe + j] = ke[i*ndofe+j];
+               if ( nonlinear ) Vgeo[off + i*ndofe + j] = kg[i*ndofe+j];
+            }
+         }
+      }
+   }
+
+   if ( missing )
+      mexErrMsgTxt("FEMAssemble: Kpattern does not contain all element couplings");
+}
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+#include "util.h"
+#include "basis.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" FluidMPM.c util.c basis.c
+ */
+
+typedef struct {
+   const double *bulk, *gamma, *visc;   /* K, Tait exponent, dynamic viscosity */
+   mwSize        sk, sg, sm;            /* strides, 0 for a scalar */
+   double        q1, q2, l;             /* artificial viscosity, length */
+} Fluid;
+
+static void getFluid (const mxArray* bodies, mwIndex ib, mwSize np, const BsplineGrid* g, Fluid* f)
+/*
+ * material of body ib: bulk, gamma (default 1, linear EOS), viscosity
+ * (default 0) and artificialViscosity [q1 q2] (default none)
+ */
+{
+   mxArray *av = getBodyField(bodies, ib, "artificialViscosity");
+   int      d;
+
+   f->bulk  = getBodyValues("FluidMPM", bodies, ib, "bulk",      np, 1, &f->sk);
+   f->gamma = getBodyValues("FluidMPM", bodies, ib, "gamma",     np, 0, &f->sg);
+   f->visc  = getBodyValues("FluidMPM", bodies, ib, "viscosity", np, 0, &f->sm);
+   f->q1 = f->q2 = 0.;
+   if ( av != NULL && !mxIsEmpty(av) ){
+      if ( !mxIsDouble(av) || mxGetNumberOfElements(av) > 2 )
+         mexErrMsgTxt("FluidMPM: body field artificialViscosity must be [q1] or [q1 q2]");
+      f->q1 = mxGetPr(av)[0];
+      f->q2 = ( mxGetNumberOfElements(av) == 2 ) ? mxGetPr(av)[1] : 0.;
+   }
+   for(d = 1, f->l = g->h[0]; d < g->nsd; d++) if ( g->h[d] < f->l ) f->l = g->h[d];
+}
+
+static double fluidStress (int nsd, mwSize ip, mwSize particleCount, double dtime, double L[3][3],
+                           double rho0, const Fluid* f, double* J, double* stress, double* pres)
+/*
+ * J = det(I + dt L) J_old and the Cauchy stress -(p + q) I + 2 mu dev(D) of
+ * particle ip, with the Tait pressure p = K/gamma (J^-gamma - 1) (linear,
+ * K (rho/rho0 - 1), for gamma = 1), the artificial bulk viscosity
+ * q = rho l (q1 c |tr D| + q2 l tr D^2) in compression (tr D < 0) and dev
+ * the deviator of the plane strain (2D) or 3D rate of deformation D.
+ * Returns the sound speed c = sqrt(dp/drho).
+ */
+{
+   double A[3][3], detA, trD, p, q = 0., c, K = f->bulk[ip*f->sk];
+   double gamma = ( f->gamma != NULL ) ? f->gamma[ip*f->sg] : 1.;
+   double mu    = ( f->visc  != NULL ) ? f->visc[ip*f->sm]  : 0.;
+   int    i, j;
+
+   for(i = 0; i < nsd; i++)
+      for(j = 0; j < nsd; j++) A[i][j] = ( i == j ? 1. : 0. ) + dtime*L[i][j];
+   if ( nsd == 3 )
+      detA = A[0][0]*(A[1][1]*A[2][2] - A[1][2]*A[2][1])
+           - A[0][1]*(A[1][0]*A[2][2] - A[1][2]*A[2][0])
+           + A[0][2]*(A[1][0]*A[2][1] - A[1][1]*A[2][0]);
+   else
+      detA = A[0][0]*A[1][1] - A[0][1]*A[1][0];
+   J[ip] *= detA;
+
+   p = K/gamma*(pow(J[ip], -gamma) - 1.);
+   c = sqrt(K*pow(J[ip], 1.-gamma)/rho0);
+   for(i = 0, trD = 0.; i < nsd; i++) trD += L[i][i];
+   if ( trD < 0. )
+      q = rho0/J[ip]*f->l*(f->q1*c*fabs(trD) + f->q2*f->l*trD*trD);
+   if ( pres != NULL ) pres[ip] = p;
+
+   for(i = 0; i < nsd; i++)
+      stress[ip+i*particleCount] = -(p + q) + 2.*mu*(L[i][i] - trD/3.);
+   if ( nsd == 3 ){
+      stress[ip+3*particleCount] = mu*(L[1][2]+L[2][1]);
+      stress[ip+4*particleCount] = mu*(L[0][2]+L[2][0]);
+      stress[ip+5*particleCount] = mu*(L[0][1]+L[1][0]);
+   }
+   else
+      stress[ip+2*particleCount] = mu*(L[0][1]+L[1][0]);
+   return c;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Weakly compressible fluid MPM transfers used with B-splines.
+	//
+	// We expect the function to be called as :
+        // [nmass,nmomenta,nforce,cache] = FluidMPM('p2g',bodies,grid)
+        // [cmax] = FluidMPM('g2p',bodies,grid,cache,nvelo,nacce,dtime)
+        //
+        // bodies : cell array {ib} or struct array (ib), fields coord, mass,
+        //          volume0, velo, J (volume ratio, one per particle, instead
+        //          of the deformation gradient), stress (Cauchy, Voigt, 3 or
+        //          6 columns) and bulk (bulk modulus K = rho0 c0^2); optionally
+        //          gamma (Tait exponent, default 1: linear EOS), viscosity
+        //          (dynamic viscosity, default 0), artificialViscosity ([q1 q2],
+        //          bulk viscosity coefficients, default none), gravity (-y in
+        //          2D, -z in 3D), and volume and pressure (filled by 'g2p').
+        //          bulk, gamma and viscosity are scalars or one value per
+        //          particle; rho0 = mass/volume0
+        // grid   : uniform B-spline grid, see ParticlesToNodesBspline
+        //
+        // p2g  : nodal mass, momenta and forces -sum V0 J sigma.dN + N m g
+        // g2p  : particle positions, velocities (FLIP), J = det(I + dt L) J,
+        //        and stresses -(p + q) I + 2 mu dev(D), with the Tait pressure
+        //        p = K/gamma (J^-gamma - 1) and the artificial viscosity
+        //        q = rho l (q1 c |tr D| + q2 l tr D^2) in compression, l the
+        //        grid spacing (bodies are modified)
+        // cmax : max over the particles of c + |v|, c the sound speed, for
+        //        the next time step dtime = CFL*h/cmax
+        //
+        // The basis functions and gradients of every particle are evaluated once
+        // per step, by 'p2g', and kept in cache for 'g2p'. The Dirichlet (wall)
+        // conditions are applied to nvelo and nacce between the two calls, as
+        // with ParticlesToNodesBspline. Cells are processed in parallel, in
+        // (p+1)^nsd colours for the transfers to the grid.
+        */
+   const mxArray *bodies;
+   char           mode[8];
+   BsplineGrid    g;
+   mwSize         bodyCount, ib;
+   double         dtime;
+
+   if ( nrhs < 3 || !mxIsChar(prhs[0]) )
+      mexErrMsgTxt("FluidMPM: expected ('p2g', bodies, grid) or "
+                   "('g2p', bodies, grid, cache, nvelo, nacce, dtime)");
+   mxGetString(prhs[0], mode, sizeof(mode));
+   bodies    = prhs[1];
+   bodyCount = mxGetNumberOfElements(bodies);
+   if ( !getBsplineGridData(prhs[2], &g) )
+      mexErrMsgTxt("FluidMPM: grid.degree must be 1, 2 or 3");
+
+   if ( strcmp(mode, "p2g") == 0 ){
+      static const char *names[] = {"start", "order", "N", "dN"};
+      double        *nmass, *nmomenta, *nforce;
+      mxArray       *cache;
+
+      plhs[0] = mxCreateDoubleMatrix(g.nodeCount, 1,     mxREAL);
+      plhs[1] = mxCreateDoubleMatrix(g.nodeCount, g.nsd, mxREAL);
+      plhs[2] = mxCreateDoubleMatrix(g.nodeCount, g.nsd, mxREAL);
+      nmass    = mxGetPr(plhs[0]);
+      nmomenta = mxGetPr(plhs[1]);
+      nforce   = mxGetPr(plhs[2]);
+      cache    = mxCreateStructMatrix(bodyCount, 1, 4, names);
+
+      for(ib = 0; ib < bodyCount; ib++){                  /* loop over bodies*/
+         mxArray *coordp = getBodyField(bodies, ib, "coord");
+         mxArray *grap   = getBodyField(bodies, ib, "gravity");
+         mwSize   particleCount = ( coordp != NULL ) ? mxGetM(coordp) : 0;
+         double  *coord  = getBodyArray("FluidMPM", bodies, ib, "coord",   particleCount, g.nsd);
+         double  *mass   = getBodyArray("FluidMPM", bodies, ib, "mass",    particleCount, 1);
+         double  *vol0   = getBodyArray("FluidMPM", bodies, ib, "volume0", particleCount, 1);
+         double  *J      = getBodyArray("FluidMPM", bodies, ib, "J",       particleCount, 1);
+         double  *velo   = getBodyArray("FluidMPM", bodies, ib, "velo",    particleCount, g.nsd);
+         double  *stress = getBodyArray("FluidMPM", bodies, ib, "stress",  particleCount, g.nsd == 3 ? 6 : 3);
+         double   grav   = ( grap != NULL ) ? mxGetScalar(grap) : 0.;
+         BasisCache B;
+
+         buildBasisCache(&g, coord, particleCount, cache, ib);
+         getBasisCache(cache, ib, &g, particleCount, &B);
+         particlesToNodesCached(&g, &B, mass, vol0, J, velo, stress, grav, nmass, nmomenta, nforce);
+      }
+
+      if ( nlhs > 3 ) plhs[3] = cache;
+      else            mxDestroyArray(cache);
+   }
+   else if ( strcmp(mode, "g2p") == 0 ){
+      const mxArray *cache;
+      const double  *nvelo, *nacce;
+      double         cmax = 0.;
+
+      if ( nrhs != 7 )
+         mexErrMsgTxt("FluidMPM: expected ('g2p', bodies, grid, cache, nvelo, nacce, dtime)");
+      cache  = prhs[3];
+      nvelo  = mxGetPr(prhs[4]);
+      nacce  = mxGetPr(prhs[5]);
+      dtime  = mxGetScalar(prhs[6]);
+      if ( mxGetM(prhs[4]) != g.nodeCount || mxGetN(prhs[4]) != (mwSize) g.nsd ||
+           mxGetM(prhs[5]) != g.nodeCount || mxGetN(prhs[5]) != (mwSize) g.nsd )
+         mexErrMsgTxt("FluidMPM: nvelo and nacce must be nodeCount x nsd");
+      if ( !mxIsStruct(cache) || mxGetNumberOfElements(cache) != bodyCount )
+         mexErrMsgTxt("FluidMPM: the basis cache does not match the bodies and grid, use the one of 'p2g'");
+
+      for(ib = 0; ib < bodyCount; ib++){                  /* loop over bodies*/
+         mxArray *coordp = getBodyField(bodies, ib, "coord");
+         mwSize   particleCount = ( coordp != NULL ) ? mxGetM(coordp) : 0;
+         double  *coord  = getBodyArray("FluidMPM", bodies, ib, "coord",   particleCount, g.nsd);
+         double  *mass   = getBodyArray("FluidMPM", bodies, ib, "mass",    particleCount, 1);
+         double  *velo   = getBodyArray("FluidMPM", bodies, ib, "velo",    particleCount, g.nsd);
+         double  *vol0   = getBodyArray("FluidMPM", bodies, ib, "volume0", particleCount, 1);
+         double  *J      = getBodyArray("FluidMPM", bodies, ib, "J",       particleCount, 1);
+         double  *stress = getBodyArray("FluidMPM", bodies, ib, "stress",  particleCount, g.nsd == 3 ? 6 : 3);
+         double  *vol    = ( getBodyField(bodies, ib, "volume") != NULL ) ?
+                           getBodyArray("FluidMPM", bodies, ib, "volume", particleCount, 1) : NULL;
+         double  *pres   = ( getBodyField(bodies, ib, "pressure") != NULL ) ?
+                           getBodyArray("FluidMPM", bodies, ib, "pressure", particleCount, 1) : NULL;
+         BasisCache B;
+         Fluid    f;
+         int      nsd = g.nsd, nn = g.nn;
+         long     c;
+
+         getFluid(bodies, ib, particleCount, &g, &f);
+         if ( !getBasisCache(cache, ib, &g, particleCount, &B) )
+            mexErrMsgTxt("FluidMPM: the basis cache does not match the bodies and grid, use the one of 'p2g'");
+
+         #pragma omp parallel
+         {
+            double L[3][3], cloc = 0.;
+            int    nodes[64];
+            #pragma omp for schedule(dynamic,4)
+            for(c = 0; c < (long) g.ncell; c++){        /* loop over cells with particles of this body*/
+               long q;
+               int  k, i, j;
+               if ( B.start[c+1] == B.start[c] ) continue;
+               cellStencil(&g, (mwSize) c, nodes);
+               for(q = B.start[c]; q < B.start[c+1]; q++){
+                  mwSize        ip = (mwSize) B.order[q];
+                  const double *N  = B.N + nn*q, *dN = B.dN + nn*nsd*q;
+                  double        v[3] = {0., 0., 0.}, a[3] = {0., 0., 0.}, vp2 = 0., cp;
+                  memset(L, 0, sizeof(L));
+                  for(k = 0; k < nn; k++){
+                     mwSize id = nodes[k];
+                     for(i = 0; i < nsd; i++){
+                        double vi = nvelo[id+i*g.nodeCount];
+                        v[i] += N[k]*vi;
+                        a[i] += N[k]*nacce[id+i*g.nodeCount];
+                        for(j = 0; j < nsd; j++) L[i][j] += vi*dN[k*nsd+j];   /* L_ij = dv_i/dx_j */
+                     }
+                  }
+                  for(i = 0; i < nsd; i++){
+                     coord[ip+i*particleCount] += dtime*v[i];
+                     velo[ip+i*particleCount]  += dtime*a[i];
+                     vp2 += velo[ip+i*particleCount]*velo[ip+i*particleCount];
+                  }
+                  cp = fluidStress (nsd, ip, particleCount, dtime, L, mass[ip]/vol0[ip], &f,
+                                    J, stress, pres);
+                  if ( vol != NULL ) vol[ip] = vol0[ip]*J[ip];
+                  if ( cp + sqrt(vp2) > cloc ) cloc = cp + sqrt(vp2);
+               }
+            }
+            #pragma omp critical
+            if ( cloc > cmax ) cmax = cloc;
+         }
+      }
+      if ( nlhs > 0 ) plhs[0] = mxCreateDoubleScalar(cmax);
+   }
+   else
+      mexErrMsgTxt("FluidMPM: mode must be 'p2g' or 'g2p'");
+}
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+#include "util.h"
+#include "basis.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" GridNormalCurvature.c util.c basis.c
+ */
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Grid normals and curvatures of all bodies from one particle scatter.
+	//
+	// We expect the function to be called as :
+        // [normals,curvature,density,cellDensity,cellCurvature] = GridNormalCurvature(bodies,grid)
+	// bodies: cell array {ib} or struct array (ib) with fields coord and mass.
+        // grid:   structured grid (deltax, deltay, numx, numy, node), 3D if it has
+        //         numz and deltaz.
+        //
+        // normals:   nodeCount x nsd x bodyCount, sum_p m_p grad N_I(x_p)/cellVolume,
+        //            pointing out of the body (same direction as computeGridNormal.m).
+        // curvature: nodeCount x bodyCount, -div(n/|n|) as in computeGridNormalCurvature.m
+        //            (negative on a convex surface).
+        // density:   nodeCount x bodyCount, sum_p m_p N_I(x_p)/cellVolume.
+        // cellDensity, cellCurvature: cellCount x bodyCount, the density scattered the
+        //            same way to the cell centres and the curvature at the centres of
+        //            the cells containing particles, from the (bi/tri)linear interpolation
+        //            of the nodal normals as computeGridNormalCurvature.m does.
+        //
+        // N_I are uniform quadratic B-splines, so the nodal normals are smooth enough
+        // to be differentiated once more on the grid for the curvature. Density and
+        // normals of all bodies come from one parallel loop over all particles.
+        // Nodes whose normal is below 1e-3 of the body maximum get zero curvature.
+        */
+   const mxArray *bodies, *grid;
+   mwSize   bodyCount, nodeCount, cellCount, total;
+   int      nsd, numx, numy, numz = 0;
+   double   h[3], org[3], cellVol;
+   double  *ncoord, *normals, *curva, *dens, *normTol, *cdens, *ccurva;
+   double **coordB, **massB;
+   char    *occupied;
+   mwSize  *offset;
+   long     ig, I;
+   mwSize   ib;
+
+   bodies    = prhs[0];
+   grid      = prhs[1];
+   bodyCount = mxGetNumberOfElements(bodies);
+
+   nsd  = ( mxGetField(grid, 0, "numz") != NULL ) ? 3 : 2;
+   h[0] = mxGetScalar(mxGetField(grid, 0, "deltax"));
+   h[1] = mxGetScalar(mxGetField(grid, 0, "deltay"));
+   numx = (int) mxGetScalar(mxGetField(grid, 0, "numx"));
+   numy = (int) mxGetScalar(mxGetField(grid, 0, "numy"));
+   if ( nsd == 3 ){
+      h[2] = mxGetScalar(mxGetField(grid, 0, "deltaz"));
+      numz = (int) mxGetScalar(mxGetField(grid, 0, "numz"));
+   }
+   nodeCount = (numx+1)*(numy+1)*( nsd == 3 ? numz+1 : 1 );
+   cellCount = (mwSize) numx*numy*( nsd == 3 ? numz : 1 );
+   ncoord    = mxGetPr(mxGetField(grid, 0, "node"));
+   cellVol   = h[0]*h[1]*( nsd == 3 ? h[2] : 1. );
+   for(int i = 0; i < nsd; i++) org[i] = ncoord[i*nodeCount];
+
+   {
+      mwSize dims[3] = {nodeCount, nsd, bodyCount};
+      plhs[0] = mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL);
+   }
+   plhs[1] = mxCreateDoubleMatrix(nodeCount, bodyCount, mxREAL);
+   plhs[2] = mxCreateDoubleMatrix(nodeCount, bodyCount, mxREAL);
+   plhs[3] = mxCreateDoubleMatrix(cellCount, bodyCount, mxREAL);
+   plhs[4] = mxCreateDoubleMatrix(cellCount, bodyCount, mxREAL);
+   normals = mxGetPr(plhs[0]);
+   curva   = mxGetPr(plhs[1]);
+   dens    = mxGetPr(plhs[2]);
+   cdens   = mxGetPr(plhs[3]);
+   ccurva  = mxGetPr(plhs[4]);
+   occupied= (char*) mxCalloc(cellCount*bodyCount, sizeof(char));
+
+   /* all particles of all bodies form one index range; the body arrays are
+      read here since the MEX API is not thread safe */
+
+   offset = (mwSize*)  mxMalloc((bodyCount+1)*sizeof(mwSize));
+   coordB = (double**) mxMalloc((bodyCount+1)*sizeof(double*));
+   massB  = (double**) mxMalloc((bodyCount+1)*sizeof(double*));
+   offset[0] = 0;
+   for(ib = 0; ib < bodyCount; ib++){
+      coordB[ib]   = mxGetPr(getBodyField(bodies, ib, "coord"));
+      massB[ib]    = mxGetPr(getBodyField(bodies, ib, "mass"));
+      offset[ib+1] = offset[ib] + mxGetM(getBodyField(bodies, ib, "mass"));
+   }
+   total = offset[bodyCount];
+
+   #pragma omp parallel for schedule(static)
+   for(ig = 0; ig < (long) total; ig++){
+      mwSize  lo = 0, hi = bodyCount, b, ip, pCount;
+      double *coord, *mass, xp[3], Mp;
+      double  f[3][3], df[3][3], fc[3][3], d2f;
+      int     base[3], cbase[3], cell[3], i, a, c, d;
+
+      while ( hi - lo > 1 ){                         /* body owning particle ig */
+         mwSize mid = (lo+hi)/2;
+         if ( offset[mid] <= (mwSize) ig ) lo = mid; else hi = mid;
+      }
+      b      = lo;
+      ip     = ig - offset[b];
+      pCount = offset[b+1] - offset[b];
+      coord  = coordB[b];
+      mass   = massB[b];
+      Mp     = mass[ip];
+
+      /* 1D weights of the 3 nodes and the 3 cell centres around the particle
+         in each direction */
+      for(i = 0; i < nsd; i++){
+         double dfc;
+         xp[i]    = coord[ip + i*pCount] - org[i];
+         base[i]  = (int) floor(xp[i]/h[i] + 0.5) - 1;
+         cbase[i] = (int) floor(xp[i]/h[i]) - 1;
+         for(a = 0; a < 3; a++){
+            computeQuadraticBsplineBasis1D (xp[i] - (base[i]+a)*h[i], h[i],
+                                            &f[i][a], &df[i][a], &d2f);
+            computeQuadraticBsplineBasis1D (xp[i] - (cbase[i]+a+0.5)*h[i], h[i],
+                                            &fc[i][a], &dfc, &d2f);
+         }
+      }
+      cell[2] = 0;                                   /* cell of the particle */
+      for(i = 0; i < nsd; i++){
+         int n = ( i == 0 ) ? numx : ( i == 1 ) ? numy : numz;
+         cell[i] = cbase[i] + 1;
+         if ( cell[i] < 0   ) cell[i] = 0;
+         if ( cell[i] > n-1 ) cell[i] = n-1;
+      }
+      #pragma omp atomic write
+      occupied[cell[0] + numx*cell[1] + (mwSize)numx*numy*cell[2] + b*cellCount] = 1;
+
+      for(c = 0; c < ( nsd == 3 ? 3 : 1 ); c++){
+         int kz = ( nsd == 3 ) ? base[2] + c : 0;
+         if ( kz < 0 || kz > numz ) continue;
+         for(d = 0; d < 3; d++){
+            int jy = base[1] + d;
+            if ( jy < 0 || jy > numy ) continue;
+            for(a = 0; a < 3; a++){
+               int    ix = base[0] + a;
+               double fz = 1., dfz = 0., N, g[3];
+               mwSize nid;
+               if ( ix < 0 || ix > numx ) continue;
+               if ( nsd == 3 ){ fz = f[2][c]; dfz = df[2][c]; }
+               nid  = ix + (numx+1)*jy + (mwSize)(numx+1)*(numy+1)*kz;
+               N    = f[0][a]*f[1][d]*fz;
+               g[0] = df[0][a]*f[1][d]*fz;
+               g[1] = f[0][a]*df[1][d]*fz;
+               if ( nsd == 3 ) g[2] = f[0][a]*f[1][d]*dfz;
+               #pragma omp atomic
+               dens[nid + b*nodeCount] += Mp*N;
+               for(i = 0; i < nsd; i++){
+                  #pragma omp atomic
+                  normals[nid + (i + b*nsd)*nodeCount] += Mp*g[i];
+               }
+            }
+         }
+      }
+
+      for(c = 0; c < ( nsd == 3 ? 3 : 1 ); c++){
+         int kz = ( nsd == 3 ) ? cbase[2] + c : 0;
+         if ( kz < 0 || ( nsd == 3 && kz > numz-1 ) ) continue;
+         for(d = 0; d < 3; d++){
+            int jy = cbase[1] + d;
+            if ( jy < 0 || jy > numy-1 ) continue;
+            for(a = 0; a < 3; a++){
+               int ix = cbase[0] + a;
+               if ( ix < 0 || ix > numx-1 ) continue;
+               #pragma omp atomic
+               cdens[ix + numx*jy + (mwSize)numx*numy*kz + b*cellCount] +=
+                  Mp*fc[0][a]*fc[1][d]*( nsd == 3 ? fc[2][c] : 1. );
+            }
+         }
+      }
+   }
+
+   /* scale to densities */
+
+   #pragma omp parallel for schedule(static)
+   for(I = 0; I < (long) (nodeCount*bodyCount); I++){
+      mwSize b = I/nodeCount, nid = I%nodeCount;
+      int    i;
+      dens[I] /= cellVol;
+      for(i = 0; i < nsd; i++) normals[nid + (i + b*nsd)*nodeCount] /= cellVol;
+   }
+   for(I = 0; I < (long) (cellCount*bodyCount); I++) cdens[I] /= cellVol;
+
+   normTol = (double*) mxCalloc(bodyCount, sizeof(double));
+   for(ib = 0; ib < bodyCount; ib++){
+      double *nb = normals + ib*nsd*nodeCount, lmax = 0.;
+      mwSize  k;
+      for(k = 0; k < nodeCount; k++){
+         double l = 0.;
+         for(int i = 0; i < nsd; i++) l += nb[k + i*nodeCount]*nb[k + i*nodeCount];
+         if ( l > lmax ) lmax = l;
+      }
+      normTol[ib] = 1e-3*sqrt(lmax) + DBL_MIN;
+   }
+
+   /* curvature -div(n/|n|) = -(div n - n/|n|.grad|n|)/|n| by central differences of the
+      nodal normals, as computeGridNormalCurvature.m does with the cell derivatives */
+
+   #pragma omp parallel for schedule(static)
+   for(I = 0; I < (long) (nodeCount*bodyCount); I++){
+      mwSize  b = I/nodeCount, nid = I%nodeCount;
+      int     idx[3], n[3] = {numx, numy, numz}, i, j;
+      double *nb = normals + b*nsd*nodeCount, ln, divn = 0., ngl = 0.;
+      mwSize  stride[3];
+
+      stride[0] = 1; stride[1] = numx+1; stride[2] = (mwSize)(numx+1)*(numy+1);
+      idx[0] = nid%(numx+1);
+      idx[1] = (nid/(numx+1))%(numy+1);
+      idx[2] = ( nsd == 3 ) ? nid/stride[2] : 0;
+
+      ln = 0.;
+      for(i = 0; i < nsd; i++) ln += nb[nid + i*nodeCount]*nb[nid + i*nodeCount];
+      ln = sqrt(ln);
+      if ( ln < normTol[b] ) continue;
+
+      for(i = 0; i < nsd; i++){
+         mwSize lo = ( idx[i] > 0    ) ? nid - stride[i] : nid;
+         mwSize hi = ( idx[i] < n[i] ) ? nid + stride[i] : nid;
+         double dx = ( (hi != nid) + (lo != nid) )*h[i], llo = 0., lhi = 0.;
+         if ( dx == 0. ) continue;
+         for(j = 0; j < nsd; j++){
+            llo += nb[lo + j*nodeCount]*nb[lo + j*nodeCount];
+            lhi += nb[hi + j*nodeCount]*nb[hi + j*nodeCount];
+         }
+         divn += ( nb[hi + i*nodeCount] - nb[lo + i*nodeCount] )/dx;
+         ngl  += nb[nid + i*nodeCount]/ln * ( sqrt(lhi) - sqrt(llo) )/dx;
+      }
+      curva[I] = -( divn - ngl )/ln;
+   }
+
+   /* cell curvature (div(|n|) n/|n| - div n)/|n| with the derivatives of the linear
+      interpolation of the corner normals at the cell centre */
+
+   #pragma omp parallel for schedule(static)
+   for(I = 0; I < (long) (cellCount*bodyCount); I++){
+      mwSize  b = I/cellCount, cid = I%cellCount, nid;
+      int     corners = 1 << nsd, cx, cy, cz, q, i;
+      double *nb = normals + b*nsd*nodeCount, cn[3] = {0.,0.,0.}, dl[3] = {0.,0.,0.};
+      double  divn = 0., le = 0., cur = 0.;
+
+      if ( !occupied[I] ) continue;
+      cx = cid%numx;
+      cy = (cid/numx)%numy;
+      cz = ( nsd == 3 ) ? cid/((mwSize)numx*numy) : 0;
+
+      for(q = 0; q < corners; q++){
+         double ln = 0.;
+         nid = (cx + (q&1)) + (numx+1)*(cy + ((q>>1)&1))
+             + (mwSize)(numx+1)*(numy+1)*(cz + ((q>>2)&1));
+         for(i = 0; i < nsd; i++){
+            cn[i] += nb[nid + i*nodeCount]/corners;
+            ln    += nb[nid + i*nodeCount]*nb[nid + i*nodeCount];
+         }
+         ln = sqrt(ln);
+         for(i = 0; i < nsd; i++){
+            double dN = ( ((q>>i)&1) ? 2. : -2. )/(h[i]*corners);
+            divn  += dN*nb[nid + i*nodeCount];
+            dl[i] += dN*ln;
+         }
+      }
+      for(i = 0; i < nsd; i++) le += cn[i]*cn[i];
+      le = sqrt(le);
+      if ( le < 1e-5 ) le = 1.;
+      for(i = 0; i < nsd; i++) cur += cn[i]/le*dl[i];
+      ccurva[I] = ( cur - divn )/le;
+   }
+
+   mxFree(occupied);
+   mxFree(normTol);
+   mxFree(massB);
+   mxFree(coordB);
+   mxFree(offset);
+}
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" ImageParticles.c
+ */
+
+typedef struct {
+   const double* map;      /* k x 2 [value id] or k x 3 [lo hi id] */
+   int           k;
+   int           ranges;
+   int*          lut;      /* phase of every value of 8 and 16 bit images */
+   int           lutOffset;
+} PhaseMap;
+
+static double voxelValue (const void* data, mxClassID cls, mwSize i)
+{
+   switch ( cls ){
+      case mxDOUBLE_CLASS:  return ((const double*)         data)[i];
+      case mxSINGLE_CLASS:  return ((const float*)          data)[i];
+      case mxINT8_CLASS:    return ((const signed char*)    data)[i];
+      case mxUINT8_CLASS:   return ((const unsigned char*)  data)[i];
+      case mxLOGICAL_CLASS: return ((const mxLogical*)      data)[i];
+      case mxINT16_CLASS:   return ((const short*)          data)[i];
+      case mxUINT16_CLASS:  return ((const unsigned short*) data)[i];
+      case mxINT32_CLASS:   return ((const int*)            data)[i];
+      case mxUINT32_CLASS:  return ((const unsigned int*)   data)[i];
+      default:              return 0.;
+   }
+}
+
+static int lookupPhase (const PhaseMap* pm, double v)
+/*
+ * material id of the intensity v, 0 if v is not in the map
+ */
+{
+   int r;
+
+   for(r = 0; r < pm->k; r++){
+      if ( pm->ranges ){
+         if ( v >= pm->map[r] && v <= pm->map[r + pm->k] ) return (int) pm->map[r + 2*pm->k];
+      }
+      else if ( v == pm->map[r] ) return (int) pm->map[r + pm->k];
+   }
+   return 0;
+}
+
+static int voxelPhase (const PhaseMap* pm, const void* data, mxClassID cls, mwSize i)
+{
+   double v = voxelValue(data, cls, i);
+   return pm->lut ? pm->lut[(int) v + pm->lutOffset] : lookupPhase(pm, v);
+}
+
+static int blockParticles (const PhaseMap* pm, const void* data, mxClassID cls, int nsd,
+                           const mwSize* n, const mwSize* block, const mwSize* b,
+                           int nphase, double* cnt, double* sum)
+/*
+ * voxel count (cnt) and sum of the voxel indices (sum, 3 per phase) of
+ * every phase in the block b, returns the number of phases present
+ */
+{
+   mwSize lo[3] = {0, 0, 0}, hi[3] = {1, 1, 1}, i, j, k;
+   int    d, ph, np = 0;
+
+   for(d = 0; d < nsd; d++){
+      lo[d] = b[d]*block[d];
+      hi[d] = ( lo[d] + block[d] < n[d] ) ? lo[d] + block[d] : n[d];
+   }
+   memset(cnt, 0, (nphase+1)*sizeof(double));
+   memset(sum, 0, (nphase+1)*3*sizeof(double));
+   for(k = lo[2]; k < hi[2]; k++)
+      for(j = lo[1]; j < hi[1]; j++)
+         for(i = lo[0]; i < hi[0]; i++){
+            ph = voxelPhase(pm, data, cls, i + n[0]*(j + n[1]*k));
+            if ( ph <= 0 || ph > nphase ) continue;
+            cnt[ph]       += 1.;
+            sum[3*ph]     += (double) i;
+            sum[3*ph + 1] += (double) j;
+            sum[3*ph + 2] += (double) k;
+         }
+   for(ph = 1; ph <= nphase; ph++) if ( cnt[ph] > 0. ) np++;
+   return np;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Particles of a 2D image or a 3D voxel stack.
+	//
+	// We expect the function to be called as :
+        // [pts,vol,phase] = ImageParticles(img,map,spacing)
+        // [pts,vol,phase] = ImageParticles(img,map,spacing,block,origin)
+        //
+        // img     : nx x ny image or nx x ny x nz stack (integer, logical,
+        //           single or double), dimension 1 along x as image2particles.m
+        // map     : k x 2 [intensity id] or k x 3 [lo hi id] (lo <= intensity
+        //           <= hi), voxels not in the map give no particle
+        // spacing : voxel size [dx dy (dz)] (or a scalar)
+        // block   : voxels per particle along each direction (default 1), a
+        //           block of voxels gives one particle per phase it holds, at
+        //           the centroid of the voxels of that phase. For a grid of
+        //           cell size h and ppc particles per direction, block = h/(ppc*dx)
+        // origin  : coordinates of the corner of voxel (1,1,1) (default 0); a
+        //           stack can be processed slab by slab by shifting origin(3)
+        //
+        // pts (np x nsd), vol (np x 1, voxel count times voxel volume) and
+        // phase (np x 1, material id) are ordered by block. 8 and 16 bit
+        // images use a lookup table of the intensities; blocks are processed
+        // in parallel with OpenMP.
+        */
+   const mxArray *img;
+   const void    *data;
+   mxClassID      cls;
+   PhaseMap       pm;
+   mwSize         n[3] = {1, 1, 1}, block[3] = {1, 1, 1}, nb[3] = {1, 1, 1}, nblock, np, *off;
+   double         h[3] = {1., 1., 1.}, org[3] = {0., 0., 0.}, vvox = 1.;
+   double        *pts, *vol, *phase;
+   const mwSize  *dims;
+   int            nsd, nphase = 0, d, r;
+   long           b;
+
+   if ( nrhs < 3 )
+      mexErrMsgTxt("ImageParticles: expected (img, map, spacing[, block, origin])");
+
+   img  = prhs[0];
+   data = mxGetData(img);
+   cls  = mxGetClassID(img);
+   if ( mxIsComplex(img) || mxIsSparse(img) ||
+        ( !mxIsNumeric(img) && !mxIsLogical(img) ) || cls == mxINT64_CLASS || cls == mxUINT64_CLASS )
+      mexErrMsgTxt("ImageParticles: img must be a real (u)int8/16/32, logical, single or double array");
+   nsd  = ( mxGetNumberOfDimensions(img) > 2 ) ? 3 : 2;
+   if ( mxGetNumberOfDimensions(img) > 3 ) mexErrMsgTxt("ImageParticles: img must be 2D or 3D (convert RGB with rgb2gray)");
+   dims = mxGetDimensions(img);
+   for(d = 0; d < nsd; d++) n[d] = dims[d];
+
+   /* intensity -> material map */
+   if ( !mxIsDouble(prhs[1]) || ( mxGetN(prhs[1]) != 2 && mxGetN(prhs[1]) != 3 ) )
+      mexErrMsgTxt("ImageParticles: map must be k x 2 [intensity id] or k x 3 [lo hi id]");
+   pm.map       = mxGetPr(prhs[1]);
+   pm.k         = (int) mxGetM(prhs[1]);
+   pm.ranges    = ( mxGetN(prhs[1]) == 3 );
+   pm.lut       = NULL;
+   pm.lutOffset = 0;
+   for(r = 0; r < pm.k; r++){
+      double id = pm.map[r + (pm.ranges ? 2 : 1)*pm.k];
+      if ( id < 1. || id != floor(id) ) mexErrMsgTxt("ImageParticles: material ids must be integers >= 1");
+      if ( (int) id > nphase ) nphase = (int) id;
+   }
+
+   /* voxel size, block and origin */
+   for(d = 0; d < nsd; d++){
+      mwSize m = mxGetNumberOfElements(prhs[2]);
+      h[d]  = mxGetPr(prhs[2])[ m > (mwSize) d ? d : 0 ];
+      vvox *= h[d];
+   }
+   if ( nrhs > 3 && !mxIsEmpty(prhs[3]) ){
+      mwSize m = mxGetNumberOfElements(prhs[3]);
+      for(d = 0; d < nsd; d++){
+         double bd = mxGetPr(prhs[3])[ m > (mwSize) d ? d : 0 ];
+         if ( bd < 1. ) mexErrMsgTxt("ImageParticles: block must be >= 1 voxel");
+         block[d] = (mwSize) floor(bd + 0.5);
+      }
+   }
+   if ( nrhs > 4 && !mxIsEmpty(prhs[4]) ){
+      mwSize m = mxGetNumberOfElements(prhs[4]);
+      for(d = 0; d < nsd; d++) org[d] = mxGetPr(prhs[4])[ m > (mwSize) d ? d : 0 ];
+   }
+
+   /* lookup table for 8 and 16 bit images */
+   if ( cls == mxUINT8_CLASS || cls == mxINT8_CLASS || cls == mxLOGICAL_CLASS ||
+        cls == mxUINT16_CLASS || cls == mxINT16_CLASS ){
+      int size = ( cls == mxUINT16_CLASS || cls == mxINT16_CLASS ) ? 65536 : 256, v;
+      pm.lutOffset = ( cls == mxINT8_CLASS ) ? 128 : ( cls == mxINT16_CLASS ) ? 32768 : 0;
+      pm.lut       = (int*) mxMalloc(size*sizeof(int));
+      for(v = 0; v < size; v++) pm.lut[v] = lookupPhase(&pm, (double)(v - pm.lutOffset));
+   }
+
+   nblock = 1;
+   for(d = 0; d < nsd; d++){
+      nb[d]   = ( n[d] + block[d] - 1 )/block[d];
+      nblock *= nb[d];
+   }
+
+   /* number of particles of every block, offsets, then the particles */
+   off = (mwSize*) mxMalloc((nblock+1)*sizeof(mwSize));
+   #pragma omp parallel
+   {
+      double *cnt = (double*) malloc((nphase+1)*4*sizeof(double)), *sum = cnt + nphase + 1;
+      mwSize  bi[3];
+      #pragma omp for
+      for(b = 0; b < (long) nblock; b++){
+         bi[0] = b % nb[0];
+         bi[1] = ( b / nb[0] ) % nb[1];
+         bi[2] = b / ( nb[0]*nb[1] );
+         off[b+1] = blockParticles(&pm, data, cls, nsd, n, block, bi, nphase, cnt, sum);
+      }
+      free(cnt);
+   }
+   off[0] = 0;
+   for(b = 0; b < (long) nblock; b++) off[b+1] += off[b];
+   np = off[nblock];
+
+   plhs[0] = mxCreateDoubleMatrix(np, nsd, mxREAL);
+   plhs[1] = mxCreateDoubleMatrix(np, 1, mxREAL);
+   plhs[2] = mxCreateDoubleMatrix(np, 1, mxREAL);
+   pts     = mxGetPr(plhs[0]);
+   vol     = mxGetPr(plhs[1]);
+   phase   = mxGetPr(plhs[2]);
+
+   #pragma omp parallel
+   {
+      double *cnt = (double*) malloc((nphase+1)*4*sizeof(double)), *sum = cnt + nphase + 1;
+      mwSize  bi[3], o;
+      int     ph, dd;
+      #pragma omp for
+      for(b = 0; b < (long) nblock; b++){
+         if ( off[b+1] == off[b] ) continue;
+         bi[0] = b % nb[0];
+         bi[1] = ( b / nb[0] ) % nb[1];
+         bi[2] = b / ( nb[0]*nb[1] );
+         blockParticles(&pm, data, cls, nsd, n, block, bi, nphase, cnt, sum);
+         o = off[b];
+         for(ph = 1; ph <= nphase; ph++){
+            if ( cnt[ph] == 0. ) continue;
+            /* centroid of the voxel centres of the phase */
+            for(dd = 0; dd < nsd; dd++) pts[o + np*dd] = org[dd] + ( sum[3*ph + dd]/cnt[ph] + 0.5 )*h[dd];
+            vol[o]   = cnt[ph]*vvox;
+            phase[o] = ph;
+            o++;
+         }
+      }
+      free(cnt);
+   }
+
+   if ( pm.lut ) mxFree(pm.lut);
+   mxFree(off);
+}
@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+#include "util.h"
+#include "gemm.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" MLSBasis.c util.c basis.c gemm.c
+ */
+
+#define MLS_MAX_BASIS 10     /* quadratic basis in 3D */
+
+enum { MLS_CUBIC, MLS_QUARTIC, MLS_EXP };
+
+static double mlsWeight (int form, double r, double alpha, double* dwdr)
+/*
+ * cubicSpline.m, quarticSpline.m and expSpline.m, w(r) and dw/dr
+ */
+{
+   double w = 0.;
+
+   *dwdr = 0.;
+   if ( r > 1. ) return 0.;
+   switch ( form ){
+      case MLS_CUBIC :
+         if ( r <= 0.5 ){
+            w     = 2./3. - 4.*r*r + 4.*r*r*r;
+            *dwdr = -8.*r + 12.*r*r;
+         }
+         else{
+            w     = 4./3. - 4.*r + 4.*r*r - (4./3.)*r*r*r;
+            *dwdr = -4. + 8.*r - 4.*r*r;
+         }
+         break;
+      case MLS_QUARTIC :
+         w     = 1. - 6.*r*r + 8.*r*r*r - 3.*r*r*r*r;
+         *dwdr = -12.*r + 24.*r*r - 12.*r*r*r;
+         break;
+      case MLS_EXP :
+         w     = exp(-(r/alpha)*(r/alpha));
+         *dwdr = -2.*r/(alpha*alpha)*w;
+         break;
+   }
+   return w;
+}
+
+static int mlsBasisSize (int nsd, int order)
+{
+   return ( order == 0 ) ? 1 : ( order == 1 ) ? 1 + nsd : (nsd+1)*(nsd+2)/2;
+}
+
+static void mlsBasis (int nsd, int order, const double* x, double* p)
+/*
+ * p = [1 x y z xx xy xz yy yz zz] (up to order, in nsd dimensions)
+ */
+{
+   int m = 0, i, j;
+
+   p[m++] = 1.;
+   if ( order > 0 ) for(i = 0; i < nsd; i++) p[m++] = x[i];
+   if ( order > 1 ) for(i = 0; i < nsd; i++) for(j = i; j < nsd; j++) p[m++] = x[i]*x[j];
+}
+
+typedef struct {
+   int           nsd, nel[3];
+   double        org[3], h[3];
+   const double *node;         /* nn x nsd */
+   const double *di;           /* support radius of the nodes */
+   mwSize        nn;
+   int           diScalar;
+   mwSize       *start, *order;
+} MLSNodes;
+
+static mwSize findNeighbours (const MLSNodes* g, const double* x, mwIndex* nbr)
+/*
+ * Nodes I with |x - x_I| <= di(I), through the cell list of the nodes (cells
+ * of size max(di), so only the 3^nsd cells around x are visited). Only
+ * counts when nbr is NULL.
+ */
+{
+   int    lo[3] = {0, 0, 0}, hi[3] = {0, 0, 0}, c[3], d;
+   mwSize k = 0, s;
+
+   for(d = 0; d < g->nsd; d++){
+      int e = (int) floor((x[d] - g->org[d])/g->h[d]);
+      if ( e < 0 )             e = 0;
+      if ( e > g->nel[d] - 1 ) e = g->nel[d] - 1;
+      lo[d] = ( e > 0 ) ? e - 1 : 0;
+      hi[d] = ( e < g->nel[d] - 1 ) ? e + 1 : e;
+   }
+   for(c[2] = lo[2]; c[2] <= hi[2]; c[2]++)
+   for(c[1] = lo[1]; c[1] <= hi[1]; c[1]++)
+   for(c[0] = lo[0]; c[0] <= hi[0]; c[0]++){
+      mwSize cell = c[0] + (mwSize) g->nel[0]*( c[1] + (mwSize) g->nel[1]*c[2] );
+      for(s = g->start[cell]; s < g->start[cell+1]; s++){
+         mwSize I  = g->order[s];
+         double r2 = 0., R = g->di[ g->diScalar ? 0 : I ];
+         for(d = 0; d < g->nsd; d++){
+            double dx = x[d] - g->node[I + d*g->nn];
+            r2 += dx*dx;
+         }
+         if ( r2 > R*R ) continue;
+         if ( nbr ) nbr[k] = I;
+         k++;
+      }
+   }
+   return k;
+}
+
+static int mlsShapeFunctions (const MLSNodes* g, int order, int form, double alpha, double scale,
+                              const double* x, mwSize k, const mwIndex* nbr,
+                              double* phi, double* dphi, double* w, double* dw)
+/*
+ * MLS shape functions phi_I = p(x)'*inv(A)*p(x_I)*w_I of the k neighbours of
+ * x and, when dphi != NULL, their derivatives dphi[I + k*d] (as
+ * mlsLinearBasis2D.m, plus the derivatives of A and p). The basis is taken
+ * about x and scaled by 'scale' to keep A well conditioned. Returns 0 if A is
+ * singular (too few or badly placed neighbours).
+ */
+{
+   int    nsd = g->nsd, m = mlsBasisSize(nsd, order), d, i, j;
+   double A[MLS_MAX_BASIS*MLS_MAX_BASIS], dA[3][MLS_MAX_BASIS*MLS_MAX_BASIS];
+   double p[MLS_MAX_BASIS], gam[MLS_MAX_BASIS], dgam[3*MLS_MAX_BASIS], xi[3], det, diag;
+   mwSize q;
+
+   if ( k < (mwSize) m ) return 0;
+   memset(A,  0, sizeof(A));
+   memset(dA, 0, sizeof(dA));
+
+   for(q = 0; q < k; q++){
+      mwSize I = nbr[q];
+      double R = g->di[ g->diScalar ? 0 : I ], r = 0., dwdr;
+      for(d = 0; d < nsd; d++){
+         xi[d] = g->node[I + d*g->nn] - x[d];
+         r    += xi[d]*xi[d];
+      }
+      r    = sqrt(r);
+      w[q] = mlsWeight(form, r/R, alpha, &dwdr);
+      for(d = 0; d < nsd; d++){
+         dw[q + k*d] = ( r > 0. ) ? -dwdr*xi[d]/(r*R) : 0.;   /* dw/dx_d, xi = x_I - x */
+         xi[d] /= scale;
+      }
+      mlsBasis(nsd, order, xi, p);
+      for(j = 0; j < m; j++)
+         for(i = 0; i < m; i++){
+            A[i + m*j] += w[q]*p[i]*p[j];
+            if ( dphi ) for(d = 0; d < nsd; d++) dA[d][i + m*j] += dw[q + k*d]*p[i]*p[j];
+         }
+   }
+
+   /* A*gam = p(x) = e1, A*dgam_d = dp/dx_d - dA_d*gam. A is symmetric
+      positive semi-definite, det(A) <= prod(A_ii) with equality for a
+      well conditioned A */
+   memset(gam, 0, m*sizeof(double));
+   gam[0] = 1.;
+   for(i = 0, diag = 1.; i < m; i++) diag *= A[i + m*i];
+   if ( !solvePage(m, 1, A, gam, &det) || det <= 1e-12*diag ) return 0;
+
+   if ( dphi ){
+      for(d = 0; d < nsd; d++){
+         double* dg = dgam + m*d;
+         for(i = 0; i < m; i++){
+            dg[i] = ( order > 0 && i == d + 1 ) ? 1./scale : 0.;
+            for(j = 0; j < m; j++) dg[i] -= dA[d][i + m*j]*gam[j];
+         }
+      }
+      solvePage(m, nsd, A, dgam, &det);
+   }
+
+   for(q = 0; q < k; q++){
+      double pg = 0.;
+      for(d = 0; d < nsd; d++) xi[d] = (g->node[nbr[q] + d*g->nn] - x[d])/scale;
+      mlsBasis(nsd, order, xi, p);
+      for(i = 0; i < m; i++) pg += gam[i]*p[i];
+      phi[q] = pg*w[q];
+      if ( dphi )
+         for(d = 0; d < nsd; d++){
+            double pdg = 0.;
+            for(i = 0; i < m; i++) pdg += dgam[i + m*d]*p[i];
+            dphi[q + k*d] = pdg*w[q] + pg*dw[q + k*d];
+         }
+   }
+   return 1;
+}
+
+static mxArray* createSparse (mwSize npt, mwSize nn, const mwSize* rowStart, const mwIndex* col,
+                              const double* val)
+/*
+ * npt x nn sparse matrix from the rows (points) rowStart, col, val
+ */
+{
+   mwSize   nnz = rowStart[npt], i, s;
+   mxArray* S   = mxCreateSparse(npt, nn, nnz > 0 ? nnz : 1, mxREAL);
+   mwIndex *ir  = mxGetIr(S), *jc = mxGetJc(S);
+   double  *pr  = mxGetPr(S);
+
+   for(i = 0; i <= nn; i++) jc[i] = 0;
+   for(s = 0; s < nnz; s++) jc[col[s]+1]++;
+   for(i = 0; i < nn; i++) jc[i+1] += jc[i];
+   for(i = 0; i < npt; i++)
+      for(s = rowStart[i]; s < rowStart[i+1]; s++){
+         mwIndex t = jc[col[s]]++;
+         ir[t] = i;
+         pr[t] = val[s];
+      }
+   for(i = nn; i > 0; i--) jc[i] = jc[i-1];
+   jc[0] = 0;
+   return S;
+}
+
+static int computeRows (const mxArray** in, int nin, int wantDer, mwSize** rowStartOut,
+                        mwIndex** colOut, double** valOut, double** dvalOut)
+/*
+ * Rows (one per point, CSR) of the shape functions and, if wantDer, of their
+ * derivatives for in = (points, nodes, di, order, form[, alpha]). Returns nsd.
+ */
+{
+   const double *points;
+   double       *val, *dval = NULL, alpha = 0.3, scale = 0., lo[3], hi[3], inf = mxGetInf();
+   mwSize        npt, nn, i, ncell, kmax = 0;
+   mwSize       *rowStart;
+   mwIndex      *col;
+   int           nsd, order, form = MLS_CUBIC, d;
+   long          ip, singular = 0;
+   char          name[32];
+   MLSNodes      g;
+
+   if ( nin < 5 )
+      mexErrMsgTxt("MLSBasis: expected (points, nodes, di, order, form[, alpha])");
+
+   points = mxGetPr(in[0]);
+   npt    = mxGetM(in[0]);
+   nsd    = (int) mxGetN(in[0]);
+   nn     = mxGetM(in[1]);
+   order  = (int) mxGetScalar(in[3]);
+   if ( nsd < 1 || nsd > 3 || (int) mxGetN(in[1]) != nsd )
+      mexErrMsgTxt("MLSBasis: points and nodes must be npt x nsd and nn x nsd, nsd = 1, 2 or 3");
+   if ( order < 0 || order > 2 )
+      mexErrMsgTxt("MLSBasis: order must be 0, 1 or 2");
+   if ( mxGetNumberOfElements(in[2]) != 1 && mxGetNumberOfElements(in[2]) != nn )
+      mexErrMsgTxt("MLSBasis: di must have one radius per node, or be a scalar");
+
+   mxGetString(in[4], name, sizeof(name));
+   if      ( strncmp(name, "cu", 2) == 0 ) form = MLS_CUBIC;
+   else if ( strncmp(name, "qu", 2) == 0 ) form = MLS_QUARTIC;
+   else if ( strncmp(name, "ex", 2) == 0 ) form = MLS_EXP;
+   else mexErrMsgTxt("MLSBasis: form must be 'cubic_spline', 'quartic_spline' or 'exp_spline'");
+   if ( nin > 5 ) alpha = mxGetScalar(in[5]);
+
+   /* cell list of the nodes, cells of size max(di) over their bounding box */
+   g.nsd      = nsd;
+   g.node     = mxGetPr(in[1]);
+   g.di       = mxGetPr(in[2]);
+   g.nn       = nn;
+   g.diScalar = ( mxGetNumberOfElements(in[2]) == 1 );
+   for(i = 0; i < (mwSize) mxGetNumberOfElements(in[2]); i++)
+      if ( g.di[i] > scale ) scale = g.di[i];
+   if ( scale <= 0. ) mexErrMsgTxt("MLSBasis: di must be positive");
+   for(d = 0; d < 3; d++){ lo[d] = inf; hi[d] = -inf; g.nel[d] = 1; g.org[d] = 0.; g.h[d] = 1.; }
+   for(d = 0; d < nsd; d++){
+      for(i = 0; i < nn; i++){
+         double xd = g.node[i + d*nn];
+         if ( xd < lo[d] ) lo[d] = xd;
+         if ( xd > hi[d] ) hi[d] = xd;
+      }
+      if ( nn == 0 ){ lo[d] = hi[d] = 0.; }
+      g.org[d] = lo[d];
+      g.h[d]   = scale;
+      g.nel[d] = (int) ceil((hi[d] - lo[d])/scale);
+      if ( g.nel[d] < 1 ) g.nel[d] = 1;
+   }
+   /* supports much smaller than the spread of the nodes: do not use more
+      cells than nodes */
+   while ( (double) g.nel[0]*g.nel[1]*g.nel[2] > 2.*nn + 8 ){
+      for(d = 0; d < nsd; d++){
+         g.h[d]  *= 2.;
+         g.nel[d] = (int) ceil((hi[d] - lo[d])/g.h[d]);
+         if ( g.nel[d] < 1 ) g.nel[d] = 1;
+      }
+   }
+   ncell   = (mwSize) g.nel[0]*g.nel[1]*g.nel[2];
+   g.start = (mwSize*) mxMalloc((ncell+1)*sizeof(mwSize));
+   g.order = (mwSize*) mxMalloc((nn+1)*sizeof(mwSize));
+   bucketParticlesByCell(nsd, g.node, nn, g.org, g.h, g.nel, g.start, g.order);
+
+   /* count the neighbours of every point, then fill the rows */
+   rowStart = (mwSize*) mxMalloc((npt+1)*sizeof(mwSize));
+   rowStart[0] = 0;
+   #pragma omp parallel for private(d)
+   for(ip = 0; ip < (long) npt; ip++){
+      double x[3];
+      for(d = 0; d < nsd; d++) x[d] = points[ip + d*npt];
+      rowStart[ip+1] = findNeighbours(&g, x, NULL);
+   }
+   for(i = 0; i < npt; i++){
+      if ( rowStart[i+1] > kmax ) kmax = rowStart[i+1];
+      rowStart[i+1] += rowStart[i];
+   }
+   col  = (mwIndex*) mxMalloc((rowStart[npt]+1)*sizeof(mwIndex));
+   val  = (double*)  mxMalloc((rowStart[npt]+1)*sizeof(double));
+   if ( wantDer ) dval = (double*) mxMalloc((nsd*rowStart[npt]+1)*sizeof(double));
+
+   #pragma omp parallel private(d)
+   {
+      double *w  = (double*) malloc(((1+2*nsd)*kmax+1)*sizeof(double));
+      double *dw = w + kmax, *dphi = dw + nsd*kmax;
+
+      #pragma omp for schedule(dynamic,64) reduction(+:singular)
+      for(ip = 0; ip < (long) npt; ip++){
+         double  x[3];
+         mwSize  s = rowStart[ip], k = rowStart[ip+1] - s, q;
+         for(d = 0; d < nsd; d++) x[d] = points[ip + d*npt];
+         findNeighbours(&g, x, col + s);
+         if ( !mlsShapeFunctions(&g, order, form, alpha, scale, x, k, col + s, val + s,
+                                 wantDer ? dphi : NULL, w, dw) ){
+            memset(val + s, 0, k*sizeof(double));
+            memset(dphi, 0, nsd*k*sizeof(double));
+            singular++;
+         }
+         if ( wantDer )
+            for(d = 0; d < nsd; d++)
+               for(q = 0; q < k; q++) dval[d*rowStart[npt] + s + q] = dphi[q + k*d];
+      }
+      free(w);
+   }
+   if ( singular ) mexWarnMsgTxt("MLSBasis: singular moment matrix at some points, their shape functions are set to zero");
+
+   mxFree(g.start);
+   mxFree(g.order);
+   *rowStartOut = rowStart;
+   *colOut      = col;
+   *valOut      = val;
+   *dvalOut     = dval;
+   return nsd;
+}
+
+static void applyRows (const mxArray* cache, const mxArray* uI, mxArray** u)
+/*
+ * u = phi*uI with the CSR rows of a 'factor' cache, in parallel over the rows
+ */
+{
+   const mxArray *rp = mxGetField(cache, 0, "rowptr"), *cl = mxGetField(cache, 0, "col");
+   const mxArray *vl = mxGetField(cache, 0, "val"),    *nd = mxGetField(cache, 0, "nodes");
+   const long long    *rowptr;
+   const unsigned int *col;
+   const double       *val, *x;
+   double             *y;
+   mwSize              npt, nn, ncol, j;
+   long                i;
+
+   if ( rp == NULL || cl == NULL || vl == NULL || nd == NULL || !mxIsInt64(rp) || !mxIsUint32(cl) )
+      mexErrMsgTxt("MLSBasis: apply expects a cache from MLSBasis('factor', ...)");
+   npt    = mxGetNumberOfElements(rp) - 1;
+   nn     = mxGetM(nd);
+   ncol   = mxGetN(uI);
+   if ( mxGetM(uI) != nn )
+      mexErrMsgTxt("MLSBasis: uI must have one row per node of the cache");
+   rowptr = (const long long*) mxGetData(rp);
+   col    = (const unsigned int*) mxGetData(cl);
+   val    = mxGetPr(vl);
+   x      = mxGetPr(uI);
+   *u     = mxCreateDoubleMatrix(npt, ncol, mxREAL);
+   y      = mxGetPr(*u);
+
+   #pragma omp parallel for private(j)
+   for(i = 0; i < (long) npt; i++){
+      long long s;
+      for(j = 0; j < ncol; j++){
+         double sum = 0.;
+         for(s = rowptr[i]; s < rowptr[i+1]; s++) sum += val[s]*x[col[s] + nn*j];
+         y[i + npt*j] = sum;
+      }
+   }
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Moving least squares shape functions at many points.
+	//
+	// We expect the function to be called as :
+        // [phi,dphidx,dphidy,dphidz] = MLSBasis(points,nodes,di,order,form[,alpha])
+        // cache = MLSBasis('factor',points,nodes,di,order,form[,alpha])
+        // u     = MLSBasis('apply',cache,uI)
+        //
+        // points: npt x nsd points x where the shape functions are evaluated
+        //         (grid nodes, cell centres), nsd = 1, 2 or 3
+        // nodes:  nn x nsd nodes of the approximation (the particles in MPM)
+        // di:     nn x 1 (or scalar) radius of the support of the nodes
+        // order:  0, 1 or 2 for the constant, linear and quadratic basis
+        // form:   'cubic_spline', 'quartic_spline' or 'exp_spline' weight
+        //         (cubicSpline.m, quarticSpline.m, expSpline.m with alpha,
+        //         default 0.3)
+        // phi:    npt x nn sparse matrix of the shape functions, so that
+        //         u(points) = phi*uI; dphidx ... its derivatives (optional)
+        //
+        // 'factor' solves the moment matrices once and keeps the shape
+        // functions as CSR rows (cache.rowptr, 0-based cache.col, cache.val)
+        // with a copy of points, nodes, di, order, form and alpha; 'apply' is
+        // then a parallel sparse mat-vec u = phi*uI (uI nn x ncomp). mlsProject.m
+        // refactors the cache only when any of these inputs change.
+        //
+        // Points whose moment matrix A is singular (fewer nodes in their
+        // support than basis functions) get a zero row and a warning.
+        // The neighbours are found through a cell list of the nodes with cells
+        // of size max(di); points are processed in parallel with OpenMP.
+        */
+   mwSize   *rowStart, npt, nn, i;
+   mwIndex  *col;
+   double   *val, *dval;
+   int       nsd, d;
+   char      mode[8];
+
+   if ( nrhs > 0 && mxIsChar(prhs[0]) ){
+      mxGetString(prhs[0], mode, sizeof(mode));
+      if ( strcmp(mode, "apply") == 0 ){
+         if ( nrhs != 3 || !mxIsStruct(prhs[1]) )
+            mexErrMsgTxt("MLSBasis: expected ('apply', cache, uI)");
+         applyRows(prhs[1], prhs[2], &plhs[0]);
+         return;
+      }
+      if ( strcmp(mode, "factor") == 0 ){
+         const char *names[] = {"points", "nodes", "di", "order", "form", "alpha",
+                                "rowptr", "col", "val"};
+         mxArray    *rp, *cl, *vl;
+         long long  *r;
+         unsigned int *c;
+
+         computeRows(prhs + 1, nrhs - 1, 0, &rowStart, &col, &val, &dval);
+         npt = mxGetM(prhs[1]);
+         nn  = mxGetM(prhs[2]);
+         if ( nn > 4294967295u ) mexErrMsgTxt("MLSBasis: too many nodes for a cache");
+         rp  = mxCreateNumericMatrix(npt+1, 1, mxINT64_CLASS, mxREAL);
+         cl  = mxCreateNumericMatrix(rowStart[npt], 1, mxUINT32_CLASS, mxREAL);
+         vl  = mxCreateDoubleMatrix(rowStart[npt], 1, mxREAL);
+         r   = (long long*) mxGetData(rp);
+         c   = (unsigned int*) mxGetData(cl);
+         for(i = 0; i <= npt; i++) r[i] = (long long) rowStart[i];
+         for(i = 0; i < rowStart[npt]; i++) c[i] = (unsigned int) col[i];
+         memcpy(mxGetPr(vl), val, rowStart[npt]*sizeof(double));
+
+         plhs[0] = mxCreateStructMatrix(1, 1, 9, names);
+         mxSetField(plhs[0], 0, "points", mxDuplicateArray(prhs[1]));
+         mxSetField(plhs[0], 0, "nodes",  mxDuplicateArray(prhs[2]));
+         mxSetField(plhs[0], 0, "di",     mxDuplicateArray(prhs[3]));
+         mxSetField(plhs[0], 0, "order",  mxDuplicateArray(prhs[4]));
+         mxSetField(plhs[0], 0, "form",   mxDuplicateArray(prhs[5]));
+         mxSetField(plhs[0], 0, "alpha",  nrhs > 6 ? mxDuplicateArray(prhs[6])
+                                                   : mxCreateDoubleScalar(0.3));
+         mxSetField(plhs[0], 0, "rowptr", rp);
+         mxSetField(plhs[0], 0, "col",    cl);
+         mxSetField(plhs[0], 0, "val",    vl);
+         mxFree(rowStart);
+         mxFree(col);
+         mxFree(val);
+         return;
+      }
+      mexErrMsgTxt("MLSBasis: unknown mode, expected 'factor' or 'apply'");
+   }
+
+   if ( nrhs >= 1 && nlhs > 1 + (int) mxGetN(prhs[0]) )
+      mexErrMsgTxt("MLSBasis: too many outputs for the number of dimensions");
+   nsd = computeRows(prhs, nrhs, nlhs > 1, &rowStart, &col, &val, &dval);
+   npt = mxGetM(prhs[0]);
+   nn  = mxGetM(prhs[1]);
+
+   plhs[0] = createSparse(npt, nn, rowStart, col, val);
+   for(d = 0; d < nlhs - 1 && d < nsd; d++)
+      plhs[1+d] = createSparse(npt, nn, rowStart, col, dval + d*rowStart[npt]);
+
+   mxFree(rowStart);
+   mxFree(col);
+   mxFree(val);
+   if ( dval ) mxFree(dval);
+}
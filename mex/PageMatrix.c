@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+#include "gemm.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" PageMatrix.c gemm.c
+ */
+
+static void getPages (const mxArray* A, const char* name, mwSize* m, mwSize* n, mwSize* np)
+/*
+ * A is m x n x np (any trailing dimensions are pages)
+ */
+{
+   const mwSize* dims = mxGetDimensions(A);
+   mwSize        nd   = mxGetNumberOfDimensions(A), d;
+   char          msg[128];
+
+   if ( !mxIsDouble(A) || mxIsComplex(A) || mxIsSparse(A) ){
+      sprintf(msg, "PageMatrix: %s must be a full real double array", name);
+      mexErrMsgTxt(msg);
+   }
+   *m  = dims[0];
+   *n  = dims[1];
+   *np = 1;
+   for(d = 2; d < nd; d++) *np *= dims[d];
+}
+
+static mxArray* createPages (mwSize m, mwSize n, mwSize np, const mxArray* S)
+/*
+ * m x n x np array, with the page dimensions of S when S has np pages
+ */
+{
+   mwSize   ns = mxGetNumberOfDimensions(S), nd = ns, d, nps = 1;
+   mwSize*  dims;
+   mxArray* C;
+
+   for(d = 2; d < ns; d++) nps *= mxGetDimensions(S)[d];
+   if ( nps != np || nd < 3 ) nd = 3;
+   dims = (mwSize*) mxMalloc(nd*sizeof(mwSize));
+   dims[0] = m;
+   dims[1] = n;
+   if ( ns >= 3 && nps == np )
+      for(d = 2; d < nd; d++) dims[d] = mxGetDimensions(S)[d];
+   else
+      dims[2] = np;
+   C = mxCreateNumericArray(nd, dims, mxDOUBLE_CLASS, mxREAL);
+   mxFree(dims);
+   return C;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Products, inverses and solves of many small matrices at once.
+	//
+	// We expect the function to be called as :
+        // C     = PageMatrix('mtimes',A,B)      C(:,:,i) = A(:,:,i)*B(:,:,i)
+        // C     = PageMatrix('mtimes',A,B,op)   op 'NN', 'TN' (A(:,:,i)'*B(:,:,i)),
+        //                                       'NT' or 'TT'
+        // [X,d] = PageMatrix('inv',A)           X(:,:,i) = inv(A(:,:,i)), d(i) = det(A(:,:,i))
+        // [X,d] = PageMatrix('solve',A,B)       X(:,:,i) = A(:,:,i)\B(:,:,i)
+        //
+        // The pages are the trailing dimensions of A and B (m x n x np or
+        // m x n x np1 x np2 ...). A single page of A or B is used with all the
+        // pages of the other one, e.g. PageMatrix('mtimes',enodes,dNdxi,'TN')
+        // gives the Jacobians J0 = enode'*dNdxi of all elements at once.
+        //
+        // Matrices up to PAGE_MAX_SIZE (16) are handled; sizes 2, 3, 4, 6 and
+        // 8 have fixed size, unrolled kernels (gemm.c), 2 and 3 use the closed
+        // form inverse. Singular pages give Inf (inv, solve) and d = 0 with a
+        // single warning. Pages are processed in parallel with OpenMP.
+        */
+   char     op[8], ta = 'N', tb = 'N';
+   mwSize   m, k, kb, n, npa, npb, np;
+   mwSize   sa, sb, sc;
+   double  *A, *B = NULL, *C, *d = NULL, inf = mxGetInf();
+   long     i, singular = 0;
+
+   if ( nrhs < 2 || mxGetString(prhs[0], op, sizeof(op)) )
+      mexErrMsgTxt("PageMatrix: expected ('mtimes'|'inv'|'solve', A, ...)");
+
+   getPages(prhs[1], "A", &m, &k, &npa);
+   A = mxGetPr(prhs[1]);
+
+   if ( strcmp(op, "inv") == 0 ){
+      if ( m != k || m > PAGE_MAX_SIZE ) mexErrMsgTxt("PageMatrix: inv needs square pages of size <= 16");
+      plhs[0] = createPages(m, m, npa, prhs[1]);
+      plhs[1] = mxCreateDoubleMatrix(npa, 1, mxREAL);
+      C = mxGetPr(plhs[0]);
+      d = mxGetPr(plhs[1]);
+      sa = m*m;
+      #pragma omp parallel for reduction(+:singular)
+      for(i = 0; i < (long) npa; i++){
+         if ( !invPage((int) m, A + sa*i, C + sa*i, d + i) ){
+            mwSize j;
+            for(j = 0; j < sa; j++) C[sa*i + j] = inf;
+            singular++;
+         }
+      }
+      if ( singular ) mexWarnMsgTxt("PageMatrix: singular pages, their inverse is set to Inf");
+      return;
+   }
+
+   if ( nrhs < 3 ) mexErrMsgTxt("PageMatrix: mtimes and solve expect (op, A, B)");
+   getPages(prhs[2], "B", &kb, &n, &npb);
+   B  = mxGetPr(prhs[2]);
+   if ( npa != npb && npa != 1 && npb != 1 )
+      mexErrMsgTxt("PageMatrix: A and B must have the same number of pages, or a single one");
+   np = ( npa > npb ) ? npa : npb;
+   sa = m*k;
+   sb = kb*n;
+
+   if ( strcmp(op, "mtimes") == 0 ){
+      mwSize mc, nc, kk;
+      if ( nrhs > 3 ){
+         char t[4];
+         if ( mxGetString(prhs[3], t, sizeof(t)) || strlen(t) != 2 ||
+              ( t[0] != 'N' && t[0] != 'T' ) || ( t[1] != 'N' && t[1] != 'T' ) )
+            mexErrMsgTxt("PageMatrix: op must be 'NN', 'TN', 'NT' or 'TT'");
+         ta = t[0];
+         tb = t[1];
+      }
+      mc = ( ta == 'N' ) ? m : k;
+      kk = ( ta == 'N' ) ? k : m;
+      nc = ( tb == 'N' ) ? n : kb;
+      if ( kk != ( ( tb == 'N' ) ? kb : n ) )
+         mexErrMsgTxt("PageMatrix: inner dimensions of the pages do not match");
+      plhs[0] = createPages(mc, nc, np, npa == np ? prhs[1] : prhs[2]);
+      C  = mxGetPr(plhs[0]);
+      sc = mc*nc;
+      #pragma omp parallel for
+      for(i = 0; i < (long) np; i++)
+         gemmPage(ta, tb, (int) mc, (int) nc, (int) kk, A + ( npa == 1 ? 0 : sa*i ),
+                  B + ( npb == 1 ? 0 : sb*i ), C + sc*i);
+      return;
+   }
+
+   if ( strcmp(op, "solve") == 0 ){
+      if ( m != k || m > PAGE_MAX_SIZE ) mexErrMsgTxt("PageMatrix: solve needs square pages of size <= 16");
+      if ( kb != m ) mexErrMsgTxt("PageMatrix: pages of A and B must have the same number of rows");
+      plhs[0] = createPages(m, n, np, npa == np ? prhs[1] : prhs[2]);
+      plhs[1] = mxCreateDoubleMatrix(np, 1, mxREAL);
+      C  = mxGetPr(plhs[0]);
+      d  = mxGetPr(plhs[1]);
+      sc = m*n;
+      #pragma omp parallel for reduction(+:singular)
+      for(i = 0; i < (long) np; i++){
+         memcpy(C + sc*i, B + ( npb == 1 ? 0 : sb*i ), sc*sizeof(double));
+         if ( !solvePage((int) m, (int) n, A + ( npa == 1 ? 0 : sa*i ), C + sc*i, d + i) ){
+            mwSize j;
+            for(j = 0; j < sc; j++) C[sc*i + j] = inf;
+            singular++;
+         }
+      }
+      if ( singular ) mexWarnMsgTxt("PageMatrix: singular pages, their solution is set to Inf");
+      return;
+   }
+
+   mexErrMsgTxt("PageMatrix: unknown operation, expected 'mtimes', 'inv' or 'solve'");
+}
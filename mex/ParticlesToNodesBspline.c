@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+#include "util.h"
+#include "basis.h"
+#include "gemm.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" ParticlesToNodesBspline.c util.c basis.c gemm.c
+ */
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Interpolate from particles to grid nodes used with B-splines.
+	//
+	// We expect the function to be called as :
+        // [nmass,nmomenta,nforce] = ParticlesToNodesBspline(bodies,grid)
+	// bodies: cell array {ib} or struct array (ib) with fields coord, mass, volume,
+        //         velo, stress (Voigt, [xx yy xy] or [xx yy zz yz xz xy]) and
+        //         optionally gravity (acting along -y in 2D, -z in 3D).
+        // grid:   uniform B-spline grid of degree grid.degree (1, 2 or 3, default 2)
+        //         with numx x numy (x numz) elements of size deltax x deltay
+        //         (x deltaz) starting at (xmin,ymin,zmin), default 0.
+        //
+        // The nodes are the (numx+p)*(numy+p)[*(numz+p)] control points of the
+        // open uniform knot vectors, numbered x fastest as the control points of
+        // the k-refined NURBS surface of mpm2DTwoDisksBsplines.m. Each particle
+        // sees (p+1)^nsd nodes; in the boundary elements the clamped B-splines
+        // are used.
+        //
+        // Particles are grouped by cell. The basis of the k particles of a cell
+        // and its gradient form a (nsd+1)k x (p+1)^nsd matrix A and the nodal
+        // mass, momenta and forces of the cell are one small product A'*P (gemm.c)
+        // with P holding m, m*v and -V*sigma of the particles. Cells are
+        // processed in parallel, in (p+1)^nsd colours of non-overlapping stencils.
+        */
+   const mxArray *bodies;
+   mwSize   bodyCount, nodeCount, ib;
+   mwSize   ncell;
+   int      nsd, p, nel[3] = {1, 1, 1}, nn;
+   double   h[3], org[3];
+   double  *nmass, *nmomenta, *nforce;
+
+   if ( nrhs != 2 )
+      mexErrMsgTxt("ParticlesToNodesBspline: expected (bodies, grid)");
+
+   bodies    = prhs[0];
+   bodyCount = mxGetNumberOfElements(bodies);
+   if ( !getBsplineGrid(prhs[1], &nsd, h, nel, &p, org) )
+      mexErrMsgTxt("ParticlesToNodesBspline: grid.degree must be 1, 2 or 3");
+   nodeCount = (mwSize)(nel[0]+p)*(nel[1]+p)*( nsd == 3 ? nel[2]+p : 1 );
+   ncell     = (mwSize) nel[0]*nel[1]*( nsd == 3 ? nel[2] : 1 );
+   nn        = ( nsd == 3 ) ? (p+1)*(p+1)*(p+1) : (p+1)*(p+1);
+
+   plhs[0] = mxCreateDoubleMatrix(nodeCount,1,mxREAL);
+   plhs[1] = mxCreateDoubleMatrix(nodeCount,nsd,mxREAL);
+   plhs[2] = mxCreateDoubleMatrix(nodeCount,nsd,mxREAL);
+
+   nmass     = mxGetPr(plhs[0]);
+   nmomenta  = mxGetPr(plhs[1]);
+   nforce    = mxGetPr(plhs[2]);
+
+   for(ib = 0; ib < bodyCount; ib++){                     /* loop over bodies*/
+      mxArray *coordp = getBodyField(bodies, ib, "coord");
+      mxArray *grap   = getBodyField(bodies, ib, "gravity");
+      double  *coord  = mxGetPr(coordp);
+      double  *mass   = mxGetPr(getBodyField(bodies, ib, "mass"));
+      double  *vol    = mxGetPr(getBodyField(bodies, ib, "volume"));
+      double  *velo   = mxGetPr(getBodyField(bodies, ib, "velo"));
+      double  *stress = mxGetPr(getBodyField(bodies, ib, "stress"));
+      double   g      = ( grap != NULL ) ? mxGetScalar(grap) : 0.;
+      mwSize   particleCount = mxGetM(coordp), kmax = 0, *start, *order;
+      int      ncol = 1 + 2*nsd, color, c;
+
+      /* particles grouped by cell, all particles of a cell share its stencil */
+      start = (mwSize*) mxMalloc((ncell+1)*sizeof(mwSize));
+      order = (mwSize*) mxMalloc((particleCount+1)*sizeof(mwSize));
+      bucketParticlesByCell(nsd, coord, particleCount, org, h, nel, start, order);
+      for(c = 0; c < (int) ncell; c++)
+         if ( start[c+1] - start[c] > kmax ) kmax = start[c+1] - start[c];
+
+      /* cells of one colour are p+1 cells apart in every direction, so their
+         stencils do not overlap and they are processed in parallel without
+         atomics; (p+1)^nsd colours */
+      for(color = 0; color < nn; color++){
+         int  off[3], cnt[3] = {1, 1, 1}, d;
+         long t, tcount = 1;
+         for(d = 0, c = color; d < nsd; d++, c /= (p+1)){
+            off[d]  = c % (p+1);
+            cnt[d]  = ( nel[d] - off[d] + p )/(p+1);
+            tcount *= cnt[d];
+         }
+
+         #pragma omp parallel
+         {
+            mwSize  lda = (nsd+1)*kmax;
+            double *A   = (double*) malloc((lda*(nn+ncol) + nn*ncol + 1)*sizeof(double));
+            double *P   = A + lda*nn, *G = P + lda*ncol;
+            double  f[64], df[3*64], x[3], sig[3][3];
+            int     nodes[64];
+
+            #pragma omp for schedule(dynamic,4)
+            for(t = 0; t < tcount; t++){
+               mwSize cell = 0, stride = 1, k, ip, q;
+               long   r = t;
+               int    in, i, j;
+               for(i = 0; i < nsd; i++){
+                  cell   += stride*(off[i] + (p+1)*(r % cnt[i]));
+                  r      /= cnt[i];
+                  stride *= nel[i];
+               }
+               k = start[cell+1] - start[cell];
+               if ( k == 0 ) continue;
+
+               /* A = [N; dN/dx_1; ..] ((nsd+1)k x nn) and P = [m m*v 0; 0 0 -V*sigma_j]
+                  ((nsd+1)k x ncol), so that A'*P = [nmass nmomenta nforce] of the cell */
+               memset(P, 0, lda*ncol*sizeof(double));
+               for(q = 0; q < k; q++){
+                  ip = order[start[cell]+q];
+                  for(i = 0; i < nsd; i++) x[i] = coord[ip+i*particleCount] - org[i];
+                  if ( nsd == 3 ){
+                     sig[0][0] = stress[ip];                 sig[1][1] = stress[ip+  particleCount];
+                     sig[2][2] = stress[ip+2*particleCount]; sig[1][2] = sig[2][1] = stress[ip+3*particleCount];
+                     sig[0][2] = sig[2][0] = stress[ip+4*particleCount];
+                     sig[0][1] = sig[1][0] = stress[ip+5*particleCount];
+                  }
+                  else{
+                     sig[0][0] = stress[ip];                 sig[1][1] = stress[ip+particleCount];
+                     sig[0][1] = sig[1][0] = stress[ip+2*particleCount];
+                  }
+                  computeBsplineBasisStencil (nsd, x, h, nel, p, nodes, f, df);
+                  for(in = 0; in < nn; in++){
+                     A[q + lda*in] = f[in];
+                     for(j = 0; j < nsd; j++) A[(j+1)*k + q + lda*in] = df[in*nsd+j];
+                  }
+                  P[q] = mass[ip];
+                  for(i = 0; i < nsd; i++){
+                     P[q + lda*(1+i)] = mass[ip]*velo[ip+i*particleCount];
+                     for(j = 0; j < nsd; j++)
+                        P[(j+1)*k + q + lda*(1+nsd+i)] = -vol[ip]*sig[i][j];
+                  }
+                  P[q + lda*(2*nsd)] = -mass[ip]*g;           /* gravity, -y (2D) or -z (3D) */
+               }
+               memset(G, 0, nn*ncol*sizeof(double));
+               gemmTN (nn, ncol, (nsd+1)*k, A, lda, P, lda, G, nn);
+
+               for(in = 0; in < nn; in++){                  /* stencil shared by the particles of the cell */
+                  mwSize nodeid = nodes[in];
+                  nmass[nodeid] += G[in];
+                  for(i = 0; i < nsd; i++){
+                     nmomenta[nodeid+i*nodeCount] += G[in + nn*(1+i)];
+                     nforce[nodeid+i*nodeCount]   += G[in + nn*(1+nsd+i)];
+                  }
+               }
+            }
+            free(A);
+         }
+      }
+      mxFree(start);
+      mxFree(order);
+   }
+}
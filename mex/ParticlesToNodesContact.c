@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+#include "util.h"
+#include "basis.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" ParticlesToNodesContact.c util.c basis.c
+ */
+
+static int compareInt (const void* a, const void* b)
+{
+   int x = *(const int*) a, y = *(const int*) b;
+   return (x > y) - (x < y);
+}
+
+static int particleNodes (double xp, double yp, const double* h, int numx, int numy, int* nodes)
+/*
+ * Nodes of the cell containing (xp,yp), 0 if the particle has left the grid.
+ */
+{
+   if ( xp < 0. || yp < 0. || xp >= numx*h[0] || yp >= numy*h[1] ) return 0;
+   getNodesForParticle2D ( xp, yp, h[0], h[1], numx, numy, nodes );
+   return 1;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Multi-body MPM contact: per-body particle to grid transfer followed by
+	//      the frictional contact correction of Bardenhagen et al. (2000).
+	//
+	// We expect the function to be called as :
+        // [nvelo,nacce,contactNodes,layer] = ParticlesToNodesContact(bodies,mesh,dtime,friction)
+	// bodies:   cell array {ib} or struct array (ib) with fields coord, mass, volume,
+        //           velo, stress and optionally gravity.
+        // mesh:     background grid (deltax, deltay, numx, numy, node).
+        // dtime:    time increment.
+        // friction: Coulomb friction coefficient, negative for no-slip (stick) contact.
+        //
+        // Every body only stores the nodes it is active on (its layer). The layers are
+        // stacked body after body into one body-id x active-node table:
+        // layer.bodyPtr: (bodyCount+1) offsets, rows bodyPtr(ib)+1:bodyPtr(ib+1) belong to body ib,
+        // layer.node:    one-based grid node of each row, sorted within a body,
+        // layer.mass:    nodal mass of each row.
+        // nvelo, nacce:  rows x 2 body velocities v_I^{t+dt} and accelerations after the
+        //                contact correction. Pass them with the layer to
+        //                UpdateParticles(bodies,mesh,nvelo,nacce,dtime,layer).
+        // contactNodes:  nodes (one-based) shared by two or more bodies.
+        //
+        // Storage is proportional to the active nodes of each body instead of
+        // nodeCount x bodyCount. Layers are built and filled in parallel over bodies
+        // (no two threads write the same row); contact nodes are corrected in
+        // parallel over nodes through the node -> rows transpose of the table.
+        */
+   const mxArray* bodies;
+   mwSize   bodyCount, nodeCount, rowCount, nc;
+   double   dtime, mu, tol = 1e-12;
+   double  *nmass, *nmomen, *nforce, *ngrad, *nvelo, *nacce;
+   double **coordB, **massB, **volB, **veloB, **stressB, *graB;
+   int    **bodyNodes, *bodyNodeCount, *rowNode;
+   mwSize  *bodyPtr, *nodePtr, *nodeRows, *fill, *pCountB;
+   long     ib, I, r;
+
+   if ( nrhs < 3 ) mexErrMsgTxt("ParticlesToNodesContact: expected (bodies,mesh,dtime[,friction])");
+
+   bodies    = prhs[0];
+   bodyCount = mxGetNumberOfElements(prhs[0]);
+
+   double* phx   = mxGetPr(mxGetField(prhs[1], 0, "deltax"));
+   double* phy   = mxGetPr(mxGetField(prhs[1], 0, "deltay"));
+   double* pnx   = mxGetPr(mxGetField(prhs[1], 0, "numx"));
+   double* pny   = mxGetPr(mxGetField(prhs[1], 0, "numy"));
+   double* ncoord= mxGetPr(mxGetField(prhs[1], 0, "node"));
+
+   double h[2]   = {*phx, *phy};
+   int    numx   = (int) *pnx;
+   int    numy   = (int) *pny;
+   nodeCount     = (numx+1)*(numy+1);
+
+   dtime = mxGetScalar(prhs[2]);
+   mu    = ( nrhs > 3 ) ? mxGetScalar(prhs[3]) : 0.;
+
+   /* body arrays and node lists, read and allocated before the parallel
+      regions since the MEX API is not thread safe */
+
+   coordB        = (double**) mxCalloc(bodyCount, sizeof(double*));
+   massB         = (double**) mxCalloc(bodyCount, sizeof(double*));
+   volB          = (double**) mxCalloc(bodyCount, sizeof(double*));
+   veloB         = (double**) mxCalloc(bodyCount, sizeof(double*));
+   stressB       = (double**) mxCalloc(bodyCount, sizeof(double*));
+   graB          = (double*)  mxCalloc(bodyCount, sizeof(double));
+   pCountB       = (mwSize*)  mxCalloc(bodyCount, sizeof(mwSize));
+   bodyNodes     = (int**)    mxCalloc(bodyCount, sizeof(int*));
+   bodyNodeCount = (int*)     mxCalloc(bodyCount, sizeof(int));
+
+   for(ib = 0; ib < (long) bodyCount; ib++){
+      mxArray* grap = getBodyField(bodies, ib, "gravity");
+      coordB[ib]    = mxGetPr(getBodyField(bodies, ib, "coord"));
+      massB[ib]     = mxGetPr(getBodyField(bodies, ib, "mass"));
+      volB[ib]      = mxGetPr(getBodyField(bodies, ib, "volume"));
+      veloB[ib]     = mxGetPr(getBodyField(bodies, ib, "velo"));
+      stressB[ib]   = mxGetPr(getBodyField(bodies, ib, "stress"));
+      graB[ib]      = grap ? mxGetPr(grap)[0] : 0.;
+      pCountB[ib]   = mxGetM(getBodyField(bodies, ib, "mass"));
+      bodyNodes[ib] = (int*) mxMalloc((4*pCountB[ib]+1)*sizeof(int));
+   }
+
+   /* 1. active nodes of every body (sorted, unique), one body per thread */
+
+   #pragma omp parallel for schedule(dynamic,1)
+   for(ib = 0; ib < (long) bodyCount; ib++){
+      double *coord = coordB[ib];
+      mwSize  particleCount = pCountB[ib];
+      int    *list  = bodyNodes[ib];
+      mwSize  ip, n = 0, u = 0;
+
+      for(ip = 0; ip < particleCount; ip++){
+         if ( particleNodes (coord[ip], coord[ip+particleCount], h, numx, numy, list+n) ) n += 4;
+      }
+      qsort(list, n, sizeof(int), compareInt);
+      for(ip = 0; ip < n; ip++) if ( u == 0 || list[ip] != list[u-1] ) list[u++] = list[ip];
+      bodyNodeCount[ib] = (int) u;
+   }
+
+   bodyPtr = (mwSize*) mxCalloc(bodyCount+1, sizeof(mwSize));
+   for(ib = 0; ib < (long) bodyCount; ib++) bodyPtr[ib+1] = bodyPtr[ib] + bodyNodeCount[ib];
+   rowCount = bodyPtr[bodyCount];
+
+   rowNode = (int*)    mxMalloc((rowCount+1)*sizeof(int));
+   nmass   = (double*) mxCalloc(rowCount+1,   sizeof(double));
+   nmomen  = (double*) mxCalloc(2*rowCount+1, sizeof(double));
+   nforce  = (double*) mxCalloc(2*rowCount+1, sizeof(double));
+   ngrad   = (double*) mxCalloc(2*rowCount+1, sizeof(double));
+
+   plhs[0] = mxCreateDoubleMatrix(rowCount, 2, mxREAL);
+   plhs[1] = mxCreateDoubleMatrix(rowCount, 2, mxREAL);
+   nvelo   = mxGetPr(plhs[0]);
+   nacce   = mxGetPr(plhs[1]);
+
+   /* 2. particles to nodes, one body per thread, each writing its own rows */
+
+   #pragma omp parallel for schedule(dynamic,1)
+   for(ib = 0; ib < (long) bodyCount; ib++){
+      double *coord  = coordB[ib];
+      double *mass   = massB[ib];
+      double *vol    = volB[ib];
+      double *velo   = veloB[ib];
+      double *stress = stressB[ib];
+      double  gra    = graB[ib];
+      mwSize  particleCount = pCountB[ib];
+      int    *list   = bodyNodes[ib];
+      int     cnt    = bodyNodeCount[ib];
+      mwSize  off    = bodyPtr[ib];
+
+      double  xp, yp, Mp, Vp, vpx, vpy, sigxx, sigyy, sigxy, f, dfx, dfy, x[2];
+      int     nodes[4], in, nodeid, *hit;
+      mwSize  ip, row;
+
+      memcpy(rowNode + off, list, cnt*sizeof(int));
+
+      for(ip = 0; ip < particleCount; ip++){
+         xp    = coord[ip];
+         yp    = coord[ip+particleCount];
+         Mp    = mass[ip];
+         Vp    = vol[ip];
+         vpx   = velo[ip];
+         vpy   = velo[ip+particleCount];
+         sigxx = stress[ip];
+         sigyy = stress[ip+particleCount];
+         sigxy = stress[ip+2*particleCount];
+         if ( !particleNodes (xp, yp, h, numx, numy, nodes) ) continue;
+         for(in = 0; in < 4; in++){
+            nodeid = nodes[in];
+            hit    = (int*) bsearch(&nodeid, list, cnt, sizeof(int), compareInt);
+            row    = off + (hit - list);
+            x[0]   = xp - ncoord[nodeid];
+            x[1]   = yp - ncoord[nodeid+nodeCount];
+            computeMPMBasis2D (x,h,&f,&dfx,&dfy);
+            nmass[row]             += f*Mp;
+            nmomen[row]            += f*Mp*vpx;
+            nmomen[row+rowCount]   += f*Mp*vpy;
+            nforce[row]            += - Vp*(sigxx*dfx + sigxy*dfy);
+            nforce[row+rowCount]   += - Vp*(sigxy*dfx + sigyy*dfy) - Mp*f*gra;
+            ngrad[row]             += Mp*dfx;               /* normal */
+            ngrad[row+rowCount]    += Mp*dfy;
+         }
+      }
+   }
+   for(ib = 0; ib < (long) bodyCount; ib++) mxFree(bodyNodes[ib]);
+
+   /* 3. uncorrected body velocities and accelerations, one row per thread */
+
+   #pragma omp parallel for schedule(static)
+   for(r = 0; r < (long) rowCount; r++){
+      double m = nmass[r];
+      if ( m <= tol ) continue;
+      nvelo[r]          = ( nmomen[r]          + dtime*nforce[r] )/m;
+      nvelo[r+rowCount] = ( nmomen[r+rowCount] + dtime*nforce[r+rowCount] )/m;
+      nacce[r]          = nforce[r]/m;
+      nacce[r+rowCount] = nforce[r+rowCount]/m;
+   }
+
+   /* node -> rows transpose of the layer table */
+
+   nodePtr  = (mwSize*) mxCalloc(nodeCount+1, sizeof(mwSize));
+   nodeRows = (mwSize*) mxMalloc((rowCount+1)*sizeof(mwSize));
+   fill     = (mwSize*) mxMalloc((nodeCount+1)*sizeof(mwSize));
+   for(r = 0; r < (long) rowCount; r++) if ( nmass[r] > tol ) nodePtr[rowNode[r]+1]++;
+   for(I = 0; I < (long) nodeCount; I++) nodePtr[I+1] += nodePtr[I];
+   memcpy(fill, nodePtr, (nodeCount+1)*sizeof(mwSize));
+   for(r = 0; r < (long) rowCount; r++) if ( nmass[r] > tol ) nodeRows[fill[rowNode[r]]++] = r;
+
+   /* 4. contact correction, one node per thread */
+
+   #pragma omp parallel for schedule(dynamic,64)
+   for(I = 0; I < (long) nodeCount; I++){
+      double msum = 0., psum[2] = {0.,0.}, vcm[2];
+      mwSize k;
+
+      if ( nodePtr[I+1] - nodePtr[I] < 2 ) continue;
+
+      for(k = nodePtr[I]; k < nodePtr[I+1]; k++){
+         mwSize row = nodeRows[k];
+         msum    += nmass[row];
+         psum[0] += nmass[row]*nvelo[row];
+         psum[1] += nmass[row]*nvelo[row+rowCount];
+      }
+      vcm[0] = psum[0]/msum;
+      vcm[1] = psum[1]/msum;
+
+      for(k = nodePtr[I]; k < nodePtr[I+1]; k++){
+         mwSize  row = nodeRows[k];
+         double  n[2], dv[2], t[2], nn, alpha, tnorm;
+
+         /* outward unit normal of the body: sum_p m_p grad N_I(x_p) */
+         n[0] = ngrad[row];
+         n[1] = ngrad[row+rowCount];
+         nn   = sqrt(n[0]*n[0] + n[1]*n[1]);
+         if ( nn < DBL_MIN ) continue;
+         n[0] /= nn; n[1] /= nn;
+
+         dv[0] = nvelo[row]          - vcm[0];
+         dv[1] = nvelo[row+rowCount] - vcm[1];
+         alpha = dv[0]*n[0] + dv[1]*n[1];
+         if ( alpha <= 0. ) continue;                     /* separating */
+
+         /* no-slip: dv is removed entirely and the body moves with the centre of mass */
+         if ( mu >= 0. ){
+            /* remove the normal approach, limit the tangential slip by Coulomb */
+            t[0]  = dv[0] - alpha*n[0];
+            t[1]  = dv[1] - alpha*n[1];
+            tnorm = sqrt(t[0]*t[0] + t[1]*t[1]);
+            dv[0] = alpha*n[0];
+            dv[1] = alpha*n[1];
+            if ( tnorm > DBL_MIN ){
+               double slip = ( mu*alpha < tnorm ) ? mu*alpha : tnorm;
+               dv[0] += slip*t[0]/tnorm;
+               dv[1] += slip*t[1]/tnorm;
+            }
+         }
+         nvelo[row]          -= dv[0];
+         nvelo[row+rowCount] -= dv[1];
+         nacce[row]          -= dv[0]/dtime;
+         nacce[row+rowCount] -= dv[1]/dtime;
+      }
+   }
+
+   /* contact nodes */
+
+   nc = 0;
+   for(I = 0; I < (long) nodeCount; I++) if ( nodePtr[I+1] - nodePtr[I] > 1 ) nc++;
+   plhs[2] = mxCreateDoubleMatrix(nc,1,mxREAL);
+   {
+      double *cn = mxGetPr(plhs[2]);
+      nc = 0;
+      for(I = 0; I < (long) nodeCount; I++) if ( nodePtr[I+1] - nodePtr[I] > 1 ) cn[nc++] = I + 1;
+   }
+
+   /* layer table */
+
+   if ( nlhs > 3 ){
+      const char* fields[] = {"bodyPtr", "node", "mass"};
+      mxArray *bp, *nd, *ms;
+      double  *p;
+
+      plhs[3] = mxCreateStructMatrix(1, 1, 3, fields);
+      bp = mxCreateDoubleMatrix(bodyCount+1, 1, mxREAL);
+      nd = mxCreateDoubleMatrix(rowCount, 1, mxREAL);
+      ms = mxCreateDoubleMatrix(rowCount, 1, mxREAL);
+      p  = mxGetPr(bp);
+      for(ib = 0; ib <= (long) bodyCount; ib++) p[ib] = (double) bodyPtr[ib];
+      p  = mxGetPr(nd);
+      for(r = 0; r < (long) rowCount; r++) p[r] = rowNode[r] + 1.;
+      memcpy(mxGetPr(ms), nmass, rowCount*sizeof(double));
+      mxSetField(plhs[3], 0, "bodyPtr", bp);
+      mxSetField(plhs[3], 0, "node",    nd);
+      mxSetField(plhs[3], 0, "mass",    ms);
+   }
+
+   mxFree(coordB); mxFree(massB); mxFree(volB); mxFree(veloB); mxFree(stressB);
+   mxFree(graB); mxFree(pCountB);
+   mxFree(bodyNodes); mxFree(bodyNodeCount); mxFree(bodyPtr); mxFree(rowNode);
+   mxFree(nmass); mxFree(nmomen); mxFree(nforce); mxFree(ngrad);
+   mxFree(nodePtr); mxFree(nodeRows); mxFree(fill);
+}
@@ -0,0 +1,732 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+#include "mapfile.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" PlyIO.c mapfile.c
+ */
+
+enum { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32,
+       PLY_FLOAT32, PLY_FLOAT64, PLY_NTYPES };
+
+static const int   plySize[PLY_NTYPES] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+/* PLY type names and their aliases, as in plyread.m */
+static const char* plyName[3][PLY_NTYPES] = {
+   { "char",  "uchar",  "short",   "ushort",   "int",   "uint",   "float",   "double"   },
+   { "int8",  "uint8",  "int16",   "uint16",   "int32", "uint32", "float32", "float64"  },
+   { "char8", "uchar8", "short16", "ushort16", "int32", "uint32", "float32", "double64" } };
+
+/* lower and upper bound of the integer types, to narrow integer data when writing */
+static const double plyMin[PLY_FLOAT32] = { -128., 0., -32768., 0., -2147483648., 0. };
+static const double plyMax[PLY_FLOAT32] = {  127., 255., 32767., 65535., 2147483647., 4294967295. };
+
+#define PLY_CHUNK 65536
+
+typedef struct {
+   char           name[64];
+   int            type;        /* value type, type of the items of a list */
+   int            countType;   /* type of the list count, -1 if not a list */
+   mwSize         offset;      /* offset in a binary record without lists */
+   double        *col;         /* read: values of a scalar property */
+   mxArray       *data;        /* read: column, or cell of rows of a list */
+   const mxArray *src;         /* write: numeric array or cell array */
+   const void    *srcData;     /* write: data and class of src (numeric) */
+   mxClassID      srcClass;
+   mwSize         column;      /* write: column of src */
+} PlyProperty;
+
+typedef struct {
+   char         name[64];
+   mwSize       count;
+   int          nprop;
+   PlyProperty *prop;
+   mwSize       recSize;       /* binary record size, 0 if there are lists */
+} PlyElement;
+
+static char plyError[256];
+
+static int hostIsLittleEndian (void)
+{
+   unsigned short one = 1;
+   return *(unsigned char*) &one == 1;
+}
+
+static int plyType (const char* name)
+{
+   int k, t;
+
+   for(k = 0; k < 3; k++)
+      for(t = 0; t < PLY_NTYPES; t++)
+         if ( strcmp(name, plyName[k][t]) == 0 ) return t;
+   return -1;
+}
+
+static double readValue (const unsigned char* p, int type, int swap)
+/*
+ * value of type at p, byte-swapped if swap
+ */
+{
+   unsigned char b[8];
+   int           k, s = plySize[type];
+
+   if ( swap ){
+      for(k = 0; k < s; k++) b[k] = p[s-1-k];
+      p = b;
+   }
+   switch ( type ){
+      case PLY_INT8:    { signed char    v; memcpy(&v, p, 1); return v; }
+      case PLY_UINT8:   { unsigned char  v; memcpy(&v, p, 1); return v; }
+      case PLY_INT16:   { short          v; memcpy(&v, p, 2); return v; }
+      case PLY_UINT16:  { unsigned short v; memcpy(&v, p, 2); return v; }
+      case PLY_INT32:   { int            v; memcpy(&v, p, 4); return v; }
+      case PLY_UINT32:  { unsigned int   v; memcpy(&v, p, 4); return v; }
+      case PLY_FLOAT32: { float          v; memcpy(&v, p, 4); return v; }
+      default:          { double         v; memcpy(&v, p, 8); return v; }
+   }
+}
+
+static void writeValue (unsigned char* q, int type, double x, int swap)
+/*
+ * store x as type at q, byte-swapped if swap
+ */
+{
+   unsigned char t;
+   int           k, s = plySize[type];
+
+   switch ( type ){
+      case PLY_INT8:    { signed char    v = (signed char)    x; memcpy(q, &v, 1); break; }
+      case PLY_UINT8:   { unsigned char  v = (unsigned char)  x; memcpy(q, &v, 1); break; }
+      case PLY_INT16:   { short          v = (short)          x; memcpy(q, &v, 2); break; }
+      case PLY_UINT16:  { unsigned short v = (unsigned short) x; memcpy(q, &v, 2); break; }
+      case PLY_INT32:   { int            v = (int)            x; memcpy(q, &v, 4); break; }
+      case PLY_UINT32:  { unsigned int   v = (unsigned int)   x; memcpy(q, &v, 4); break; }
+      case PLY_FLOAT32: { float          v = (float)          x; memcpy(q, &v, 4); break; }
+      default:          { memcpy(q, &x, 8); break; }
+   }
+   if ( swap )
+      for(k = 0; k < s/2; k++){ t = q[k]; q[k] = q[s-1-k]; q[s-1-k] = t; }
+}
+
+/* ------------------------------------------------------------------------ */
+/*  reading                                                                 */
+/* ------------------------------------------------------------------------ */
+
+static const char* skipSpace (const char* p, const char* end)
+{
+   while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' ) ) p++;
+   return p;
+}
+
+static const char* parseDouble (const char* p, const char* end, double* v)
+{
+   char* q;
+
+   p = skipSpace(p, end);
+   if ( p >= end ) return NULL;
+   *v = strtod(p, &q);
+   return ( q == p ) ? NULL : q;
+}
+
+static int splitLine (const char** p, const char* end, char* buf, size_t nbuf, char** tok, int maxTok)
+/*
+ * tokens of the line at *p (copied to buf), *p is moved to the next line
+ */
+{
+   const char* q = (const char*) memchr(*p, '\n', end - *p);
+   size_t      len = ( q ? q : end ) - *p;
+   int         n = 0;
+   char       *s;
+
+   if ( len >= nbuf ) len = nbuf - 1;
+   memcpy(buf, *p, len);
+   buf[len] = '\0';
+   *p = q ? q + 1 : end;
+   for(s = strtok(buf, " \t\r"); s && n < maxTok; s = strtok(NULL, " \t\r")) tok[n++] = s;
+   return n;
+}
+
+static const char* readHeader (const char* p, const char* end, int* format,
+                               PlyElement** elems, int* nelem, mxArray** comments)
+{
+   char        buf[1024], *tok[64];
+   int         n, i, maxElem = 0;
+   mxArray    *list[1024];
+   int         ncomment = 0;
+   PlyElement *cur = NULL;
+
+   *format = -1;
+   *nelem  = 0;
+   *elems  = NULL;
+   n = splitLine(&p, end, buf, sizeof(buf), tok, 64);
+   if ( n < 1 || strcmp(tok[0], "ply") != 0 ){
+      sprintf(plyError, "PlyIO: not a PLY file");
+      return NULL;
+   }
+   while ( p < end ){
+      n = splitLine(&p, end, buf, sizeof(buf), tok, 64);
+      if ( n == 0 ) continue;
+      if ( strcmp(tok[0], "format") == 0 && n >= 2 ){
+         if      ( strcmp(tok[1], "ascii") == 0 )                *format = 0;
+         else if ( strcmp(tok[1], "binary_little_endian") == 0 ) *format = 1;
+         else if ( strcmp(tok[1], "binary_big_endian") == 0 )    *format = 2;
+         else{
+            sprintf(plyError, "PlyIO: data format '%.64s' not supported", tok[1]);
+            return NULL;
+         }
+         if ( n == 3 && strcmp(tok[2], "1.0") != 0 ){
+            sprintf(plyError, "PlyIO: only PLY format version 1.0 supported");
+            return NULL;
+         }
+      }
+      else if ( strcmp(tok[0], "comment") == 0 ){
+         /* tokens joined as in plyread.m */
+         char line[1024] = "";
+         for(i = 1; i < n; i++){
+            strncat(line, tok[i], sizeof(line) - strlen(line) - 2);
+            strcat(line, " ");
+         }
+         if ( ncomment < 1024 ) list[ncomment++] = mxCreateString(line);
+      }
+      else if ( strcmp(tok[0], "element") == 0 ){
+         if ( n < 3 ){
+            sprintf(plyError, "PlyIO: bad element definition");
+            return NULL;
+         }
+         if ( *nelem == maxElem ){
+            maxElem = 2*maxElem + 4;
+            *elems  = (PlyElement*) mxRealloc(*elems, maxElem*sizeof(PlyElement));
+         }
+         cur = *elems + (*nelem)++;
+         memset(cur, 0, sizeof(PlyElement));
+         strncpy(cur->name, tok[1], sizeof(cur->name) - 1);
+         cur->count = (mwSize) strtod(tok[2], NULL);
+      }
+      else if ( strcmp(tok[0], "property") == 0 ){
+         PlyProperty* pr;
+         if ( cur == NULL || n < 3 ){
+            sprintf(plyError, "PlyIO: property definition without element definition");
+            return NULL;
+         }
+         cur->prop = (PlyProperty*) mxRealloc(cur->prop, (cur->nprop+1)*sizeof(PlyProperty));
+         pr = cur->prop + cur->nprop++;
+         memset(pr, 0, sizeof(PlyProperty));
+         strncpy(pr->name, tok[n-1], sizeof(pr->name) - 1);
+         if ( strcmp(tok[1], "list") == 0 ){
+            if ( n != 5 ){
+               sprintf(plyError, "PlyIO: invalid list syntax in %.32s.%.32s", cur->name, pr->name);
+               return NULL;
+            }
+            pr->countType = plyType(tok[2]);
+            pr->type      = plyType(tok[3]);
+            if ( pr->countType < 0 || pr->type < 0 ){
+               sprintf(plyError, "PlyIO: unknown property data type in %.32s.%.32s", cur->name, pr->name);
+               return NULL;
+            }
+         }
+         else{
+            pr->countType = -1;
+            pr->type      = plyType(tok[1]);
+            if ( pr->type < 0 ){
+               sprintf(plyError, "PlyIO: unknown property data type '%.32s'", tok[1]);
+               return NULL;
+            }
+         }
+      }
+      else if ( strcmp(tok[0], "end_header") == 0 ){
+         if ( *format < 0 ) *format = 0;
+         *comments = mxCreateCellMatrix(1, ncomment);
+         for(i = 0; i < ncomment; i++) mxSetCell(*comments, i, list[i]);
+         return p;
+      }
+   }
+   sprintf(plyError, "PlyIO: end_header missing");
+   return NULL;
+}
+
+static const char* readBinary (const char* p, const char* end, PlyElement* el, int swap)
+/*
+ * element data of a binary file: records of fixed size in parallel,
+ * records with lists one after the other
+ */
+{
+   const unsigned char* u = (const unsigned char*) p;
+   long                 i;
+   int                  k;
+
+   if ( el->recSize ){
+      if ( (mwSize)(end - p) < el->count*el->recSize ) return NULL;
+      #pragma omp parallel for private(k)
+      for(i = 0; i < (long) el->count; i++){
+         const unsigned char* r = u + i*el->recSize;
+         for(k = 0; k < el->nprop; k++)
+            el->prop[k].col[i] = readValue(r + el->prop[k].offset, el->prop[k].type, swap);
+      }
+      return p + el->count*el->recSize;
+   }
+   for(i = 0; i < (long) el->count; i++){
+      for(k = 0; k < el->nprop; k++){
+         PlyProperty* pr = el->prop + k;
+         if ( pr->countType < 0 ){
+            if ( u + plySize[pr->type] > (const unsigned char*) end ) return NULL;
+            pr->col[i] = readValue(u, pr->type, swap);
+            u += plySize[pr->type];
+         }
+         else{
+            mwSize   j, m;
+            mxArray *row;
+            double  *v;
+            if ( u + plySize[pr->countType] > (const unsigned char*) end ) return NULL;
+            m  = (mwSize) readValue(u, pr->countType, swap);
+            u += plySize[pr->countType];
+            if ( u + m*plySize[pr->type] > (const unsigned char*) end ) return NULL;
+            row = mxCreateDoubleMatrix(1, m, mxREAL);
+            v   = mxGetPr(row);
+            for(j = 0; j < m; j++, u += plySize[pr->type]) v[j] = readValue(u, pr->type, swap);
+            mxSetCell(pr->data, i, row);
+         }
+      }
+   }
+   return (const char*) u;
+}
+
+static const char* readAsciiSerial (const char* p, const char* end, PlyElement* el)
+{
+   mwSize i, j, m;
+   int    k;
+   double v;
+
+   for(i = 0; i < el->count; i++){
+      for(k = 0; k < el->nprop; k++){
+         PlyProperty* pr = el->prop + k;
+         if ( (p = parseDouble(p, end, &v)) == NULL ) return NULL;
+         if ( pr->countType < 0 ){
+            pr->col[i] = v;
+         }
+         else{
+            mxArray* row;
+            double*  r;
+            m   = (mwSize) v;
+            row = mxCreateDoubleMatrix(1, m, mxREAL);
+            r   = mxGetPr(row);
+            for(j = 0; j < m; j++) if ( (p = parseDouble(p, end, &r[j])) == NULL ) return NULL;
+            mxSetCell(pr->data, i, row);
+         }
+      }
+   }
+   return p;
+}
+
+static const char* readAscii (const char* p, const char* end, PlyElement* el)
+/*
+ * element data of an ASCII file; without lists, one record per line is
+ * assumed and the lines are parsed in parallel (else token by token)
+ */
+{
+   const char **line, *q = p;
+   long         i;
+   int          bad = 0;
+
+   if ( el->recSize == 0 || el->count == 0 ) return readAsciiSerial(p, end, el);
+
+   line = (const char**) mxMalloc(el->count*sizeof(const char*));
+   for(i = 0; i < (long) el->count; i++){
+      const char* nl;
+      q       = skipSpace(q, end);
+      line[i] = q;
+      nl      = (const char*) memchr(q, '\n', end - q);
+      q       = nl ? nl + 1 : end;
+   }
+   #pragma omp parallel for reduction(+:bad)
+   for(i = 0; i < (long) el->count; i++){
+      const char* r = line[i];
+      int         k;
+      for(k = 0; k < el->nprop && r; k++) r = parseDouble(r, end, &el->prop[k].col[i]);
+      if ( r == NULL ){ bad++; continue; }
+      while ( r < end && ( *r == ' ' || *r == '\t' || *r == '\r' ) ) r++;
+      if ( r < end && *r != '\n' ) bad++;
+   }
+   mxFree(line);
+   return bad ? readAsciiSerial(p, end, el) : q;
+}
+
+static void readPly (const char* filename, mxArray** elements, mxArray** comments)
+{
+   MappedFile  f;
+   PlyElement *el;
+   const char *p, *end;
+   int         format, nelem, e, k, swap;
+   const char **names;
+
+   if ( !mapFile(filename, &f) ){
+      sprintf(plyError, "PlyIO: cannot open %.200s", filename);
+      mexErrMsgTxt(plyError);
+   }
+   end = f.data + f.size;
+   p   = readHeader(f.data, end, &format, &el, &nelem, comments);
+   if ( p == NULL ){
+      unmapFile(&f);
+      mexErrMsgTxt(plyError);
+   }
+   swap = ( format == 1 && !hostIsLittleEndian() ) || ( format == 2 && hostIsLittleEndian() );
+
+   names = (const char**) mxMalloc((nelem+1)*sizeof(const char*));
+   for(e = 0; e < nelem; e++) names[e] = el[e].name;
+   *elements = mxCreateStructMatrix(1, 1, nelem, names);
+
+   for(e = 0; e < nelem && p; e++){
+      PlyElement* cur = el + e;
+      const char  **pnames;
+      mxArray      *s;
+
+      if ( cur->nprop == 0 ){
+         mxSetFieldByNumber(*elements, 0, e, mxCreateDoubleMatrix(0, 0, mxREAL));
+         continue;
+      }
+      pnames = (const char**) mxMalloc(cur->nprop*sizeof(const char*));
+      cur->recSize = 0;
+      for(k = 0; k < cur->nprop; k++){
+         PlyProperty* pr = cur->prop + k;
+         pnames[k]  = pr->name;
+         pr->offset = cur->recSize;
+         if ( pr->countType < 0 ){
+            mxArray* c = mxCreateDoubleMatrix(cur->count, 1, mxREAL);
+            pr->col    = mxGetPr(c);
+            pr->data   = c;
+            cur->recSize += plySize[pr->type];
+         }
+         else{
+            pr->data = mxCreateCellMatrix(cur->count, 1);
+         }
+      }
+      for(k = 0; k < cur->nprop; k++) if ( cur->prop[k].countType >= 0 ) cur->recSize = 0;
+
+      s = mxCreateStructMatrix(1, 1, cur->nprop, pnames);
+      for(k = 0; k < cur->nprop; k++) mxSetFieldByNumber(s, 0, k, cur->prop[k].data);
+      mxSetFieldByNumber(*elements, 0, e, s);
+      mxFree(pnames);
+
+      p = format ? readBinary(p, end, cur, swap) : readAscii(p, end, cur);
+      if ( p == NULL ) sprintf(plyError, "PlyIO: unexpected end of data in element '%.32s'", cur->name);
+   }
+   unmapFile(&f);
+   if ( p == NULL ) mexErrMsgTxt(plyError);
+   for(e = 0; e < nelem; e++) mxFree(el[e].prop);
+   mxFree(el);
+   mxFree(names);
+}
+
+/* ------------------------------------------------------------------------ */
+/*  writing                                                                 */
+/* ------------------------------------------------------------------------ */
+
+static double sourceValue (const void* data, mxClassID cls, mwSize i)
+{
+   switch ( cls ){
+      case mxDOUBLE_CLASS:  return ((const double*)         data)[i];
+      case mxSINGLE_CLASS:  return ((const float*)          data)[i];
+      case mxINT8_CLASS:    return ((const signed char*)    data)[i];
+      case mxUINT8_CLASS:   return ((const unsigned char*)  data)[i];
+      case mxLOGICAL_CLASS: return ((const mxLogical*)      data)[i];
+      case mxINT16_CLASS:   return ((const short*)          data)[i];
+      case mxUINT16_CLASS:  return ((const unsigned short*) data)[i];
+      case mxINT32_CLASS:   return ((const int*)            data)[i];
+      case mxUINT32_CLASS:  return ((const unsigned int*)   data)[i];
+      case mxINT64_CLASS:   return (double) ((const long long*) data)[i];
+      case mxUINT64_CLASS:  return (double) ((const unsigned long long*) data)[i];
+      default:              return 0.;
+   }
+}
+
+static int classType (mxClassID cls)
+{
+   switch ( cls ){
+      case mxINT8_CLASS:    return PLY_INT8;
+      case mxUINT8_CLASS:   return PLY_UINT8;
+      case mxLOGICAL_CLASS: return PLY_UINT8;
+      case mxINT16_CLASS:   return PLY_INT16;
+      case mxUINT16_CLASS:  return PLY_UINT16;
+      case mxINT32_CLASS:   return PLY_INT32;
+      case mxUINT32_CLASS:  return PLY_UINT32;
+      case mxSINGLE_CLASS:  return PLY_FLOAT32;
+      case mxDOUBLE_CLASS:  return PLY_FLOAT64;
+      case mxINT64_CLASS:   return PLY_FLOAT64;
+      case mxUINT64_CLASS:  return PLY_FLOAT64;
+      default:              return -1;
+   }
+}
+
+static void valueRange (const mxArray* a, double* lo, double* hi, int* integer)
+{
+   const void* data = mxGetData(a);
+   mxClassID   cls  = mxGetClassID(a);
+   mwSize      i, n = mxGetNumberOfElements(a);
+
+   for(i = 0; i < n; i++){
+      double v = sourceValue(data, cls, i);
+      if ( v < *lo ) *lo = v;
+      if ( v > *hi ) *hi = v;
+      if ( v != floor(v) ) *integer = 0;
+   }
+}
+
+static int storageType (const mxArray* a, int isList, int wantDouble)
+/*
+ * PLY type of the data of a (a cell array for lists): the type of the
+ * class, floating point data with integer values is narrowed to the smallest
+ * integer type holding it and double becomes float unless wantDouble, as
+ * plywrite.m
+ */
+{
+   const mxArray* first = isList ? ( mxGetNumberOfElements(a) ? mxGetCell(a, 0) : NULL ) : a;
+   int            type, integer = 1, t;
+   double         lo = DBL_MAX, hi = -DBL_MAX;
+   mwSize         i;
+
+   if ( first == NULL ) return PLY_INT32;
+   type = classType(mxGetClassID(first));
+   if ( type < 0 ) return -1;
+   if ( type < PLY_FLOAT32 ) return type;
+   if ( isList ){
+      for(i = 0; i < mxGetNumberOfElements(a); i++){
+         const mxArray* c = mxGetCell(a, i);
+         if ( c == NULL || classType(mxGetClassID(c)) < 0 ) return -1;
+         valueRange(c, &lo, &hi, &integer);
+      }
+   }
+   else valueRange(a, &lo, &hi, &integer);
+   if ( integer && lo <= hi )
+      for(t = 0; t < PLY_FLOAT32; t++) if ( lo >= plyMin[t] && hi <= plyMax[t] ) return t;
+   return ( type == PLY_FLOAT64 && !wantDouble ) ? PLY_FLOAT32 : type;
+}
+
+static void formatValue (char* s, int type, double v)
+{
+   if      ( type == PLY_FLOAT32 ) sprintf(s, "%.9g ", (double)(float) v);
+   else if ( type == PLY_FLOAT64 ) sprintf(s, "%.17g ", v);
+   else                            sprintf(s, "%lld ", (long long) v);
+}
+
+static void writeElementData (FILE* fid, const PlyElement* el, int format, int swap)
+{
+   mwSize i, j, m, i0, i1;
+   int    k;
+   char   s[64];
+
+   if ( format && el->recSize ){
+      /* fixed size records, filled in parallel chunk by chunk */
+      unsigned char* buf = (unsigned char*) mxMalloc(PLY_CHUNK*el->recSize);
+      for(i0 = 0; i0 < el->count; i0 += PLY_CHUNK){
+         long c, nc;
+         i1 = ( i0 + PLY_CHUNK < el->count ) ? i0 + PLY_CHUNK : el->count;
+         nc = (long)(i1 - i0);
+         #pragma omp parallel for private(k)
+         for(c = 0; c < nc; c++){
+            for(k = 0; k < el->nprop; k++){
+               const PlyProperty* pr = el->prop + k;
+               writeValue(buf + c*el->recSize + pr->offset, pr->type,
+                          sourceValue(pr->srcData, pr->srcClass, i0 + c + el->count*pr->column), swap);
+            }
+         }
+         fwrite(buf, el->recSize, i1 - i0, fid);
+      }
+      mxFree(buf);
+      return;
+   }
+
+   for(i = 0; i < el->count; i++){
+      for(k = 0; k < el->nprop; k++){
+         const PlyProperty* pr = el->prop + k;
+         if ( pr->countType < 0 ){
+            double v = sourceValue(pr->srcData, pr->srcClass, i + el->count*pr->column);
+            if ( format ){
+               unsigned char b[8];
+               writeValue(b, pr->type, v, swap);
+               fwrite(b, plySize[pr->type], 1, fid);
+            }
+            else{
+               formatValue(s, pr->type, v);
+               fputs(s, fid);
+            }
+         }
+         else{
+            const mxArray* c = mxGetCell(pr->src, i);
+            m = c ? mxGetNumberOfElements(c) : 0;
+            if ( format ){
+               unsigned char b[8];
+               writeValue(b, pr->countType, (double) m, swap);
+               fwrite(b, plySize[pr->countType], 1, fid);
+               for(j = 0; j < m; j++){
+                  writeValue(b, pr->type, sourceValue(mxGetData(c), mxGetClassID(c), j), swap);
+                  fwrite(b, plySize[pr->type], 1, fid);
+               }
+            }
+            else{
+               fprintf(fid, "%u ", (unsigned) m);
+               for(j = 0; j < m; j++){
+                  formatValue(s, pr->type, sourceValue(mxGetData(c), mxGetClassID(c), j));
+                  fputs(s, fid);
+               }
+            }
+         }
+      }
+      if ( !format ) fputc('\n', fid);
+   }
+}
+
+static void writePly (const char* filename, const mxArray* data, const char* fmt, int wantDouble)
+{
+   int          format = 0, swap, nelem, e, k, nf;
+   PlyElement  *el;
+   FILE        *fid;
+   char         msg[256];
+
+   if      ( strcmp(fmt, "ascii") == 0 )                format = 0;
+   else if ( strcmp(fmt, "binary_little_endian") == 0 ) format = 1;
+   else if ( strcmp(fmt, "binary_big_endian") == 0 )    format = 2;
+   else mexErrMsgTxt("PlyIO: format must be 'ascii', 'binary_little_endian' or 'binary_big_endian'");
+   swap = ( format == 1 && !hostIsLittleEndian() ) || ( format == 2 && hostIsLittleEndian() );
+
+   if ( !mxIsStruct(data) ) mexErrMsgTxt("PlyIO: data must be a struct of elements");
+   nelem = mxGetNumberOfFields(data);
+   el    = (PlyElement*) mxCalloc(nelem + 1, sizeof(PlyElement));
+
+   /* elements and properties; a matrix property name with k > 1 columns
+      gives the properties name_1 ... name_k */
+   for(e = 0; e < nelem; e++){
+      const mxArray* s = mxGetFieldByNumber(data, 0, e);
+      PlyElement*    cur = el + e;
+      strncpy(cur->name, mxGetFieldNameByNumber(data, e), sizeof(cur->name) - 1);
+      if ( s == NULL || !mxIsStruct(s) ) continue;
+      nf = mxGetNumberOfFields(s);
+      for(k = 0; k < nf; k++){
+         const mxArray* a = mxGetFieldByNumber(s, 0, k);
+         const char*    name = mxGetFieldNameByNumber(s, k);
+         int            isList, type;
+         mwSize         count, ncol, c;
+         if ( a == NULL ) continue;
+         isList = mxIsCell(a);
+         if ( !isList && !mxIsNumeric(a) && !mxIsLogical(a) ){
+            sprintf(msg, "PlyIO: unsupported data in %.32s.%.32s", cur->name, name);
+            mexErrMsgTxt(msg);
+         }
+         if ( isList || mxGetM(a) == 1 || mxGetN(a) == 1 ){ count = mxGetNumberOfElements(a); ncol = 1; }
+         else{ count = mxGetM(a); ncol = mxGetN(a); }
+         if ( cur->nprop && count != cur->count )
+            mexErrMsgTxt("PlyIO: all property data in an element must have the same length");
+         cur->count = count;
+         type = storageType(a, isList, wantDouble);
+         if ( type < 0 ){
+            sprintf(msg, "PlyIO: unsupported data in %.32s.%.32s", cur->name, name);
+            mexErrMsgTxt(msg);
+         }
+         cur->prop = (PlyProperty*) mxRealloc(cur->prop, (cur->nprop + ncol)*sizeof(PlyProperty));
+         for(c = 0; c < ncol; c++){
+            PlyProperty* pr = cur->prop + cur->nprop++;
+            memset(pr, 0, sizeof(PlyProperty));
+            if ( ncol > 1 ) snprintf(pr->name, sizeof(pr->name), "%s_%u", name, (unsigned)(c + 1));
+            else            strncpy(pr->name, name, sizeof(pr->name) - 1);
+            pr->type      = type;
+            pr->countType = -1;
+            pr->src       = a;
+            pr->srcData   = isList ? NULL : mxGetData(a);
+            pr->srcClass  = mxGetClassID(a);
+            pr->column    = c;
+            if ( isList ){
+               mwSize i, maxLen = 0;
+               for(i = 0; i < count; i++){
+                  const mxArray* ci = mxGetCell(a, i);
+                  if ( ci && mxGetNumberOfElements(ci) > maxLen ) maxLen = mxGetNumberOfElements(ci);
+               }
+               pr->countType = ( maxLen <= 255 ) ? PLY_UINT8 : PLY_INT32;
+            }
+         }
+      }
+      cur->recSize = 0;
+      for(k = 0; k < cur->nprop; k++){
+         cur->prop[k].offset = cur->recSize;
+         cur->recSize       += plySize[cur->prop[k].type];
+      }
+      for(k = 0; k < cur->nprop; k++) if ( cur->prop[k].countType >= 0 ) cur->recSize = 0;
+   }
+
+   if ( (fid = fopen(filename, "wb")) == NULL ){
+      sprintf(msg, "PlyIO: cannot open %.200s for writing", filename);
+      mexErrMsgTxt(msg);
+   }
+   setvbuf(fid, NULL, _IOFBF, 1 << 20);
+   fprintf(fid, "ply\nformat %s 1.0\ncomment created by MATLAB ply_write\n", fmt);
+   for(e = 0; e < nelem; e++){
+      fprintf(fid, "element %s %u\n", el[e].name, (unsigned) el[e].count);
+      for(k = 0; k < el[e].nprop; k++){
+         const PlyProperty* pr = el[e].prop + k;
+         if ( pr->countType < 0 )
+            fprintf(fid, "property %s %s\n", plyName[0][pr->type], pr->name);
+         else
+            fprintf(fid, "property list %s %s %s\n", plyName[0][pr->countType], plyName[0][pr->type], pr->name);
+      }
+   }
+   fprintf(fid, "end_header\n");
+   for(e = 0; e < nelem; e++) writeElementData(fid, el + e, format, swap);
+   fclose(fid);
+
+   for(e = 0; e < nelem; e++) mxFree(el[e].prop);
+   mxFree(el);
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Read and write PLY files.
+	//
+	// We expect the function to be called as :
+        // [Elements,Comments] = PlyIO('read',filename)
+        // PlyIO('write',filename,Elements[,format[,'double']])
+        //
+        // Elements has the layout of plyread.m/plywrite.m: Elements.vertex.x,
+        // Elements.face.vertex_indices, ... Scalar properties are read as
+        // count x 1 columns and list properties as count x 1 cells of row
+        // vectors. ASCII, binary_little_endian and binary_big_endian files are
+        // read from a memory-mapped file; records without lists are parsed in
+        // parallel.
+        //
+        // format is 'ascii', 'binary_little_endian' or 'binary_big_endian'
+        // (default, as plywrite.m). The type of a property follows the class
+        // of its data, integer valued floating point data is stored with the
+        // smallest integer type and double as float unless 'double' is given.
+        // A count x k matrix is written as the k properties name_1 ... name_k
+        // (e.g. Elements.vertex.stress = stress of the particles).
+        */
+   char op[8], *filename;
+
+   if ( nrhs < 2 || mxGetString(prhs[0], op, sizeof(op)) || !mxIsChar(prhs[1]) )
+      mexErrMsgTxt("PlyIO: expected ('read'|'write', filename, ...)");
+   filename = mxArrayToString(prhs[1]);
+
+   if ( strcmp(op, "read") == 0 ){
+      mxArray *elements, *comments;
+      readPly(filename, &elements, &comments);
+      plhs[0] = elements;
+      if ( nlhs > 1 ) plhs[1] = comments;
+      else            mxDestroyArray(comments);
+   }
+   else if ( strcmp(op, "write") == 0 ){
+      char fmt[32] = "binary_big_endian";
+      int  wantDouble = 0, a;
+      if ( nrhs < 3 ) mexErrMsgTxt("PlyIO: expected ('write', filename, Elements)");
+      for(a = 3; a < nrhs; a++){
+         char s[32];
+         if ( mxGetString(prhs[a], s, sizeof(s)) ) mexErrMsgTxt("PlyIO: format must be a string");
+         if      ( strcmp(s, "double") == 0 ) wantDouble = 1;
+         else if ( s[0] != '\0' ) strcpy(fmt, s);
+      }
+      writePly(filename, prhs[2], fmt, wantDouble);
+   }
+   else
+      mexErrMsgTxt("PlyIO: unknown operation, expected 'read' or 'write'");
+   mxFree(filename);
+}
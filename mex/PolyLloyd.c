@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" PolyLloyd.c
+ */
+
+typedef struct {
+   const double* x;        /* np x 2 points, column major */
+   long          np;
+   double        lo[2], hb; /* origin and size of the buckets */
+   long          nb[2];
+   long*         start;    /* points of bucket b: start[b] .. start[b+1]-1 */
+   double*       xy;       /* x0 y0 x1 y1 .. of the points, bucket by bucket */
+} Buckets;
+
+typedef struct {
+   double* v;              /* vertices, x0 y0 x1 y1 .. relative to the seed */
+   int     n, cap;
+} Polygon;
+
+static void buildBuckets (Buckets* bk, const double* x, long np)
+/*
+ * uniform buckets of about 1 point, filled by a counting sort
+ */
+{
+   double hi[2] = {-DBL_MAX, -DBL_MAX};
+   long   i, b, nbk;
+   int    d;
+
+   bk->x     = x;
+   bk->np    = np;
+   bk->lo[0] = bk->lo[1] = DBL_MAX;
+   for(i = 0; i < np; i++)
+      for(d = 0; d < 2; d++){
+         if ( x[i + np*d] < bk->lo[d] ) bk->lo[d] = x[i + np*d];
+         if ( x[i + np*d] > hi[d] )     hi[d]     = x[i + np*d];
+      }
+   bk->hb = sqrt(( hi[0] - bk->lo[0] + DBL_EPSILON )*( hi[1] - bk->lo[1] + DBL_EPSILON )/(double) np);
+   if ( !( bk->hb > 0. ) ) bk->hb = 1.;
+   for(d = 0; d < 2; d++){
+      bk->nb[d] = (long) floor(( hi[d] - bk->lo[d] )/bk->hb) + 1;
+      if ( bk->nb[d] > 4*(long) sqrt((double) np) + 1 ) bk->nb[d] = 4*(long) sqrt((double) np) + 1;
+   }
+   /* widen the buckets if the extent was clamped */
+   for(d = 0; d < 2; d++)
+      if ( bk->hb*bk->nb[d] <= hi[d] - bk->lo[d] ) bk->hb = 1.000001*( hi[d] - bk->lo[d] )/bk->nb[d];
+   nbk       = bk->nb[0]*bk->nb[1];
+   bk->start = (long*) mxCalloc(nbk+1, sizeof(long));
+   bk->xy    = (double*) mxMalloc((np > 0 ? np : 1)*2*sizeof(double));
+   for(i = 0; i < np; i++) bk->start[ 1 + (long)((x[i] - bk->lo[0])/bk->hb) + bk->nb[0]*(long)((x[i + np] - bk->lo[1])/bk->hb) ]++;
+   for(b = 0; b < nbk; b++) bk->start[b+1] += bk->start[b];
+   for(i = 0; i < np; i++){
+      b = (long)((x[i] - bk->lo[0])/bk->hb) + bk->nb[0]*(long)((x[i + np] - bk->lo[1])/bk->hb);
+      bk->xy[2*bk->start[b]]     = x[i];
+      bk->xy[2*bk->start[b] + 1] = x[i + np];
+      bk->start[b]++;
+   }
+   for(b = nbk; b > 0; b--) bk->start[b] = bk->start[b-1];
+   bk->start[0] = 0;
+}
+
+static double radius2 (const Polygon* pg)
+/*
+ * squared distance of the farthest vertex to the seed
+ */
+{
+   double r2, r2max = 0.;
+   int    i;
+
+   for(i = 0; i < pg->n; i++){
+      r2 = pg->v[2*i]*pg->v[2*i] + pg->v[2*i+1]*pg->v[2*i+1];
+      if ( r2 > r2max ) r2max = r2;
+   }
+   return r2max;
+}
+
+static void clip (Polygon* pg, double nx, double ny, double c, Polygon* tmp)
+/*
+ * keeps the part of the polygon where nx*x + ny*y <= c (Sutherland-Hodgman)
+ */
+{
+   int     i, j;
+   double  fi, fj, t, *v = pg->v;
+   Polygon sw;
+
+   if ( tmp->cap < 2*pg->n + 2 ){
+      tmp->cap = 2*pg->n + 2;
+      tmp->v   = (double*) realloc(tmp->v, 2*tmp->cap*sizeof(double));
+   }
+   tmp->n = 0;
+   for(i = 0; i < pg->n; i++){
+      j  = ( i + 1 ) % pg->n;
+      fi = nx*v[2*i] + ny*v[2*i+1] - c;
+      fj = nx*v[2*j] + ny*v[2*j+1] - c;
+      if ( fi <= 0. ){
+         tmp->v[2*tmp->n] = v[2*i]; tmp->v[2*tmp->n+1] = v[2*i+1]; tmp->n++;
+      }
+      if ( ( fi < 0. && fj > 0. ) || ( fi > 0. && fj < 0. ) ){
+         t = fi/( fi - fj );
+         tmp->v[2*tmp->n]   = v[2*i]   + t*( v[2*j]   - v[2*i] );
+         tmp->v[2*tmp->n+1] = v[2*i+1] + t*( v[2*j+1] - v[2*i+1] );
+         tmp->n++;
+      }
+   }
+   sw = *pg; *pg = *tmp; *tmp = sw;
+}
+
+static void voronoiCell (const Buckets* bk, long s, const double* box, Polygon* pg, Polygon* tmp,
+                         double* pc, double* area)
+/*
+ * Voronoi cell of the point s, clipped by the bisectors of the neighbours
+ * ring of buckets by ring of buckets: once every vertex is closer to s than
+ * half the distance to the next ring, the cell cannot change anymore.
+ * Returns the centroid pc and the (positive) area
+ */
+{
+   const double *x = bk->x;
+   double        xs = x[s], ys = x[s + bk->np], r2, r2max, dx, dy, a, cx, cy, t;
+   long          bx, by, ix, iy, k, kmax, i, j, q;
+
+   /* start from the bounding box of all points, enlarged */
+   pg->n = 4;
+   pg->v[0] = box[0] - xs; pg->v[1] = box[2] - ys;
+   pg->v[2] = box[1] - xs; pg->v[3] = box[2] - ys;
+   pg->v[4] = box[1] - xs; pg->v[5] = box[3] - ys;
+   pg->v[6] = box[0] - xs; pg->v[7] = box[3] - ys;
+
+   r2max = radius2(pg);
+   bx   = (long)((xs - bk->lo[0])/bk->hb);
+   by   = (long)((ys - bk->lo[1])/bk->hb);
+   kmax = ( bk->nb[0] > bk->nb[1] ) ? bk->nb[0] : bk->nb[1];
+   for(k = 0; k <= kmax && pg->n > 0; k++){
+      for(iy = by - k; iy <= by + k; iy++){
+         if ( iy < 0 || iy >= bk->nb[1] ) continue;
+         for(ix = bx - k; ix <= bx + k; ix += ( k == 0 || iy == by - k || iy == by + k ) ? 1 : 2*k){
+            if ( ix < 0 || ix >= bk->nb[0] ) continue;
+            for(q = bk->start[ix + bk->nb[0]*iy]; q < bk->start[ix + bk->nb[0]*iy + 1]; q++){
+               dx = bk->xy[2*q] - xs; dy = bk->xy[2*q+1] - ys;
+               r2 = dx*dx + dy*dy;
+               /* the seed itself (and duplicates), and the points farther
+                  than twice the cell radius whose bisector misses the cell */
+               if ( r2 == 0. || r2 >= 4.*r2max ) continue;
+               clip(pg, dx, dy, 0.5*r2, tmp);
+               r2max = radius2(pg);
+            }
+         }
+      }
+      /* the points not visited are outside the (2k+1)^2 buckets around s */
+      dx = fmin(xs - bk->lo[0] - (bx - k)*bk->hb, bk->lo[0] + (bx + k + 1)*bk->hb - xs);
+      dy = fmin(ys - bk->lo[1] - (by - k)*bk->hb, bk->lo[1] + (by + k + 1)*bk->hb - ys);
+      if ( 4.*r2max <= fmin(dx, dy)*fmin(dx, dy) ) break;
+   }
+
+   a = cx = cy = 0.;
+   for(i = 0; i < pg->n; i++){
+      j  = ( i + 1 ) % pg->n;
+      t  = pg->v[2*i]*pg->v[2*j+1] - pg->v[2*j]*pg->v[2*i+1];
+      a  += t;
+      cx += ( pg->v[2*i]   + pg->v[2*j] )*t;
+      cy += ( pg->v[2*i+1] + pg->v[2*j+1] )*t;
+   }
+   *area = 0.5*a;
+   pc[0] = ( a != 0. ) ? xs + cx/(3.*a) : xs;
+   pc[1] = ( a != 0. ) ? ys + cy/(3.*a) : ys;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Kernels of the Lloyd iterations of PolyMesher.
+	//
+	// We expect the function to be called as :
+        // [Pc,A] = PolyLloyd('cells',P,R_P)
+        // [R_P,dI] = PolyLloyd('reflect',P,d,n1,n2,Alpha)
+        //
+        // cells   : centroids Pc (NElem x 2) and areas A (NElem x 1) of the
+        //           Voronoi cells of the seeds P (NElem x 2) in the diagram
+        //           of [P;R_P], as voronoin followed by PolyMshr_CntrdPly.
+        //           Every cell is clipped by the bisectors of its neighbours
+        //           (bucket search), cells are computed in parallel; the
+        //           reflections R_P keep the cells of P bounded
+        // reflect : reflections P - 2*n*d of the seeds closer than Alpha to
+        //           a boundary segment, d, n1, n2 are the NElem x (NBdrySegs+1)
+        //           distances and gradients of PolyMshr_Rflct. R_P and dI
+        //           (distance of the reflected seed) are ordered as P1(I),
+        //           d(I), segment by segment
+        */
+   char mode[16];
+
+   if ( nrhs < 3 || !mxIsChar(prhs[0]) )
+      mexErrMsgTxt("PolyLloyd: expected ('cells', P, R_P) or ('reflect', P, d, n1, n2, Alpha)");
+   mxGetString(prhs[0], mode, sizeof(mode));
+
+   if ( strcmp(mode, "cells") == 0 ){
+      Buckets  bk;
+      double  *x, *pc, *area, box[4], w;
+      long     ns, nr, np, i, s;
+      int      d;
+
+      if ( !mxIsDouble(prhs[1]) || mxGetN(prhs[1]) != 2 || !mxIsDouble(prhs[2]) || ( mxGetN(prhs[2]) != 2 && !mxIsEmpty(prhs[2]) ) )
+         mexErrMsgTxt("PolyLloyd: P and R_P must be n x 2 (double)");
+      ns = (long) mxGetM(prhs[1]);
+      nr = mxIsEmpty(prhs[2]) ? 0 : (long) mxGetM(prhs[2]);
+      np = ns + nr;
+
+      /* [P;R_P] */
+      x = (double*) mxMalloc((np > 0 ? np : 1)*2*sizeof(double));
+      for(d = 0; d < 2; d++){
+         memcpy(x + np*d,      mxGetPr(prhs[1]) + ns*d, ns*sizeof(double));
+         memcpy(x + np*d + ns, mxGetPr(prhs[2]) + nr*d, nr*sizeof(double));
+      }
+      plhs[0] = mxCreateDoubleMatrix(ns, 2, mxREAL);
+      plhs[1] = mxCreateDoubleMatrix(ns, 1, mxREAL);
+      pc      = mxGetPr(plhs[0]);
+      area    = mxGetPr(plhs[1]);
+      if ( ns == 0 ){ mxFree(x); return; }
+
+      buildBuckets(&bk, x, np);
+      box[0] = box[2] = DBL_MAX; box[1] = box[3] = -DBL_MAX;
+      for(i = 0; i < np; i++)
+         for(d = 0; d < 2; d++){
+            if ( x[i + np*d] < box[2*d] )   box[2*d]   = x[i + np*d];
+            if ( x[i + np*d] > box[2*d+1] ) box[2*d+1] = x[i + np*d];
+         }
+      w = ( box[1] - box[0] ) + ( box[3] - box[2] ) + 1.;
+      box[0] -= w; box[1] += w; box[2] -= w; box[3] += w;
+
+      #pragma omp parallel
+      {
+         Polygon pg, tmp;
+         double  c[2], a;
+         pg.cap  = tmp.cap = 64;
+         pg.v    = (double*) malloc(2*pg.cap*sizeof(double));
+         tmp.v   = (double*) malloc(2*tmp.cap*sizeof(double));
+         #pragma omp for schedule(dynamic,256)
+         for(s = 0; s < ns; s++){
+            voronoiCell(&bk, s, box, &pg, &tmp, c, &a);
+            pc[s]      = c[0];
+            pc[s + ns] = c[1];
+            area[s]    = a;
+         }
+         free(pg.v);
+         free(tmp.v);
+      }
+      mxFree(bk.start);
+      mxFree(bk.xy);
+      mxFree(x);
+   }
+   else if ( strcmp(mode, "reflect") == 0 ){
+      const double *P, *dd, *n1, *n2;
+      double        alpha, *rp, *di;
+      long          ns, nseg, nr, *off, g;
+
+      if ( nrhs < 6 ) mexErrMsgTxt("PolyLloyd: expected ('reflect', P, d, n1, n2, Alpha)");
+      ns   = (long) mxGetM(prhs[1]);
+      nseg = (long) mxGetN(prhs[2]) - 1;
+      if ( (long) mxGetM(prhs[2]) != ns || nseg < 1 ||
+           mxGetM(prhs[3]) != mxGetM(prhs[2]) || mxGetN(prhs[3]) != mxGetN(prhs[2]) ||
+           mxGetM(prhs[4]) != mxGetM(prhs[2]) || mxGetN(prhs[4]) != mxGetN(prhs[2]) )
+         mexErrMsgTxt("PolyLloyd: d, n1 and n2 must be NElem x (NBdrySegs+1)");
+      P     = mxGetPr(prhs[1]);
+      dd    = mxGetPr(prhs[2]);
+      n1    = mxGetPr(prhs[3]);
+      n2    = mxGetPr(prhs[4]);
+      alpha = mxGetScalar(prhs[5]);
+
+      /* reflections of every segment, offsets, then the reflections */
+      off = (long*) mxMalloc((nseg+1)*sizeof(long));
+      #pragma omp parallel for
+      for(g = 0; g < nseg; g++){
+         long i, c = 0;
+         for(i = 0; i < ns; i++) if ( fabs(dd[i + ns*g]) < alpha ) c++;
+         off[g+1] = c;
+      }
+      off[0] = 0;
+      for(g = 0; g < nseg; g++) off[g+1] += off[g];
+      nr = off[nseg];
+
+      plhs[0] = mxCreateDoubleMatrix(nr, 2, mxREAL);
+      plhs[1] = mxCreateDoubleMatrix(nr, 1, mxREAL);
+      rp      = mxGetPr(plhs[0]);
+      di      = mxGetPr(plhs[1]);
+      #pragma omp parallel for
+      for(g = 0; g < nseg; g++){
+         long i, k, o = off[g];
+         for(i = 0; i < ns; i++){
+            k = i + ns*g;
+            if ( !( fabs(dd[k]) < alpha ) ) continue;
+            rp[o]      = P[i]      - 2.*n1[k]*dd[k];
+            rp[o + nr] = P[i + ns] - 2.*n2[k]*dd[k];
+            di[o]      = dd[k];
+            o++;
+         }
+      }
+      mxFree(off);
+   }
+   else
+      mexErrMsgTxt("PolyLloyd: mode must be 'cells' or 'reflect'");
+}
@@ -0,0 +1,677 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+#include "mapfile.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" ReadGmsh.c mapfile.c
+ */
+
+#define GMSH_MAX_TYPE 19
+
+/* number of nodes in function of the element type, as load_gmsh.m */
+static const int nodesPerType[GMSH_MAX_TYPE+1] = {
+   0, 2, 3, 4, 4, 8, 6, 5, 3, 6, 9, 10, 27, 18, 14, 1, 8, 20, 15, 13 };
+
+/* element types kept in the POINTS, LINES, ... arrays of load_gmsh.m */
+#define GMSH_NCAT 8
+static const int   catType [GMSH_NCAT] = { 15, 1, 2, 3, 4, 5, 6, 7 };
+static const char* catName [GMSH_NCAT] = { "POINTS", "LINES", "TRIANGLES", "QUADS",
+                                           "TETS", "HEXAS", "PRISMS", "PYRAMIDS" };
+static const char* catCount[GMSH_NCAT] = { "nbPoints", "nbLines", "nbTriangles", "nbQuads",
+                                           "nbTets", "nbHexas", "nbPrisms", "nbPyramids" };
+
+static char gmshError[256];
+
+/* ------------------------------------------------------------------------ */
+/*  ASCII and binary tokens                                                 */
+/* ------------------------------------------------------------------------ */
+
+static const char* skipSpace (const char* p, const char* end)
+{
+   while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' ) ) p++;
+   return p;
+}
+
+static const char* parseInt (const char* p, const char* end, long long* v)
+{
+   long long s = 1, x = 0;
+
+   p = skipSpace(p, end);
+   if ( p < end && ( *p == '-' || *p == '+' ) ){ if ( *p == '-' ) s = -1; p++; }
+   if ( p >= end || *p < '0' || *p > '9' ) return NULL;
+   while ( p < end && *p >= '0' && *p <= '9' ) x = 10*x + (*p++ - '0');
+   *v = s*x;
+   return p;
+}
+
+static const char* parseDouble (const char* p, const char* end, double* v)
+{
+   char* q;
+
+   p = skipSpace(p, end);
+   if ( p >= end ) return NULL;
+   *v = strtod(p, &q);
+   return ( q == p ) ? NULL : q;
+}
+
+static const char* nextLine (const char* p, const char* end)
+{
+   const char* q = (const char*) memchr(p, '\n', end - p);
+   return q ? q + 1 : end;
+}
+
+static int readBinInt (const char** p, const char* end)
+{
+   int v = 0;
+   if ( *p + sizeof(int) <= end ) memcpy(&v, *p, sizeof(int));
+   *p += sizeof(int);
+   return v;
+}
+
+static long long readBinSize (const char** p, const char* end, int dsize)
+{
+   long long v = 0;
+   if ( dsize == 8 ){ if ( *p + 8 <= end ) memcpy(&v, *p, 8); }
+   else             { int w = 0; if ( *p + 4 <= end ) memcpy(&w, *p, 4); v = w; }
+   *p += dsize;
+   return v;
+}
+
+static double readBinDouble (const char** p, const char* end)
+{
+   double v = 0.;
+   if ( *p + sizeof(double) <= end ) memcpy(&v, *p, sizeof(double));
+   *p += sizeof(double);
+   return v;
+}
+
+static const char* findEnd (const char* p, const char* end, const char* name)
+/*
+ * position after the "$End<name>" line
+ */
+{
+   char   tag[80];
+   size_t n;
+
+   sprintf(tag, "$End%s", name);
+   n = strlen(tag);
+   while ( p + n <= end ){
+      const char* q = (const char*) memchr(p, '$', end - p);
+      if ( q == NULL || q + n > end ) break;
+      if ( memcmp(q, tag, n) == 0 ) return nextLine(q, end);
+      p = q + 1;
+   }
+   return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+/*  mesh data                                                               */
+/* ------------------------------------------------------------------------ */
+
+typedef struct {
+   mwSize     n;
+   long long *tag;          /* node tags */
+   long long  maxTag;
+   mxArray   *POS;          /* n x 3 */
+} GmshNodes;
+
+typedef struct {
+   mwSize     n;
+   long long *id;
+   int       *type;
+   int       *ntags;
+   int        maxTags;
+   int       *tags;         /* n x maxTags, element e at tags[e*maxTags] */
+   mwSize    *off;          /* nodes of e are node[off[e] .. off[e+1]-1] */
+   long long *node;
+} GmshElements;
+
+typedef struct {            /* $Entities of v4: first physical tag of (dim, tag) */
+   long long  maxTag[4];
+   int       *phys[4];
+} GmshEntities;
+
+static int allocElements (GmshElements* E, mwSize n, int maxTags)
+{
+   E->n       = n;
+   E->maxTags = maxTags;
+   E->id      = (long long*) mxMalloc((n+1)*sizeof(long long));
+   E->type    = (int*)       mxMalloc((n+1)*sizeof(int));
+   E->ntags   = (int*)       mxMalloc((n+1)*sizeof(int));
+   E->tags    = (int*)       mxCalloc((n+1)*( maxTags > 0 ? maxTags : 1 ), sizeof(int));
+   E->off     = (mwSize*)    mxMalloc((n+1)*sizeof(mwSize));
+   E->node    = NULL;
+   return 1;
+}
+
+static int physicalTag (const GmshEntities* ent, int dim, long long tag)
+{
+   if ( dim < 0 || dim > 3 || ent->phys[dim] == NULL || tag < 0 || tag > ent->maxTag[dim] ) return 0;
+   return ent->phys[dim][tag];
+}
+
+/* ------------------------------------------------------------------------ */
+/*  format 2 (ASCII and binary)                                             */
+/* ------------------------------------------------------------------------ */
+
+static const char* readNodes2 (const char* p, const char* end, int binary, GmshNodes* N)
+{
+   long long  n, i;
+   double    *pos;
+   const char **line;
+   int        bad = 0;
+
+   if ( (p = parseInt(p, end, &n)) == NULL || n < 0 ) return NULL;
+   p = nextLine(p, end);
+   N->n      = (mwSize) n;
+   N->tag    = (long long*) mxMalloc((n+1)*sizeof(long long));
+   N->POS    = mxCreateDoubleMatrix(n, 3, mxREAL);
+   N->maxTag = 0;
+   pos       = mxGetPr(N->POS);
+
+   if ( binary ){
+      for(i = 0; i < n; i++){
+         N->tag[i]    = readBinInt(&p, end);
+         pos[i]       = readBinDouble(&p, end);
+         pos[i+n]     = readBinDouble(&p, end);
+         pos[i+2*n]   = readBinDouble(&p, end);
+      }
+      if ( p > end ) return NULL;
+   }
+   else{
+      /* one node per line: find the lines, then parse them in parallel */
+      line = (const char**) mxMalloc((n+1)*sizeof(const char*));
+      for(i = 0; i < n; i++){
+         p       = skipSpace(p, end);
+         line[i] = p;
+         p       = nextLine(p, end);
+      }
+      #pragma omp parallel for reduction(+:bad)
+      for(i = 0; i < n; i++){
+         const char* q = line[i];
+         if ( (q = parseInt(q, end, &N->tag[i])) == NULL ||
+              (q = parseDouble(q, end, &pos[i])) == NULL ||
+              (q = parseDouble(q, end, &pos[i+n])) == NULL ||
+              (q = parseDouble(q, end, &pos[i+2*n])) == NULL ) bad++;
+      }
+      mxFree(line);
+      if ( bad ) return NULL;
+   }
+   for(i = 0; i < n; i++) if ( N->tag[i] > N->maxTag ) N->maxTag = N->tag[i];
+   return p;
+}
+
+static const char* readElements2 (const char* p, const char* end, int binary, GmshElements* E)
+{
+   long long   n, i, e;
+   const char **line = NULL;
+   int         bad = 0, maxTags = 0;
+
+   if ( (p = parseInt(p, end, &n)) == NULL || n < 0 ) return NULL;
+   p = nextLine(p, end);
+
+   if ( binary ){
+      /* blocks: type, number of elements, number of tags, then
+         id tags... nodes... for every element of the block */
+      const char* q = p;
+      for(e = 0; e < n; ){                    /* first pass: maxTags */
+         int type = readBinInt(&q, end), ne = readBinInt(&q, end), nt = readBinInt(&q, end);
+         if ( type < 1 || type > GMSH_MAX_TYPE || ne <= 0 || q > end ) return NULL;
+         if ( nt > maxTags ) maxTags = nt;
+         q += (size_t) ne*(1 + nt + nodesPerType[type])*sizeof(int);
+         e += ne;
+      }
+      allocElements(E, (mwSize) n, maxTags);
+      E->off[0] = 0;
+      E->node   = (long long*) mxMalloc(((q - p)/sizeof(int) + 1)*sizeof(long long));
+      for(e = 0; e < n; ){
+         int type = readBinInt(&p, end), ne = readBinInt(&p, end), nt = readBinInt(&p, end), k, t;
+         for(k = 0; k < ne; k++, e++){
+            E->id[e]    = readBinInt(&p, end);
+            E->type[e]  = type;
+            E->ntags[e] = nt;
+            for(t = 0; t < nt; t++) E->tags[e*maxTags + t] = readBinInt(&p, end);
+            E->off[e+1] = E->off[e] + nodesPerType[type];
+            for(t = 0; t < nodesPerType[type]; t++) E->node[E->off[e] + t] = readBinInt(&p, end);
+         }
+      }
+      return ( p > end ) ? NULL : p;
+   }
+
+   /* ASCII, one element per line "id type ntags tags... nodes...":
+      find the lines, read id, type and ntags in parallel, then the offsets
+      of the nodes and finally the tags and nodes in parallel */
+   line = (const char**) mxMalloc((n+1)*sizeof(const char*));
+   for(i = 0; i < n; i++){
+      p       = skipSpace(p, end);
+      line[i] = p;
+      p       = nextLine(p, end);
+   }
+   allocElements(E, (mwSize) n, 0);
+   #pragma omp parallel for reduction(+:bad)
+   for(i = 0; i < n; i++){
+      long long id, type, nt;
+      const char* q = line[i];
+      if ( (q = parseInt(q, end, &id)) == NULL || (q = parseInt(q, end, &type)) == NULL ||
+           (q = parseInt(q, end, &nt)) == NULL || type < 1 || type > GMSH_MAX_TYPE || nt < 0 ){
+         bad++;
+         E->type[i] = 1; E->ntags[i] = 0;
+         continue;
+      }
+      E->id[i]    = id;
+      E->type[i]  = (int) type;
+      E->ntags[i] = (int) nt;
+   }
+   if ( bad ) return NULL;
+   E->off[0] = 0;
+   for(i = 0; i < n; i++){
+      E->off[i+1] = E->off[i] + nodesPerType[E->type[i]];
+      if ( E->ntags[i] > maxTags ) maxTags = E->ntags[i];
+   }
+   mxFree(E->tags);
+   E->maxTags = maxTags;
+   E->tags    = (int*) mxCalloc((n+1)*( maxTags > 0 ? maxTags : 1 ), sizeof(int));
+   E->node    = (long long*) mxMalloc((E->off[n]+1)*sizeof(long long));
+   #pragma omp parallel for reduction(+:bad)
+   for(i = 0; i < n; i++){
+      long long v;
+      int       t, k;
+      const char* q = line[i];
+      for(k = 0; k < 3 && q; k++) q = parseInt(q, end, &v);
+      for(t = 0; t < E->ntags[i] && q; t++){ q = parseInt(q, end, &v); E->tags[i*maxTags + t] = (int) v; }
+      for(k = 0; k < nodesPerType[E->type[i]] && q; k++) q = parseInt(q, end, &E->node[E->off[i] + k]);
+      if ( q == NULL ) bad++;
+   }
+   mxFree(line);
+   return bad ? NULL : p;
+}
+
+/* ------------------------------------------------------------------------ */
+/*  format 4.1 (ASCII and binary)                                           */
+/* ------------------------------------------------------------------------ */
+
+static const char* readEntities4 (const char* p, const char* end, int binary, int dsize, GmshEntities* ent)
+{
+   long long   num[4], d, i, k, tag, nphys, nb, v;
+   double      x;
+   const char *q;
+   int         pass;
+
+   /* two passes: the largest tag of every dimension, then the physical tags */
+   for(pass = 0; pass < 2; pass++){
+      q = p;
+      for(d = 0; d < 4; d++){
+         if ( binary ) num[d] = readBinSize(&q, end, dsize);
+         else if ( (q = parseInt(q, end, &num[d])) == NULL ) return NULL;
+      }
+      for(d = 0; d < 4; d++){
+         if ( pass == 1 ){
+            ent->phys[d] = (int*) mxCalloc(ent->maxTag[d] + 1, sizeof(int));
+         }
+         else ent->maxTag[d] = 0;
+         for(i = 0; i < num[d]; i++){
+            if ( binary ){
+               tag = readBinInt(&q, end);
+               q  += ( d == 0 ? 3 : 6 )*sizeof(double);
+               nphys = readBinSize(&q, end, dsize);
+               for(k = 0; k < nphys; k++){
+                  v = readBinInt(&q, end);
+                  if ( pass == 1 && k == 0 && tag >= 0 ) ent->phys[d][tag] = (int) v;
+               }
+               if ( d > 0 ){
+                  nb = readBinSize(&q, end, dsize);
+                  q += nb*sizeof(int);
+               }
+               if ( q > end ) return NULL;
+            }
+            else{
+               if ( (q = parseInt(q, end, &tag)) == NULL ) return NULL;
+               for(k = 0; k < ( d == 0 ? 3 : 6 ); k++) if ( (q = parseDouble(q, end, &x)) == NULL ) return NULL;
+               if ( (q = parseInt(q, end, &nphys)) == NULL ) return NULL;
+               for(k = 0; k < nphys; k++){
+                  if ( (q = parseInt(q, end, &v)) == NULL ) return NULL;
+                  if ( pass == 1 && k == 0 && tag >= 0 ) ent->phys[d][tag] = (int) v;
+               }
+               if ( d > 0 ){
+                  if ( (q = parseInt(q, end, &nb)) == NULL ) return NULL;
+                  for(k = 0; k < nb; k++) if ( (q = parseInt(q, end, &v)) == NULL ) return NULL;
+               }
+            }
+            if ( pass == 0 && tag > ent->maxTag[d] ) ent->maxTag[d] = tag;
+         }
+      }
+   }
+   return q;
+}
+
+static const char* readNodes4 (const char* p, const char* end, int binary, int dsize, GmshNodes* N)
+{
+   long long nblk, n, minTag, maxTag, b, i, k, j = 0;
+   double   *pos, x;
+
+   if ( binary ){
+      nblk   = readBinSize(&p, end, dsize);
+      n      = readBinSize(&p, end, dsize);
+      minTag = readBinSize(&p, end, dsize);
+      maxTag = readBinSize(&p, end, dsize);
+   }
+   else if ( (p = parseInt(p, end, &nblk)) == NULL || (p = parseInt(p, end, &n)) == NULL ||
+             (p = parseInt(p, end, &minTag)) == NULL || (p = parseInt(p, end, &maxTag)) == NULL )
+      return NULL;
+   if ( n < 0 || p > end ) return NULL;
+   N->n      = (mwSize) n;
+   N->tag    = (long long*) mxMalloc((n+1)*sizeof(long long));
+   N->POS    = mxCreateDoubleMatrix(n, 3, mxREAL);
+   N->maxTag = 0;
+   pos       = mxGetPr(N->POS);
+
+   for(b = 0; b < nblk; b++){
+      long long dim, etag, param, nb, npar;
+      if ( binary ){
+         dim   = readBinInt(&p, end);
+         etag  = readBinInt(&p, end);
+         param = readBinInt(&p, end);
+         nb    = readBinSize(&p, end, dsize);
+      }
+      else if ( (p = parseInt(p, end, &dim)) == NULL || (p = parseInt(p, end, &etag)) == NULL ||
+                (p = parseInt(p, end, &param)) == NULL || (p = parseInt(p, end, &nb)) == NULL )
+         return NULL;
+      if ( j + nb > n || p > end ) return NULL;
+      npar = param ? dim : 0;
+      for(i = 0; i < nb; i++){
+         if ( binary ) N->tag[j+i] = readBinSize(&p, end, dsize);
+         else if ( (p = parseInt(p, end, &N->tag[j+i])) == NULL ) return NULL;
+      }
+      for(i = 0; i < nb; i++){
+         if ( binary ){
+            pos[j+i]     = readBinDouble(&p, end);
+            pos[j+i+n]   = readBinDouble(&p, end);
+            pos[j+i+2*n] = readBinDouble(&p, end);
+            p += npar*sizeof(double);
+         }
+         else{
+            if ( (p = parseDouble(p, end, &pos[j+i])) == NULL ||
+                 (p = parseDouble(p, end, &pos[j+i+n])) == NULL ||
+                 (p = parseDouble(p, end, &pos[j+i+2*n])) == NULL ) return NULL;
+            for(k = 0; k < npar; k++) if ( (p = parseDouble(p, end, &x)) == NULL ) return NULL;
+         }
+      }
+      j += nb;
+   }
+   /* the header's maxTag is not trusted: rowOf is sized from the tags read */
+   for(i = 0; i < j; i++) if ( N->tag[i] > N->maxTag ) N->maxTag = N->tag[i];
+   return ( p > end || j != n ) ? NULL : p;
+}
+
+static const char* readElements4 (const char* p, const char* end, int binary, int dsize,
+                                  const GmshEntities* ent, GmshElements* E)
+{
+   long long nblk, n, minTag, maxTag, b, i, j = 0;
+   int       bad = 0;
+
+   if ( binary ){
+      nblk   = readBinSize(&p, end, dsize);
+      n      = readBinSize(&p, end, dsize);
+      minTag = readBinSize(&p, end, dsize);
+      maxTag = readBinSize(&p, end, dsize);
+   }
+   else if ( (p = parseInt(p, end, &nblk)) == NULL || (p = parseInt(p, end, &n)) == NULL ||
+             (p = parseInt(p, end, &minTag)) == NULL || (p = parseInt(p, end, &maxTag)) == NULL )
+      return NULL;
+   if ( n < 0 || p > end ) return NULL;
+   /* tags as in format 2: physical and elementary (entity) tag */
+   allocElements(E, (mwSize) n, 2);
+   E->off[0] = 0;
+   E->node   = NULL;
+
+   for(b = 0; b < nblk; b++){
+      long long   dim, etag, type, nb;
+      int         npe, phys;
+      const char **line = NULL;
+      if ( binary ){
+         dim  = readBinInt(&p, end);
+         etag = readBinInt(&p, end);
+         type = readBinInt(&p, end);
+         nb   = readBinSize(&p, end, dsize);
+      }
+      else if ( (p = parseInt(p, end, &dim)) == NULL || (p = parseInt(p, end, &etag)) == NULL ||
+                (p = parseInt(p, end, &type)) == NULL || (p = parseInt(p, end, &nb)) == NULL )
+         return NULL;
+      if ( type < 1 || type > GMSH_MAX_TYPE || j + nb > n || p > end ) return NULL;
+      npe  = nodesPerType[type];
+      phys = physicalTag(ent, (int) dim, etag);
+      E->node = (long long*) mxRealloc(E->node, (E->off[j] + nb*npe + 1)*sizeof(long long));
+      for(i = 0; i < nb; i++){
+         E->type[j+i]          = (int) type;
+         E->ntags[j+i]         = 2;
+         E->tags[(j+i)*2]      = phys;
+         E->tags[(j+i)*2 + 1]  = (int) etag;
+         E->off[j+i+1]         = E->off[j+i] + npe;
+      }
+      if ( binary ){
+         for(i = 0; i < nb; i++){
+            int k;
+            E->id[j+i] = readBinSize(&p, end, dsize);
+            for(k = 0; k < npe; k++) E->node[E->off[j+i] + k] = readBinSize(&p, end, dsize);
+         }
+         if ( p > end ) return NULL;
+      }
+      else{
+         /* one element per line, parsed in parallel */
+         line = (const char**) mxMalloc((nb+1)*sizeof(const char*));
+         for(i = 0; i < nb; i++){
+            p       = skipSpace(p, end);
+            line[i] = p;
+            p       = nextLine(p, end);
+         }
+         #pragma omp parallel for reduction(+:bad)
+         for(i = 0; i < nb; i++){
+            const char* q = parseInt(line[i], end, &E->id[j+i]);
+            int k;
+            for(k = 0; k < npe && q; k++) q = parseInt(q, end, &E->node[E->off[j+i] + k]);
+            if ( q == NULL ) bad++;
+         }
+         mxFree(line);
+         if ( bad ) return NULL;
+      }
+      j += nb;
+   }
+   return ( j != n ) ? NULL : p;
+}
+
+/* ------------------------------------------------------------------------ */
+/*  mesh struct as load_gmsh.m                                              */
+/* ------------------------------------------------------------------------ */
+
+static mxArray* buildMesh (const GmshNodes* N, const GmshElements* E)
+{
+   const char *fields[] = { "MIN", "MAX", "nbNod", "POS", "nbElm", "ELE_INFOS",
+                            "nbPoints", "nbLines", "nbTriangles", "nbQuads", "nbTets", "nbHexas",
+                            "nbPrisms", "nbPyramids", "POINTS", "LINES", "TRIANGLES", "QUADS",
+                            "TETS", "HEXAS", "PRISMS", "PYRAMIDS", "ELE_TAGS" };
+   mxArray   *mesh = mxCreateStructMatrix(1, 1, 23, fields), *cat[GMSH_NCAT], *M;
+   double    *pos = mxGetPr(N->POS), *mn, *mx, *info, *etags, *out[GMSH_NCAT];
+   int       *rowOf, catOf[GMSH_MAX_TYPE+1], c, d;
+   mwSize     count[GMSH_NCAT], *slot, n = N->n, ne = E->n, i;
+   long       e;
+   int        ntagcols = ( E->maxTags > 1 ) ? E->maxTags - 1 : 0;
+
+   /* nodes, numbered 1..n in the order of the file */
+   M  = mxCreateDoubleMatrix(3, 1, mxREAL); mn = mxGetPr(M); mxSetField(mesh, 0, "MIN", M);
+   M  = mxCreateDoubleMatrix(3, 1, mxREAL); mx = mxGetPr(M); mxSetField(mesh, 0, "MAX", M);
+   for(d = 0; d < 3; d++){
+      mn[d] = ( n > 0 ) ?  pos[d*n] : 0.;
+      mx[d] = mn[d];
+      for(i = 1; i < n; i++){
+         if ( pos[i + d*n] < mn[d] ) mn[d] = pos[i + d*n];
+         if ( pos[i + d*n] > mx[d] ) mx[d] = pos[i + d*n];
+      }
+   }
+   mxSetField(mesh, 0, "nbNod", mxCreateDoubleScalar((double) n));
+   mxSetField(mesh, 0, "POS",   N->POS);
+
+   rowOf = (int*) mxCalloc(N->maxTag + 2, sizeof(int));
+   for(i = 0; i < n; i++) if ( N->tag[i] >= 0 ) rowOf[N->tag[i]] = (int)(i + 1);
+
+   /* ELE_INFOS = [id type ntags firstTag], ELE_TAGS the other tags */
+   mxSetField(mesh, 0, "nbElm", mxCreateDoubleScalar((double) ne));
+   M     = mxCreateDoubleMatrix(ne, 4, mxREAL); info = mxGetPr(M); mxSetField(mesh, 0, "ELE_INFOS", M);
+   M     = mxCreateDoubleMatrix(ne, ntagcols, mxREAL); etags = mxGetPr(M); mxSetField(mesh, 0, "ELE_TAGS", M);
+
+   /* slot of every element in its POINTS, LINES, ... array */
+   for(c = 0; c <= GMSH_MAX_TYPE; c++) catOf[c] = -1;
+   for(c = 0; c < GMSH_NCAT; c++){ catOf[catType[c]] = c; count[c] = 0; }
+   slot = (mwSize*) mxMalloc((ne+1)*sizeof(mwSize));
+   for(i = 0; i < ne; i++){
+      c = catOf[E->type[i]];
+      slot[i] = ( c >= 0 ) ? count[c]++ : 0;
+   }
+   for(c = 0; c < GMSH_NCAT; c++){
+      cat[c] = mxCreateDoubleMatrix(count[c], nodesPerType[catType[c]] + 1, mxREAL);
+      out[c] = mxGetPr(cat[c]);
+   }
+
+   #pragma omp parallel for private(c)
+   for(e = 0; e < (long) ne; e++){
+      int    t, k, npe, first = ( E->ntags[e] > 0 ) ? E->tags[e*E->maxTags] : 0;
+      info[e]        = (double) E->id[e];
+      info[e + ne]   = E->type[e];
+      info[e + 2*ne] = E->ntags[e];
+      info[e + 3*ne] = first;
+      for(t = 1; t < E->ntags[e]; t++) etags[e + ne*(t-1)] = E->tags[e*E->maxTags + t];
+      c = catOf[E->type[e]];
+      if ( c < 0 ) continue;
+      npe = nodesPerType[E->type[e]];
+      for(k = 0; k < npe; k++){
+         long long tag = E->node[E->off[e] + k];
+         out[c][slot[e] + count[c]*k] = ( tag >= 0 && tag <= N->maxTag ) ? rowOf[tag] : 0;
+      }
+      out[c][slot[e] + count[c]*npe] = first;
+   }
+
+   for(c = 0; c < GMSH_NCAT; c++){
+      mxSetField(mesh, 0, catCount[c], mxCreateDoubleScalar((double) count[c]));
+      mxSetField(mesh, 0, catName[c], cat[c]);
+   }
+   mxFree(rowOf);
+   mxFree(slot);
+   return mesh;
+}
+
+static mxArray* readGmsh (const char* p, const char* end)
+{
+   GmshNodes    N;
+   GmshElements E;
+   GmshEntities ent;
+   double       version = 0.;
+   long long    ftype, dsize = 8;
+   int          binary = 0, haveNodes = 0, haveElements = 0, d;
+   char         name[64];
+
+   memset(&N, 0, sizeof(N));
+   memset(&E, 0, sizeof(E));
+   memset(&ent, 0, sizeof(ent));
+
+   while ( (p = skipSpace(p, end)) < end ){
+      const char* q = p;
+      size_t      len;
+      if ( *p != '$' ){ sprintf(gmshError, "ReadGmsh: unexpected data outside a section"); return NULL; }
+      p = nextLine(p, end);
+      len = (size_t)(p - q - 1);
+      while ( len > 0 && ( q[len] == '\n' || q[len] == '\r' || q[len] == ' ' ) ) len--;
+      len = ( len + 1 < sizeof(name) ) ? len : sizeof(name) - 2;
+      memcpy(name, q + 1, len);
+      name[len] = '\0';
+
+      if ( strcmp(name, "MeshFormat") == 0 ){
+         if ( (p = parseDouble(p, end, &version)) == NULL || (p = parseInt(p, end, &ftype)) == NULL ||
+              (p = parseInt(p, end, &dsize)) == NULL ) break;
+         binary = ( ftype == 1 );
+         p = nextLine(p, end);
+         if ( binary ){
+            const char* b = p;
+            if ( readBinInt(&b, end) != 1 ){
+               sprintf(gmshError, "ReadGmsh: binary file with a different byte order");
+               return NULL;
+            }
+            p = b;
+         }
+         if ( !( version >= 2. && version < 3. ) && !( version >= 4.1 && version < 5. ) ){
+            sprintf(gmshError, "ReadGmsh: msh format %g not supported (2.x and 4.1 are)", version);
+            return NULL;
+         }
+      }
+      else if ( version >= 4. && strcmp(name, "Entities") == 0 )
+         p = readEntities4(p, end, binary, (int) dsize, &ent);
+      else if ( strcmp(name, "Nodes") == 0 ){
+         p = ( version < 3. ) ? readNodes2(p, end, binary, &N) : readNodes4(p, end, binary, (int) dsize, &N);
+         haveNodes = 1;
+      }
+      else if ( strcmp(name, "Elements") == 0 ){
+         p = ( version < 3. ) ? readElements2(p, end, binary, &E)
+                              : readElements4(p, end, binary, (int) dsize, &ent, &E);
+         haveElements = 1;
+      }
+      if ( p == NULL ){
+         sprintf(gmshError, "ReadGmsh: cannot read the $%s section", name);
+         return NULL;
+      }
+      /* skip to the end of the section (the whole section if unknown) */
+      if ( (p = findEnd(p, end, name)) == NULL ){
+         sprintf(gmshError, "ReadGmsh: $End%s missing", name);
+         return NULL;
+      }
+   }
+   if ( version == 0. || !haveNodes ){
+      sprintf(gmshError, "ReadGmsh: no $MeshFormat or $Nodes section");
+      return NULL;
+   }
+   if ( !haveElements ) allocElements(&E, 0, 0), E.off[0] = 0;
+   for(d = 0; d < 4; d++) if ( ent.phys[d] ) mxFree(ent.phys[d]);
+   return buildMesh(&N, &E);
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Read a Gmsh mesh file.
+	//
+	// We expect the function to be called as :
+        // mesh = ReadGmsh(filename)
+        //
+        // Formats 2.x and 4.1, ASCII and binary. mesh has the fields of
+        // load_gmsh.m: MIN, MAX, nbNod, POS (nbNod x 3), nbElm, ELE_INFOS
+        // ([id type ntags physical tag]), ELE_TAGS (the other tags) and
+        // POINTS, LINES, TRIANGLES, QUADS, TETS, HEXAS, PRISMS, PYRAMIDS with
+        // nbPoints ... rows (node numbers 1..nbNod in file order, last column
+        // the physical tag). For format 4.1 the physical tag of an element is
+        // the first physical tag of its entity and ELE_TAGS is the entity.
+        //
+        // The file is memory-mapped; node and element lines of ASCII files are
+        // located first and then parsed in parallel with OpenMP.
+        */
+   char       *filename;
+   MappedFile  f;
+   mxArray    *mesh;
+
+   if ( nrhs != 1 || !mxIsChar(prhs[0]) )
+      mexErrMsgTxt("ReadGmsh: expected (filename)");
+
+   filename = mxArrayToString(prhs[0]);
+   if ( !mapFile(filename, &f) ){
+      char msg[512];
+      sprintf(msg, "ReadGmsh: cannot open %.400s", filename);
+      mxFree(filename);
+      mexErrMsgTxt(msg);
+   }
+   mxFree(filename);
+   gmshError[0] = '\0';
+   mesh = readGmsh(f.data, f.data + f.size);
+   unmapFile(&f);
+   if ( mesh == NULL ) mexErrMsgTxt(gmshError);
+   plhs[0] = mesh;
+}
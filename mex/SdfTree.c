@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" SdfTree.c
+ */
+
+#define SDF_NPAR  6        /* parameters per instruction */
+#define SDF_BATCH 1024     /* points evaluated together */
+
+/* instruction codes, see sdfOp.m */
+enum { SDF_CIRCLE = 1, SDF_RECTANGLE = 2, SDF_LINE = 3, SDF_SPHERE = 4, SDF_BOX = 5,
+       SDF_UNION = 11, SDF_INTERSECT = 12, SDF_DIFF = 13 };
+
+typedef struct {
+   int           nop;
+   const double* code;     /* nop x (1+SDF_NPAR), postfix order */
+   int           depth;    /* stack size needed by the program */
+   int           nsd;      /* 3 if the program has a sphere or a box */
+} Program;
+
+typedef struct {
+   double* x;              /* n x (nsd+2): coordinates, volume, level */
+   long    n, cap;
+} Particles;
+
+static double par (const Program* pg, int i, int k)
+{
+   return pg->code[i + pg->nop*(k+1)];
+}
+
+static void checkProgram (Program* pg)
+/*
+ * validates the instructions and computes the stack size
+ */
+{
+   int i, sp = 0, op;
+
+   pg->depth = 0;
+   pg->nsd   = 2;
+   for(i = 0; i < pg->nop; i++){
+      op = (int) pg->code[i];
+      switch ( op ){
+         case SDF_SPHERE: case SDF_BOX:
+            pg->nsd = 3;
+            /* fall through */
+         case SDF_CIRCLE: case SDF_RECTANGLE: case SDF_LINE:
+            sp++;
+            break;
+         case SDF_UNION: case SDF_INTERSECT: case SDF_DIFF:
+            if ( sp < 2 ) mexErrMsgTxt("SdfTree: combinator with less than two operands");
+            sp--;
+            break;
+         default:
+            mexErrMsgTxt("SdfTree: unknown instruction (build the tree with sdfOp)");
+      }
+      if ( op == SDF_LINE && par(pg,i,0) == par(pg,i,2) && par(pg,i,1) == par(pg,i,3) )
+         mexErrMsgTxt("SdfTree: line with coincident points");
+      if ( sp > pg->depth ) pg->depth = sp;
+   }
+   if ( sp != 1 ) mexErrMsgTxt("SdfTree: the program must leave exactly one distance");
+}
+
+static void evalBatch (const Program* pg, const double* p, long ld, int n, double* stack, double* d)
+/*
+ * distance d (last column of the PolyMesher functions) of the n points
+ * p[i + ld*k], instruction by instruction over the whole batch
+ */
+{
+   const double *x = p, *y = p + ld, *z = p + 2*ld;
+   double       *s, *t, a0, a1, a2, a3, a4, a5, nx, ny, len;
+   int           i, j, sp = 0;
+
+   for(i = 0; i < pg->nop; i++){
+      s  = stack + (long) sp*SDF_BATCH;
+      a0 = par(pg,i,0); a1 = par(pg,i,1); a2 = par(pg,i,2);
+      a3 = par(pg,i,3); a4 = par(pg,i,4); a5 = par(pg,i,5);
+      switch ( (int) pg->code[i] ){
+         case SDF_CIRCLE:
+            for(j = 0; j < n; j++) s[j] = sqrt((x[j]-a0)*(x[j]-a0) + (y[j]-a1)*(y[j]-a1)) - a2;
+            sp++;
+            break;
+         case SDF_SPHERE:
+            for(j = 0; j < n; j++)
+               s[j] = sqrt((x[j]-a0)*(x[j]-a0) + (y[j]-a1)*(y[j]-a1) + (z[j]-a2)*(z[j]-a2)) - a3;
+            sp++;
+            break;
+         case SDF_RECTANGLE:
+            for(j = 0; j < n; j++){
+               double m = fmax(a0 - x[j], x[j] - a1);
+               s[j] = fmax(m, fmax(a2 - y[j], y[j] - a3));
+            }
+            sp++;
+            break;
+         case SDF_BOX:
+            for(j = 0; j < n; j++){
+               double m = fmax(fmax(a0 - x[j], x[j] - a1), fmax(a2 - y[j], y[j] - a3));
+               s[j] = fmax(m, fmax(a4 - z[j], z[j] - a5));
+            }
+            sp++;
+            break;
+         case SDF_LINE:
+            /* negative on the left hand side of (x1,y1) -> (x2,y2) */
+            len = sqrt((a2-a0)*(a2-a0) + (a3-a1)*(a3-a1));
+            nx  = (a2-a0)/len; ny = (a3-a1)/len;
+            for(j = 0; j < n; j++) s[j] = (x[j]-a0)*ny - (y[j]-a1)*nx;
+            sp++;
+            break;
+         case SDF_UNION:
+            s -= 2*SDF_BATCH; t = s + SDF_BATCH;
+            for(j = 0; j < n; j++) s[j] = fmin(s[j], t[j]);
+            sp--;
+            break;
+         case SDF_INTERSECT:
+            s -= 2*SDF_BATCH; t = s + SDF_BATCH;
+            for(j = 0; j < n; j++) s[j] = fmax(s[j], t[j]);
+            sp--;
+            break;
+         case SDF_DIFF:
+            s -= 2*SDF_BATCH; t = s + SDF_BATCH;
+            for(j = 0; j < n; j++) s[j] = fmax(s[j], -t[j]);
+            sp--;
+            break;
+      }
+   }
+   memcpy(d, stack, n*sizeof(double));
+}
+
+static void emit (Particles* out, int nsd, const double* x, double vol, int level)
+{
+   int k;
+
+   if ( out->n == out->cap ){
+      out->cap = out->cap ? 2*out->cap : 16;
+      out->x   = (double*) realloc(out->x, out->cap*(nsd+2)*sizeof(double));
+   }
+   for(k = 0; k < nsd; k++) out->x[out->n*(nsd+2) + k] = x[k];
+   out->x[out->n*(nsd+2) + nsd]     = vol;
+   out->x[out->n*(nsd+2) + nsd + 1] = level;
+   out->n++;
+}
+
+static void sampleRoot (const Program* pg, int nsd, const double* org, const double* h,
+                        const long* nmax, const long* root, int levels, int adaptive,
+                        double* stack, Particles* out)
+/*
+ * particles of the root cell root (cell size h*2^levels), refined level by
+ * level: the SDF is evaluated at the centres of all cells of a level at
+ * once. The PolyMesher distances are 1-Lipschitz lower bounds of the true
+ * distance, so a cell whose centre is farther than its half diagonal from
+ * the boundary is entirely inside (leaves emitted without evaluation, or a
+ * single particle if adaptive) or entirely outside (dropped). Only the cells
+ * cut by the boundary are split, down to the leaves of size h. Leaves
+ * outside the nmax[k] leaves of the bbox are skipped: children past it are
+ * not created, and an inside cell reaching past it is split (adaptive) or
+ * only emits its leaves within the bbox
+ */
+{
+   long   *cur, *next, ncur = 1, nnext, ccur = 1, cnext = 0, c, m, nleaf;
+   double  p[3*SDF_BATCH], d[SDF_BATCH], x[3], hl[3], vleaf = 1., diag = 0.;
+   int     l, k, b, nb, ch, nch = 1 << nsd, partial;
+
+   for(k = 0; k < nsd; k++){ vleaf *= h[k]; diag += h[k]*h[k]; }
+   diag = 0.5*sqrt(diag);
+
+   /* room for the leaves of the root cell, up to 4096 particles */
+   out->cap = ( nsd*levels < 12 ) ? 1L << (nsd*levels) : 4096;
+   out->x   = (double*) malloc(out->cap*(nsd+2)*sizeof(double));
+   cur      = (long*) malloc(3*sizeof(long));
+   next     = NULL;
+   for(k = 0; k < 3; k++) cur[k] = ( k < nsd ) ? root[k] : 0;
+
+   for(l = levels; l >= 0 && ncur > 0; l--){
+      nleaf = 1L << l;
+      for(k = 0; k < nsd; k++) hl[k] = h[k]*nleaf;
+      if ( l > 0 && cnext < ncur*nch ){
+         cnext = ncur*nch;
+         next  = (long*) realloc(next, cnext*3*sizeof(long));
+      }
+      nnext = 0;
+      for(b = 0; (long) b*SDF_BATCH < ncur; b++){
+         nb = ( ncur - (long) b*SDF_BATCH < SDF_BATCH ) ? (int)( ncur - (long) b*SDF_BATCH ) : SDF_BATCH;
+         for(m = 0; m < nb; m++){
+            c = (long) b*SDF_BATCH + m;
+            for(k = 0; k < nsd; k++) p[m + SDF_BATCH*k] = org[k] + ( cur[3*c+k] + 0.5 )*hl[k];
+         }
+         evalBatch(pg, p, SDF_BATCH, nb, stack, d);
+         for(m = 0; m < nb; m++){
+            c = (long) b*SDF_BATCH + m;
+            for(k = 0; k < nsd; k++) x[k] = p[m + SDF_BATCH*k];
+            partial = 0;
+            for(k = 0; k < nsd; k++) if ( (cur[3*c+k] + 1)*nleaf > nmax[k] ) partial = 1;
+            if ( l == 0 ){
+               if ( d[m] < 0. ) emit(out, nsd, x, vleaf, 0);
+            }
+            else if ( d[m] <= -diag*nleaf && !( adaptive && partial ) ){
+               if ( adaptive ) emit(out, nsd, x, vleaf*pow((double) nleaf, nsd), l);
+               else {
+                  long i0, i1, i2, n2 = ( nsd == 3 ) ? nleaf : 1;
+                  for(i2 = 0; i2 < n2; i2++)
+                     for(i1 = 0; i1 < nleaf; i1++)
+                        for(i0 = 0; i0 < nleaf; i0++){
+                           if ( cur[3*c]*nleaf + i0 >= nmax[0] || cur[3*c+1]*nleaf + i1 >= nmax[1] ||
+                                ( nsd == 3 && cur[3*c+2]*nleaf + i2 >= nmax[2] ) ) continue;
+                           x[0] = org[0] + ( cur[3*c]*nleaf + i0 + 0.5 )*h[0];
+                           x[1] = org[1] + ( cur[3*c+1]*nleaf + i1 + 0.5 )*h[1];
+                           if ( nsd == 3 ) x[2] = org[2] + ( cur[3*c+2]*nleaf + i2 + 0.5 )*h[2];
+                           emit(out, nsd, x, vleaf, 0);
+                        }
+               }
+            }
+            else if ( d[m] < diag*nleaf ){
+               for(ch = 0; ch < nch; ch++){
+                  int in = 1;
+                  for(k = 0; k < 3; k++){
+                     next[3*nnext+k] = ( k < nsd ) ? 2*cur[3*c+k] + ((ch >> k) & 1) : 0;
+                     if ( k < nsd && next[3*nnext+k]*(nleaf/2) >= nmax[k] ) in = 0;
+                  }
+                  nnext += in;
+               }
+            }
+         }
+      }
+      /* the children are the cells of the next level */
+      {
+         long* tmp = cur; cur = next; next = tmp;
+         long  ct  = ccur; ccur = cnext; cnext = ct;
+         ncur = nnext;
+      }
+   }
+   free(cur);
+   free(next);
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Signed distance expression trees.
+	//
+	// We expect the function to be called as :
+        // d = SdfTree('eval',tree,P)
+        // [xp,vp,level] = SdfTree('sample',tree,bbox,h)
+        // [xp,vp,level] = SdfTree('sample',tree,bbox,h,levels,adaptive)
+        //
+        // tree   : postfix program built with sdfOp, one instruction per row
+        //          [code p1 .. p6]; the primitives dCircle, dRectangle, dLine
+        //          (and sphere, box in 3D) push a distance, dUnion (min),
+        //          dIntersect (max) and dDiff (max(d1,-d2)) combine the two
+        //          last ones as the PolyMesher functions
+        // P      : np x nsd points, d is the np x 1 distance (the last column
+        //          of the PolyMesher functions); evaluated by batches of
+        //          points in parallel with OpenMP
+        // bbox   : [xmin xmax ymin ymax (zmin zmax)], h the particle spacing
+        //          (scalar or one per direction), particles are the centres
+        //          of the cells of size h, with origin bbox(1:2:end), inside
+        //          the domain (d < 0) as generateMP's 'sdf' geometry
+        // levels : depth of the quadtree/octree (default: root cells of about
+        //          8 leaves, at least); only the cells cut by the boundary
+        //          are refined, cells inside give their leaves directly
+        // adaptive : 1 to give a single particle per cell inside the domain
+        //          (volume of the cell, level > 0) instead of the leaves
+        //
+        // xp (np x nsd), vp (np x 1) and level (np x 1) are ordered by root
+        // cell, root cells are sampled in parallel.
+        */
+   char     mode[16];
+   Program  pg;
+
+   if ( nrhs < 3 || !mxIsChar(prhs[0]) )
+      mexErrMsgTxt("SdfTree: expected ('eval', tree, P) or ('sample', tree, bbox, h[, levels, adaptive])");
+   mxGetString(prhs[0], mode, sizeof(mode));
+
+   if ( !mxIsDouble(prhs[1]) || mxGetN(prhs[1]) != 1 + SDF_NPAR || mxGetM(prhs[1]) == 0 )
+      mexErrMsgTxt("SdfTree: tree must be a nop x 7 program (sdfOp)");
+   pg.nop  = (int) mxGetM(prhs[1]);
+   pg.code = mxGetPr(prhs[1]);
+   checkProgram(&pg);
+
+   if ( strcmp(mode, "eval") == 0 ){
+      const double *P;
+      double       *d;
+      long          np, b;
+
+      if ( !mxIsDouble(prhs[2]) || (int) mxGetN(prhs[2]) < pg.nsd )
+         mexErrMsgTxt("SdfTree: P must be np x nsd (double)");
+      np      = (long) mxGetM(prhs[2]);
+      P       = mxGetPr(prhs[2]);
+      plhs[0] = mxCreateDoubleMatrix(np, 1, mxREAL);
+      d       = mxGetPr(plhs[0]);
+      #pragma omp parallel
+      {
+         double *stack = (double*) malloc(pg.depth*SDF_BATCH*sizeof(double));
+         #pragma omp for
+         for(b = 0; b < ( np + SDF_BATCH - 1 )/SDF_BATCH; b++){
+            long o = b*SDF_BATCH;
+            int  n = ( np - o < SDF_BATCH ) ? (int)( np - o ) : SDF_BATCH;
+            evalBatch(&pg, P + o, np, n, stack, d + o);
+         }
+         free(stack);
+      }
+   }
+   else if ( strcmp(mode, "sample") == 0 ){
+      Particles *roots;
+      double     org[3] = {0., 0., 0.}, h[3] = {1., 1., 1.}, *xp, *vp, *lv;
+      long       nr[3] = {1, 1, 1}, nmax[3] = {1, 1, 1}, nroot = 1, *off, np, r;
+      int        nsd, levels = -1, adaptive = 0, k;
+
+      if ( nrhs < 4 ) mexErrMsgTxt("SdfTree: expected ('sample', tree, bbox, h[, levels, adaptive])");
+      nsd = ( mxGetNumberOfElements(prhs[2]) >= 6 ) ? 3 : 2;
+      if ( mxGetNumberOfElements(prhs[2]) < 4 ) mexErrMsgTxt("SdfTree: bbox must be [xmin xmax ymin ymax (zmin zmax)]");
+      if ( pg.nsd > nsd ) mexErrMsgTxt("SdfTree: 3D tree with a 2D bbox");
+      if ( nrhs > 4 && !mxIsEmpty(prhs[4]) ) levels = (int) mxGetScalar(prhs[4]);
+      if ( nrhs > 5 && !mxIsEmpty(prhs[5]) ) adaptive = mxGetScalar(prhs[5]) != 0.;
+      for(k = 0; k < nsd; k++){
+         mwSize m = mxGetNumberOfElements(prhs[3]);
+         org[k] = mxGetPr(prhs[2])[2*k];
+         h[k]   = mxGetPr(prhs[3])[ m > (mwSize) k ? k : 0 ];
+         if ( h[k] <= 0. ) mexErrMsgTxt("SdfTree: h must be positive");
+      }
+      if ( levels < 0 ){
+         /* root cells of about 8 leaves along the shortest side */
+         double nmin = DBL_MAX;
+         for(k = 0; k < nsd; k++){
+            double nk = ( mxGetPr(prhs[2])[2*k+1] - org[k] )/h[k];
+            if ( nk < nmin ) nmin = nk;
+         }
+         levels = ( nmin > 16. ) ? (int) floor(log2(nmin/8.)) : 0;
+      }
+      if ( levels > 20 ) mexErrMsgTxt("SdfTree: too many levels");
+      for(k = 0; k < nsd; k++){
+         double ext = mxGetPr(prhs[2])[2*k+1] - org[k];
+         nmax[k] = (long) ceil(ext/h[k] - 1e-12);
+         if ( nmax[k] < 1 ) nmax[k] = 1;
+         nr[k]   = ( nmax[k] + (1L << levels) - 1 ) >> levels;
+         nroot *= nr[k];
+      }
+
+      roots = (Particles*) mxCalloc(nroot, sizeof(Particles));
+      off   = (long*) mxMalloc((nroot+1)*sizeof(long));
+      #pragma omp parallel
+      {
+         double *stack = (double*) malloc(pg.depth*SDF_BATCH*sizeof(double));
+         long    ri[3];
+         #pragma omp for schedule(dynamic,4)
+         for(r = 0; r < nroot; r++){
+            ri[0] = r % nr[0];
+            ri[1] = ( r / nr[0] ) % nr[1];
+            ri[2] = r / ( nr[0]*nr[1] );
+            sampleRoot(&pg, nsd, org, h, nmax, ri, levels, adaptive, stack, roots + r);
+            off[r+1] = roots[r].n;
+         }
+         free(stack);
+      }
+      off[0] = 0;
+      for(r = 0; r < nroot; r++) off[r+1] += off[r];
+      np = off[nroot];
+
+      plhs[0] = mxCreateDoubleMatrix(np, nsd, mxREAL);
+      plhs[1] = mxCreateDoubleMatrix(np, 1, mxREAL);
+      plhs[2] = mxCreateDoubleMatrix(np, 1, mxREAL);
+      xp      = mxGetPr(plhs[0]);
+      vp      = mxGetPr(plhs[1]);
+      lv      = mxGetPr(plhs[2]);
+      #pragma omp parallel for
+      for(r = 0; r < nroot; r++){
+         long i, o = off[r];
+         int  kk;
+         for(i = 0; i < roots[r].n; i++){
+            const double* x = roots[r].x + i*(nsd+2);
+            for(kk = 0; kk < nsd; kk++) xp[o + i + np*kk] = x[kk];
+            vp[o + i] = x[nsd];
+            lv[o + i] = x[nsd+1];
+         }
+         free(roots[r].x);
+      }
+      mxFree(roots);
+      mxFree(off);
+   }
+   else
+      mexErrMsgTxt("SdfTree: mode must be 'eval' or 'sample'");
+}
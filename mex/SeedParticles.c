@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" SeedParticles.c
+ */
+
+#define SEED_MAX_PPC 8
+
+enum { SHAPE_ALL, SHAPE_BOX, SHAPE_CIRCLE, SHAPE_POLYGON };
+
+typedef struct {
+   int           type;
+   int           nsd;
+   const double* g;        /* box [xmin xmax ymin ymax ..], circle [xc yc (zc) r] */
+   int           nv;       /* polygon: nv x 2 vertices */
+   double        lo[3], hi[3];
+} Shape;
+
+/* Gauss-Legendre points and weights on [-1,1] */
+static const double glX[SEED_MAX_PPC][SEED_MAX_PPC] = {
+   { 0. },
+   { -0.577350269189626, 0.577350269189626 },
+   { -0.774596669241483, 0., 0.774596669241483 },
+   { -0.861136311594053, -0.339981043584856, 0.339981043584856, 0.861136311594053 },
+   { -0.906179845938664, -0.538469310105683, 0., 0.538469310105683, 0.906179845938664 },
+   { -0.932469514203152, -0.661209386466265, -0.238619186083197, 0.238619186083197,
+      0.661209386466265, 0.932469514203152 },
+   { -0.949107912342759, -0.741531185599394, -0.405845151377397, 0., 0.405845151377397,
+      0.741531185599394, 0.949107912342759 },
+   { -0.960289856497536, -0.796666477413627, -0.525532409916329, -0.183434642495650,
+      0.183434642495650, 0.525532409916329, 0.796666477413627, 0.960289856497536 } };
+static const double glW[SEED_MAX_PPC][SEED_MAX_PPC] = {
+   { 2. },
+   { 1., 1. },
+   { 0.555555555555556, 0.888888888888889, 0.555555555555556 },
+   { 0.347854845137454, 0.652145154862546, 0.652145154862546, 0.347854845137454 },
+   { 0.236926885056189, 0.478628670499366, 0.568888888888889, 0.478628670499366, 0.236926885056189 },
+   { 0.171324492379170, 0.360761573048139, 0.467913934850852, 0.467913934850852,
+     0.360761573048139, 0.171324492379170 },
+   { 0.129484966168870, 0.279705391489277, 0.381830050505119, 0.417959183673469,
+     0.381830050505119, 0.279705391489277, 0.129484966168870 },
+   { 0.101228536290376, 0.222381034453374, 0.313706645877887, 0.362683783378362,
+     0.362683783378362, 0.313706645877887, 0.222381034453374, 0.101228536290376 } };
+
+static unsigned long long splitmix64 (unsigned long long* s)
+/*
+ * counter based generator: the jitter of a cell only depends on the seed
+ * and the cell, not on the threads
+ */
+{
+   unsigned long long z = (*s += 0x9E3779B97F4A7C15ULL);
+   z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+   z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+   return z ^ (z >> 31);
+}
+
+static double uniform (unsigned long long* s)
+{
+   return (double)(splitmix64(s) >> 11)*(1.0/9007199254740992.0);
+}
+
+static int inside (const Shape* sh, const double* x)
+{
+   int    d, i, j, c = 0;
+   double r2 = 0.;
+
+   switch ( sh->type ){
+      case SHAPE_BOX:
+         for(d = 0; d < sh->nsd; d++)
+            if ( !( x[d] > sh->g[2*d] && x[d] < sh->g[2*d+1] ) ) return 0;
+         return 1;
+      case SHAPE_CIRCLE:
+         for(d = 0; d < sh->nsd; d++) r2 += (x[d] - sh->g[d])*(x[d] - sh->g[d]);
+         return r2 < sh->g[sh->nsd]*sh->g[sh->nsd];
+      case SHAPE_POLYGON:
+         /* crossing number */
+         for(i = 0, j = sh->nv - 1; i < sh->nv; j = i++){
+            double xi = sh->g[i], yi = sh->g[i + sh->nv], xj = sh->g[j], yj = sh->g[j + sh->nv];
+            if ( ( yi > x[1] ) != ( yj > x[1] ) && x[0] < (xj - xi)*(x[1] - yi)/(yj - yi) + xi ) c = !c;
+         }
+         return c;
+      default:
+         return 1;
+   }
+}
+
+static int cellParticles (const Shape* sh, int nsd, const double* org, const double* h,
+                          const mwSize* ci, mwSize cellId, int nq, const double* ref,
+                          const double* frac, const int* ppc, double jitter,
+                          unsigned long long seed, double* x, double* v)
+/*
+ * particles of the cell ci (reference points ref, volume fractions frac),
+ * kept if inside the shape; x (nq x nsd) and v receive them when not NULL
+ */
+{
+   unsigned long long s = seed ^ ( (unsigned long long) cellId*0xD1B54A32D192ED03ULL );
+   double             p[3], vcell = 1.;
+   int                q, d, n = 0;
+
+   for(d = 0; d < nsd; d++) vcell *= h[d];
+   for(q = 0; q < nq; q++){
+      for(d = 0; d < nsd; d++){
+         double r = ref[q*nsd + d];
+         if ( jitter > 0. ) r += jitter*( uniform(&s) - 0.5 )/ppc[d];
+         p[d] = org[d] + ( ci[d] + r )*h[d];
+      }
+      if ( !inside(sh, p) ) continue;
+      if ( x ){
+         for(d = 0; d < nsd; d++) x[n*nsd + d] = p[d];
+         v[n] = frac[q]*vcell;
+      }
+      n++;
+   }
+   return n;
+}
+
+/* ------------------------------------------------------------------------ */
+/*  particles at the Gauss points of the elements of a mesh                 */
+/* ------------------------------------------------------------------------ */
+
+static void shapeFunctions (int nsd, int npe, const double* r, double* N, double* dN)
+/*
+ * N (npe) and dN (npe x nsd) of T3, Q4, T4 and H8 at r
+ */
+{
+   static const double q4[4][2] = { {-1,-1}, {1,-1}, {1,1}, {-1,1} };
+   static const double h8[8][3] = { {-1,-1,-1}, {1,-1,-1}, {1,1,-1}, {-1,1,-1},
+                                    {-1,-1, 1}, {1,-1, 1}, {1,1, 1}, {-1,1, 1} };
+   int a;
+
+   if ( nsd == 2 && npe == 3 ){
+      N[0] = 1. - r[0] - r[1]; N[1] = r[0]; N[2] = r[1];
+      dN[0] = -1.; dN[1] = 1.; dN[2] = 0.;
+      dN[3] = -1.; dN[4] = 0.; dN[5] = 1.;
+   }
+   else if ( nsd == 2 ){
+      for(a = 0; a < 4; a++){
+         N[a]     = 0.25*(1. + q4[a][0]*r[0])*(1. + q4[a][1]*r[1]);
+         dN[a]    = 0.25*q4[a][0]*(1. + q4[a][1]*r[1]);
+         dN[a+4]  = 0.25*q4[a][1]*(1. + q4[a][0]*r[0]);
+      }
+   }
+   else if ( npe == 4 ){
+      N[0] = 1. - r[0] - r[1] - r[2]; N[1] = r[0]; N[2] = r[1]; N[3] = r[2];
+      for(a = 0; a < 12; a++) dN[a] = 0.;
+      dN[0] = dN[4] = dN[8] = -1.;
+      dN[1] = dN[6] = dN[11] = 1.;
+   }
+   else{
+      for(a = 0; a < 8; a++){
+         double s0 = 1. + h8[a][0]*r[0], s1 = 1. + h8[a][1]*r[1], s2 = 1. + h8[a][2]*r[2];
+         N[a]      = 0.125*s0*s1*s2;
+         dN[a]     = 0.125*h8[a][0]*s1*s2;
+         dN[a+8]   = 0.125*h8[a][1]*s0*s2;
+         dN[a+16]  = 0.125*h8[a][2]*s0*s1;
+      }
+   }
+}
+
+static int elementRule (int nsd, int npe, int ppc, double* r, double* w)
+/*
+ * quadrature of the reference element, returns the number of points:
+ * Gauss ppc^nsd for Q4/H8, 1 or 3 points for T3 and 1 or 4 for T4
+ */
+{
+   int i, j, k, n = 0;
+
+   if ( nsd == 2 && npe == 3 ){
+      if ( ppc == 1 ){ r[0] = r[1] = 1./3.; w[0] = 0.5; return 1; }
+      r[0] = 1./6.; r[1] = 1./6.; r[2] = 2./3.; r[3] = 1./6.; r[4] = 1./6.; r[5] = 2./3.;
+      w[0] = w[1] = w[2] = 1./6.;
+      return 3;
+   }
+   if ( nsd == 3 && npe == 4 ){
+      const double a = 0.585410196624969, b = 0.138196601125011;
+      if ( ppc == 1 ){ r[0] = r[1] = r[2] = 0.25; w[0] = 1./6.; return 1; }
+      for(i = 0; i < 4; i++){
+         for(j = 0; j < 3; j++) r[3*i + j] = ( i == j + 1 ) ? a : b;
+         w[i] = 1./24.;
+      }
+      return 4;
+   }
+   for(k = 0; k < ( nsd == 3 ? ppc : 1 ); k++)
+      for(j = 0; j < ppc; j++)
+         for(i = 0; i < ppc; i++){
+            r[nsd*n]     = glX[ppc-1][i];
+            r[nsd*n + 1] = glX[ppc-1][j];
+            w[n]         = glW[ppc-1][i]*glW[ppc-1][j];
+            if ( nsd == 3 ){ r[nsd*n + 2] = glX[ppc-1][k]; w[n] *= glW[ppc-1][k]; }
+            n++;
+         }
+   return n;
+}
+
+static void meshParticles (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+   const double *node, *elem;
+   mwSize        nn, ne, np;
+   int           nsd, npe, ppc, nq;
+   double        r[SEED_MAX_PPC*SEED_MAX_PPC*SEED_MAX_PPC*3], w[SEED_MAX_PPC*SEED_MAX_PPC*SEED_MAX_PPC];
+   double       *xp, *vp, *ep;
+   long          e;
+   int           bad = 0;
+
+   if ( nrhs < 4 ) mexErrMsgTxt("SeedParticles: expected ('mesh', node, element, ppc)");
+   node = mxGetPr(prhs[1]);
+   nn   = mxGetM(prhs[1]);
+   nsd  = (int) mxGetN(prhs[1]);
+   elem = mxGetPr(prhs[2]);
+   ne   = mxGetM(prhs[2]);
+   npe  = (int) mxGetN(prhs[2]);
+   ppc  = (int) mxGetScalar(prhs[3]);
+   if ( !( ( nsd == 2 && ( npe == 3 || npe == 4 ) ) || ( nsd == 3 && ( npe == 4 || npe == 8 ) ) ) )
+      mexErrMsgTxt("SeedParticles: mesh elements must be T3, Q4 (2D), T4 or H8 (3D)");
+   if ( ppc < 1 || ppc > SEED_MAX_PPC ) mexErrMsgTxt("SeedParticles: ppc must be 1..8");
+
+   nq = elementRule(nsd, npe, ppc, r, w);
+   np = ne*nq;
+   plhs[0] = mxCreateDoubleMatrix(np, nsd, mxREAL);
+   plhs[1] = mxCreateDoubleMatrix(np, 1, mxREAL);
+   plhs[2] = mxCreateDoubleMatrix(np, 1, mxREAL);
+   xp = mxGetPr(plhs[0]);
+   vp = mxGetPr(plhs[1]);
+   ep = mxGetPr(plhs[2]);
+
+   #pragma omp parallel for reduction(+:bad)
+   for(e = 0; e < (long) ne; e++){
+      double N[8], dN[24], J[9], X[24], det;
+      int    q, a, i, j;
+      for(a = 0; a < npe; a++){
+         mwSize id = (mwSize) elem[e + ne*a] - 1;
+         if ( id >= nn ){ bad++; id = 0; }
+         for(i = 0; i < nsd; i++) X[a + npe*i] = node[id + nn*i];
+      }
+      for(q = 0; q < nq; q++){
+         mwSize p = e*nq + q;
+         shapeFunctions(nsd, npe, r + nsd*q, N, dN);
+         /* J(i,j) = sum_a X(a,i) dN(a,j) */
+         for(i = 0; i < nsd; i++){
+            xp[p + np*i] = 0.;
+            for(a = 0; a < npe; a++) xp[p + np*i] += N[a]*X[a + npe*i];
+            for(j = 0; j < nsd; j++){
+               J[i + nsd*j] = 0.;
+               for(a = 0; a < npe; a++) J[i + nsd*j] += X[a + npe*i]*dN[a + npe*j];
+            }
+         }
+         det = ( nsd == 2 ) ? J[0]*J[3] - J[1]*J[2]
+             : J[0]*(J[4]*J[8] - J[7]*J[5]) - J[3]*(J[1]*J[8] - J[7]*J[2]) + J[6]*(J[1]*J[5] - J[4]*J[2]);
+         vp[p] = w[q]*fabs(det);
+         ep[p] = (double)(e + 1);
+      }
+   }
+   if ( bad ) mexErrMsgTxt("SeedParticles: element connectivity out of the node range");
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Seed particles in the cells of a structured grid or in a mesh.
+	//
+	// We expect the function to be called as :
+        // [xp,vp,cell] = SeedParticles('grid',org,h,nel,ppc,place,shape,geo[,jitter,seed])
+        // [xp,vp,elem] = SeedParticles('mesh',node,element,ppc)
+        //
+        // grid  : cells of size h (1 x nsd) of the grid with nel cells per
+        //         direction starting at org, cell numbering i + nelx*(j-1) as
+        //         buildGrid2D (mesh.numx).
+        // ppc   : particles per cell per direction (scalar or 1 x nsd, <= 8)
+        // place : 'regular' (centres of the ppc^nsd sub-cells), 'gauss'
+        //         (Gauss points of the cell, volume = weight*det J) or
+        //         'random' (sub-cell centres moved by up to jitter/2 of a
+        //         sub-cell, jitter in [0,1], default 1; seed default 0)
+        // shape : 'all', 'box' geo = [xmin xmax ymin ymax (zmin zmax)],
+        //         'circle' geo = [xc yc (zc) r] or 'polygon' geo = nv x 2
+        //         vertices. A particle is kept if it is strictly inside, as
+        //         generateMPForRectangle/Circle; only the cells covering the
+        //         bounding box of the shape are visited.
+        //
+        // mesh  : Gauss points of T3 (ppc 1 or 3), Q4, T4 (ppc 1 or 4) or H8
+        //         elements (ppc per direction), e.g. the TRIANGLES/TETS of a
+        //         Gmsh mesh, volume = weight*det J.
+        //
+        // The particles of every cell are counted first, the outputs are then
+        // allocated once and filled in parallel with OpenMP. The jitter of a
+        // cell only depends on the seed and the cell, not on the threads.
+        */
+   char          op[8], place[16], shape[16];
+   Shape         sh;
+   const double *org, *h, *dnel;
+   double        ref[SEED_MAX_PPC*SEED_MAX_PPC*SEED_MAX_PPC*3], frac[SEED_MAX_PPC*SEED_MAX_PPC*SEED_MAX_PPC];
+   double        jitter = 0., *xp, *vp, *cp;
+   int           nsd, ppc[3] = {1, 1, 1}, nq, d, i, j, k, q;
+   mwSize        nel[3] = {1, 1, 1}, lo[3] = {0, 0, 0}, hi[3] = {0, 0, 0}, nc[3] = {1, 1, 1};
+   mwSize        ncell, np, *off;
+   unsigned long long seed = 0;
+   long          c;
+
+   if ( nrhs < 1 || mxGetString(prhs[0], op, sizeof(op)) )
+      mexErrMsgTxt("SeedParticles: expected ('grid'|'mesh', ...)");
+   if ( strcmp(op, "mesh") == 0 ){
+      meshParticles(nlhs, plhs, nrhs, prhs);
+      return;
+   }
+   if ( strcmp(op, "grid") != 0 || nrhs < 8 )
+      mexErrMsgTxt("SeedParticles: expected ('grid', org, h, nel, ppc, place, shape, geo[, jitter, seed])");
+
+   org  = mxGetPr(prhs[1]);
+   h    = mxGetPr(prhs[2]);
+   dnel = mxGetPr(prhs[3]);
+   nsd  = (int) mxGetNumberOfElements(prhs[1]);
+   if ( nsd < 1 || nsd > 3 || mxGetNumberOfElements(prhs[2]) != (mwSize) nsd ||
+        mxGetNumberOfElements(prhs[3]) != (mwSize) nsd )
+      mexErrMsgTxt("SeedParticles: org, h and nel must have nsd = 1, 2 or 3 entries");
+   for(d = 0; d < nsd; d++){
+      mwSize m = mxGetNumberOfElements(prhs[4]);
+      nel[d] = (mwSize) dnel[d];
+      ppc[d] = (int) mxGetPr(prhs[4])[ m > (mwSize) d ? d : 0 ];
+      if ( ppc[d] < 1 || ppc[d] > SEED_MAX_PPC ) mexErrMsgTxt("SeedParticles: ppc must be 1..8");
+   }
+   if ( mxGetString(prhs[5], place, sizeof(place)) || mxGetString(prhs[6], shape, sizeof(shape)) )
+      mexErrMsgTxt("SeedParticles: place and shape must be strings");
+
+   /* reference points in [0,1]^nsd and volume fractions */
+   nq = 0;
+   for(k = 0; k < ( nsd > 2 ? ppc[2] : 1 ); k++)
+      for(j = 0; j < ( nsd > 1 ? ppc[1] : 1 ); j++)
+         for(i = 0; i < ppc[0]; i++){
+            int idx[3] = { i, j, k };
+            frac[nq] = 1.;
+            for(d = 0; d < nsd; d++){
+               if ( strcmp(place, "gauss") == 0 ){
+                  ref[nq*nsd + d] = 0.5*( glX[ppc[d]-1][idx[d]] + 1. );
+                  frac[nq]       *= 0.5*glW[ppc[d]-1][idx[d]];
+               }
+               else{
+                  ref[nq*nsd + d] = ( idx[d] + 0.5 )/ppc[d];
+                  frac[nq]       /= ppc[d];
+               }
+            }
+            nq++;
+         }
+   if ( strcmp(place, "random") == 0 ){
+      jitter = ( nrhs > 8 && !mxIsEmpty(prhs[8]) ) ? mxGetScalar(prhs[8]) : 1.;
+      seed   = ( nrhs > 9 ) ? (unsigned long long) mxGetScalar(prhs[9]) : 0ULL;
+      if ( jitter < 0. || jitter > 1. ) mexErrMsgTxt("SeedParticles: jitter must be in [0,1]");
+   }
+   else if ( strcmp(place, "regular") != 0 && strcmp(place, "gauss") != 0 )
+      mexErrMsgTxt("SeedParticles: place must be 'regular', 'gauss' or 'random'");
+
+   /* shape and its bounding box */
+   sh.nsd = nsd;
+   sh.g   = mxGetPr(prhs[7]);
+   sh.nv  = 0;
+   for(d = 0; d < nsd; d++){ sh.lo[d] = -DBL_MAX; sh.hi[d] = DBL_MAX; }
+   if ( strcmp(shape, "all") == 0 ) sh.type = SHAPE_ALL;
+   else if ( strcmp(shape, "box") == 0 ){
+      if ( mxGetNumberOfElements(prhs[7]) != (mwSize)(2*nsd) ) mexErrMsgTxt("SeedParticles: box geo is [xmin xmax ymin ymax (zmin zmax)]");
+      sh.type = SHAPE_BOX;
+      for(d = 0; d < nsd; d++){ sh.lo[d] = sh.g[2*d]; sh.hi[d] = sh.g[2*d+1]; }
+   }
+   else if ( strcmp(shape, "circle") == 0 || strcmp(shape, "sphere") == 0 ){
+      if ( mxGetNumberOfElements(prhs[7]) != (mwSize)(nsd + 1) ) mexErrMsgTxt("SeedParticles: circle geo is [xc yc (zc) r]");
+      sh.type = SHAPE_CIRCLE;
+      for(d = 0; d < nsd; d++){ sh.lo[d] = sh.g[d] - sh.g[nsd]; sh.hi[d] = sh.g[d] + sh.g[nsd]; }
+   }
+   else if ( strcmp(shape, "polygon") == 0 ){
+      if ( nsd != 2 || mxGetN(prhs[7]) != 2 ) mexErrMsgTxt("SeedParticles: polygon geo is nv x 2 (2D)");
+      sh.type = SHAPE_POLYGON;
+      sh.nv   = (int) mxGetM(prhs[7]);
+      for(q = 0; q < sh.nv; q++)
+         for(d = 0; d < 2; d++){
+            double x = sh.g[q + sh.nv*d];
+            if ( q == 0 || x < sh.lo[d] ) sh.lo[d] = x;
+            if ( q == 0 || x > sh.hi[d] ) sh.hi[d] = x;
+         }
+   }
+   else mexErrMsgTxt("SeedParticles: shape must be 'all', 'box', 'circle', 'sphere' or 'polygon'");
+
+   /* cells covering the bounding box */
+   ncell = 1;
+   for(d = 0; d < nsd; d++){
+      double a = floor(( sh.lo[d] - org[d] )/h[d]), b = floor(( sh.hi[d] - org[d] )/h[d]);
+      lo[d] = ( a <= 0. ) ? 0 : ( a >= (double) nel[d] ) ? nel[d] : (mwSize) a;
+      hi[d] = ( b < 0. ) ? 0 : ( b >= (double) nel[d] - 1. ) ? nel[d] - 1 : (mwSize) b;
+      nc[d] = ( hi[d] >= lo[d] && lo[d] < nel[d] ) ? hi[d] - lo[d] + 1 : 0;
+      ncell *= nc[d];
+   }
+
+   off = (mwSize*) mxMalloc((ncell+1)*sizeof(mwSize));
+   #pragma omp parallel for
+   for(c = 0; c < (long) ncell; c++){
+      mwSize ci[3];
+      ci[0] = lo[0] + c % nc[0];
+      ci[1] = lo[1] + ( c / nc[0] ) % nc[1];
+      ci[2] = lo[2] + c / ( nc[0]*nc[1] );
+      off[c+1] = cellParticles(&sh, nsd, org, h, ci, ci[0] + nel[0]*(ci[1] + nel[1]*ci[2]),
+                               nq, ref, frac, ppc, jitter, seed, NULL, NULL);
+   }
+   off[0] = 0;
+   for(c = 0; c < (long) ncell; c++) off[c+1] += off[c];
+   np = off[ncell];
+
+   plhs[0] = mxCreateDoubleMatrix(np, nsd, mxREAL);
+   plhs[1] = mxCreateDoubleMatrix(np, 1, mxREAL);
+   plhs[2] = mxCreateDoubleMatrix(np, 1, mxREAL);
+   xp = mxGetPr(plhs[0]);
+   vp = mxGetPr(plhs[1]);
+   cp = mxGetPr(plhs[2]);
+
+   #pragma omp parallel
+   {
+      double *x = (double*) malloc(nq*(nsd + 1)*sizeof(double)), *v = x + nq*nsd;
+      mwSize  ci[3], id, p;
+      int     n, m, dd;
+      #pragma omp for
+      for(c = 0; c < (long) ncell; c++){
+         if ( off[c+1] == off[c] ) continue;
+         ci[0] = lo[0] + c % nc[0];
+         ci[1] = lo[1] + ( c / nc[0] ) % nc[1];
+         ci[2] = lo[2] + c / ( nc[0]*nc[1] );
+         id    = ci[0] + nel[0]*(ci[1] + nel[1]*ci[2]);
+         n     = cellParticles(&sh, nsd, org, h, ci, id, nq, ref, frac, ppc, jitter, seed, x, v);
+         for(m = 0; m < n; m++){
+            p = off[c] + m;
+            for(dd = 0; dd < nsd; dd++) xp[p + np*dd] = x[m*nsd + dd];
+            vp[p] = v[m];
+            cp[p] = (double)(id + 1);
+         }
+      }
+      free(x);
+   }
+   mxFree(off);
+}
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+#include "util.h"
+#include "basis.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" TLMPM.c util.c basis.c
+ */
+
+typedef struct {
+   int               nsd;
+   mwSize            np, nodeCount;
+   const long long  *rowptr, *nodeptr, *entry;
+   const unsigned   *col, *row;
+   const double     *N, *dN;
+} Operator;
+
+static const mxArray* getOpField (const mxArray* op, const char* name)
+{
+   const mxArray* f = mxGetField(op, 0, name);
+   if ( f == NULL ) mexErrMsgTxt("TLMPM: expected an operator from TLMPM('build', X0, grid)");
+   return f;
+}
+
+static void getOperator (const mxArray* op, Operator* A)
+{
+   if ( !mxIsStruct(op) ) mexErrMsgTxt("TLMPM: expected an operator from TLMPM('build', X0, grid)");
+   A->nsd       = (int) mxGetScalar(getOpField(op, "nsd"));
+   A->nodeCount = (mwSize) mxGetScalar(getOpField(op, "nodeCount"));
+   A->rowptr    = (const long long*) mxGetData(getOpField(op, "rowptr"));
+   A->col       = (const unsigned*)  mxGetData(getOpField(op, "col"));
+   A->N         = mxGetPr(getOpField(op, "N"));
+   A->dN        = mxGetPr(getOpField(op, "dN"));
+   A->nodeptr   = (const long long*) mxGetData(getOpField(op, "nodeptr"));
+   A->entry     = (const long long*) mxGetData(getOpField(op, "entry"));
+   A->row       = (const unsigned*)  mxGetData(getOpField(op, "row"));
+   A->np        = mxGetNumberOfElements(getOpField(op, "rowptr")) - 1;
+   if ( !mxIsInt64(getOpField(op, "rowptr")) || !mxIsUint32(getOpField(op, "col")) ||
+        !mxIsInt64(getOpField(op, "nodeptr")) || !mxIsInt64(getOpField(op, "entry")) )
+      mexErrMsgTxt("TLMPM: corrupted operator, rebuild it with TLMPM('build', X0, grid)");
+}
+
+static const double* particleArray (const mxArray* a, const Operator* A, mwSize ncol, const char* msg)
+{
+   if ( !mxIsDouble(a) || mxGetM(a) != A->np || mxGetN(a) != ncol ) mexErrMsgTxt(msg);
+   return mxGetPr(a);
+}
+
+static const double* nodeArray (const mxArray* a, const Operator* A, mwSize ncol, const char* msg)
+{
+   if ( !mxIsDouble(a) || mxGetM(a) != A->nodeCount || mxGetN(a) != ncol ) mexErrMsgTxt(msg);
+   return mxGetPr(a);
+}
+
+static mxArray* buildOperator (const mxArray* X0, const mxArray* grid)
+/*
+ * basis functions and reference gradients of all particles, as CSR rows
+ * (one row per particle) and their transpose (one row per node, pointing
+ * to the entries of the particle rows)
+ */
+{
+   const char *names[] = {"nsd", "nodeCount", "degree", "rowptr", "col", "N", "dN", "nodeptr", "entry", "row"};
+   mxArray    *op, *rp, *cl, *fN, *fdN, *np_, *en, *rw;
+   double      h[3], org[3], *N, *dN;
+   long long  *rowptr, *nodeptr, *entry;
+   unsigned   *col, *row;
+   int         nsd, p, nel[3] = {1, 1, 1}, nn, outside = 0;
+   mwSize      np, nodeCount, nnz, I;
+   long        ip;
+
+   if ( !getBsplineGrid(grid, &nsd, h, nel, &p, org) )
+      mexErrMsgTxt("TLMPM: grid.degree must be 1, 2 or 3");
+   if ( mxGetField(grid, 0, "degree") == NULL ) p = 1;    /* linear hat functions of buildGrid2D/3D */
+   if ( !mxIsDouble(X0) || (int) mxGetN(X0) != nsd )
+      mexErrMsgTxt("TLMPM: X0 must be np x nsd (double), nsd as the grid");
+   np        = mxGetM(X0);
+   nodeCount = (mwSize)(nel[0]+p)*(nel[1]+p)*( nsd == 3 ? nel[2]+p : 1 );
+   nn        = ( nsd == 3 ) ? (p+1)*(p+1)*(p+1) : (p+1)*(p+1);
+   nnz       = np*nn;
+
+   rp  = mxCreateNumericMatrix(np+1, 1, mxINT64_CLASS, mxREAL);
+   cl  = mxCreateNumericMatrix(nnz, 1, mxUINT32_CLASS, mxREAL);
+   fN  = mxCreateDoubleMatrix(nnz, 1, mxREAL);
+   fdN = mxCreateDoubleMatrix(nnz, nsd, mxREAL);
+   np_ = mxCreateNumericMatrix(nodeCount+1, 1, mxINT64_CLASS, mxREAL);
+   en  = mxCreateNumericMatrix(nnz, 1, mxINT64_CLASS, mxREAL);
+   rw  = mxCreateNumericMatrix(nnz, 1, mxUINT32_CLASS, mxREAL);
+   rowptr  = (long long*) mxGetData(rp);
+   col     = (unsigned*)  mxGetData(cl);
+   N       = mxGetPr(fN);
+   dN      = mxGetPr(fdN);
+   nodeptr = (long long*) mxGetData(np_);
+   entry   = (long long*) mxGetData(en);
+   row     = (unsigned*)  mxGetData(rw);
+
+   {
+      const double* X = mxGetPr(X0);
+      #pragma omp parallel for reduction(+:outside)
+      for(ip = 0; ip < (long) np; ip++){
+         double x[3], f[64], df[3*64];
+         int    nodes[64], in, j;
+         long long e = (long long) ip*nn;
+         for(j = 0; j < nsd; j++){
+            x[j] = X[ip + np*j] - org[j];
+            if ( !( x[j] >= 0. && x[j] <= nel[j]*h[j] ) ) outside++;
+         }
+         computeBsplineBasisStencil (nsd, x, h, nel, p, nodes, f, df);
+         rowptr[ip+1] = e + nn;
+         for(in = 0; in < nn; in++){
+            col[e+in] = (unsigned) nodes[in];
+            N[e+in]   = f[in];
+            for(j = 0; j < nsd; j++) dN[e+in + nnz*j] = df[in*nsd+j];
+         }
+      }
+   }
+   if ( outside ) mexErrMsgTxt("TLMPM: particles outside the grid");
+
+   /* transpose by a counting sort of the entries on their node */
+   for(I = 0; I <= nodeCount; I++) nodeptr[I] = 0;
+   for(I = 0; I < nnz; I++) nodeptr[col[I]+1]++;
+   for(I = 0; I < nodeCount; I++) nodeptr[I+1] += nodeptr[I];
+   for(ip = 0; ip < (long) np; ip++){
+      long long e;
+      for(e = rowptr[ip]; e < rowptr[ip+1]; e++){
+         long long t = nodeptr[col[e]]++;
+         entry[t] = e;
+         row[t]   = (unsigned) ip;
+      }
+   }
+   for(I = nodeCount; I > 0; I--) nodeptr[I] = nodeptr[I-1];
+   nodeptr[0] = 0;
+
+   op = mxCreateStructMatrix(1, 1, 10, names);
+   mxSetField(op, 0, "nsd",       mxCreateDoubleScalar(nsd));
+   mxSetField(op, 0, "nodeCount", mxCreateDoubleScalar((double) nodeCount));
+   mxSetField(op, 0, "degree",    mxCreateDoubleScalar(p));
+   mxSetField(op, 0, "rowptr",    rp);
+   mxSetField(op, 0, "col",       cl);
+   mxSetField(op, 0, "N",         fN);
+   mxSetField(op, 0, "dN",        fdN);
+   mxSetField(op, 0, "nodeptr",   np_);
+   mxSetField(op, 0, "entry",     en);
+   mxSetField(op, 0, "row",       rw);
+   return op;
+}
+
+static void piolaStress (int nsd, const double* F, double lambda, double mu, double* P)
+/*
+ * first Piola-Kirchhoff stress of the compressible neo-Hookean material
+ * P = mu (F - F^-T) + lambda ln(J) F^-T, F and P stored column-wise
+ */
+{
+   double iFT[9], J;
+   int    i;
+
+   if ( nsd == 3 ){
+      J = F[0]*(F[4]*F[8] - F[7]*F[5]) - F[3]*(F[1]*F[8] - F[7]*F[2]) + F[6]*(F[1]*F[5] - F[4]*F[2]);
+      /* F^-T (i,j) = cofactor (i,j) / J */
+      iFT[0] = ( F[4]*F[8] - F[7]*F[5] )/J;
+      iFT[1] = ( F[5]*F[6] - F[3]*F[8] )/J;
+      iFT[2] = ( F[3]*F[7] - F[4]*F[6] )/J;
+      iFT[3] = ( F[7]*F[2] - F[1]*F[8] )/J;
+      iFT[4] = ( F[0]*F[8] - F[6]*F[2] )/J;
+      iFT[5] = ( F[6]*F[1] - F[0]*F[7] )/J;
+      iFT[6] = ( F[1]*F[5] - F[4]*F[2] )/J;
+      iFT[7] = ( F[2]*F[3] - F[0]*F[5] )/J;
+      iFT[8] = ( F[0]*F[4] - F[3]*F[1] )/J;
+   }
+   else{
+      J      = F[0]*F[3] - F[1]*F[2];
+      iFT[0] =  F[3]/J; iFT[1] = -F[2]/J;
+      iFT[2] = -F[1]/J; iFT[3] =  F[0]/J;
+   }
+   for(i = 0; i < nsd*nsd; i++) P[i] = mu*( F[i] - iFT[i] ) + lambda*log(J)*iFT[i];
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Total Lagrangian MPM transfers with a precomputed operator.
+	//
+	// We expect the function to be called as :
+        // op = TLMPM('build',X0,grid)
+        // [nmass,nmomentum,nforce] = TLMPM('p2g',op,mass,velo,P,volume0[,bforce])
+        // [velo,coord,nvelo] = TLMPM('g2p',op,nmass,nmomentum0,nmomentum,velo,coord,mass,dtime[,alpha])
+        // [F,P] = TLMPM('deform',op,nvelo,F,dtime[,lambda,mu])
+        //
+        // X0      : np x nsd reference (initial) particle positions, grid a
+        //           uniform grid as ParticlesToNodesBspline (buildGrid2D/3D
+        //           mesh with xmin, ymin, zmin if not at 0); grid.degree 1
+        //           (default, linear) to 3. The basis functions and their
+        //           gradients with respect to X0 are computed once and kept
+        //           in op as CSR rows (op.rowptr, 0-based op.col, op.N, op.dN)
+        //           with their transpose (op.nodeptr, op.entry, op.row)
+        // p2g     : nodal mass, momentum and force, nforce = -sum V0 P dN/dX
+        //           (+ sum N m b). P (and F) are np x nsd^2, stored column-wise
+        //           as the 'deform' field of the bodies; bforce np x nsd the
+        //           body force per unit mass
+        // g2p     : particle velocities (FLIP, alpha = 1 default, or PIC/FLIP
+        //           blending) and positions from the nodal momenta before and
+        //           after the time step; nvelo the nodal velocities of the
+        //           updated particle momenta (double mapping), 0 at the nodes
+        //           without mass, to apply the Dirichlet conditions to
+        // deform  : F += dtime grad_X(v), and with lambda, mu the first
+        //           Piola-Kirchhoff stress of the compressible neo-Hookean
+        //           material
+        //
+        // p2g gathers over the transposed rows, every node is summed by one
+        // thread; g2p and deform run over the particle rows in parallel.
+        */
+   char     mode[16];
+   Operator A;
+
+   if ( nrhs < 2 || !mxIsChar(prhs[0]) )
+      mexErrMsgTxt("TLMPM: expected ('build'|'p2g'|'g2p'|'deform', ...)");
+   mxGetString(prhs[0], mode, sizeof(mode));
+
+   if ( strcmp(mode, "build") == 0 ){
+      if ( nrhs != 3 || !mxIsStruct(prhs[2]) ) mexErrMsgTxt("TLMPM: expected ('build', X0, grid)");
+      plhs[0] = buildOperator(prhs[1], prhs[2]);
+      return;
+   }
+
+   getOperator(prhs[1], &A);
+
+   if ( strcmp(mode, "p2g") == 0 ){
+      const double *mass, *velo, *P, *vol0, *bf = NULL;
+      double       *nmass, *nmom, *nforce;
+      int           nsd = A.nsd;
+      long          I;
+
+      if ( nrhs < 6 ) mexErrMsgTxt("TLMPM: expected ('p2g', op, mass, velo, P, volume0[, bforce])");
+      mass = particleArray(prhs[2], &A, 1,       "TLMPM: mass must be np x 1");
+      velo = particleArray(prhs[3], &A, nsd,     "TLMPM: velo must be np x nsd");
+      P    = particleArray(prhs[4], &A, nsd*nsd, "TLMPM: P must be np x nsd^2");
+      vol0 = particleArray(prhs[5], &A, 1,       "TLMPM: volume0 must be np x 1");
+      if ( nrhs > 6 && !mxIsEmpty(prhs[6]) ) bf = particleArray(prhs[6], &A, nsd, "TLMPM: bforce must be np x nsd");
+
+      plhs[0] = mxCreateDoubleMatrix(A.nodeCount, 1, mxREAL);
+      plhs[1] = mxCreateDoubleMatrix(A.nodeCount, nsd, mxREAL);
+      plhs[2] = mxCreateDoubleMatrix(A.nodeCount, nsd, mxREAL);
+      nmass   = mxGetPr(plhs[0]);
+      nmom    = mxGetPr(plhs[1]);
+      nforce  = mxGetPr(plhs[2]);
+
+      #pragma omp parallel for schedule(dynamic,64)
+      for(I = 0; I < (long) A.nodeCount; I++){
+         double    m = 0., mv[3] = {0., 0., 0.}, f[3] = {0., 0., 0.}, Ni, w;
+         long long t, e, nnz = A.rowptr[A.np];
+         mwSize    ip;
+         int       i, j;
+         for(t = A.nodeptr[I]; t < A.nodeptr[I+1]; t++){
+            e  = A.entry[t];
+            ip = A.row[t];
+            Ni = A.N[e];
+            w  = Ni*mass[ip];
+            m += w;
+            for(i = 0; i < nsd; i++){
+               mv[i] += w*velo[ip + A.np*i];
+               for(j = 0; j < nsd; j++) f[i] -= vol0[ip]*P[ip + A.np*(i + nsd*j)]*A.dN[e + nnz*j];
+               if ( bf ) f[i] += w*bf[ip + A.np*i];
+            }
+         }
+         nmass[I] = m;
+         for(i = 0; i < nsd; i++){
+            nmom[I + A.nodeCount*i]   = mv[i];
+            nforce[I + A.nodeCount*i] = f[i];
+         }
+      }
+   }
+   else if ( strcmp(mode, "g2p") == 0 ){
+      const double *nmass, *nmom0, *nmom, *mass;
+      double       *velo, *coord, *nvelo, dtime, alpha = 1.;
+      int           nsd = A.nsd;
+      long          ip, I;
+
+      if ( nrhs < 9 ) mexErrMsgTxt("TLMPM: expected ('g2p', op, nmass, nmomentum0, nmomentum, velo, coord, mass, dtime[, alpha])");
+      nmass = nodeArray(prhs[2], &A, 1,   "TLMPM: nmass must be nodeCount x 1");
+      nmom0 = nodeArray(prhs[3], &A, nsd, "TLMPM: nmomentum0 must be nodeCount x nsd");
+      nmom  = nodeArray(prhs[4], &A, nsd, "TLMPM: nmomentum must be nodeCount x nsd");
+      particleArray(prhs[5], &A, nsd, "TLMPM: velo must be np x nsd");
+      particleArray(prhs[6], &A, nsd, "TLMPM: coord must be np x nsd");
+      mass  = particleArray(prhs[7], &A, 1, "TLMPM: mass must be np x 1");
+      dtime = mxGetScalar(prhs[8]);
+      if ( nrhs > 9 && !mxIsEmpty(prhs[9]) ) alpha = mxGetScalar(prhs[9]);
+
+      plhs[0] = mxDuplicateArray(prhs[5]);
+      plhs[1] = mxDuplicateArray(prhs[6]);
+      plhs[2] = mxCreateDoubleMatrix(A.nodeCount, nsd, mxREAL);
+      velo    = mxGetPr(plhs[0]);
+      coord   = mxGetPr(plhs[1]);
+      nvelo   = mxGetPr(plhs[2]);
+
+      #pragma omp parallel for
+      for(ip = 0; ip < (long) A.np; ip++){
+         double    dv[3] = {0., 0., 0.}, v[3] = {0., 0., 0.}, Ni;
+         long long e;
+         mwSize    J;
+         int       i;
+         for(e = A.rowptr[ip]; e < A.rowptr[ip+1]; e++){
+            J  = A.col[e];
+            Ni = A.N[e];
+            if ( nmass[J] <= 0. ) continue;
+            for(i = 0; i < nsd; i++){
+               dv[i] += Ni*( nmom[J + A.nodeCount*i] - nmom0[J + A.nodeCount*i] )/nmass[J];
+               v[i]  += Ni*nmom[J + A.nodeCount*i]/nmass[J];
+            }
+         }
+         for(i = 0; i < nsd; i++){
+            velo[ip + A.np*i]   = alpha*( velo[ip + A.np*i] + dv[i] ) + ( 1. - alpha )*v[i];
+            coord[ip + A.np*i] += dtime*v[i];
+         }
+      }
+
+      /* double mapping: nodal velocities of the updated particle momenta */
+      #pragma omp parallel for schedule(dynamic,64)
+      for(I = 0; I < (long) A.nodeCount; I++){
+         double    mv[3] = {0., 0., 0.};
+         long long t;
+         mwSize    q;
+         int       i;
+         if ( nmass[I] <= 0. ) continue;
+         for(t = A.nodeptr[I]; t < A.nodeptr[I+1]; t++){
+            q = A.row[t];
+            for(i = 0; i < nsd; i++) mv[i] += A.N[A.entry[t]]*mass[q]*velo[q + A.np*i];
+         }
+         for(i = 0; i < nsd; i++) nvelo[I + A.nodeCount*i] = mv[i]/nmass[I];
+      }
+   }
+   else if ( strcmp(mode, "deform") == 0 ){
+      const double *nvelo;
+      double       *F, *P = NULL, dtime, lambda = 0., mu = 0.;
+      int           nsd = A.nsd, material;
+      long          ip;
+
+      if ( nrhs < 5 ) mexErrMsgTxt("TLMPM: expected ('deform', op, nvelo, F, dtime[, lambda, mu])");
+      nvelo    = nodeArray(prhs[2], &A, nsd, "TLMPM: nvelo must be nodeCount x nsd");
+      particleArray(prhs[3], &A, nsd*nsd, "TLMPM: F must be np x nsd^2");
+      dtime    = mxGetScalar(prhs[4]);
+      material = ( nrhs > 6 );
+      if ( material ){ lambda = mxGetScalar(prhs[5]); mu = mxGetScalar(prhs[6]); }
+
+      plhs[0] = mxDuplicateArray(prhs[3]);
+      F       = mxGetPr(plhs[0]);
+      if ( material ){
+         plhs[1] = mxCreateDoubleMatrix(A.np, nsd*nsd, mxREAL);
+         P       = mxGetPr(plhs[1]);
+      }
+      else if ( nlhs > 1 ) mexErrMsgTxt("TLMPM: the stress needs lambda and mu");
+
+      #pragma omp parallel for
+      for(ip = 0; ip < (long) A.np; ip++){
+         double    Fp[9], Pp[9], Ni;
+         long long e, nnz = A.rowptr[A.np];
+         mwSize    J;
+         int       i, j;
+         for(i = 0; i < nsd*nsd; i++) Fp[i] = F[ip + A.np*i];
+         /* F(i,j) += dt v_i dN/dX_j */
+         for(e = A.rowptr[ip]; e < A.rowptr[ip+1]; e++){
+            J = A.col[e];
+            for(j = 0; j < nsd; j++){
+               Ni = dtime*A.dN[e + nnz*j];
+               for(i = 0; i < nsd; i++) Fp[i + nsd*j] += Ni*nvelo[J + A.nodeCount*i];
+            }
+         }
+         for(i = 0; i < nsd*nsd; i++) F[ip + A.np*i] = Fp[i];
+         if ( material ){
+            piolaStress(nsd, Fp, lambda, mu, Pp);
+            for(i = 0; i < nsd*nsd; i++) P[ip + A.np*i] = Pp[i];
+         }
+      }
+   }
+   else
+      mexErrMsgTxt("TLMPM: mode must be 'build', 'p2g', 'g2p' or 'deform'");
+}
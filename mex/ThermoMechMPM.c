@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+#include "util.h"
+#include "basis.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" ThermoMechMPM.c util.c basis.c
+ */
+
+static void heatCapacity (const BsplineGrid* g, const BasisCache* B, const double* mass,
+                          const double* cap, mwSize sc, const double* temp,
+                          double* ncap, double* nenergy)
+/*
+ * nodal heat capacity sum_p N_I m_p c_p and thermal energy sum_p N_I m_p c_p T_p
+ * of a body, added to ncap and nenergy
+ */
+{
+   int color, nn = g->nn;
+
+   for(color = 0; color < nn; color++){
+      int  off[3], cnt[3];
+      long t, tcount = colourCells(g, color, off, cnt);
+
+      #pragma omp parallel
+      {
+         int nodes[64];
+         #pragma omp for schedule(dynamic,4)
+         for(t = 0; t < tcount; t++){
+            mwSize cell = colourCell(g, off, cnt, t);
+            long   q;
+            int    in;
+            if ( B->start[cell+1] == B->start[cell] ) continue;
+            cellStencil(g, cell, nodes);
+            for(q = B->start[cell]; q < B->start[cell+1]; q++){
+               mwSize        ip = (mwSize) B->order[q];
+               const double *N  = B->N + nn*q;
+               double        mc = mass[ip]*cap[ip*sc], mcT = mc*temp[ip];
+               for(in = 0; in < nn; in++){
+                  ncap[nodes[in]]    += N[in]*mc;
+                  nenergy[nodes[in]] += N[in]*mcT;
+               }
+            }
+         }
+      }
+   }
+}
+
+static void heatFlux (const BsplineGrid* g, const BasisCache* B, const double* vol, const double* cond,
+                      mwSize sk, const double* mass, const double* src, mwSize sr,
+                      const double* ntemp, double* nheat)
+/*
+ * nodal heat rate sum_p V_p q_p . dN_I + N_I m_p r_p of a body, q_p = -k_p grad T
+ * interpolated from the nodal temperatures; every particle reads and writes
+ * the nodes of its cell stencil once
+ */
+{
+   int color, nsd = g->nsd, nn = g->nn;
+
+   for(color = 0; color < nn; color++){
+      int  off[3], cnt[3];
+      long t, tcount = colourCells(g, color, off, cnt);
+
+      #pragma omp parallel
+      {
+         int nodes[64];
+         #pragma omp for schedule(dynamic,4)
+         for(t = 0; t < tcount; t++){
+            mwSize cell = colourCell(g, off, cnt, t);
+            long   q;
+            int    in, d;
+            if ( B->start[cell+1] == B->start[cell] ) continue;
+            cellStencil(g, cell, nodes);
+            for(q = B->start[cell]; q < B->start[cell+1]; q++){
+               mwSize        ip = (mwSize) B->order[q];
+               const double *N  = B->N + nn*q, *dN = B->dN + nn*nsd*q;
+               double        grad[3] = {0., 0., 0.}, r;
+               for(in = 0; in < nn; in++)
+                  for(d = 0; d < nsd; d++) grad[d] += dN[in*nsd+d]*ntemp[nodes[in]];
+               for(d = 0; d < nsd; d++) grad[d] *= -vol[ip]*cond[ip*sk];      /* V q */
+               r = ( src != NULL ) ? mass[ip]*src[ip*sr] : 0.;
+               for(in = 0; in < nn; in++){
+                  double qdN = 0.;
+                  for(d = 0; d < nsd; d++) qdN += grad[d]*dN[in*nsd+d];
+                  nheat[nodes[in]] += qdN + N[in]*r;
+               }
+            }
+         }
+      }
+   }
+}
+
+static void fixTemperatures (const double* fixed, mwSize nfix, double* ntemp)
+{
+   mwSize i;
+   for(i = 0; i < nfix; i++) ntemp[(mwSize) fixed[i] - 1] = fixed[i+nfix];
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Coupled thermo-mechanical MPM transfers used with B-splines.
+	//
+	// We expect the function to be called as :
+        // [nmass,nmomenta,nforce,ntemp0,ntemp,cache] = ThermoMechMPM('p2g',bodies,grid,dtime[,thermal])
+        // ThermoMechMPM('g2p',bodies,grid,cache,nvelo,nacce,ntemp0,ntemp,dtime)
+        //
+        // bodies  : cell array {ib} or struct array (ib) with the fields of
+        //           ParticlesToNodesBspline and UpdateParticlesBspline, and
+        //           temp (temperature), capacity (specific heat) and
+        //           conductivity; optionally expansion (thermal expansion
+        //           coefficient, default 0), source (heat source per unit mass),
+        //           flux (np x nsd, filled with the heat flux -k grad T) and
+        //           tempFixed (np x 1 prescribed temperatures, NaN where free).
+        //           capacity, conductivity, expansion and source are scalars
+        //           or one value per particle
+        // grid    : uniform B-spline grid, see ParticlesToNodesBspline
+        // thermal : optional struct, substeps (explicit thermal sub-steps of
+        //           dtime/substeps per mechanical step, default 1) or dtime
+        //           (stable thermal time step, substeps = ceil(dtime/thermal.dtime)),
+        //           and fixed (k x 2 [node temperature], one-based nodes) the
+        //           Dirichlet temperatures
+        //
+        // p2g : nodal mass, momenta and forces as ParticlesToNodesBspline, and
+        //       the nodal temperatures at the beginning (ntemp0 = sum N m c T /
+        //       sum N m c) and at the end (ntemp) of the step, after the thermal
+        //       sub-steps c T_I += dt/substeps (sum V q.dN + N m r) on the grid
+        // g2p : particle positions, velocities, deformation gradients, strains
+        //       and stresses as UpdateParticlesBspline, with the thermal strain
+        //       expansion*dT removed from the strain increment of the stress,
+        //       and particle temperatures T += sum N (ntemp - ntemp0), or
+        //       T = tempFixed where it is prescribed, dT entering the thermal
+        //       strain either way (bodies are modified)
+        //
+        // The basis functions and gradients of every particle are evaluated once
+        // per step, by 'p2g', and kept in cache for the thermal sub-steps and
+        // 'g2p'. The mechanical Dirichlet conditions are applied to
+        // nvelo and nacce between the two calls, as with ParticlesToNodesBspline.
+        // Cells are processed in parallel, in (p+1)^nsd colours for the
+        // transfers to the grid.
+        */
+   const mxArray *bodies;
+   char           mode[8];
+   BsplineGrid    g;
+   mwSize         bodyCount, ib, in;
+   double         dtime;
+
+   if ( nrhs < 4 || !mxIsChar(prhs[0]) )
+      mexErrMsgTxt("ThermoMechMPM: expected ('p2g', bodies, grid, dtime[, thermal]) or "
+                   "('g2p', bodies, grid, cache, nvelo, nacce, ntemp0, ntemp, dtime)");
+   mxGetString(prhs[0], mode, sizeof(mode));
+   bodies    = prhs[1];
+   bodyCount = mxGetNumberOfElements(bodies);
+   if ( !getBsplineGridData(prhs[2], &g) )
+      mexErrMsgTxt("ThermoMechMPM: grid.degree must be 1, 2 or 3");
+
+   if ( strcmp(mode, "p2g") == 0 ){
+      static const char *names[] = {"start", "order", "N", "dN"};
+      const mxArray *thermal = ( nrhs > 4 && mxIsStruct(prhs[4]) ) ? prhs[4] : NULL;
+      const mxArray *fx      = ( thermal != NULL ) ? mxGetField(thermal, 0, "fixed") : NULL;
+      double        *nmass, *nmomenta, *nforce, *ntemp0, *ntemp, *ncap, *nheat, *fixed = NULL;
+      mwSize         nfix = 0;
+      int            substeps = 1, s;
+      mxArray       *cache;
+
+      dtime = mxGetScalar(prhs[3]);
+      if ( thermal != NULL ){
+         const mxArray *ns = mxGetField(thermal, 0, "substeps");
+         const mxArray *dt = mxGetField(thermal, 0, "dtime");
+         if ( ns != NULL )                        substeps = (int) mxGetScalar(ns);
+         else if ( dt != NULL && mxGetScalar(dt) > 0. ) substeps = (int) ceil(dtime/mxGetScalar(dt) - 1e-12);
+         if ( substeps < 1 ) substeps = 1;
+      }
+      if ( fx != NULL && !mxIsEmpty(fx) ){
+         if ( !mxIsDouble(fx) || mxGetN(fx) != 2 )
+            mexErrMsgTxt("ThermoMechMPM: thermal.fixed must be k x 2 [node temperature]");
+         fixed = mxGetPr(fx);
+         nfix  = mxGetM(fx);
+         for(in = 0; in < nfix; in++)
+            if ( fixed[in] < 1. || fixed[in] > (double) g.nodeCount )
+               mexErrMsgTxt("ThermoMechMPM: thermal.fixed has nodes outside the grid");
+      }
+
+      plhs[0] = mxCreateDoubleMatrix(g.nodeCount, 1,     mxREAL);
+      plhs[1] = mxCreateDoubleMatrix(g.nodeCount, g.nsd, mxREAL);
+      plhs[2] = mxCreateDoubleMatrix(g.nodeCount, g.nsd, mxREAL);
+      plhs[3] = mxCreateDoubleMatrix(g.nodeCount, 1,     mxREAL);
+      plhs[4] = mxCreateDoubleMatrix(g.nodeCount, 1,     mxREAL);
+      nmass    = mxGetPr(plhs[0]);
+      nmomenta = mxGetPr(plhs[1]);
+      nforce   = mxGetPr(plhs[2]);
+      ntemp0   = mxGetPr(plhs[3]);
+      ntemp    = mxGetPr(plhs[4]);
+      ncap     = (double*) mxCalloc(2*g.nodeCount, sizeof(double));
+      nheat    = ncap + g.nodeCount;
+      cache    = mxCreateStructMatrix(bodyCount, 1, 4, names);
+
+      for(ib = 0; ib < bodyCount; ib++){                  /* loop over bodies*/
+         mxArray *coordp = getBodyField(bodies, ib, "coord");
+         mxArray *grap   = getBodyField(bodies, ib, "gravity");
+         mwSize   particleCount = ( coordp != NULL ) ? mxGetM(coordp) : 0, sc;
+         double  *coord  = getBodyArray("ThermoMechMPM", bodies, ib, "coord",  particleCount, g.nsd);
+         double  *mass   = getBodyArray("ThermoMechMPM", bodies, ib, "mass",   particleCount, 1);
+         double  *vol    = getBodyArray("ThermoMechMPM", bodies, ib, "volume", particleCount, 1);
+         double  *velo   = getBodyArray("ThermoMechMPM", bodies, ib, "velo",   particleCount, g.nsd);
+         double  *stress = getBodyArray("ThermoMechMPM", bodies, ib, "stress", particleCount, g.nsd == 3 ? 6 : 3);
+         double  *temp   = getBodyArray("ThermoMechMPM", bodies, ib, "temp",   particleCount, 1);
+         double  *cap    = getBodyValues("ThermoMechMPM", bodies, ib, "capacity", particleCount, 1, &sc);
+         double   grav   = ( grap != NULL ) ? mxGetScalar(grap) : 0.;
+         BasisCache B;
+
+         buildBasisCache(&g, coord, particleCount, cache, ib);
+         getBasisCache(cache, ib, &g, particleCount, &B);
+         particlesToNodesCached(&g, &B, mass, vol, NULL, velo, stress, grav, nmass, nmomenta, nforce);
+         heatCapacity(&g, &B, mass, cap, sc, temp, ncap, ntemp0);
+      }
+
+      /* nodal temperatures, then the explicit thermal sub-steps on the grid */
+      for(in = 0; in < g.nodeCount; in++) ntemp0[in] = ( ncap[in] > 0. ) ? ntemp0[in]/ncap[in] : 0.;
+      fixTemperatures(fixed, nfix, ntemp0);
+      memcpy(ntemp, ntemp0, g.nodeCount*sizeof(double));
+
+      for(s = 0; s < substeps; s++){
+         memset(nheat, 0, g.nodeCount*sizeof(double));
+         for(ib = 0; ib < bodyCount; ib++){
+            mwSize   particleCount = mxGetM(getBodyField(bodies, ib, "coord")), sk, sr = 0;
+            double  *mass = getBodyArray("ThermoMechMPM", bodies, ib, "mass",   particleCount, 1);
+            double  *vol  = getBodyArray("ThermoMechMPM", bodies, ib, "volume", particleCount, 1);
+            double  *cond = getBodyValues("ThermoMechMPM", bodies, ib, "conductivity", particleCount, 1, &sk);
+            double  *src  = getBodyValues("ThermoMechMPM", bodies, ib, "source",       particleCount, 0, &sr);
+            BasisCache B;
+            if ( !getBasisCache(cache, ib, &g, particleCount, &B) )
+               mexErrMsgTxt("ThermoMechMPM: the basis cache does not match the bodies and grid, use the one of 'p2g'");
+            heatFlux(&g, &B, vol, cond, sk, mass, src, sr, ntemp, nheat);
+         }
+         for(in = 0; in < g.nodeCount; in++)
+            if ( ncap[in] > 0. ) ntemp[in] += dtime/substeps*nheat[in]/ncap[in];
+         fixTemperatures(fixed, nfix, ntemp);
+      }
+      mxFree(ncap);
+
+      if ( nlhs > 5 ) plhs[5] = cache;
+      else            mxDestroyArray(cache);
+   }
+   else if ( strcmp(mode, "g2p") == 0 ){
+      const mxArray *cache;
+      const double  *nvelo, *nacce, *ntemp0, *ntemp;
+
+      if ( nrhs != 9 )
+         mexErrMsgTxt("ThermoMechMPM: expected ('g2p', bodies, grid, cache, nvelo, nacce, ntemp0, ntemp, dtime)");
+      cache  = prhs[3];
+      nvelo  = mxGetPr(prhs[4]);
+      nacce  = mxGetPr(prhs[5]);
+      ntemp0 = mxGetPr(prhs[6]);
+      ntemp  = mxGetPr(prhs[7]);
+      dtime  = mxGetScalar(prhs[8]);
+      if ( mxGetM(prhs[4]) != g.nodeCount || mxGetN(prhs[4]) != (mwSize) g.nsd ||
+           mxGetM(prhs[5]) != g.nodeCount || mxGetN(prhs[5]) != (mwSize) g.nsd )
+         mexErrMsgTxt("ThermoMechMPM: nvelo and nacce must be nodeCount x nsd");
+      if ( mxGetNumberOfElements(prhs[6]) != g.nodeCount || mxGetNumberOfElements(prhs[7]) != g.nodeCount )
+         mexErrMsgTxt("ThermoMechMPM: ntemp0 and ntemp must have one value per grid node");
+      if ( !mxIsStruct(cache) || mxGetNumberOfElements(cache) != bodyCount )
+         mexErrMsgTxt("ThermoMechMPM: the basis cache does not match the bodies and grid, use the one of 'p2g'");
+
+      for(ib = 0; ib < bodyCount; ib++){                  /* loop over bodies*/
+         mxArray *coordp = getBodyField(bodies, ib, "coord");
+         mwSize   particleCount = ( coordp != NULL ) ? mxGetM(coordp) : 0, nv = ( g.nsd == 3 ) ? 6 : 3, sa = 0, sk;
+         double  *coord  = getBodyArray("ThermoMechMPM", bodies, ib, "coord",   particleCount, g.nsd);
+         double  *velo   = getBodyArray("ThermoMechMPM", bodies, ib, "velo",    particleCount, g.nsd);
+         double  *vol    = getBodyArray("ThermoMechMPM", bodies, ib, "volume",  particleCount, 1);
+         double  *vol0   = getBodyArray("ThermoMechMPM", bodies, ib, "volume0", particleCount, 1);
+         double  *defo   = getBodyArray("ThermoMechMPM", bodies, ib, "deform",  particleCount, g.nsd*g.nsd);
+         double  *stress = getBodyArray("ThermoMechMPM", bodies, ib, "stress",  particleCount, nv);
+         double  *strain = getBodyArray("ThermoMechMPM", bodies, ib, "strain",  particleCount, nv);
+         double  *temp   = getBodyArray("ThermoMechMPM", bodies, ib, "temp",    particleCount, 1);
+         double  *alpha  = getBodyValues("ThermoMechMPM", bodies, ib, "expansion",    particleCount, 0, &sa);
+         double  *cond   = getBodyValues("ThermoMechMPM", bodies, ib, "conductivity", particleCount, 1, &sk);
+         double  *flux   = ( getBodyField(bodies, ib, "flux") != NULL ) ?
+                           getBodyArray("ThermoMechMPM", bodies, ib, "flux", particleCount, g.nsd) : NULL;
+         double  *tfix   = ( getBodyField(bodies, ib, "tempFixed") != NULL ) ?
+                           getBodyArray("ThermoMechMPM", bodies, ib, "tempFixed", particleCount, 1) : NULL;
+         mxArray *Cp     = getBodyField(bodies, ib, "C");
+         double  *Cma;
+         BasisCache B;
+         int      nsd = g.nsd, nn = g.nn;
+         long     c;
+
+         if ( Cp == NULL || mxGetNumberOfElements(Cp) != nv*nv )
+            mexErrMsgTxt("ThermoMechMPM: the bodies need the elasticity matrix C (3 x 3 or 6 x 6)");
+         Cma = mxGetPr(Cp);
+         if ( !getBasisCache(cache, ib, &g, particleCount, &B) )
+            mexErrMsgTxt("ThermoMechMPM: the basis cache does not match the bodies and grid, use the one of 'p2g'");
+
+         #pragma omp parallel
+         {
+            double L[3][3];
+            int    nodes[64];
+            #pragma omp for schedule(dynamic,4)
+            for(c = 0; c < (long) g.ncell; c++){        /* loop over cells with particles of this body*/
+               long q;
+               int  k, i, j;
+               if ( B.start[c+1] == B.start[c] ) continue;
+               cellStencil(&g, (mwSize) c, nodes);
+               for(q = B.start[c]; q < B.start[c+1]; q++){
+                  mwSize        ip = (mwSize) B.order[q];
+                  const double *N  = B.N + nn*q, *dN = B.dN + nn*nsd*q;
+                  double        v[3] = {0., 0., 0.}, a[3] = {0., 0., 0.}, grad[3] = {0., 0., 0.}, dT = 0.;
+                  memset(L, 0, sizeof(L));
+                  for(k = 0; k < nn; k++){
+                     mwSize id = nodes[k];
+                     dT += N[k]*(ntemp[id] - ntemp0[id]);
+                     for(i = 0; i < nsd; i++){
+                        double vi = nvelo[id+i*g.nodeCount];
+                        v[i]    += N[k]*vi;
+                        a[i]    += N[k]*nacce[id+i*g.nodeCount];
+                        grad[i] += dN[k*nsd+i]*ntemp[id];
+                        for(j = 0; j < nsd; j++) L[i][j] += vi*dN[k*nsd+j];   /* L_ij = dv_i/dx_j */
+                     }
+                  }
+                  for(i = 0; i < nsd; i++){
+                     coord[ip+i*particleCount] += dtime*v[i];
+                     velo[ip+i*particleCount]  += dtime*a[i];
+                     if ( flux != NULL ) flux[ip+i*particleCount] = -cond[ip*sk]*grad[i];
+                  }
+                  if ( tfix != NULL && !isnan(tfix[ip]) ) dT = tfix[ip] - temp[ip];
+                  temp[ip] += dT;
+                  updateParticleState (nsd, ip, particleCount, dtime, L,
+                                       ( alpha != NULL ) ? alpha[ip*sa]*dT : 0., Cma,
+                                       vol, vol0, defo, strain, stress);
+               }
+            }
+         }
+      }
+   }
+   else
+      mexErrMsgTxt("ThermoMechMPM: mode must be 'p2g' or 'g2p'");
+}
@@ -18,6 +18,10 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         // mesh:   background grid
         // nvelo:  nodal velocities at time t+dtime
         // nacce:  nodal accelerations at time t+dtime
+        // With a 6th argument, UpdateParticles(bodies,mesh,nvelo,nacce,dtime,layer),
+        // nvelo/nacce are the compact per-body layers returned by
+        // ParticlesToNodesContact and body ib reads its own nodal fields.
+        // nvelo/nacce may also be nodeCount x 2 x bodyCount, one nodal field per body.
         // bodies are modified to update stress, positions, velocities of particles.
         //
         // VP Nguyen
@@ -25,7 +29,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         */
 	
    const mxArray* bodies;
-         mxArray  *masst, *body, *coordp, *matProp;
+         mxArray  *masst, *coordp, *matProp;
          double   *mass, *vol, *vol0, *coord, *velo, *stress, *strain, *Cma, *defo;
          double   *kappa;
    mwSize          bodyCount, particleCount;
@@ -53,6 +57,18 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 
    double dtime = *pdt;
 
+   /* optional per-body nodal layers */
+
+   double *layerNode = NULL, *bodyPtr = NULL;
+   mwSize  ld = nodeCount, off = 0;
+   long    k;
+   int     perBody = ( mxGetNumberOfDimensions(prhs[2]) == 3 );
+   if ( nrhs > 5 ){
+      layerNode = mxGetPr(mxGetField(prhs[5], 0, "node"));
+      bodyPtr   = mxGetPr(mxGetField(prhs[5], 0, "bodyPtr"));
+      ld        = mxGetM(prhs[2]);
+   }
+
    /* local variables*/
 
    double xp,yp;
@@ -78,19 +94,19 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
    int ip, in;
 
    for(ib = 0; ib < bodyCount; ib++){                     /* loop over bodies*/
-      body   = mxGetCell ( bodies, ib  );
-      coordp  = mxGetField(body, 0, "coord");             /* get particle info. of this body*/
+      coordp  = getBodyField(bodies, ib, "coord");        /* get particle info. of this body*/
       coord   = mxGetPr(coordp);
-      vol     = mxGetPr(mxGetField(body, 0, "volume"));
-      vol0    = mxGetPr(mxGetField(body, 0, "volume0"));
-      velo    = mxGetPr(mxGetField(body, 0, "velo"));
-      defo    = mxGetPr(mxGetField(body, 0, "deform"));   /* deformation gradient*/
-      stress  = mxGetPr(mxGetField(body, 0, "stress"));   
-      strain  = mxGetPr(mxGetField(body, 0, "strain"));   
+      vol     = mxGetPr(getBodyField(bodies, ib, "volume"));
+      vol0    = mxGetPr(getBodyField(bodies, ib, "volume0"));
+      velo    = mxGetPr(getBodyField(bodies, ib, "velo"));
+      defo    = mxGetPr(getBodyField(bodies, ib, "deform"));   /* deformation gradient*/
+      stress  = mxGetPr(getBodyField(bodies, ib, "stress"));   
+      strain  = mxGetPr(getBodyField(bodies, ib, "strain"));   
 
-      Cma     = mxGetPr(mxGetField(body, 0, "C"));        
+      Cma     = mxGetPr(getBodyField(bodies, ib, "C"));        
 
       particleCount = mxGetM(coordp);
+      if ( perBody && !layerNode ) off = 2*ib*nodeCount;
       
 
       C11 = Cma[0]; C21 = Cma[1]; C31 = Cma[2];
@@ -113,13 +129,18 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
             x[0]   = xp - ncoord[nodeid];
             x[1]   = yp - ncoord[nodeid+nodeCount];
             computeMPMBasis2D (x,h,&f,&dfx,&dfy);
+            k      = nodeid + off;
+            if ( layerNode ){
+               k = findLayerSlot(layerNode, (mwSize) bodyPtr[ib], (mwSize) bodyPtr[ib+1], nodeid);
+               if ( k < 0 ) continue;
+            }
             /* update particle coordinates and velocities*/
-            vix = nvelo[nodeid];
-            viy = nvelo[nodeid+nodeCount];
+            vix = nvelo[k];
+            viy = nvelo[k+ld];
             newcoordx += dtime * f * vix;
             newcoordy += dtime * f * viy;
-            newvelox  += dtime * f * nacce[nodeid];
-            newveloy  += dtime * f * nacce[nodeid+nodeCount];
+            newvelox  += dtime * f * nacce[k];
+            newveloy  += dtime * f * nacce[k+ld];
             L[0] +=  dfx*vix;   /* L_xx */
             L[1] +=  dfy*vix;   /* L_xy */
             L[2] +=  dfx*viy;   /* L_yx */
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+#include "util.h"
+#include "basis.h"
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" UpdateParticlesBspline.c util.c basis.c
+ */
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Update particle positions, velocities and stresses used with B-splines.
+	//
+	// We expect the function to be called as UpdateParticlesBspline(bodies,grid,nvelo,nacce,dtime)
+	// bodies: bodies in the simulation (cell array {ib} or struct array (ib)),
+        //         fields coord, velo, volume, volume0, deform (F stored column-wise,
+        //         4 or 9 columns), stress, strain (Voigt, 3 or 6 columns) and the
+        //         elasticity matrix C.
+        // grid:   uniform B-spline grid, see ParticlesToNodesBspline.
+        // nvelo:  nodal velocities at time t+dtime
+        // nacce:  nodal accelerations at time t+dtime
+        // bodies are modified to update stress, positions, velocities of particles,
+        // as UpdateParticles does for linear MPM. Particles are processed in parallel.
+        */
+   const mxArray *bodies;
+   mwSize   bodyCount, nodeCount, ib;
+   int      nsd, p, nel[3] = {1, 1, 1};
+   double   h[3], org[3], dtime;
+   double  *nvelo, *nacce;
+
+   if ( nrhs != 5 )
+      mexErrMsgTxt("UpdateParticlesBspline: expected (bodies, grid, nvelo, nacce, dtime)");
+
+   bodies    = prhs[0];
+   bodyCount = mxGetNumberOfElements(bodies);
+   if ( !getBsplineGrid(prhs[1], &nsd, h, nel, &p, org) )
+      mexErrMsgTxt("UpdateParticlesBspline: grid.degree must be 1, 2 or 3");
+   nodeCount = (mwSize)(nel[0]+p)*(nel[1]+p)*( nsd == 3 ? nel[2]+p : 1 );
+
+   nvelo = mxGetPr(prhs[2]);
+   nacce = mxGetPr(prhs[3]);
+   dtime = mxGetScalar(prhs[4]);
+   if ( mxGetM(prhs[2]) != nodeCount || mxGetM(prhs[3]) != nodeCount )
+      mexErrMsgTxt("UpdateParticlesBspline: nvelo and nacce must have one row per grid node");
+
+   for(ib = 0; ib < bodyCount; ib++){                     /* loop over bodies*/
+      mxArray *coordp = getBodyField(bodies, ib, "coord");
+      double  *coord  = mxGetPr(coordp);
+      double  *vol    = mxGetPr(getBodyField(bodies, ib, "volume"));
+      double  *vol0   = mxGetPr(getBodyField(bodies, ib, "volume0"));
+      double  *velo   = mxGetPr(getBodyField(bodies, ib, "velo"));
+      double  *defo   = mxGetPr(getBodyField(bodies, ib, "deform"));
+      double  *stress = mxGetPr(getBodyField(bodies, ib, "stress"));
+      double  *strain = mxGetPr(getBodyField(bodies, ib, "strain"));
+      double  *Cma    = mxGetPr(getBodyField(bodies, ib, "C"));
+      long     particleCount = (long) mxGetM(coordp), ip;
+
+      #pragma omp parallel for schedule(static)
+      for(ip = 0; ip < particleCount; ip++){          /* loop over particles of this body*/
+         int    nodes[64], nn, in, i, j;
+         double f[64], df[3*64], x[3], xnew[3], vnew[3], L[3][3];
+
+         for(i = 0; i < nsd; i++){
+            xnew[i] = coord[ip+i*particleCount];
+            vnew[i] = velo[ip+i*particleCount];
+            x[i]    = xnew[i] - org[i];
+         }
+         memset(L, 0, sizeof(L));
+
+         nn = computeBsplineBasisStencil (nsd, x, h, nel, p, nodes, f, df);
+         for(in = 0; in < nn; in++){                   /* interpolate from the nodes of this particle*/
+            mwSize nodeid = nodes[in];
+            for(i = 0; i < nsd; i++){
+               double vi = nvelo[nodeid+i*nodeCount];
+               xnew[i] += dtime * f[in] * vi;
+               vnew[i] += dtime * f[in] * nacce[nodeid+i*nodeCount];
+               for(j = 0; j < nsd; j++) L[i][j] += df[in*nsd+j]*vi;   /* L_ij = dv_i/dx_j */
+            }
+         }
+         for(i = 0; i < nsd; i++){
+            coord[ip+i*particleCount] = xnew[i];
+            velo[ip+i*particleCount]  = vnew[i];
+         }
+         updateParticleState (nsd, (mwSize) ip, (mwSize) particleCount, dtime, L, 0., Cma,
+                              vol, vol0, defo, strain, stress);
+      }
+   }
+}
@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "matrix.h"
+#include "mex.h"
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+/*
+ * mex CFLAGS="\$CFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp" WriteVTK.c
+ * mex CFLAGS="\$CFLAGS -fopenmp -DUSE_ZLIB" LDFLAGS="\$LDFLAGS -fopenmp" WriteVTK.c -lz
+ */
+
+#define VTK_FLOAT64  0
+#define VTK_INT32    1
+#define VTK_UINT8    2
+
+#define VTK_SEC_POINTS    0
+#define VTK_SEC_CELLS     1
+#define VTK_SEC_POINTDATA 2
+#define VTK_SEC_CELLDATA  3
+
+#define VTK_BLOCK_SIZE 32768
+
+typedef unsigned long long vtkUInt64;
+
+typedef struct {
+   char            name[64];
+   int             type;         /* VTK_FLOAT64, VTK_INT32, VTK_UINT8     */
+   int             ncomp;        /* components per tuple                  */
+   int             section;      /* VTK_SEC_xxx the array is listed under */
+   size_t          bytes;        /* size of the uncompressed data         */
+   unsigned char  *data;         /* uncompressed data, tuples interleaved */
+   unsigned char  *block;        /* header + (compressed) data            */
+   size_t          blockSize;
+   vtkUInt64       offset;       /* offset of the block in AppendedData   */
+} VTKArray;
+
+static const char* typeName[3] = {"Float64", "Int32", "UInt8"};
+static const size_t typeSize[3] = {8, 4, 1};
+
+static VTKArray* addArray (VTKArray* arrays, int* count, const char* name, int type,
+                           int ncomp, size_t tuples, int section)
+{
+   VTKArray* a = arrays + (*count)++;
+   strncpy(a->name, name, 63); a->name[63] = '\0';
+   a->type    = type;
+   a->ncomp   = ncomp;
+   a->section = section;
+   a->bytes   = tuples*ncomp*typeSize[type];
+   a->data    = (unsigned char*) mxMalloc(a->bytes + 1);
+   a->block   = NULL;
+   return a;
+}
+
+static void interleave (const double* src, size_t m, int ncol, int ncomp, double* dst)
+/*
+ * Column-major m x ncol matrix to row-major m x ncomp tuples, padded with zeros
+ * (2D points and vectors become 3D ones).
+ */
+{
+   long i;
+   #pragma omp parallel for schedule(static)
+   for(i = 0; i < (long) m; i++){
+      int j;
+      for(j = 0; j < ncomp; j++)
+         dst[i*ncomp + j] = ( j < ncol ) ? src[i + j*m] : 0.;
+   }
+}
+
+static int encodeArray (VTKArray* a, int compress)
+/*
+ * Appended raw block: UInt64 byte count followed by the data, or the
+ * vtkZLibDataCompressor layout [nblocks, blocksize, lastblocksize, csize_1..n]
+ * followed by the compressed blocks. Returns 0 on a compression failure.
+ */
+{
+   if ( !compress ){
+      vtkUInt64 n = a->bytes;
+      a->blockSize = sizeof(vtkUInt64) + a->bytes;
+      a->block     = (unsigned char*) malloc(a->blockSize);
+      if ( a->block == NULL ) return 0;
+      memcpy(a->block, &n, sizeof(vtkUInt64));
+      memcpy(a->block + sizeof(vtkUInt64), a->data, a->bytes);
+      return 1;
+   }
+#ifdef USE_ZLIB
+   {
+      size_t     nb    = ( a->bytes + VTK_BLOCK_SIZE - 1 )/VTK_BLOCK_SIZE, b, pos;
+      size_t     bound = compressBound(VTK_BLOCK_SIZE);
+      size_t     hsize = ( 3 + nb )*sizeof(vtkUInt64);
+      vtkUInt64 *head;
+
+      a->block = (unsigned char*) malloc(hsize + nb*bound + 1);
+      if ( a->block == NULL ) return 0;
+      head    = (vtkUInt64*) a->block;
+      head[0] = nb;
+      head[1] = VTK_BLOCK_SIZE;
+      head[2] = a->bytes % VTK_BLOCK_SIZE;
+      pos     = hsize;
+      for(b = 0; b < nb; b++){
+         size_t len  = ( b == nb-1 && head[2] ) ? head[2] : VTK_BLOCK_SIZE;
+         uLongf clen = bound;
+         if ( compress2(a->block + pos, &clen, a->data + b*VTK_BLOCK_SIZE, len,
+                        Z_DEFAULT_COMPRESSION) != Z_OK ) return 0;
+         head[3+b] = clen;
+         pos      += clen;
+      }
+      a->blockSize = pos;
+   }
+   return 1;
+#else
+   return 0;
+#endif
+}
+
+static void writeDataArray (FILE* fid, const VTKArray* a)
+{
+   fprintf(fid, "<DataArray type=\"%s\" Name=\"%s\" NumberOfComponents=\"%d\" "
+                "format=\"appended\" offset=\"%llu\"/>\n",
+           typeName[a->type], a->name, a->ncomp, a->offset);
+}
+
+static int addFieldArrays (VTKArray* arrays, int* count, const mxArray* data,
+                           size_t tuples, int section, const char* what)
+/*
+ * Every field of the struct data is one data array, one row per point (cell).
+ * Vectors with two components are written as 3D vectors.
+ */
+{
+   int f, nf;
+
+   if ( data == NULL || mxIsEmpty(data) ) return 1;
+   if ( !mxIsStruct(data) ) return 0;
+   nf = mxGetNumberOfFields(data);
+   for(f = 0; f < nf; f++){
+      const mxArray *v = mxGetFieldByNumber(data, 0, f);
+      int            ncol, ncomp;
+      VTKArray      *a;
+
+      if ( v == NULL || mxIsEmpty(v) ) continue;
+      if ( !mxIsDouble(v) || mxGetM(v) != tuples ){
+         char msg[160];
+         sprintf(msg, "WriteVTK: %s field '%.60s' must be a double array with one row per entry",
+                 what, mxGetFieldNameByNumber(data, f));
+         mexErrMsgTxt(msg);
+      }
+      ncol  = (int) mxGetN(v);
+      ncomp = ( ncol == 2 ) ? 3 : ncol;
+      a     = addArray(arrays, count, mxGetFieldNameByNumber(data, f), VTK_FLOAT64, ncomp,
+                       tuples, section);
+      interleave(mxGetPr(v), tuples, ncol, ncomp, (double*) a->data);
+   }
+   return 1;
+}
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	/*	Write a VTK XML file with all data arrays in one binary appended block.
+	//
+	// We expect the function to be called as :
+        // WriteVTK(fileName,points,cells,pointData,cellData,encoding)
+	// fileName:  output file, '.vtu' (UnstructuredGrid) or '.vtp' (PolyData).
+        // points:    numPoints x 2 or numPoints x 3 coordinates.
+        // cells:     [] (particles only, written as vertex cells in a .vtu file) or a
+        //            struct with fields
+        //            conn: one-based connectivity, numCells x nv matrix (entries <= 0 or
+        //                  NaN are skipped, so polygons of different sizes can be padded)
+        //                  or a cell array of vectors,
+        //            type: VTK cell code, scalar or one per cell (.vtu only, the cells
+        //                  of a .vtp file are polygons).
+        // pointData: struct, every field is a numPoints x ncomp double array written
+        //            under its field name (ncomp = 2 is written as a 3D vector).
+        // cellData:  same for the cells.
+        // encoding:  'raw' (default) or 'zlib' (needs a build with -DUSE_ZLIB -lz).
+        //
+        // The arrays are converted (and compressed) in parallel and written after the
+        // XML header in one fwrite per array, instead of one fprintf per value.
+        */
+   char      fileName[1024], encoding[16] = "raw";
+   const mxArray *points, *cells = NULL, *pointData = NULL, *cellData = NULL;
+   size_t    numPoints, numCells = 0, nlen;
+   int       isPoly, compress = 0, count = 0, maxArray, i;
+   VTKArray *arrays;
+   vtkUInt64 offset;
+   FILE     *fid;
+   int       bigEndian;
+
+   if ( nrhs < 2 ) mexErrMsgTxt("WriteVTK: expected (fileName,points[,cells,pointData,cellData,encoding])");
+
+   mxGetString(prhs[0], fileName, sizeof(fileName));
+   nlen   = strlen(fileName);
+   isPoly = ( nlen > 4 && strcmp(fileName + nlen - 4, ".vtp") == 0 );
+   if ( !isPoly && !( nlen > 4 && strcmp(fileName + nlen - 4, ".vtu") == 0 ) )
+      mexErrMsgTxt("WriteVTK: file name must end with .vtu or .vtp");
+
+   points    = prhs[1];
+   numPoints = mxGetM(points);
+   if ( nrhs > 2 && !mxIsEmpty(prhs[2]) ) cells     = prhs[2];
+   if ( nrhs > 3 )                         pointData = prhs[3];
+   if ( nrhs > 4 )                         cellData  = prhs[4];
+   if ( nrhs > 5 ) mxGetString(prhs[5], encoding, sizeof(encoding));
+
+   if ( strcmp(encoding, "zlib") == 0 ){
+#ifdef USE_ZLIB
+      compress = 1;
+#else
+      mexWarnMsgTxt("WriteVTK: compiled without zlib (-DUSE_ZLIB), writing raw data");
+#endif
+   }
+   else if ( strcmp(encoding, "raw") != 0 )
+      mexErrMsgTxt("WriteVTK: encoding must be 'raw' or 'zlib'");
+
+   maxArray = 4 + ( pointData && mxIsStruct(pointData) ? mxGetNumberOfFields(pointData) : 0 )
+                + ( cellData  && mxIsStruct(cellData)  ? mxGetNumberOfFields(cellData)  : 0 );
+   arrays   = (VTKArray*) mxCalloc(maxArray, sizeof(VTKArray));
+
+   /* points, always 3D */
+
+   {
+      VTKArray* a = addArray(arrays, &count, "Points", VTK_FLOAT64, 3, numPoints, VTK_SEC_POINTS);
+      interleave(mxGetPr(points), numPoints, (int) mxGetN(points), 3, (double*) a->data);
+   }
+
+   /* cells: connectivity, offsets and (.vtu) types */
+
+   if ( cells ){
+      const mxArray *conn = mxGetField(cells, 0, "conn");
+      const mxArray *type = mxGetField(cells, 0, "type");
+      size_t   total = 0, c, k;
+      int     *cptr, *off;
+      VTKArray *ac, *ao, *at;
+
+      if ( conn == NULL ) mexErrMsgTxt("WriteVTK: cells needs a conn field");
+      if ( !isPoly && type == NULL ) mexErrMsgTxt("WriteVTK: cells of a .vtu file need a type field");
+
+      if ( mxIsCell(conn) ){
+         numCells = mxGetNumberOfElements(conn);
+         for(c = 0; c < numCells; c++) total += mxGetNumberOfElements(mxGetCell(conn, c));
+      }
+      else{
+         const double *cv = mxGetPr(conn);
+         numCells = mxGetM(conn);
+         for(k = 0; k < numCells*mxGetN(conn); k++) total += ( cv[k] > 0. );
+      }
+
+      ac   = addArray(arrays, &count, "connectivity", VTK_INT32, 1, total, VTK_SEC_CELLS);
+      ao   = addArray(arrays, &count, "offsets", VTK_INT32, 1, numCells, VTK_SEC_CELLS);
+      cptr = (int*) ac->data;
+      off  = (int*) ao->data;
+      total = 0;
+      for(c = 0; c < numCells; c++){
+         if ( mxIsCell(conn) ){
+            const mxArray *cc = mxGetCell(conn, c);
+            const double  *cv = mxGetPr(cc);
+            for(k = 0; k < mxGetNumberOfElements(cc); k++) cptr[total++] = (int) cv[k] - 1;
+         }
+         else{
+            const double *cv = mxGetPr(conn);
+            size_t        m  = mxGetM(conn), nv = mxGetN(conn);
+            for(k = 0; k < nv; k++)
+               if ( cv[c + k*m] > 0. ) cptr[total++] = (int) cv[c + k*m] - 1;
+         }
+         off[c] = (int) total;
+      }
+
+      if ( !isPoly ){
+         const double  *tv = mxGetPr(type);
+         size_t         nt = mxGetNumberOfElements(type);
+         unsigned char *tp;
+         at = addArray(arrays, &count, "types", VTK_UINT8, 1, numCells, VTK_SEC_CELLS);
+         tp = at->data;
+         for(c = 0; c < numCells; c++) tp[c] = (unsigned char) tv[ nt == 1 ? 0 : c ];
+      }
+   }
+
+   else if ( !isPoly ){
+      /* particles only: one VTK_VERTEX cell per point */
+      int           *cptr, *off;
+      unsigned char *tp;
+      size_t         c;
+      numCells = numPoints;
+      cptr = (int*) addArray(arrays, &count, "connectivity", VTK_INT32, 1, numCells, VTK_SEC_CELLS)->data;
+      off  = (int*) addArray(arrays, &count, "offsets", VTK_INT32, 1, numCells, VTK_SEC_CELLS)->data;
+      tp   = addArray(arrays, &count, "types", VTK_UINT8, 1, numCells, VTK_SEC_CELLS)->data;
+      for(c = 0; c < numCells; c++){ cptr[c] = (int) c; off[c] = (int) c+1; tp[c] = 1; }
+   }
+
+   if ( !addFieldArrays(arrays, &count, pointData, numPoints, VTK_SEC_POINTDATA, "point") )
+      mexErrMsgTxt("WriteVTK: pointData must be a struct");
+   if ( !addFieldArrays(arrays, &count, cellData, numCells, VTK_SEC_CELLDATA, "cell") )
+      mexErrMsgTxt("WriteVTK: cellData must be a struct");
+
+   /* encode (compress) all arrays in parallel */
+
+   {
+      int failed = 0;
+      #pragma omp parallel for schedule(dynamic) reduction(+:failed)
+      for(i = 0; i < count; i++) failed += !encodeArray(arrays + i, compress);
+      if ( failed ){
+         for(i = 0; i < count; i++) free(arrays[i].block);
+         mexErrMsgTxt("WriteVTK: out of memory or compression failure");
+      }
+   }
+   offset = 0;
+   for(i = 0; i < count; i++){
+      arrays[i].offset = offset;
+      offset          += arrays[i].blockSize;
+   }
+
+   /* XML header */
+
+   fid = fopen(fileName, "wb");
+   if ( fid == NULL ){
+      for(i = 0; i < count; i++) free(arrays[i].block);
+      mexErrMsgTxt("WriteVTK: cannot open output file");
+   }
+
+   {
+      unsigned int one = 1;
+      bigEndian = ( *(unsigned char*) &one == 0 );
+   }
+   fprintf(fid, "<?xml version=\"1.0\"?>\n");
+   fprintf(fid, "<VTKFile type=\"%s\" version=\"1.0\" byte_order=\"%s\" header_type=\"UInt64\"%s>\n",
+           isPoly ? "PolyData" : "UnstructuredGrid", bigEndian ? "BigEndian" : "LittleEndian",
+           compress ? " compressor=\"vtkZLibDataCompressor\"" : "");
+   fprintf(fid, "<%s>\n", isPoly ? "PolyData" : "UnstructuredGrid");
+   if ( isPoly )
+      fprintf(fid, "<Piece NumberOfPoints=\"%lu\" NumberOfVerts=\"0\" NumberOfLines=\"0\" "
+                   "NumberOfStrips=\"0\" NumberOfPolys=\"%lu\">\n",
+              (unsigned long) numPoints, (unsigned long) numCells);
+   else
+      fprintf(fid, "<Piece NumberOfPoints=\"%lu\" NumberOfCells=\"%lu\">\n",
+              (unsigned long) numPoints, (unsigned long) numCells);
+
+   fprintf(fid, "<PointData>\n");
+   for(i = 0; i < count; i++) if ( arrays[i].section == VTK_SEC_POINTDATA ) writeDataArray(fid, arrays + i);
+   fprintf(fid, "</PointData>\n");
+   fprintf(fid, "<CellData>\n");
+   for(i = 0; i < count; i++) if ( arrays[i].section == VTK_SEC_CELLDATA ) writeDataArray(fid, arrays + i);
+   fprintf(fid, "</CellData>\n");
+   fprintf(fid, "<Points>\n");
+   writeDataArray(fid, arrays);
+   fprintf(fid, "</Points>\n");
+   if ( isPoly ) fprintf(fid, "<Polys>\n"); else fprintf(fid, "<Cells>\n");
+   for(i = 0; i < count; i++) if ( arrays[i].section == VTK_SEC_CELLS ) writeDataArray(fid, arrays + i);
+   if ( isPoly ) fprintf(fid, "</Polys>\n"); else fprintf(fid, "</Cells>\n");
+   fprintf(fid, "</Piece>\n");
+   fprintf(fid, "</%s>\n", isPoly ? "PolyData" : "UnstructuredGrid");
+
+   /* binary blocks */
+
+   fprintf(fid, "<AppendedData encoding=\"raw\">\n_");
+   for(i = 0; i < count; i++){
+      fwrite(arrays[i].block, 1, arrays[i].blockSize, fid);
+      free(arrays[i].block);
+      mxFree(arrays[i].data);
+   }
+   fprintf(fid, "\n</AppendedData>\n");
+   fprintf(fid, "</VTKFile>\n");
+   fclose(fid);
+
+   mxFree(arrays);
+}
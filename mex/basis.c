@@ -73,3 +73,130 @@ void computeGIMPBasis2D (double* x, double* h, double *lp, double* f, double* df
    *df1   = dfx * fy;
    *df2   = fx  * dfy;
 }
+
+void computeQuadraticBsplineBasis1D (double x, double h, double* f, double* df, double* d2f)
+/*
+ * Uniform quadratic B-spline centred at a node, support [-1.5h,1.5h].
+ * x is the particle position relative to the node.
+ */
+{
+   double ax   = fabs(x)/h;
+   double sigx = ( x < 0 ) ? -1. : 1.;
+
+   if ( ax <= 0.5 ){
+       *f   = 0.75 - ax*ax;
+       *df  = -2.*x/(h*h);
+       *d2f = -2./(h*h);
+   }
+   else if ( ax <= 1.5 ){
+       double tem = 1.5 - ax;
+       *f   = 0.5*tem*tem;
+       *df  = -tem*sigx/h;
+       *d2f = 1./(h*h);
+   }
+   else{
+       *f   = 0.;
+       *df  = 0.;
+       *d2f = 0.;
+   }
+}
+
+static double openUniformKnot (int k, int p, int nel, double h)
+/*
+ * k-th knot (zero-based) of the open uniform knot vector with nel elements
+ * of size h: p+1 knots at 0, nel-1 interior knots, p+1 knots at nel*h.
+ */
+{
+   int j = k - p;
+   if ( j < 0 )   j = 0;
+   if ( j > nel ) j = nel;
+   return j*h;
+}
+
+void computeBsplineBasis1D (double x, double h, int nel, int p, int* first, double* N, double* dN)
+/*
+ * B-splines of degree p (1 <= p <= BSPLINE_MAX_DEGREE) of the open uniform
+ * knot vector on [0,nel*h], and their first derivatives, at x. The p+1
+ * nonzero ones are returned in N[0..p], N[0] being basis function (= grid
+ * node) number *first of 0..nel+p-1. In the p boundary elements at each end
+ * these are the clamped B-splines of the repeated end knots, not shifted
+ * copies of the interior one, so that they still sum to one there.
+ * Points outside [0,nel*h] are extrapolated from the first/last element.
+ */
+{
+   double left[BSPLINE_MAX_DEGREE+1], right[BSPLINE_MAX_DEGREE+1];
+   double Nm[BSPLINE_MAX_DEGREE+1], saved, temp;
+   int    e, i, j, r;
+
+   e = (int) floor(x/h);
+   if ( e < 0 )       e = 0;
+   if ( e > nel - 1 ) e = nel - 1;
+   i      = e + p;                               /* knot span */
+   *first = e;
+
+   /* Cox-de Boor recursion (The NURBS Book, A2.2), keeping degree p-1 */
+   N[0]  = 1.;
+   Nm[0] = 1.;
+   for(j = 1; j <= p; j++){
+      if ( j == p ) for(r = 0; r < p; r++) Nm[r] = N[r];
+      left[j]  = x - openUniformKnot(i+1-j, p, nel, h);
+      right[j] = openUniformKnot(i+j, p, nel, h) - x;
+      saved = 0.;
+      for(r = 0; r < j; r++){
+         temp  = N[r]/(right[r+1] + left[j-r]);
+         N[r]  = saved + right[r+1]*temp;
+         saved = left[j-r]*temp;
+      }
+      N[j] = saved;
+   }
+
+   /* N'_{j,p} = p ( N_{j,p-1}/(U_{j+p}-U_j) - N_{j+1,p-1}/(U_{j+p+1}-U_{j+1}) ) */
+   for(j = 0; j <= p; j++){
+      dN[j] = 0.;
+      if ( j > 0 )
+         dN[j] += p*Nm[j-1]/(openUniformKnot(i+j, p, nel, h) - openUniformKnot(i+j-p, p, nel, h));
+      if ( j < p )
+         dN[j] -= p*Nm[j]/(openUniformKnot(i+j+1, p, nel, h) - openUniformKnot(i+j+1-p, p, nel, h));
+   }
+}
+
+int computeBsplineBasisStencil (int nsd, const double* x, const double* h, const int* nel, int p,
+                                int* nodes, double* f, double* df)
+/*
+ * Tensor product B-splines of degree p at point x (relative to the grid
+ * origin) of a uniform B-spline grid with nel[d] elements of size h[d],
+ * whose (nel[0]+p)*(nel[1]+p)[*(nel[2]+p)] nodes (control points) are
+ * numbered x fastest from 0. Fills the (p+1)^nsd nodes of the particle, the
+ * basis function f[in] and its gradient df[in*nsd+d] of each, and returns
+ * their count.
+ */
+{
+   double N[3][BSPLINE_MAX_DEGREE+1], dN[3][BSPLINE_MAX_DEGREE+1];
+   int    first[3] = {0, 0, 0}, a, b, c, d, in = 0;
+   int    nx = nel[0] + p, ny = nel[1] + p;
+
+   for(d = 0; d < nsd; d++)
+      computeBsplineBasis1D (x[d], h[d], nel[d], p, &first[d], N[d], dN[d]);
+
+   for(c = 0; c < ( nsd == 3 ? p+1 : 1 ); c++){
+      for(b = 0; b <= p; b++){
+         for(a = 0; a <= p; a++){
+            nodes[in] = (first[0]+a) + nx*(first[1]+b);
+            if ( nsd == 3 ){
+               nodes[in]    += nx*ny*(first[2]+c);
+               f[in]         = N[0][a]*N[1][b]*N[2][c];
+               df[3*in]      = dN[0][a]* N[1][b]* N[2][c];
+               df[3*in+1]    =  N[0][a]*dN[1][b]* N[2][c];
+               df[3*in+2]    =  N[0][a]* N[1][b]*dN[2][c];
+            }
+            else{
+               f[in]         = N[0][a]*N[1][b];
+               df[2*in]      = dN[0][a]* N[1][b];
+               df[2*in+1]    =  N[0][a]*dN[1][b];
+            }
+            in++;
+         }
+      }
+   }
+   return in;
+}
@@ -1,6 +1,6 @@
 /*
  * Declaration of functions used to evaluate MPM basis functions and first derivatives.
- * Implemented basis include: MPM, GIMP
+ * Implemented basis include: MPM, GIMP, quadratic B-splines
  * Definition given in file basis.c
  *
  * VP Nguyen, nvinhphu@gmail.com
@@ -13,3 +13,10 @@ void computeMPMBasis2D (double* x, double* h, double * f, double * dfx, double *
 void computeGIMPBasis1D (double x, double h, double lp, double * f, double * df);
 void computeGIMPBasis2D (double* x, double* h, double* lp, double * f, double * dfx, double * dfy);
 
+void computeQuadraticBsplineBasis1D (double x, double h, double * f, double * df, double * d2f);
+
+/* B-splines of open uniform knot vectors (B-spline MPM grids), degree 1 to 3 */
+#define BSPLINE_MAX_DEGREE 3
+void computeBsplineBasis1D (double x, double h, int nel, int p, int* first, double* N, double* dN);
+int  computeBsplineBasisStencil (int nsd, const double* x, const double* h, const int* nel, int p,
+                                 int* nodes, double* f, double* df);
@@ -0,0 +1,147 @@
+#include "element.h"
+#include <string.h>
+
+/*
+ * All small matrices are stored row-major: dNdxi[a*nsd+i] = dN_a/dxi_i,
+ * enode[a*nsd+i] = i-th coordinate of element node a, J[i*nsd+j] = dx_i/dxi_j.
+ */
+
+int getElementType (const char* name)
+{
+   if      ( strcmp(name,"T3") == 0 ) return ELEM_T3;
+   else if ( strcmp(name,"Q4") == 0 ) return ELEM_Q4;
+   else if ( strcmp(name,"H4") == 0 ) return ELEM_H4;
+   else if ( strcmp(name,"B8") == 0 ) return ELEM_B8;
+   return ELEM_UNKNOWN;
+}
+
+int getElementNodeCount (int type)
+{
+   switch (type){
+      case ELEM_T3: return 3;
+      case ELEM_Q4: return 4;
+      case ELEM_H4: return 4;
+      case ELEM_B8: return 8;
+   }
+   return 0;
+}
+
+int getElementDimension (int type)
+{
+   return ( type == ELEM_H4 || type == ELEM_B8 ) ? 3 : 2;
+}
+
+void lagrangeBasis (int type, const double* xi, double* N, double* dNdxi)
+{
+   double I1[3], I2[3];
+   int    a, i;
+
+   switch (type){
+      case ELEM_T3:
+         N[0] = 1. - xi[0] - xi[1]; N[1] = xi[0]; N[2] = xi[1];
+         dNdxi[0] = -1.; dNdxi[1] = -1.;
+         dNdxi[2] =  1.; dNdxi[3] =  0.;
+         dNdxi[4] =  0.; dNdxi[5] =  1.;
+         break;
+      case ELEM_Q4:
+         N[0] = 0.25*(1.-xi[0])*(1.-xi[1]);
+         N[1] = 0.25*(1.+xi[0])*(1.-xi[1]);
+         N[2] = 0.25*(1.+xi[0])*(1.+xi[1]);
+         N[3] = 0.25*(1.-xi[0])*(1.+xi[1]);
+         dNdxi[0] = -0.25*(1.-xi[1]); dNdxi[1] = -0.25*(1.-xi[0]);
+         dNdxi[2] =  0.25*(1.-xi[1]); dNdxi[3] = -0.25*(1.+xi[0]);
+         dNdxi[4] =  0.25*(1.+xi[1]); dNdxi[5] =  0.25*(1.+xi[0]);
+         dNdxi[6] = -0.25*(1.+xi[1]); dNdxi[7] =  0.25*(1.-xi[0]);
+         break;
+      case ELEM_H4:
+         N[0] = 1. - xi[0] - xi[1] - xi[2]; N[1] = xi[0]; N[2] = xi[1]; N[3] = xi[2];
+         memset(dNdxi,0,12*sizeof(double));
+         dNdxi[0] = -1.; dNdxi[1] = -1.; dNdxi[2]  = -1.;
+         dNdxi[3] =  1.; dNdxi[7] =  1.; dNdxi[11] =  1.;
+         break;
+      case ELEM_B8:
+      {
+         /* node a has the sign pattern s[a] of lagrange_basis.m 'B8' */
+         static const double s[8][3] = { {-1,-1,-1}, {1,-1,-1}, {1,1,-1}, {-1,1,-1},
+                                         {-1,-1, 1}, {1,-1, 1}, {1,1, 1}, {-1,1, 1} };
+         for(i = 0; i < 3; i++){
+            I1[i] = 0.5 - 0.5*xi[i];
+            I2[i] = 0.5 + 0.5*xi[i];
+         }
+         for(a = 0; a < 8; a++){
+            double fx = s[a][0] < 0 ? I1[0] : I2[0];
+            double fy = s[a][1] < 0 ? I1[1] : I2[1];
+            double fz = s[a][2] < 0 ? I1[2] : I2[2];
+            N[a]         = fx*fy*fz;
+            dNdxi[3*a]   = 0.5*s[a][0]*fy*fz;
+            dNdxi[3*a+1] = 0.5*s[a][1]*fx*fz;
+            dNdxi[3*a+2] = 0.5*s[a][2]*fx*fy;
+         }
+         break;
+      }
+   }
+}
+
+double invertMatrix (int nsd, const double* A, double* invA)
+/*
+ * Inverse of a 2x2 or 3x3 matrix (row-major). Returns the determinant.
+ */
+{
+   double det;
+
+   if ( nsd == 2 ){
+      det     = A[0]*A[3] - A[1]*A[2];
+      invA[0] =  A[3]/det; invA[1] = -A[1]/det;
+      invA[2] = -A[2]/det; invA[3] =  A[0]/det;
+   }
+   else{
+      double c00 = A[4]*A[8] - A[5]*A[7];
+      double c01 = A[5]*A[6] - A[3]*A[8];
+      double c02 = A[3]*A[7] - A[4]*A[6];
+      det     = A[0]*c00 + A[1]*c01 + A[2]*c02;
+      invA[0] = c00/det;
+      invA[1] = (A[2]*A[7] - A[1]*A[8])/det;
+      invA[2] = (A[1]*A[5] - A[2]*A[4])/det;
+      invA[3] = c01/det;
+      invA[4] = (A[0]*A[8] - A[2]*A[6])/det;
+      invA[5] = (A[2]*A[3] - A[0]*A[5])/det;
+      invA[6] = c02/det;
+      invA[7] = (A[1]*A[6] - A[0]*A[7])/det;
+      invA[8] = (A[0]*A[4] - A[1]*A[3])/det;
+   }
+   return det;
+}
+
+double computeJacobian (int nsd, int nn, const double* enode, const double* dNdxi, double* invJ)
+/*
+ * J0 = enode'*dNdxi, returns det(J0) and its inverse in invJ.
+ */
+{
+   double J[9];
+   int    i, j, a;
+
+   for(i = 0; i < nsd; i++){
+      for(j = 0; j < nsd; j++){
+         double s = 0.;
+         for(a = 0; a < nn; a++) s += enode[a*nsd+i]*dNdxi[a*nsd+j];
+         J[i*nsd+j] = s;
+      }
+   }
+   return invertMatrix (nsd, J, invJ);
+}
+
+void computeShapeGradient (int nsd, int nn, const double* dNdxi, const double* invJ, double* dNdx)
+/*
+ * dNdx = dNdxi/J0 = dNdxi*inv(J0)
+ */
+{
+   int a, i, k;
+
+   for(a = 0; a < nn; a++){
+      for(i = 0; i < nsd; i++){
+         double s = 0.;
+         for(k = 0; k < nsd; k++) s += dNdxi[a*nsd+k]*invJ[k*nsd+i];
+         dNdx[a*nsd+i] = s;
+      }
+   }
+}
@@ -0,0 +1,23 @@
+/*
+ * Declaration of functions used to evaluate Lagrange finite element shape functions
+ * and their derivatives (same node ordering as grid/lagrange_basis.m).
+ * Implemented elements: T3, Q4, H4 (four node tetrahedron), B8 (eight node brick).
+ * Definition given in file element.c
+ */
+
+#define ELEM_UNKNOWN  0
+#define ELEM_T3       1
+#define ELEM_Q4       2
+#define ELEM_H4       3
+#define ELEM_B8       4
+
+#define ELEM_MAX_NODE 8
+
+int    getElementType      (const char* name);
+int    getElementNodeCount (int type);
+int    getElementDimension (int type);
+
+void   lagrangeBasis       (int type, const double* xi, double* N, double* dNdxi);
+double computeJacobian     (int nsd, int nn, const double* enode, const double* dNdxi, double* invJ);
+void   computeShapeGradient(int nsd, int nn, const double* dNdxi, const double* invJ, double* dNdx);
+double invertMatrix        (int nsd, const double* A, double* invA);
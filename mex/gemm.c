@@ -0,0 +1,196 @@
+#include <string.h>
+#include <math.h>
+#include "gemm.h"
+
+/*
+ * The matrices of one grid cell are a few particles times (p+1)^nsd nodes,
+ * too small for a dgemm call to pay off, so the products are plain loops
+ * written to vectorise: four dot products sharing the loads of a column of A.
+ */
+
+void gemmTN (int m, int n, int k, const double* A, int lda, const double* B, int ldb, double* C, int ldc)
+/*
+ * C (m x n) += A' * B, A being k x m and B k x n
+ */
+{
+   int i, j, l;
+
+   for(i = 0; i < m; i++){
+      const double* a = A + (long) lda*i;
+      for(j = 0; j + 3 < n; j += 4){
+         const double *b0 = B + (long) ldb*j,     *b1 = b0 + ldb;
+         const double *b2 = b1 + ldb,             *b3 = b2 + ldb;
+         double        s0 = 0., s1 = 0., s2 = 0., s3 = 0.;
+         for(l = 0; l < k; l++){
+            s0 += a[l]*b0[l];
+            s1 += a[l]*b1[l];
+            s2 += a[l]*b2[l];
+            s3 += a[l]*b3[l];
+         }
+         C[i + (long) ldc*j]     += s0;
+         C[i + (long) ldc*(j+1)] += s1;
+         C[i + (long) ldc*(j+2)] += s2;
+         C[i + (long) ldc*(j+3)] += s3;
+      }
+      for(; j < n; j++){
+         const double* b = B + (long) ldb*j;
+         double        s = 0.;
+         for(l = 0; l < k; l++) s += a[l]*b[l];
+         C[i + (long) ldc*j] += s;
+      }
+   }
+}
+
+/*
+ * Page kernels: one small matrix (a page of a m x n x np array) at a time.
+ * The sizes of deformation gradients, elasticity matrices and element
+ * Jacobians (2, 3, 4, 6, 8) are passed as constants to the inline kernels
+ * below so that the compiler unrolls their loops.
+ */
+
+static inline void gemmPageKernel (int m, int n, int k, const double* A, long ra, long ca,
+                                   const double* B, long rb, long cb, double* C)
+{
+   int i, j, l;
+
+   for(j = 0; j < n; j++)
+      for(i = 0; i < m; i++){
+         double s = 0.;
+         for(l = 0; l < k; l++) s += A[i*ra + l*ca]*B[l*rb + j*cb];
+         C[i + m*j] = s;
+      }
+}
+
+void gemmPage (char ta, char tb, int m, int n, int k, const double* A, const double* B, double* C)
+/*
+ * C (m x n) = op(A)*op(B), op(A) m x k, op(B) k x n; ta, tb 'N' or 'T'.
+ * A is stored m x k ('N') or k x m ('T'), B k x n or n x k.
+ */
+{
+   long ra = ( ta == 'N' ) ? 1 : k, ca = ( ta == 'N' ) ? m : 1;
+   long rb = ( tb == 'N' ) ? 1 : n, cb = ( tb == 'N' ) ? k : 1;
+
+   switch ( k ){
+      case 2 : gemmPageKernel (m, n, 2, A, ra, ca, B, rb, cb, C); break;
+      case 3 : gemmPageKernel (m, n, 3, A, ra, ca, B, rb, cb, C); break;
+      case 4 : gemmPageKernel (m, n, 4, A, ra, ca, B, rb, cb, C); break;
+      case 6 : gemmPageKernel (m, n, 6, A, ra, ca, B, rb, cb, C); break;
+      case 8 : gemmPageKernel (m, n, 8, A, ra, ca, B, rb, cb, C); break;
+      default: gemmPageKernel (m, n, k, A, ra, ca, B, rb, cb, C);
+   }
+}
+
+static inline int luPageKernel (int n, double* A, int* piv, double* det)
+/*
+ * In place LU factorisation with partial pivoting, A = P*L*U. Returns 0 if
+ * A is singular.
+ */
+{
+   int    i, j, l, r;
+   double d = 1.;
+
+   for(l = 0; l < n; l++){
+      r = l;
+      for(i = l+1; i < n; i++) if ( fabs(A[i+n*l]) > fabs(A[r+n*l]) ) r = i;
+      piv[l] = r;
+      if ( A[r+n*l] == 0. ){ *det = 0.; return 0; }
+      if ( r != l ){
+         for(j = 0; j < n; j++){ double t = A[l+n*j]; A[l+n*j] = A[r+n*j]; A[r+n*j] = t; }
+         d = -d;
+      }
+      d *= A[l+n*l];
+      for(i = l+1; i < n; i++){
+         double f = A[i+n*l] /= A[l+n*l];
+         for(j = l+1; j < n; j++) A[i+n*j] -= f*A[l+n*j];
+      }
+   }
+   *det = d;
+   return 1;
+}
+
+static inline void luSolvePageKernel (int n, int nrhs, const double* LU, const int* piv, double* X)
+/*
+ * X (n x nrhs) = A\X with A = P*L*U from luPageKernel
+ */
+{
+   int i, j, l;
+
+   for(j = 0; j < nrhs; j++){
+      double* x = X + n*j;
+      for(l = 0; l < n; l++)
+         if ( piv[l] != l ){ double t = x[l]; x[l] = x[piv[l]]; x[piv[l]] = t; }
+      for(l = 0; l < n; l++)
+         for(i = l+1; i < n; i++) x[i] -= LU[i+n*l]*x[l];
+      for(l = n-1; l >= 0; l--){
+         x[l] /= LU[l+n*l];
+         for(i = 0; i < l; i++) x[i] -= LU[i+n*l]*x[l];
+      }
+   }
+}
+
+static inline int solvePageKernel (int n, int nrhs, const double* A, double* X, double* det)
+{
+   double LU[PAGE_MAX_SIZE*PAGE_MAX_SIZE];
+   int    piv[PAGE_MAX_SIZE];
+
+   memcpy(LU, A, n*n*sizeof(double));
+   if ( !luPageKernel (n, LU, piv, det) ) return 0;
+   luSolvePageKernel (n, nrhs, LU, piv, X);
+   return 1;
+}
+
+int solvePage (int n, int nrhs, const double* A, double* X, double* det)
+/*
+ * X (n x nrhs) = A\X for n <= PAGE_MAX_SIZE, det = det(A). Closed form for
+ * n = 2, 3 (Cramer's rule, as inv(J0) of the 2D/3D elements). Returns 0,
+ * leaving X untouched, if A is singular.
+ */
+{
+   int    j;
+   double d, x0, x1, x2;
+
+   switch ( n ){
+      case 2 :
+         d = A[0]*A[3] - A[1]*A[2];
+         *det = d;
+         if ( d == 0. ) return 0;
+         for(j = 0; j < nrhs; j++){
+            x0 = X[2*j]; x1 = X[2*j+1];
+            X[2*j]   = ( A[3]*x0 - A[2]*x1)/d;
+            X[2*j+1] = (-A[1]*x0 + A[0]*x1)/d;
+         }
+         return 1;
+      case 3 : {
+         /* cofactors cij of A(i,j) = A[i+3j] */
+         double c00 = A[4]*A[8] - A[7]*A[5], c01 = A[7]*A[2] - A[1]*A[8], c02 = A[1]*A[5] - A[4]*A[2];
+         double c10 = A[6]*A[5] - A[3]*A[8], c11 = A[0]*A[8] - A[6]*A[2], c12 = A[3]*A[2] - A[0]*A[5];
+         double c20 = A[3]*A[7] - A[6]*A[4], c21 = A[6]*A[1] - A[0]*A[7], c22 = A[0]*A[4] - A[3]*A[1];
+         d = A[0]*c00 + A[3]*c01 + A[6]*c02;
+         *det = d;
+         if ( d == 0. ) return 0;
+         for(j = 0; j < nrhs; j++){
+            x0 = X[3*j]; x1 = X[3*j+1]; x2 = X[3*j+2];
+            X[3*j]   = (c00*x0 + c10*x1 + c20*x2)/d;
+            X[3*j+1] = (c01*x0 + c11*x1 + c21*x2)/d;
+            X[3*j+2] = (c02*x0 + c12*x1 + c22*x2)/d;
+         }
+         return 1;
+      }
+      case 4 : return solvePageKernel (4, nrhs, A, X, det);
+      case 6 : return solvePageKernel (6, nrhs, A, X, det);
+      case 8 : return solvePageKernel (8, nrhs, A, X, det);
+      default: return solvePageKernel (n, nrhs, A, X, det);
+   }
+}
+
+int invPage (int n, const double* A, double* X, double* det)
+/*
+ * X (n x n) = inv(A), det = det(A); returns 0 if A is singular
+ */
+{
+   int i;
+
+   memset(X, 0, n*n*sizeof(double));
+   for(i = 0; i < n; i++) X[i+n*i] = 1.;
+   return solvePage (n, n, A, X, det);
+}
@@ -0,0 +1,16 @@
+/*
+ * Declaration of the small dense matrix product used by the cell-batched
+ * particles to nodes transfer (ParticlesToNodesBspline), and of the page
+ * kernels of PageMatrix.c.
+ * Matrices are column-major as in Matlab (and as dgemm in blas.c), with
+ * leading dimensions lda, ldb, ldc.
+ * Definition given in file gemm.c
+ */
+
+#define PAGE_MAX_SIZE 16
+
+void gemmTN (int m, int n, int k, const double* A, int lda, const double* B, int ldb, double* C, int ldc);
+
+void gemmPage  (char ta, char tb, int m, int n, int k, const double* A, const double* B, double* C);
+int  solvePage (int n, int nrhs, const double* A, double* X, double* det);
+int  invPage   (int n, const double* A, double* X, double* det);
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mapfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+int mapFile (const char* name, MappedFile* f)
+/*
+ * map the file name read-only, returns 0 if it cannot be opened or is empty
+ */
+{
+#ifdef _WIN32
+   LARGE_INTEGER sz;
+   HANDLE        file, map;
+
+   file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+   if ( file == INVALID_HANDLE_VALUE ) return 0;
+   if ( !GetFileSizeEx(file, &sz) || sz.QuadPart == 0 ){ CloseHandle(file); return 0; }
+   f->size = (size_t) sz.QuadPart;
+   map     = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+   if ( map == NULL ){ CloseHandle(file); return 0; }
+   f->data = (const char*) MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+   if ( f->data == NULL ){ CloseHandle(map); CloseHandle(file); return 0; }
+   f->handle[0] = file;
+   f->handle[1] = map;
+#else
+   struct stat st;
+   void*       data;
+   int         fd = open(name, O_RDONLY);
+
+   if ( fd < 0 ) return 0;
+   if ( fstat(fd, &st) != 0 || st.st_size == 0 ){ close(fd); return 0; }
+   f->size = (size_t) st.st_size;
+   data    = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if ( data == MAP_FAILED ) return 0;
+   madvise(data, f->size, MADV_SEQUENTIAL);
+   f->data = (const char*) data;
+#endif
+   return 1;
+}
+
+void unmapFile (MappedFile* f)
+{
+#ifdef _WIN32
+   UnmapViewOfFile(f->data);
+   CloseHandle((HANDLE) f->handle[1]);
+   CloseHandle((HANDLE) f->handle[0]);
+#else
+   munmap((void*) f->data, f->size);
+#endif
+}
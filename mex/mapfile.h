@@ -0,0 +1,16 @@
+/*
+ * Declaration of read-only memory-mapped files, used by the file readers
+ * (ReadGmsh.c, PlyIO.c) to parse a whole file in place.
+ * Definition given in file mapfile.c
+ */
+
+#include <stddef.h>
+
+typedef struct {
+   const char* data;
+   size_t      size;
+   void*       handle[2];   /* file and mapping handles on Windows */
+} MappedFile;
+
+int  mapFile   (const char* name, MappedFile* f);
+void unmapFile (MappedFile* f);
@@ -1,4 +1,9 @@
+#include <stdio.h>
 #include<math.h>
+#include "matrix.h"
+#include "mex.h"
+#include "basis.h"
+#include "util.h"
 
 void getNodesForParticle2D(double x, double y, double dx, double dy, int numx, int numy, int* nodes )
 /*
@@ -59,3 +64,374 @@ void getNodesForParticleGIMP2D(double x, double y, double dx, double dy, int num
   nodes[14] = n4 + 1;
   nodes[15] = n4 + 2;
 }
+
+mxArray* getBodyField(const mxArray* bodies, mwIndex ib, const char* name)
+/*
+ * Field 'name' of body ib, bodies being either a cell array of structures
+ * (bodies{ib}) or a structure array (bodies(ib)).
+ */
+{
+  if ( mxIsCell(bodies) ) return mxGetField(mxGetCell(bodies, ib), 0, name);
+  return mxGetField(bodies, ib, name);
+}
+
+long findLayerSlot(const double* layerNode, mwSize lo, mwSize hi, int node)
+/*
+ * Position of (zero-based) node in the sorted one-based node list
+ * layerNode[lo..hi-1] of a body layer, -1 if the body is not on that node.
+ */
+{
+  double id = node + 1.;
+  while ( lo < hi ){
+    mwSize mid = lo + (hi-lo)/2;
+    if      ( layerNode[mid] < id ) lo = mid + 1;
+    else if ( layerNode[mid] > id ) hi = mid;
+    else return (long) mid;
+  }
+  return -1;
+}
+
+int getBsplineGrid(const mxArray* grid, int* nsd, double* h, int* nel, int* p, double* org)
+/*
+ * Uniform B-spline grid: deltax, deltay, numx, numy (elements), degree
+ * (default 2) and optionally xmin, ymin (origin, default 0); 3D if it has
+ * numz and deltaz. Returns 0 if the degree is not supported.
+ */
+{
+  const char* dname[3] = {"deltax", "deltay", "deltaz"};
+  const char* nname[3] = {"numx", "numy", "numz"};
+  const char* oname[3] = {"xmin", "ymin", "zmin"};
+  mxArray*    deg      = mxGetField(grid, 0, "degree");
+  int         d;
+
+  *nsd = ( mxGetField(grid, 0, "numz") != NULL ) ? 3 : 2;
+  *p   = ( deg != NULL ) ? (int) mxGetScalar(deg) : 2;
+  for(d = 0; d < *nsd; d++){
+    mxArray* o = mxGetField(grid, 0, oname[d]);
+    h[d]   = mxGetScalar(mxGetField(grid, 0, dname[d]));
+    nel[d] = (int) mxGetScalar(mxGetField(grid, 0, nname[d]));
+    org[d] = ( o != NULL ) ? mxGetScalar(o) : 0.;
+  }
+  return *p >= 1 && *p <= BSPLINE_MAX_DEGREE;
+}
+
+void bucketParticlesByCell(int nsd, const double* coord, mwSize np, const double* org,
+                           const double* h, const int* nel, mwSize* start, mwSize* order)
+/*
+ * Counting sort of the np particles (coord np x nsd) by the grid cell they
+ * are in, cells numbered x fastest and particles outside the grid put in the
+ * nearest boundary cell (as computeBsplineBasis1D does). The particles of
+ * cell c are order[start[c]..start[c+1]-1]; start has ncell+1 entries.
+ */
+{
+  mwSize ncell = (mwSize) nel[0]*nel[1]*( nsd == 3 ? nel[2] : 1 ), c, ip;
+  mwSize *cell = (mwSize*) mxMalloc((np+1)*sizeof(mwSize));
+  int     d;
+
+  for(c = 0; c <= ncell; c++) start[c] = 0;
+  for(ip = 0; ip < np; ip++){
+    mwSize id = 0, stride = 1;
+    for(d = 0; d < nsd; d++){
+      int e = (int) floor((coord[ip + d*np] - org[d])/h[d]);
+      if ( e < 0 )          e = 0;
+      if ( e > nel[d] - 1 ) e = nel[d] - 1;
+      id     += stride*e;
+      stride *= nel[d];
+    }
+    cell[ip] = id;
+    start[id+1]++;
+  }
+  for(c = 0; c < ncell; c++) start[c+1] += start[c];
+  for(ip = 0; ip < np; ip++) order[start[cell[ip]]++] = ip;
+  for(c = ncell; c > 0; c--) start[c] = start[c-1];   /* undo the shift of the fill */
+  start[0] = 0;
+  mxFree(cell);
+}
+
+int getBsplineGridData(const mxArray* grid, BsplineGrid* g)
+/*
+ * getBsplineGrid plus the node, cell and stencil counts of the grid.
+ * Returns 0 if the degree is not supported.
+ */
+{
+  g->nel[0] = g->nel[1] = g->nel[2] = 1;
+  if ( !getBsplineGrid(grid, &g->nsd, g->h, g->nel, &g->p, g->org) ) return 0;
+  g->nodeCount = (mwSize)(g->nel[0]+g->p)*(g->nel[1]+g->p)*( g->nsd == 3 ? g->nel[2]+g->p : 1 );
+  g->ncell     = (mwSize) g->nel[0]*g->nel[1]*( g->nsd == 3 ? g->nel[2] : 1 );
+  g->nn        = ( g->nsd == 3 ) ? (g->p+1)*(g->p+1)*(g->p+1) : (g->p+1)*(g->p+1);
+  return 1;
+}
+
+double* getBodyValues(const char* caller, const mxArray* bodies, mwIndex ib, const char* name,
+                      mwSize np, int required, mwSize* stride)
+/*
+ * Field name of body ib, a scalar (*stride = 0) or one value per particle
+ * (*stride = 1); NULL if the body has no such field and it is not required.
+ * Errors are reported as "caller: ...".
+ */
+{
+  mxArray *a = getBodyField(bodies, ib, name);
+  char     msg[160];
+
+  if ( a == NULL ){
+    if ( !required ) return NULL;
+    sprintf(msg, "%s: the bodies have no field %s", caller, name);
+    mexErrMsgTxt(msg);
+  }
+  if ( !mxIsDouble(a) || ( mxGetNumberOfElements(a) != 1 && mxGetNumberOfElements(a) != np ) ){
+    sprintf(msg, "%s: body field %s must be a scalar or have one value per particle", caller, name);
+    mexErrMsgTxt(msg);
+  }
+  *stride = ( mxGetNumberOfElements(a) == 1 && np != 1 ) ? 0 : 1;
+  return mxGetPr(a);
+}
+
+double* getBodyArray(const char* caller, const mxArray* bodies, mwIndex ib, const char* name,
+                     mwSize np, mwSize ncol)
+/*
+ * Field name of body ib, an np x ncol array.
+ */
+{
+  mxArray *a = getBodyField(bodies, ib, name);
+  char     msg[160];
+
+  if ( a == NULL || !mxIsDouble(a) || mxGetM(a) != np || mxGetN(a) != ncol ){
+    sprintf(msg, "%s: body field %s must be a %d-column array, one row per particle", caller, name, (int) ncol);
+    mexErrMsgTxt(msg);
+  }
+  return mxGetPr(a);
+}
+
+void cellStencil(const BsplineGrid* g, mwSize cell, int* nodes)
+/*
+ * The (p+1)^nsd nodes of a grid cell, numbered as computeBsplineBasisStencil
+ * (the basis of the particles of cell e starts at node e in every direction).
+ */
+{
+  int e[3] = {0, 0, 0}, nx = g->nel[0] + g->p, ny = g->nel[1] + g->p, a, b, c, d, in = 0;
+
+  for(d = 0; d < g->nsd; d++){
+    e[d]  = (int)( cell % g->nel[d] );
+    cell /= g->nel[d];
+  }
+  for(c = 0; c < ( g->nsd == 3 ? g->p+1 : 1 ); c++)
+    for(b = 0; b <= g->p; b++)
+      for(a = 0; a <= g->p; a++)
+        nodes[in++] = (e[0]+a) + nx*((e[1]+b) + ny*(e[2]+c));
+}
+
+long colourCells(const BsplineGrid* g, int color, int* off, int* cnt)
+/*
+ * Cells of one colour are p+1 cells apart in every direction, so their
+ * stencils do not overlap and they are processed in parallel without
+ * atomics; offsets and cell counts of the colour, returns the cell count.
+ */
+{
+  long tcount = 1;
+  int  d, c;
+
+  cnt[0] = cnt[1] = cnt[2] = 1;
+  for(d = 0, c = color; d < g->nsd; d++, c /= (g->p+1)){
+    off[d]  = c % (g->p+1);
+    cnt[d]  = ( g->nel[d] - off[d] + g->p )/(g->p+1);
+    tcount *= cnt[d];
+  }
+  return tcount;
+}
+
+mwSize colourCell(const BsplineGrid* g, const int* off, const int* cnt, long t)
+/*
+ * Cell t of the colour of colourCells.
+ */
+{
+  mwSize cell = 0, stride = 1;
+  int    d;
+
+  for(d = 0; d < g->nsd; d++){
+    cell   += stride*(off[d] + (g->p+1)*(t % cnt[d]));
+    t      /= cnt[d];
+    stride *= g->nel[d];
+  }
+  return cell;
+}
+
+void buildBasisCache(const BsplineGrid* g, const double* coord, mwSize np, mxArray* cache, mwIndex ib)
+/*
+ * Particles (coord np x nsd) grouped by cell and their basis functions
+ * (nn x np) and gradients (nn*nsd x np), column q for particle order(q),
+ * stored in the fields start, order, N and dN of cache(ib).
+ */
+{
+  mxArray   *st    = mxCreateNumericMatrix(g->ncell+1, 1, mxINT64_CLASS, mxREAL);
+  mxArray   *od    = mxCreateNumericMatrix(np, 1, mxINT64_CLASS, mxREAL);
+  mxArray   *fN    = mxCreateDoubleMatrix(g->nn, np, mxREAL);
+  mxArray   *fdN   = mxCreateDoubleMatrix(g->nn*g->nsd, np, mxREAL);
+  long long *start = (long long*) mxGetData(st), *order = (long long*) mxGetData(od);
+  double    *N     = mxGetPr(fN), *dN = mxGetPr(fdN);
+  mwSize    *s     = (mwSize*) mxMalloc((g->ncell+1)*sizeof(mwSize));
+  mwSize    *o     = (mwSize*) mxMalloc((np+1)*sizeof(mwSize)), i;
+  long       q;
+
+  bucketParticlesByCell(g->nsd, coord, np, g->org, g->h, g->nel, s, o);
+  for(i = 0; i <= g->ncell; i++) start[i] = (long long) s[i];
+  for(i = 0; i <  np;       i++) order[i] = (long long) o[i];
+  mxFree(s);
+  mxFree(o);
+
+  #pragma omp parallel
+  {
+    double x[3];
+    int    nodes[64], d;
+    #pragma omp for
+    for(q = 0; q < (long) np; q++){
+      mwSize ip = (mwSize) order[q];
+      for(d = 0; d < g->nsd; d++) x[d] = coord[ip+d*np] - g->org[d];
+      computeBsplineBasisStencil (g->nsd, x, g->h, g->nel, g->p, nodes,
+                                  N + g->nn*q, dN + g->nn*g->nsd*q);
+    }
+  }
+
+  mxSetField(cache, ib, "start", st);
+  mxSetField(cache, ib, "order", od);
+  mxSetField(cache, ib, "N",     fN);
+  mxSetField(cache, ib, "dN",    fdN);
+}
+
+int getBasisCache(const mxArray* cache, mwIndex ib, const BsplineGrid* g, mwSize np, BasisCache* B)
+/*
+ * The basis cache of body ib, built by buildBasisCache for np particles.
+ * Returns 0 if it does not match the grid or the particle count.
+ */
+{
+  const mxArray *st = mxIsStruct(cache) ? mxGetField(cache, ib, "start") : NULL;
+  const mxArray *od = mxIsStruct(cache) ? mxGetField(cache, ib, "order") : NULL;
+  const mxArray *fN = mxIsStruct(cache) ? mxGetField(cache, ib, "N")     : NULL;
+  const mxArray *fd = mxIsStruct(cache) ? mxGetField(cache, ib, "dN")    : NULL;
+
+  if ( st == NULL || od == NULL || fN == NULL || fd == NULL || !mxIsInt64(st) || !mxIsInt64(od) ||
+       mxGetNumberOfElements(st) != g->ncell+1 || mxGetNumberOfElements(od) != np ||
+       mxGetM(fN) != (mwSize) g->nn || mxGetN(fN) != np || mxGetNumberOfElements(fd) != g->nn*g->nsd*np )
+    return 0;
+  B->np    = np;
+  B->start = (const long long*) mxGetData(st);
+  B->order = (const long long*) mxGetData(od);
+  B->N     = mxGetPr(fN);
+  B->dN    = mxGetPr(fd);
+  return 1;
+}
+
+void particlesToNodesCached(const BsplineGrid* g, const BasisCache* B, const double* mass,
+                            const double* vol, const double* J, const double* velo,
+                            const double* stress, double grav,
+                            double* nmass, double* nmomenta, double* nforce)
+/*
+ * Nodal mass, momenta and forces -sum V sigma.dN - N m grav e_nsd of a body
+ * (stress Voigt, 3 or 6 columns), added to nmass, nmomenta and nforce. The
+ * particle volume is vol, times J when J is not NULL. Cells are processed
+ * in parallel, in (p+1)^nsd colours.
+ */
+{
+  mwSize np = B->np, nodeCount = g->nodeCount;
+  int    color, nsd = g->nsd, nn = g->nn;
+
+  for(color = 0; color < nn; color++){
+    int  off[3], cnt[3];
+    long t, tcount = colourCells(g, color, off, cnt);
+
+    #pragma omp parallel
+    {
+      double sig[3][3];
+      int    nodes[64];
+      #pragma omp for schedule(dynamic,4)
+      for(t = 0; t < tcount; t++){
+        mwSize cell = colourCell(g, off, cnt, t);
+        long   q;
+        int    i, j, k;
+        if ( B->start[cell+1] == B->start[cell] ) continue;
+        cellStencil(g, cell, nodes);
+        for(q = B->start[cell]; q < B->start[cell+1]; q++){
+          mwSize        ip = (mwSize) B->order[q];
+          const double *N  = B->N + nn*q, *dN = B->dN + nn*nsd*q;
+          double        m  = mass[ip], v = ( J != NULL ) ? vol[ip]*J[ip] : vol[ip];
+          if ( nsd == 3 ){
+            sig[0][0] = stress[ip];        sig[1][1] = stress[ip+  np];
+            sig[2][2] = stress[ip+2*np];   sig[1][2] = sig[2][1] = stress[ip+3*np];
+            sig[0][2] = sig[2][0] = stress[ip+4*np];
+            sig[0][1] = sig[1][0] = stress[ip+5*np];
+          }
+          else{
+            sig[0][0] = stress[ip];        sig[1][1] = stress[ip+np];
+            sig[0][1] = sig[1][0] = stress[ip+2*np];
+          }
+          for(k = 0; k < nn; k++){
+            mwSize id = nodes[k];
+            nmass[id] += N[k]*m;
+            for(i = 0; i < nsd; i++){
+              double fi = 0.;
+              for(j = 0; j < nsd; j++) fi -= sig[i][j]*dN[k*nsd+j];
+              nmomenta[id+i*nodeCount] += N[k]*m*velo[ip+i*np];
+              nforce[id+i*nodeCount]   += v*fi;
+            }
+            nforce[id+(nsd-1)*nodeCount] -= N[k]*m*grav;   /* gravity, -y (2D) or -z (3D) */
+          }
+        }
+      }
+    }
+  }
+}
+
+void updateParticleState(int nsd, mwSize ip, mwSize particleCount, double dtime,
+                         double L[3][3], double dtherm, const double* Cma, double* vol,
+                         const double* vol0, double* defo, double* strain, double* stress)
+/*
+ * F = (I + dt L) F_old, volume = volume0 * det F, strain += dt sym(L)
+ * (engineering shear strains) and stress += C (dstrain - dtherm I) (Hooke)
+ * of particle ip; dtherm is the thermal strain increment alpha*dT, on the
+ * normal components of the nsd x nsd strain as in mpmThermoMech2D.m, 0
+ * for a purely mechanical update (UpdateParticlesBspline).
+ */
+{
+  double A[3][3], F[3][3], Fnew[3][3], dstrain[6], delastic[6], detF;
+  int    nv = ( nsd == 3 ) ? 6 : 3, i, j, k;
+
+  for(i = 0; i < nsd; i++)
+    for(j = 0; j < nsd; j++){
+      A[i][j] = ( i == j ? 1. : 0. ) + dtime*L[i][j];
+      F[i][j] = defo[ip+(i+nsd*j)*particleCount];
+    }
+  for(i = 0; i < nsd; i++)
+    for(j = 0; j < nsd; j++){
+      Fnew[i][j] = 0.;
+      for(k = 0; k < nsd; k++) Fnew[i][j] += A[i][k]*F[k][j];
+      defo[ip+(i+nsd*j)*particleCount] = Fnew[i][j];
+    }
+  if ( nsd == 3 )
+    detF = Fnew[0][0]*(Fnew[1][1]*Fnew[2][2] - Fnew[1][2]*Fnew[2][1])
+         - Fnew[0][1]*(Fnew[1][0]*Fnew[2][2] - Fnew[1][2]*Fnew[2][0])
+         + Fnew[0][2]*(Fnew[1][0]*Fnew[2][1] - Fnew[1][1]*Fnew[2][0]);
+  else
+    detF = Fnew[0][0]*Fnew[1][1] - Fnew[0][1]*Fnew[1][0];
+  vol[ip] = vol0[ip]*detF;
+
+  if ( nsd == 3 ){
+    dstrain[0] = dtime*L[0][0];
+    dstrain[1] = dtime*L[1][1];
+    dstrain[2] = dtime*L[2][2];
+    dstrain[3] = dtime*(L[1][2]+L[2][1]);
+    dstrain[4] = dtime*(L[0][2]+L[2][0]);
+    dstrain[5] = dtime*(L[0][1]+L[1][0]);
+  }
+  else{
+    dstrain[0] = dtime*L[0][0];
+    dstrain[1] = dtime*L[1][1];
+    dstrain[2] = dtime*(L[0][1]+L[1][0]);
+  }
+  for(i = 0; i < nv; i++) delastic[i] = dstrain[i] - ( i < nsd ? dtherm : 0. );
+
+  for(i = 0; i < nv; i++){
+    double ds = 0.;
+    for(j = 0; j < nv; j++) ds += Cma[i+nv*j]*delastic[j];
+    strain[ip+i*particleCount] += dstrain[i];
+    stress[ip+i*particleCount] += ds;
+  }
+}
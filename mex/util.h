@@ -2,3 +2,44 @@
 void getNodesForParticle2D(double x, double y, double dx, double dy, int numx, int numy, int* nodes );
 void getNodesForParticle3D(double x, double y, double z, double dx, double dy, double dz, int numx, int numy, int numz, int* nodes );
 void getNodesForParticleGIMP2D(double x, double y, double dx, double dy, int numx, int numy, int* nodes );
+
+/* bodies may be a cell array of structs (bodies{ib}) or a struct array (bodies(ib)) */
+#include "matrix.h"
+mxArray* getBodyField(const mxArray* bodies, mwIndex ib, const char* name);
+long     findLayerSlot(const double* layerNode, mwSize lo, mwSize hi, int node);
+int      getBsplineGrid(const mxArray* grid, int* nsd, double* h, int* nel, int* p, double* org);
+void     bucketParticlesByCell(int nsd, const double* coord, mwSize np, const double* org,
+                               const double* h, const int* nel, mwSize* start, mwSize* order);
+
+/* uniform B-spline grid and per-step basis cache of the transfers of
+   ThermoMechMPM and FluidMPM (particles grouped by cell, N and dN of
+   particle order(q) in column q) */
+typedef struct {
+   int      nsd, p, nel[3], nn;
+   double   h[3], org[3];
+   mwSize   nodeCount, ncell;
+} BsplineGrid;
+
+typedef struct {
+   mwSize           np;
+   const long long *start, *order;
+   const double    *N, *dN;
+} BasisCache;
+
+int      getBsplineGridData(const mxArray* grid, BsplineGrid* g);
+double*  getBodyValues(const char* caller, const mxArray* bodies, mwIndex ib, const char* name,
+                       mwSize np, int required, mwSize* stride);
+double*  getBodyArray(const char* caller, const mxArray* bodies, mwIndex ib, const char* name,
+                      mwSize np, mwSize ncol);
+void     cellStencil(const BsplineGrid* g, mwSize cell, int* nodes);
+long     colourCells(const BsplineGrid* g, int color, int* off, int* cnt);
+mwSize   colourCell(const BsplineGrid* g, const int* off, const int* cnt, long t);
+void     buildBasisCache(const BsplineGrid* g, const double* coord, mwSize np, mxArray* cache, mwIndex ib);
+int      getBasisCache(const mxArray* cache, mwIndex ib, const BsplineGrid* g, mwSize np, BasisCache* B);
+void     particlesToNodesCached(const BsplineGrid* g, const BasisCache* B, const double* mass,
+                                const double* vol, const double* J, const double* velo,
+                                const double* stress, double grav,
+                                double* nmass, double* nmomenta, double* nforce);
+void     updateParticleState(int nsd, mwSize ip, mwSize particleCount, double dtime,
+                             double L[3][3], double dtherm, const double* Cma, double* vol,
+                             const double* vol0, double* defo, double* strain, double* stress);
@@ -39,6 +39,11 @@ di     = ones(numMP,1)*dmax*delta;
 % Note that data sampling points: xp,up
 ui1    = zeros(numnode,1);
 ui2    = zeros(numnode,1);
+useMex = exist('MLSBasis','file') == 3;   % mex/MLSBasis.c compiled
+if useMex
+  [ui1,cache1] = mlsProject([],node(:),xp,di,1,form,up);
+  [ui2,cache0] = mlsProject([],node(:),xp,di,0,form,up);
+else
 for i=1:numnode
   pt    = node(i);
   index = defineSupport(xp,pt,di);
@@ -47,6 +52,7 @@ for i=1:numnode
   phi   = mlsConstantBasis1D(pt,index,xp,di,form);  
   ui2(i) = dot(phi,up(index));
 end
+end
 
 
 %% visualisation
@@ -84,12 +90,17 @@ opts = struct('Color','rgb','Bounds','tight','FontMode','fixed','FontSize',20);
 %% Now, the real MLS stuff, constant function
 % Note that data sampling points: xp,upc
 ui1    = zeros(numnode,1);
+if useMex
+  % same points and sampling points: the cached shape functions are reused
+  [ui1,cache1] = mlsProject(cache1,node(:),xp,di,1,form,upc);
+else
 for i=1:numnode
   pt    = node(i);
   index = defineSupport(xp,pt,di);
   phi   = mlsLinearBasis1D(pt,index,xp,di,form);
   ui1(i) = dot(phi,upc(index));
 end
+end
 
 
 %% visualisation
@@ -0,0 +1,24 @@
+function [u,cache] = mlsProject(cache,points,nodes,di,order,form,uI,alpha)
+% Project the nodal values uI (nn x ncomp, e.g. particle velocities) to
+% 'points' with MLS shape functions: u = phi*uI.
+% Inputs:
+% cache  : [] or the cache returned by a previous call
+% points : npt x nsd, points where u is evaluated (grid nodes, cell centres)
+% nodes  : nn x nsd, nodes of the approximation (particles, data points)
+% di     : nn x 1, size of the support of the nodes
+% order  : 0, 1 or 2 (constant, linear or quadratic basis)
+% form   : 'cubic_spline', 'quartic_spline' or 'exp_spline'
+% alpha  : parameter of the 'exp_spline' weight (optional, default 0.3)
+%
+% The moment matrices are solved once by mex/MLSBasis.c and the shape
+% functions kept in 'cache' as CSR rows; as long as points, nodes, di and
+% the weight do not change, a call is only a sparse mat-vec.
+
+if nargin < 8, alpha = 0.3; end
+
+if isempty(cache) || ~isequal(cache.nodes,nodes) || ~isequal(cache.points,points) || ...
+    ~isequal(cache.di,di) || cache.order ~= order || ~strcmp(cache.form,form) || ...
+    cache.alpha ~= alpha
+  cache = MLSBasis('factor',points,nodes,di,order,form,alpha);
+end
+u = MLSBasis('apply',cache,uI);
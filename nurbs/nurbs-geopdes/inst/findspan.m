@@ -1,9 +1,10 @@
-function s = findspan(n,p,u,U)                
+function s = findspan(n,p,u,U,s0)              
 % FINDSPAN  Find the span of a B-Spline knot vector at a parametric point
 %
 % Calling Sequence:
 % 
 %   s = findspan(n,p,u,U)
+%   s = findspan(n,p,u,U,s0)
 % 
 %  INPUT:
 % 
@@ -11,6 +12,8 @@ function s = findspan(n,p,u,U)
 %    p - spline degree
 %    u - parametric point
 %    U - knot sequence
+%    s0 - (optional) spans at a previous evaluation, only used as a
+%         starting guess by the compiled version (src/findspan.cc)
 % 
 %  OUTPUT:
 % 
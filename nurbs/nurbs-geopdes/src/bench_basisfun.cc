@@ -0,0 +1,115 @@
+/* Copyright (C) 2009 Carlo de Falco
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Timing of the degree-specialised B-Spline kernels of bspline_kernels.h
+// against the generic ones, built with 'make bench' (no Octave needed):
+//
+//   ./bench_basisfun [npt]
+//
+// For p = 1, 2, 3 it evaluates basisfun and basisfunder (nders = 2) at npt
+// random points of an open uniform knot vector with 64 elements, checks
+// that both paths give the same values and prints ns per point.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include "bspline_kernels.h"
+
+static double now ()
+{
+  timespec t;
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+int main (int argc, char **argv)
+{
+  long npt = (argc > 1) ? atol (argv[1]) : 2000000;
+  const int nel = 64, nders = 2, nrep = 5;
+
+  std::vector<double> u (npt), N ((BSP_MAX_DEGREE+1)*(nders+1));
+  std::vector<double> work ((BSP_MAX_DEGREE+1)*(BSP_MAX_DEGREE+5));
+  std::vector<long>   s (npt);
+
+  srand (1);
+  for (long k = 0; k < npt; k++)
+    u[k] = rand () / (RAND_MAX + 1.0);
+
+  printf ("npt = %ld, times in ns per point (best of %d)\n", npt, nrep);
+  printf ("  p  basisfun: generic  fixed  speedup   basisfunder: generic  fixed  speedup\n");
+
+  for (int p = 1; p <= 3; p++)
+    {
+      // open uniform knot vector, n+1 = nel+p basis functions
+      std::vector<double> U;
+      for (int j = 0; j < p; j++) U.push_back (0.0);
+      for (int j = 0; j <= nel; j++) U.push_back (double (j) / nel);
+      for (int j = 0; j < p; j++) U.push_back (1.0);
+      long n = nel + p - 1;
+      for (long k = 0; k < npt; k++)
+	s[k] = bsp_findspan (n, u[k], &U[0]);
+
+      double t[4], err = 0.0;
+      volatile double sink = 0.0;
+      for (int c = 0; c < 4; c++)
+	{
+	  t[c] = 1e30;
+	  for (int r = 0; r < nrep; r++)
+	    {
+	      double t0 = now ();
+	      for (long k = 0; k < npt; k++)
+		{
+		  switch (c)
+		    {
+		    case 0: bsp_basisfun_generic (s[k], u[k], p, &U[0], &N[0], &work[0]); break;
+		    case 1: bsp_basisfun (s[k], u[k], p, &U[0], &N[0], &work[0]); break;
+		    case 2: bsp_basisfunder_generic (s[k], p, u[k], &U[0], nders, &N[0], &work[0]); break;
+		    case 3: bsp_basisfunder (s[k], p, u[k], &U[0], nders, &N[0], &work[0]); break;
+		    }
+		  sink += N[p];
+		}
+	      t[c] = std::min (t[c], now () - t0);
+	    }
+	}
+
+      // the specialised kernels must reproduce the generic ones
+      double Ng[3*(BSP_MAX_DEGREE+1)], Nf[3*(BSP_MAX_DEGREE+1)];
+      for (long k = 0; k < std::min (npt, 10000L); k++)
+	{
+	  bsp_basisfun_generic (s[k], u[k], p, &U[0], Ng, &work[0]);
+	  bsp_basisfun (s[k], u[k], p, &U[0], Nf, &work[0]);
+	  for (int j = 0; j <= p; j++)
+	    err = std::max (err, fabs (Ng[j] - Nf[j]));
+	  bsp_basisfunder_generic (s[k], p, u[k], &U[0], nders, Ng, &work[0]);
+	  bsp_basisfunder (s[k], p, u[k], &U[0], nders, Nf, &work[0]);
+	  for (int j = 0; j < (nders+1)*(p+1); j++)
+	    err = std::max (err, fabs (Ng[j] - Nf[j]) / (1.0 + fabs (Ng[j])));
+	}
+
+      for (int c = 0; c < 4; c++)
+	t[c] *= 1e9 / npt;
+      printf ("  %d  %17.1f %6.1f %7.2fx %21.1f %6.1f %7.2fx   (max diff %.1e)\n",
+	      p, t[0], t[1], t[0]/t[1], t[2], t[3], t[2]/t[3], err);
+      if (err > 1e-12)
+	{
+	  fprintf (stderr, "bench_basisfun: results differ for p = %d\n", p);
+	  return 1;
+	}
+    }
+  return 0;
+}
@@ -0,0 +1,476 @@
+/* Copyright (C) 2009 Carlo de Falco
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// B-Spline kernels on plain arrays (no Octave or MATLAB types), shared
+// by the Octave DLD functions through low_level_functions.cc and by the
+// MATLAB MEX files. Knot vectors are zero-based double arrays, spans and
+// basis function indices are zero-based as in findspan and numbasisfun.
+
+#ifndef BSPLINE_KERNELS_H
+#define BSPLINE_KERNELS_H
+
+#include <algorithm>
+
+inline long bsp_findspan (long n, double u, const double *U)
+
+// Knot span of u: the last index j <= n such that U[j] <= u (0 if there
+// is none), found by binary search.
+
+{
+  return (std::upper_bound (U+1, U+n+1, u) - U - 1);
+}
+
+inline long bsp_findspan (long n, double u, const double *U, long hint)
+
+// Same as bsp_findspan (n, u, U) starting from the guess hint: galloping
+// search in steps 1, 2, 4, ... finished by a binary search, O(1) if u is
+// still in (or next to) the hinted span.
+
+{
+  long lo, hi, step = 1;
+
+  if (hint < 0) hint = 0;
+  if (hint > n) hint = n;
+
+  if (hint == 0 || U[hint] <= u)
+    {
+      // s >= hint: check the hinted span first
+      if (hint == n || u < U[hint+1])
+	return (hint);
+      lo = hint + 1;
+      if (lo == n || u < U[lo+1])
+	return (lo);
+      hi = lo + 1;
+      while (hi <= n && U[hi] <= u)
+	{
+	  lo   = hi;
+	  step = 2*step;
+	  hi   = lo + step;
+	}
+      if (hi > n+1) hi = n+1;
+    }
+  else
+    {
+      // s < hint
+      hi = hint;
+      lo = hint - 1;
+      while (lo > 0 && u < U[lo])
+	{
+	  hi   = lo;
+	  step = 2*step;
+	  lo   = hi - step;
+	}
+      if (lo < 0) lo = 0;
+    }
+
+  // U[lo] <= u (or lo == 0) and u < U[hi] (or hi == n+1)
+  return (std::upper_bound (U+lo+1, U+hi, u) - U - 1);
+}
+
+inline void bsp_numbasisfun (long i, int p, long *N)
+
+// Indices of the p+1 basis functions that do not vanish in knot span i
+// (numbasisfun.m).
+
+{
+  for (int j = 0; j <= p; j++)
+    N[j] = i - p + j;
+}
+
+inline void bsp_basisfun_generic (long i, double u, int p, const double *U,
+				  double *N, double *work)
+
+// Nonvanishing basis functions N[0..p] at u in knot span i, Algorithm
+// A2.2 from 'The NURBS BOOK' pg70, for any degree. work holds 2*(p+1)
+// doubles.
+
+{
+  double *left = work, *right = work + p + 1;
+  double saved, temp;
+  int j, r;
+
+  N[0] = 1.0;
+  for (j = 1; j <= p; j++)
+    {
+      left[j]  = u - U[i+1-j];
+      right[j] = U[i+j] - u;
+      saved = 0.0;
+
+      for (r = 0; r < j; r++)
+	{
+	  temp  = N[r] / (right[r+1] + left[j-r]);
+	  N[r]  = saved + right[r+1] * temp;
+	  saved = left[j-r] * temp;
+	}
+
+      N[j] = saved;
+    }
+}
+
+// Full unrolling of the constant trip count loops of the degree-specialised
+// kernels below, which the compilers only do by themselves at -O3.
+#if defined (__clang__)
+#define BSP_UNROLL _Pragma ("unroll")
+#elif defined (__GNUC__)
+#define BSP_UNROLL _Pragma ("GCC unroll 16")
+#else
+#define BSP_UNROLL
+#endif
+
+template <int P>
+inline void bsp_knot_inverses (long i, const double *U, double inv[][P+1])
+
+// inv[d][r] = 1 / (U[i+r+1] - U[i+r+1-d]), d = 1..P, r = 0..d-1: the
+// denominators of the Cox-de Boor recursion at degree d, which are also
+// those of the derivative recursion. None of them vanishes in a non-empty
+// span i. They do not depend on u, so all divisions are independent and
+// issued before the recursion instead of on its critical path.
+
+{
+  BSP_UNROLL
+  for (int d = 1; d <= P; d++)
+    BSP_UNROLL
+    for (int r = 0; r < d; r++)
+      inv[d][r] = 1.0 / (U[i+r+1] - U[i+r+1-d]);
+}
+
+template <int P>
+inline void bsp_basisfun_fixed (long i, double u, const double *U, double *N)
+
+// Same as bsp_basisfun_generic for the degree P known at compile time:
+// all loops have constant trip counts and are unrolled, the work arrays
+// are fixed-size locals and the recursion itself has no divisions.
+
+{
+  double inv[P+1][P+1], left[P+1], right[P+1], saved, temp;
+
+  bsp_knot_inverses<P> (i, U, inv);
+  BSP_UNROLL
+  for (int j = 1; j <= P; j++)
+    {
+      left[j]  = u - U[i+1-j];
+      right[j] = U[i+j] - u;
+    }
+
+  N[0] = 1.0;
+  BSP_UNROLL
+  for (int j = 1; j <= P; j++)
+    {
+      saved = 0.0;
+      BSP_UNROLL
+      for (int r = 0; r < j; r++)
+	{
+	  temp  = N[r] * inv[j][r];
+	  N[r]  = saved + right[r+1] * temp;
+	  saved = left[j-r] * temp;
+	}
+      N[j] = saved;
+    }
+}
+
+inline void bsp_basisfun (long i, double u, int p, const double *U,
+			  double *N, double *work)
+
+// Nonvanishing basis functions N[0..p] at u in knot span i. Linear,
+// quadratic and cubic splines use the specialised kernels, other degrees
+// the generic one (work holds 2*(p+1) doubles, unused for p <= 3).
+
+{
+  switch (p)
+    {
+    case 0: N[0] = 1.0; break;
+    case 1: bsp_basisfun_fixed<1> (i, u, U, N); break;
+    case 2: bsp_basisfun_fixed<2> (i, u, U, N); break;
+    case 3: bsp_basisfun_fixed<3> (i, u, U, N); break;
+    default: bsp_basisfun_generic (i, u, p, U, N, work);
+    }
+}
+
+// Largest degree handled by the point-parallel evaluators below, whose
+// per-thread work arrays live on the stack.
+#define BSP_MAX_DEGREE 10
+#define BSP_MAX_NDERS  2
+
+inline void bsp_basisfunder_generic (long i, int p, double u, const double *U,
+				     int nders, double *ders, double *work)
+
+// Nonvanishing basis functions and their derivatives up to order nders
+// at u in knot span i, Algorithm A2.3 from 'The NURBS BOOK' pg72, for any
+// degree. ders[k*(p+1)+j] is the k-th derivative of basis function j.
+// work holds (p+1)*(p+3) + 2*(p+1) doubles.
+
+{
+  int     p1 = p + 1;
+  double *ndu = work, *left = ndu + p1*p1, *right = left + p1, *a = right + p1;
+  double  saved, temp, d;
+  int     j, k, r, s1, s2, rk, pk, j1, j2;
+
+  ndu[0] = 1.0;
+  for (j = 1; j <= p; j++)
+    {
+      left[j]  = u - U[i+1-j];
+      right[j] = U[i+j] - u;
+      saved = 0.0;
+      for (r = 0; r < j; r++)
+	{
+	  ndu[j*p1+r] = right[r+1] + left[j-r];                 // ndu(j,r)
+	  temp        = ndu[r*p1+j-1] / ndu[j*p1+r];
+	  ndu[r*p1+j] = saved + right[r+1]*temp;                // ndu(r,j)
+	  saved       = left[j-r]*temp;
+	}
+      ndu[j*p1+j] = saved;
+    }
+
+  for (j = 0; j <= p; j++)
+    ders[j] = ndu[j*p1+p];
+
+  for (r = 0; r <= p; r++)
+    {
+      s1 = 0; s2 = 1;
+      a[0] = 1.0;
+      for (k = 1; k <= nders; k++)
+	{
+	  d  = 0.0;
+	  rk = r - k;
+	  pk = p - k;
+	  if (r >= k)
+	    {
+	      a[s2*p1] = a[s1*p1] / ndu[(pk+1)*p1+rk];
+	      d = a[s2*p1] * ndu[rk*p1+pk];
+	    }
+	  j1 = (rk >= -1) ? 1 : -rk;
+	  j2 = (r-1 <= pk) ? k-1 : p-r;
+	  for (j = j1; j <= j2; j++)
+	    {
+	      a[s2*p1+j] = (a[s1*p1+j] - a[s1*p1+j-1]) / ndu[(pk+1)*p1+rk+j];
+	      d += a[s2*p1+j] * ndu[(rk+j)*p1+pk];
+	    }
+	  if (r <= pk)
+	    {
+	      a[s2*p1+k] = -a[s1*p1+k-1] / ndu[(pk+1)*p1+r];
+	      d += a[s2*p1+k] * ndu[r*p1+pk];
+	    }
+	  ders[k*p1+r] = d;
+	  j = s1; s1 = s2; s2 = j;
+	}
+    }
+
+  r = p;
+  for (k = 1; k <= nders; k++)
+    {
+      for (j = 0; j <= p; j++)
+	ders[k*p1+j] *= r;
+      r *= (p-k);
+    }
+}
+
+template <int P>
+inline void bsp_basisfunder_fixed (long i, double u, const double *U,
+				   int nders, double *ders)
+
+// Same as bsp_basisfunder_generic for the degree P known at compile time.
+// The basis functions of all degrees 0..P are kept (nd[d][0..d]) and the
+// k-th derivatives follow from those of degree P-k by applying k times
+//
+//   N'_{j,d} = d * (N_{j,d-1} / (U[j+d]-U[j]) - N_{j+1,d-1} / (U[j+d+1]-U[j+1]))
+//
+// with the knot inverses of the recursion, instead of the a[][] table of
+// Algorithm A2.3. Loops over the degree are unrolled.
+
+{
+  double inv[P+1][P+1], nd[P+1][P+1], left[P+1], right[P+1];
+  double D[P+1], saved, temp;
+
+  bsp_knot_inverses<P> (i, U, inv);
+  BSP_UNROLL
+  for (int j = 1; j <= P; j++)
+    {
+      left[j]  = u - U[i+1-j];
+      right[j] = U[i+j] - u;
+    }
+
+  nd[0][0] = 1.0;
+  BSP_UNROLL
+  for (int j = 1; j <= P; j++)
+    {
+      saved = 0.0;
+      BSP_UNROLL
+      for (int r = 0; r < j; r++)
+	{
+	  temp     = nd[j-1][r] * inv[j][r];
+	  nd[j][r] = saved + right[r+1] * temp;
+	  saved    = left[j-r] * temp;
+	}
+      nd[j][j] = saved;
+    }
+
+  BSP_UNROLL
+
+  for (int j = 0; j <= P; j++)
+    ders[j] = nd[P][j];
+
+  BSP_UNROLL
+
+  for (int k = 1; k <= nders; k++)
+    {
+      double *dk = ders + k*(P+1);
+      if (k > P)
+	{
+	  BSP_UNROLL
+	  for (int j = 0; j <= P; j++)
+	    dk[j] = 0.0;
+	  continue;
+	}
+      BSP_UNROLL
+      for (int j = 0; j <= P-k; j++)
+	D[j] = nd[P-k][j];
+      BSP_UNROLL
+      for (int d = P-k+1; d <= P; d++)
+	{
+	  D[d] = d * D[d-1] * inv[d][d-1];
+	  BSP_UNROLL
+	  for (int j = d-1; j > 0; j--)
+	    D[j] = d * (D[j-1] * inv[d][j-1] - D[j] * inv[d][j]);
+	  D[0] = -d * D[0] * inv[d][0];
+	}
+      BSP_UNROLL
+      for (int j = 0; j <= P; j++)
+	dk[j] = D[j];
+    }
+}
+
+inline void bsp_basisfunder (long i, int p, double u, const double *U,
+			     int nders, double *ders, double *work)
+
+// Nonvanishing basis functions and their derivatives up to order nders
+// (same as basisfunder in low_level_functions.cc), ders[k*(p+1)+j] is the
+// k-th derivative of basis function j. Linear, quadratic and cubic splines
+// with nders <= BSP_MAX_NDERS use the specialised kernels, otherwise work
+// holds (p+1)*(p+3) + 2*(p+1) doubles for the generic one.
+
+{
+  if (nders <= BSP_MAX_NDERS)
+    switch (p)
+      {
+      case 1: bsp_basisfunder_fixed<1> (i, u, U, nders, ders); return;
+      case 2: bsp_basisfunder_fixed<2> (i, u, U, nders, ders); return;
+      case 3: bsp_basisfunder_fixed<3> (i, u, U, nders, ders); return;
+      }
+  bsp_basisfunder_generic (i, p, u, U, nders, ders, work);
+}
+
+inline int bsp_srf_basis_ders (long npt, const double *u, const double *v,
+			       long m, long n, int p, int q,
+			       const double *U, const double *V,
+			       const double *w, long wstride, int nders,
+			       double *idx, double *R, double *Ru, double *Rv,
+			       double *Ruu, double *Ruv, double *Rvv)
+
+// Rational basis functions of a NURBS surface and their derivatives with
+// respect to u and v at the points (u[k], v[k]), k = 0..npt-1.
+//
+//   m, n    - number of control points - 1 in each direction
+//   p, q    - degrees
+//   U, V    - knot vectors
+//   w       - weights, the weight of control point (i,j) is
+//             w[wstride*(i + (m+1)*j)] (w = coefs+3, wstride = 4 for nrb.coefs)
+//   nders   - 0, 1 or 2: highest derivative computed
+//
+// The outputs are npt x (p+1)*(q+1) column-major arrays (the layout of
+// nrbbasisfun), column ii+(p+1)*jj belonging to basis function (Ik(ii), Jk(jj)):
+//   idx            - one-based index Ik+(m+1)*Jk+1 of the basis function
+//   R              - basis functions
+//   Ru, Rv         - first derivatives            (nders >= 1)
+//   Ruu, Ruv, Rvv  - second derivatives           (nders == 2)
+// Any output may be NULL.
+//
+// Points are processed in parallel. Every thread keeps its work arrays on
+// the stack and starts the span search from its previous point, so no
+// memory is allocated. Returns 0 if p or q exceed BSP_MAX_DEGREE.
+
+{
+  if (p > BSP_MAX_DEGREE || q > BSP_MAX_DEGREE || nders < 0 || nders > BSP_MAX_NDERS)
+    return (0);
+
+#pragma omp parallel
+  {
+    const int mx = BSP_MAX_DEGREE + 1;
+    double Nu[(BSP_MAX_NDERS+1)*mx], Nv[(BSP_MAX_NDERS+1)*mx];
+    double work[mx*(mx+2) + 2*mx], A[mx*mx];
+    long   Ik[mx], Jk[mx], spu = 0, spv = 0;
+
+#pragma omp for schedule(static)
+    for (long k = 0; k < npt; k++)
+      {
+	double W = 0.0, Wu = 0.0, Wv = 0.0, Wuu = 0.0, Wuv = 0.0, Wvv = 0.0;
+	int    ii, jj;
+
+	spu = bsp_findspan (m, u[k], U, spu);
+	spv = bsp_findspan (n, v[k], V, spv);
+	bsp_numbasisfun (spu, p, Ik);
+	bsp_numbasisfun (spv, q, Jk);
+	bsp_basisfunder (spu, p, u[k], U, nders, Nu, work);
+	bsp_basisfunder (spv, q, v[k], V, nders, Nv, work);
+
+	// weighted products and their sums (the denominator and its derivatives)
+	for (jj = 0; jj <= q; jj++)
+	  for (ii = 0; ii <= p; ii++)
+	    {
+	      double wij = w[wstride*(Ik[ii] + (m+1)*Jk[jj])];
+	      A[ii+(p+1)*jj] = wij;
+	      W += Nu[ii]*Nv[jj]*wij;
+	      if (nders >= 1)
+		{
+		  Wu += Nu[p+1+ii]*Nv[jj]*wij;
+		  Wv += Nu[ii]*Nv[q+1+jj]*wij;
+		}
+	      if (nders == 2)
+		{
+		  Wuu += Nu[2*(p+1)+ii]*Nv[jj]*wij;
+		  Wuv += Nu[p+1+ii]*Nv[q+1+jj]*wij;
+		  Wvv += Nu[ii]*Nv[2*(q+1)+jj]*wij;
+		}
+	    }
+
+	for (jj = 0; jj <= q; jj++)
+	  for (ii = 0; ii <= p; ii++)
+	    {
+	      long   c   = ii + (p+1)*jj, o = k + npt*c;
+	      double wij = A[c];
+	      double r   = Nu[ii]*Nv[jj]*wij/W, ru = 0.0, rv = 0.0;
+
+	      if (idx) idx[o] = double (Ik[ii] + (m+1)*Jk[jj] + 1);
+	      if (R)   R[o]   = r;
+	      if (nders >= 1)
+		{
+		  ru = (Nu[p+1+ii]*Nv[jj]*wij - r*Wu)/W;
+		  rv = (Nu[ii]*Nv[q+1+jj]*wij - r*Wv)/W;
+		  if (Ru) Ru[o] = ru;
+		  if (Rv) Rv[o] = rv;
+		}
+	      if (nders == 2)
+		{
+		  if (Ruu) Ruu[o] = (Nu[2*(p+1)+ii]*Nv[jj]*wij - 2.0*ru*Wu - r*Wuu)/W;
+		  if (Ruv) Ruv[o] = (Nu[p+1+ii]*Nv[q+1+jj]*wij - ru*Wv - rv*Wu - r*Wuv)/W;
+		  if (Rvv) Rvv[o] = (Nu[ii]*Nv[2*(q+1)+jj]*wij - 2.0*rv*Wv - r*Wvv)/W;
+		}
+	    }
+      }
+  }
+  return (1);
+}
+
+#endif
@@ -0,0 +1,110 @@
+/* Copyright (C) 2009 Carlo de Falco
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <octave/oct.h>
+#include "low_level_functions.h"
+
+DEFUN_DLD(findspan, args, nargout, "\n\
+ FINDSPAN  Find the span of a B-Spline knot vector at a parametric point\n\
+\n\
+ Calling Sequence:\n\
+\n\
+   s = findspan(n,p,u,U)\n\
+   s = findspan(n,p,u,U,s0)\n\
+\n\
+  INPUT:\n\
+\n\
+    n  - number of control points - 1\n\
+    p  - spline degree\n\
+    u  - parametric points\n\
+    U  - knot sequence\n\
+    s0 - (optional) spans of the same points at a previous evaluation,\n\
+         e.g. the spans of the particles at the previous time step\n\
+\n\
+  OUTPUT:\n\
+\n\
+    s - knot span index of every point\n\
+\n\
+  Binary search for the first point, then every point starts from the\n\
+  span of the point before it (or from s0): O(1) amortised per point\n\
+  for sorted points and for particles that stay in or move to a\n\
+  neighbouring span.\n\
+")
+{
+
+  octave_value_list retval;
+
+  if (args.length () < 4 || args.length () > 5)
+    {
+      print_usage ();
+      return retval;
+    }
+
+  int             n = args(0).idx_type_value();
+  int             p = args(1).idx_type_value();
+  const NDArray   u = args(2).array_value();
+  const RowVector U = args(3).row_vector_value();
+
+  if (!error_state)
+    {
+      octave_idx_type npt = u.length ();
+
+      if (npt > 0 && (u.max () > U(U.length () - 1) || u.min () < U(0)))
+	{
+	  error ("findspan: some value is outside the knot span");
+	  return retval;
+	}
+
+      Array<octave_idx_type> s (u.dims (), -1);
+      if (args.length () == 5)
+	{
+	  const NDArray s0 = args(4).array_value ();
+	  if (s0.length () != npt)
+	    {
+	      error ("findspan: s0 must have one span per point");
+	      return retval;
+	    }
+	  for (octave_idx_type ii(0); ii < npt; ii++)
+	    s(ii) = octave_idx_type (s0(ii));
+	}
+
+      findspans (n, p, npt, u.data (), U, s.fortran_vec ());
+
+      NDArray sout (u.dims ());
+      for (octave_idx_type ii(0); ii < npt; ii++)
+	sout(ii) = s(ii);
+      retval(0) = octave_value (sout);
+    }
+  return retval;
+}
+
+/*
+%!test
+%!  n = 3;
+%!  U = [0 0 0 1/2 1 1 1];
+%!  p = 2;
+%!  u = linspace(0, 1, 10);
+%!  s = findspan (n, p, u, U);
+%!  assert (s, [2*ones(1, 5) 3*ones(1, 5)]);
+%!  assert (findspan (n, p, u, U, 3*ones(1, 10)), s);
+%!test
+%! p = 2; m = 7; n = m - p - 1;
+%! U = [zeros(1,p)  linspace(0,1,m+1-2*p) ones(1,p)];
+%! u = [ 0   0.11880   0.55118   0.93141   0.40068   0.35492 0.44392   0.88360   0.35414   0.92186   0.83085   1];
+%! s = [2   2   3   4   3   3   3   4   3   4   4   4];
+%! assert (findspan (n, p, u, U), s, 1e-10);
+%! assert (findspan (n, p, u, U, fliplr (s)), s, 1e-10);
+*/
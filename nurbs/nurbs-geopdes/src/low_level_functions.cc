@@ -19,6 +19,7 @@
 
 #include <octave/oct.h>
 #include "low_level_functions.h"
+#include "bspline_kernels.h"
 #include <iostream>
 
 octave_idx_type findspan(int n, int p, double u, const RowVector& U)
@@ -68,11 +69,71 @@ Below is the original implementation from the NURBS Book
 */
 
 {
-  // FIXME : this implementation has linear, rather than log complexity
-  int ret = 0;
-  while ((ret++ < n) && (U(ret) <= u)) {
-  };
-  return (ret-1);
+  // the span is the number of knots U(1), ..., U(n) that are <= u,
+  // i.e. the last index j <= n such that U(j) <= u (0 if there is none).
+  // Same result as the linear scan
+  //   ret = 0; while ((ret++ < n) && (U(ret) <= u)) {}; return (ret-1);
+  // found with a binary search in log(n) steps (bspline_kernels.h)
+  return (bsp_findspan (n, u, U.data ()));
+}
+
+octave_idx_type findspan(int n, int p, double u, const RowVector& U, 
+			 octave_idx_type hint)
+
+// Find the knot span of the parametric point u starting from a guess.
+//
+// INPUT:
+//
+//   n    - number of control points - 1
+//   p    - spline degree       
+//   u    - parametric point    
+//   U    - knot sequence
+//   hint - expected knot span, e.g. the span of the previous point of a
+//          sorted sequence or the span of a particle at the previous step
+//
+// RETURN:
+//
+//   s - knot span, same as findspan (n, p, u, U)
+//
+// The search gallops from the hint in steps 1, 2, 4, ... and finishes
+// with a binary search, so it costs O(1) if u is still in (or next to)
+// the hinted span and O(log |s - hint|) otherwise.
+
+{
+  return (bsp_findspan (n, u, U.data (), hint));
+}
+
+void findspans(int n, int p, octave_idx_type npt, const double *u, 
+	       const RowVector& U, octave_idx_type *s)
+
+// Knot spans of a batch of parametric points.
+//
+// INPUT:
+//
+//   n   - number of control points - 1
+//   p   - spline degree       
+//   npt - number of points
+//   u   - parametric points
+//   U   - knot sequence
+//
+// OUTPUT:
+//
+//   s   - knot spans, on input (if s[0] >= 0) the spans of a previous
+//         call that are used as hints, e.g. the spans of the particles
+//         at the previous step
+//
+// Without hints every point starts from the span of the point before it,
+// so sorted or nearly sorted points cost O(1) amortised per point.
+
+{
+  bool hinted = (npt > 0 && s[0] >= 0);
+  octave_idx_type prev = 0;
+
+  for (octave_idx_type ii(0); ii < npt; ii++)
+    {
+      prev  = findspan (n, p, u[ii], U, hinted ? s[ii] : prev);
+      s[ii] = prev;
+    }
 }
 
 void basisfun(int i, double u, int p, const RowVector& U, RowVector& N)
@@ -92,30 +153,10 @@ void basisfun(int i, double u, int p, const RowVector& U, RowVector& N)
 //
 // Algorithm A2.2 from 'The NURBS BOOK' pg70.
 {
-  int j,r;
-  double saved, temp;
-
   // work space
-  OCTAVE_LOCAL_BUFFER(double, left,  p+1);
-  OCTAVE_LOCAL_BUFFER(double, right, p+1);
-  
-  N(0) = 1.0;
-  for (j = 1; j <= p; j++)
-    {
-      left[j]  = u - U(i+1-j);
-      right[j] = U(i+j) - u;
-      saved = 0.0;
-      
-      for (r = 0; r < j; r++)
-	{
-	  temp = N(r) / (right[r+1] + left[j-r]);
-	  N(r) = saved + right[r+1] * temp;
-	  saved = left[j-r] * temp;
-	} 
-      
-      N(j) = saved;
-    }
+  OCTAVE_LOCAL_BUFFER(double, work, 2*(p+1));
 
+  bsp_basisfun (i, u, p, U.data (), N.fortran_vec (), work);
 }
 
 
@@ -137,94 +178,18 @@ void basisfunder (int i, int pl, double u, const RowVector& u_knotl, int nders,
 //       ders - ders(n, i, :) (i-1)-th derivative at n-th point
 
 
-  //     ders = zeros(nders+1,pl+1);
-  Matrix ndu(octave_idx_type(pl+1), octave_idx_type(pl+1), 0.0); // ndu = zeros(pl+1,pl+1);
-  RowVector left(octave_idx_type(pl+1), 0.0);                    // left = zeros(pl+1);
-  RowVector right(left);                                         // right = zeros(pl+1);
-  Matrix a(2, octave_idx_type(pl+1), 0.0);                       // a = zeros(2,pl+1);
-  double saved = 0.0, d = 0.0, temp = 1.0;
-  octave_idx_type s1(0), s2(1), rk, pk, j, k, r, j1, j2;
+  // Algorithm A2.3 from 'The NURBS BOOK' pg72 (bspline_kernels.h), with
+  // ndu, left, right and a in one local work buffer instead of a Matrix
+  // or RowVector each
 
-  
-  ndu(0,0) = 1;                                                   // ndu(1,1) = 1;
-  
-  for (j=1; j<=pl; j++)                                           // for j = 1:pl
-    {
-      left(j) = u - u_knotl(i+1-j);                               // left(j+1) = u - u_knotl(i+1-j);
-      right(j) = u_knotl(i+j) - u;                                // right(j+1) = u_knotl(i+j) - u;
-      saved = 0.0;                                                // saved = 0;
-      for (r=0; r<=j-1; r++)                                      // for r = 0:j-1
-	{
-	  ndu(j, r) = right(r+1) + left(j-r);                     // ndu(j+1,r+1) = right(r+2) + left(j-r+1);
-	  temp = ndu(r,j-1)/ndu(j,r);                             // temp = ndu(r+1,j)/ndu(j+1,r+1);
-	  ndu(r,j) = saved + right(r+1)*temp;                     // ndu(r+1,j+1) = saved + right(r+2)*temp;
-	  saved = left(j-r)*temp;                                 // saved = left(j-r+1)*temp;
-	}                                                         // end
-      ndu(j,j) = saved;                                           // ndu(j+1,j+1) = saved;
-    }                                                             // end
-
-  for (j=0; j<=pl; j++)                                           // for j = 0:pl
-    ders(0,j) = ndu(j,pl);                                        // ders(1,j+1) = ndu(j+1,pl+1);
-                                                                  // end
-      
-  for (r=0; r<=pl; r++)                                           // for r = 0:pl
-    {
-      s1 = 0;                                                     // s1 = 0;
-      s2 = 1;                                                     // s2 = 1;
-      a(0,0) = 1;                                                 // a(1,1) = 1;
-        for (k=1; k<=nders; k++)                                  // for k = 1:nders %compute kth derivative
-	  {
-
-	    d = 0.0;                                              // d = 0;
-	    rk = r-k;                                             // rk = r-k;
-	    pk = pl - k;                                          // pk = pl-k;
-	    
-	    if (r >= k)                                           // if (r >= k)
-	      {
-		a(s2, 0) = a(s1, 0)/ndu(pk+1,rk);                 // a(s2+1,1) = a(s1+1,1)/ndu(pk+2,rk+1);
-		d = a(s2, 0)*ndu(rk,pk);                          // d = a(s2+1,1)*ndu(rk+1,pk+1);
-	      }                                                   // end
-	    
-	    if (rk >= -1)                                         // if (rk >= -1)
-	      j1 = 1;                                             // j1 = 1;
-	    else                                                  // else 
-	      j1 = -rk;                                           // j1 = -rk;
-	                                                          // end
-
-	    if ((r-1) <= pk)                                      // if ((r-1) <= pk)
-	      j2 = k-1;                                           // j2 = k-1;
-	    else                                                  // else 
-	     j2 = pl-r;                                           // j2 = pl-r;
-                                                                  // end
-
-	    for (j=j1; j <= j2; j++)                              // for j = j1:j2
-	      {
-		a(s2,j) = (a(s1,j) - a(s1,j-1))/ndu(pk+1,rk+j);   // a(s2+1,j+1) = (a(s1+1,j+1) - a(s1+1,j))/ndu(pk+2,rk+j+1);
-		d += a(s2,j)*ndu(rk+j,pk);                        // d = d + a(s2+1,j+1)*ndu(rk+j+1,pk+1);
-	      }                                                   // end
-
-	    if (r <= pk)                                          // if (r <= pk)
-	      {
-		a(s2,k) = -a(s1,k-1)/ndu(pk+1,r);                 // a(s2+1,k+1) = -a(s1+1,k)/ndu(pk+2,r+1);
-		d += a(s2,k)*ndu(r,pk);                           // d = d + a(s2+1,k+1)*ndu(r+1,pk+1);
-	      }	                                                  // end
-	    
-	    ders(k,r) = d;                                        // ders(k+1,r+1) = d;
-	    j = s1;                                               // j = s1;
-	    s1 = s2;                                              // s1 = s2;
-	    s2 = j;                                               // s2 = j;
-	  }                                                       // end
-    }                                                             // end
-
-  r = pl;                                                         // r = pl;
-  for (k=1; k <= nders; k++)                                      // for k = 1:nders
-    {
-      for (j=0; j<=pl; j++)                                       // for j = 0:pl
-	ders(k,j) = ders(k,j)*r;                                  // ders(k+1,j+1) = ders(k+1,j+1)*r;
-                                                                  // end
-      r = r*(pl-k);                                               // r = r*(pl-k);
-    }                                                             // end
-  
+  OCTAVE_LOCAL_BUFFER(double, work, (pl+1)*(pl+5));
+  OCTAVE_LOCAL_BUFFER(double, d, (nders+1)*(pl+1));
+
+  bsp_basisfunder (i, pl, u, u_knotl.data (), nders, d, work);
+
+  for (octave_idx_type k(0); k <= nders; k++)
+    for (octave_idx_type j(0); j <= pl; j++)
+      ders(k,j) = d[k*(pl+1)+j];
 }
 
 
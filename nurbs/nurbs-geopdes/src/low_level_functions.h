@@ -16,6 +16,12 @@
 
 octave_idx_type findspan(int n, int p, double u, const RowVector& U);
 
+octave_idx_type findspan(int n, int p, double u, const RowVector& U, 
+			 octave_idx_type hint);
+
+void findspans(int n, int p, octave_idx_type npt, const double *u, 
+	       const RowVector& U, octave_idx_type *s);
+
 void basisfun(int i, double u, int p, const RowVector& U, RowVector& N);
 
 void basisfunder (int i, int pl, double uu, const RowVector& u_knotl, 
@@ -16,15 +16,15 @@
 
 #include <octave/oct.h>
 #include <octave/oct-map.h>
-#include <octave/parse.h>
 #include "low_level_functions.h"
+#include "bspline_kernels.h"
 
 DEFUN_DLD(nrb_srf_basisfun__, args, nargout,"\
  NRB_SRF_BASISFUN__:  Undocumented private function\
 ")
 {
 
-  octave_value_list retval, newargs;
+  octave_value_list retval;
 
   const NDArray points = args(0).array_value();
   const Octave_map nrb = args(1).map_value();
@@ -47,74 +47,27 @@ DEFUN_DLD(nrb_srf_basisfun__, args, nargout,"\
       const NDArray v(points.index (idx).squeeze ()); // v = points(2,:);      
 
       octave_idx_type npt = u.length (); // npt = length(u);
-      RowVector M(p+1, 0.0), N (q+1, 0.0);
       Matrix RIkJk(npt, (p+1)*(q+1), 0.0);
       Matrix indIkJk(npt, (p+1)*(q+1), 0.0);
-      RowVector denom(npt, 0.0);
 
       const RowVector U(knots(0).row_vector_value ()); // U = nrb.knots{1};
 
       const RowVector V(knots(1).row_vector_value ()); // V = nrb.knots{2};
-      
-      Array<idx_vector> idx2(dim_vector (3, 1), idx_vector(':')); idx2(0) = 3;
-      NDArray w (coefs.index (idx2).squeeze ()); // w = squeeze(nrb.coefs(4,:,:));
-      
-      RowVector spu(u);
-      for (octave_idx_type ii(0); ii < npt; ii++)
-	{
-	  spu(ii) = findspan(m, p, u(ii), U);
-	} // spu  =  findspan (m, p, u, U); 
-
-      newargs(3) = U; newargs(2) = p; newargs(1) = u; newargs(0) = spu;
-      Matrix Ik = feval (std::string("numbasisfun"), newargs, 1)(0).matrix_value (); // Ik = numbasisfun (spu, u, p, U);
-
-      RowVector spv(v);
-      for (octave_idx_type ii(0); ii < v.length(); ii++)
-	{
-	  spv(ii) = findspan(n, q, v(ii), V);
-	} // spv  =  findspan (n, q, v, V);
-
-      newargs(3) = V; newargs(2) = q; newargs(1) = v; newargs(0) = spv;
-      Matrix Jk = feval (std::string("numbasisfun"), newargs, 1)(0).matrix_value (); // Jk = numbasisfun (spv, v, q, V);
 
-      Matrix NuIkuk(npt, p+1, 0.0);
-      for (octave_idx_type ii(0); ii < npt; ii++)
+      // spu = findspan (m, p, u, U); Ik = numbasisfun (spu, u, p, U);
+      // NuIkuk = basisfun (spu, u, p, U); (same for v) and 
+      // RIkJk(k, :) = NuIkuk(k, :).' * NvJkvk(k, :) .* w(Ik, Jk) / sum (...)
+      // for all points in one parallel pass, the weights
+      // w = squeeze(nrb.coefs(4,:,:)) are read in place
+      if (! bsp_srf_basis_ders (npt, u.data (), v.data (), m, n, p, q,
+				U.data (), V.data (), coefs.data () + 3, 4, 0,
+				indIkJk.fortran_vec (), RIkJk.fortran_vec (),
+				0, 0, 0, 0, 0))
 	{
-	  basisfun (int(spu(ii)), u(ii), p, U, M);
-	  NuIkuk.insert (M, ii, 0);
-	} // NuIkuk = basisfun (spu, u, p, U);
+	  error ("nrb_srf_basisfun__: degree larger than %d", BSP_MAX_DEGREE);
+	  return retval;
+	}
 
-      Matrix NvJkvk(v.length (), q+1, 0.0);
-      for (octave_idx_type ii(0); ii < npt; ii++)
-	{
-	  basisfun(int(spv(ii)), v(ii), q, V, N);
-	  NvJkvk.insert (N, ii, 0);
-	} // NvJkvk = basisfun (spv, v, q, V);
-
-
-      for (octave_idx_type k(0); k < npt; k++) 
-	for (octave_idx_type ii(0); ii < p+1; ii++) 
-	  for (octave_idx_type jj(0); jj < q+1; jj++) 
-	    denom(k) += NuIkuk(k, ii) * NvJkvk(k, jj) * w(Ik(k, ii), Jk(k, jj));
-
-      
-      for (octave_idx_type k(0); k < npt; k++) 
-	for (octave_idx_type ii(0); ii < p+1; ii++) 
-	  for (octave_idx_type jj(0); jj < q+1; jj++) 
-	    {
-	      RIkJk(k, octave_idx_type(ii+(p+1)*jj))  = NuIkuk(k, ii)*NvJkvk(k, jj) * w(Ik(k, ii), Jk(k, jj))/denom(k); 
-	      indIkJk(k, octave_idx_type(ii+(p+1)*jj))= Ik(k, ii)+(m+1)*Jk(k, jj)+1;
-	    }
-
-      // for k=1:npt
-      //       [Jkb, Ika] = meshgrid(Jk(k, :), Ik(k, :)); 
-      //       indIkJk(k, :)    = sub2ind([m+1, n+1], Ika(:)+1, Jkb(:)+1);
-      //       wIkaJkb(1:p+1, 1:q+1) = reshape (w(indIkJk(k, :)), p+1, q+1); 
-      
-      //       NuIkukaNvJkvk(1:p+1, 1:q+1) = (NuIkuk(k, :).' * NvJkvk(k, :));
-      //       RIkJk(k, :) = (NuIkukaNvJkvk .* wIkaJkb ./ sum(sum(NuIkukaNvJkvk .* wIkaJkb)))(:).';
-      //     end
-      
       retval(0) = RIkJk; // B = RIkJk;
       retval(1) = indIkJk; // N = indIkJk;
 
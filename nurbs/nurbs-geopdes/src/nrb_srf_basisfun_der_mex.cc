@@ -0,0 +1,84 @@
+/* Copyright (C) 2009 Carlo de Falco
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// MATLAB MEX version of nrb_srf_basisfun_der__.cc, built with 'make mex', i.e.
+//
+//   mex -largeArrayDims CXXFLAGS="\$CXXFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp"
+//       -output ../inst/private/nrb_srf_basisfun_der__ nrb_srf_basisfun_der_mex.cc
+//
+// so that it shadows inst/private/nrb_srf_basisfun_der__.m:
+//
+//   [Bu, Bv, N] = nrb_srf_basisfun_der__ (points, nrb)
+//   [Bu, Bv, N, B, Buu, Buv, Bvv] = nrb_srf_basisfun_der__ (points, nrb)
+//
+//   points        - 2 x npt parametric points
+//   nrb           - NURBS surface (nrbmak)
+//   Bu, Bv        - npt x (p+1)*(q+1) first derivatives of the rational basis functions
+//   N             - npt x (p+1)*(q+1) indices of the nonvanishing basis functions
+//   B             - rational basis functions
+//   Buu, Buv, Bvv - second derivatives (only computed if requested)
+//
+// All outputs are filled in one pass over the points (in parallel when built
+// with OpenMP) by bsp_srf_basis_ders of bspline_kernels.h.
+
+#include "mex.h"
+#include "bspline_kernels.h"
+
+void mexFunction (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+  if (nrhs != 2 || !mxIsStruct (prhs[1]))
+    mexErrMsgTxt ("nrb_srf_basisfun_der__: expected (points, nrb)");
+
+  const mxArray *nrb   = prhs[1];
+  const mxArray *knots = mxGetField (nrb, 0, "knots");
+  const double  *pts   = mxGetPr (prhs[0]);
+  const double  *coefs = mxGetPr (mxGetField (nrb, 0, "coefs"));
+  const double  *num   = mxGetPr (mxGetField (nrb, 0, "number"));
+  const double  *ord   = mxGetPr (mxGetField (nrb, 0, "order"));
+
+  if (!mxIsCell (knots) || mxGetNumberOfElements (knots) != 2)
+    mexErrMsgTxt ("nrb_srf_basisfun_der__: nrb must be a NURBS surface");
+
+  const double *U = mxGetPr (mxGetCell (knots, 0));
+  const double *V = mxGetPr (mxGetCell (knots, 1));
+
+  long m = long (num[0]) - 1, n = long (num[1]) - 1;   // m = size (nrb.coefs, 2) -1;
+  int  p = int (ord[0]) - 1,  q = int (ord[1]) - 1;    // p = nrb.order(1) -1;
+  long npt = long (mxGetN (prhs[0]));
+  long nb  = long (p+1)*(q+1);
+
+  // u = points(1,:), v = points(2,:)
+  double *u = (double*) mxMalloc (sizeof (double) * (2*npt + 1)), *v = u + npt;
+  for (long k = 0; k < npt; k++)
+    {
+      u[k] = pts[2*k];
+      v[k] = pts[2*k+1];
+    }
+
+  int nders = (nlhs > 4) ? 2 : 1;
+  for (int k = 0; k < (nders == 2 ? 7 : (nlhs > 3 ? 4 : 3)); k++)
+    plhs[k] = mxCreateDoubleMatrix (npt, nb, mxREAL);
+
+  int ok = bsp_srf_basis_ders (npt, u, v, m, n, p, q, U, V, coefs + 3, 4, nders,
+			       mxGetPr (plhs[2]), nlhs > 3 ? mxGetPr (plhs[3]) : 0,
+			       mxGetPr (plhs[0]), mxGetPr (plhs[1]),
+			       nders == 2 ? mxGetPr (plhs[4]) : 0,
+			       nders == 2 ? mxGetPr (plhs[5]) : 0,
+			       nders == 2 ? mxGetPr (plhs[6]) : 0);
+  mxFree (u);
+  if (!ok)
+    mexErrMsgTxt ("nrb_srf_basisfun_der__: degree larger than BSP_MAX_DEGREE");
+}
@@ -0,0 +1,78 @@
+/* Copyright (C) 2009 Carlo de Falco
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// MATLAB MEX version of nrb_srf_basisfun__.cc, built with 'make mex', i.e.
+//
+//   mex -largeArrayDims CXXFLAGS="\$CXXFLAGS -fopenmp" LDFLAGS="\$LDFLAGS -fopenmp"
+//       -output ../inst/private/nrb_srf_basisfun__ nrb_srf_basisfun_mex.cc
+//
+// so that it shadows inst/private/nrb_srf_basisfun__.m:
+//
+//   [B, N] = nrb_srf_basisfun__ (points, nrb)
+//
+//   points - 2 x npt parametric points
+//   nrb    - NURBS surface (nrbmak)
+//   B      - npt x (p+1)*(q+1) rational basis functions
+//   N      - npt x (p+1)*(q+1) indices of the nonvanishing basis functions
+//
+// Spans, basis function indices and values of a point are computed in one
+// pass with the kernels of bspline_kernels.h, without calling back into
+// MATLAB (findspan, numbasisfun and basisfun), in parallel over the points
+// when built with OpenMP.
+
+#include "mex.h"
+#include "bspline_kernels.h"
+
+void mexFunction (int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+  if (nrhs != 2 || !mxIsStruct (prhs[1]))
+    mexErrMsgTxt ("nrb_srf_basisfun__: expected (points, nrb)");
+
+  const mxArray *nrb   = prhs[1];
+  const mxArray *knots = mxGetField (nrb, 0, "knots");
+  const double  *pts   = mxGetPr (prhs[0]);
+  const double  *coefs = mxGetPr (mxGetField (nrb, 0, "coefs"));
+  const double  *num   = mxGetPr (mxGetField (nrb, 0, "number"));
+  const double  *ord   = mxGetPr (mxGetField (nrb, 0, "order"));
+
+  if (!mxIsCell (knots) || mxGetNumberOfElements (knots) != 2)
+    mexErrMsgTxt ("nrb_srf_basisfun__: nrb must be a NURBS surface");
+
+  const double *U = mxGetPr (mxGetCell (knots, 0));
+  const double *V = mxGetPr (mxGetCell (knots, 1));
+
+  long m = long (num[0]) - 1, n = long (num[1]) - 1;   // m = size (nrb.coefs, 2) -1;
+  int  p = int (ord[0]) - 1,  q = int (ord[1]) - 1;    // p = nrb.order(1) -1;
+  long npt = long (mxGetN (prhs[0]));
+  long nb  = long (p+1)*(q+1);
+
+  // u = points(1,:), v = points(2,:)
+  double *u = (double*) mxMalloc (sizeof (double) * (2*npt + 1)), *v = u + npt;
+  for (long k = 0; k < npt; k++)
+    {
+      u[k] = pts[2*k];
+      v[k] = pts[2*k+1];
+    }
+
+  plhs[0] = mxCreateDoubleMatrix (npt, nb, mxREAL);
+  plhs[1] = mxCreateDoubleMatrix (npt, nb, mxREAL);
+
+  int ok = bsp_srf_basis_ders (npt, u, v, m, n, p, q, U, V, coefs + 3, 4, 0,
+			       mxGetPr (plhs[1]), mxGetPr (plhs[0]), 0, 0, 0, 0, 0);
+  mxFree (u);
+  if (!ok)
+    mexErrMsgTxt ("nrb_srf_basisfun__: degree larger than BSP_MAX_DEGREE");
+}
@@ -10,30 +10,20 @@ else
     Q = 0;
 end
 
-Mp   = [];
-Vp   = [];
-xp   = [];
-
-for e=1:mesh.elemCount                 % start of element loop
-    if (mesh.ghostCell)
-        if (e==1) || (e==mesh.elemCount)
-            continue;
-        end
-    end
-    sctr = mesh.element(e,:);          %  element scatter vector
-    pts  = mesh.node(sctr,:);
-    for q=1:size(W,1)                           % quadrature loop
-        pt=Q(q,:);                              % quadrature point
-        wt=W(q);                                % quadrature weight
-        [N,dNdxi]=lagrange_basis('L2',pt);
-        J0 = norm(pts'*dNdxi);
-        x  = N'*pts;
-        
-        Vp  = [Vp;wt*J0];
-        Mp  = [Mp;wt*J0*rho];
-        xp  = [xp;x];
-    end
+% all elements at once (element by element, Gauss point by Gauss point)
+elems = 1:mesh.elemCount;
+if (mesh.ghostCell)
+    elems = elems(2:end-1);
 end
+x1 = mesh.node(mesh.element(elems,1),1)';
+x2 = mesh.node(mesh.element(elems,2),1)';
+J0 = abs(x2-x1)/2;                      % norm(pts'*dNdxi) of the L2 element
+N1 = (1-Q(:))/2;
+N2 = (1+Q(:))/2;
+
+xp = reshape(N1*x1 + N2*x2,[],1);
+Vp = reshape(W(:)*J0,[],1);
+Mp = Vp*rho;
 
 pCount = length(xp);
 
@@ -0,0 +1,105 @@
+function [res] = generateMP(geo,ppc,mesh,place,jitter,seed)
+%
+% Generate material points inside the geometry 'geo' on the structured
+% background mesh 'mesh' (buildGrid2D) with ppc x ppc particles per cell.
+%
+% geo.type = 'rectangle' : geo.x = [xmin xmax], geo.y = [ymin ymax]
+%            'circle'    : geo.center, geo.radius
+%            'polygon'   : geo.vertices (nv x 2)
+%            'sdf'       : geo.fd signed distance function (PolyMesher
+%                          dRectangle, dCircle, dDiff, ... last column is
+%                          the distance) or geo.tree its expression tree
+%                          (sdfOp, evaluated by SdfTree), and
+%                          geo.bbox = [xmin xmax ymin ymax]
+% place    = 'regular' (default, centres of the sub-cells), 'gauss' (Gauss
+%            points of the cells) or 'random' (sub-cell centres jittered by
+%            up to jitter/2 of a sub-cell, default 1, with the given seed;
+%            the mex and the MATLAB code do not draw the same numbers)
+%
+% res.position, res.volume: particles; res.elems: cells of the bounding box.
+% Uses the compiled SeedParticles (mex) when it is available: the
+% particles of every cell are counted, then generated in parallel.
+
+if nargin < 4 || isempty(place),  place  = 'regular'; end
+if nargin < 5 || isempty(jitter), jitter = 1;         end
+if nargin < 6 || isempty(seed),   seed   = 0;         end
+
+ppc = ppc(:)'.*[1 1];
+h   = [mesh.deltax mesh.deltay];
+org = min(mesh.node,[],1);
+nel = [mesh.numx mesh.numy];
+
+switch geo.type
+  case 'rectangle'
+    shape = 'box';     g = [geo.x(:)' geo.y(:)'];
+    bbox  = g;
+  case 'circle'
+    shape = 'circle';  g = [geo.center(:)' geo.radius];
+    bbox  = [geo.center(1)+[-1 1]*geo.radius geo.center(2)+[-1 1]*geo.radius];
+  case 'polygon'
+    shape = 'polygon'; g = geo.vertices;
+    bbox  = [min(g(:,1)) max(g(:,1)) min(g(:,2)) max(g(:,2))];
+  case 'sdf'
+    shape = 'box';     g = geo.bbox;
+    bbox  = g;
+  otherwise
+    error('generateMP: unknown geometry type %s',geo.type);
+end
+
+% res.elems contains all elements of the bounding box
+minIndex = point2ElemIndexIJ(bbox([1 3]),mesh);
+maxIndex = point2ElemIndexIJ(bbox([2 4]),mesh);
+[J,I]    = ndgrid(minIndex.j:maxIndex.j,minIndex.i:maxIndex.i);
+res.elems = I(:) + mesh.numx*(J(:)-1);
+
+if exist('SeedParticles','file') == 3
+  [coord,volume] = SeedParticles('grid',org,h,nel,ppc,place,shape,g,jitter,seed);
+else
+  % sub-cell points of all cells of the bounding box at once
+  if strcmp(place,'gauss')
+    [W1,Q1] = quadrature(ppc(1),'GAUSS',1);
+    [W2,Q2] = quadrature(ppc(2),'GAUSS',1);
+    r1 = (Q1(:)'+1)/2; f1 = W1(:)'/2;
+    r2 = (Q2(:)'+1)/2; f2 = W2(:)'/2;
+  else
+    r1 = ((1:ppc(1))-0.5)/ppc(1); f1 = ones(1,ppc(1))/ppc(1);
+    r2 = ((1:ppc(2))-0.5)/ppc(2); f2 = ones(1,ppc(2))/ppc(2);
+  end
+  [R1,R2] = ndgrid(r1,r2);
+  [F1,F2] = ndgrid(f1,f2);
+  x = org(1) + (repmat(I(:)',numel(R1),1) - 1 + repmat(R1(:),1,numel(I)))*h(1);
+  y = org(2) + (repmat(J(:)',numel(R1),1) - 1 + repmat(R2(:),1,numel(I)))*h(2);
+  if strcmp(place,'random')
+    % local stream: reproducible for a given seed, the global one untouched
+    s = RandStream('mt19937ar','Seed',seed);
+    x = x + jitter*(rand(s,size(x))-0.5)*h(1)/ppc(1);
+    y = y + jitter*(rand(s,size(y))-0.5)*h(2)/ppc(2);
+  end
+  volume = repmat(F1(:).*F2(:)*prod(h),1,numel(I));
+  coord  = [x(:) y(:)];
+  volume = volume(:);
+  switch shape
+    case 'box'
+      in = coord(:,1) > g(1) & coord(:,1) < g(2) & coord(:,2) > g(3) & coord(:,2) < g(4);
+    case 'circle'
+      in = (coord(:,1)-g(1)).^2 + (coord(:,2)-g(2)).^2 < g(3)^2;
+    case 'polygon'
+      in = inpolygon(coord(:,1),coord(:,2),g(:,1),g(:,2));
+  end
+  coord  = coord(in,:);
+  volume = volume(in);
+end
+
+if strcmp(geo.type,'sdf')
+  if isfield(geo,'tree')
+    in   = sdfDistance(geo.tree,coord) < 0;
+  else
+    d    = geo.fd(coord);
+    in   = d(:,end) < 0;
+  end
+  coord  = coord(in,:);
+  volume = volume(in);
+end
+
+res.position  = coord;
+res.volume    = volume;
@@ -6,26 +6,18 @@ grayIm = rgb2gray(A);
 dx     = 10/noPixelX;
 dy     = 10/noPixelY;
 
-pts1 = [];
-pts2 = [];
+% intensity -> material: 0 is phase 1, 45944 is phase 2, other pixels are
+% empty. One particle per pixel, use block to coarsen (see voxelParticles).
+map    = [0     1;
+          45944 2];
 
-for j=1:noPixelY
-    for i=1:noPixelX
-       intensity = grayIm(i,j); 
-       x  = (i-1)*dx + dx/2; 
-       y  = (j-1)*dy + dy/2; 
-       
-       if     (intensity==0)
-           pts1 = [pts1;x y];
-       elseif (intensity==45944)
-           pts2 = [pts2;x y];
-       end
-    end
-end
+[pts,vol,phase] = voxelParticles(grayIm,map,[dx dy]);
+
+pts1 = pts(phase==1,:);
+pts2 = pts(phase==2,:);
 
 figure(1)
 hold on
 plot(pts1(:,1),pts1(:,2),'rs');
 plot(pts2(:,1),pts2(:,2),'b.');
 axis equal
-
@@ -0,0 +1,41 @@
+function d = sdfDistance(tree,P)
+% Signed distance (the last column of the PolyMesher distance functions)
+% of the points P (np x nsd) to the domain described by the expression
+% tree built with sdfOp. Uses the compiled SdfTree (mex) when it is
+% available.
+
+if exist('SdfTree','file') == 3
+  d = SdfTree('eval',tree,P);
+  return
+end
+
+stack = cell(size(tree,1),1);
+sp    = 0;
+for i=1:size(tree,1)
+  a = tree(i,2:end);
+  switch tree(i,1)
+    case 1
+      s = sqrt((P(:,1)-a(1)).^2+(P(:,2)-a(2)).^2)-a(3);
+    case 2
+      s = max([a(1)-P(:,1), P(:,1)-a(2), a(3)-P(:,2), P(:,2)-a(4)],[],2);
+    case 3
+      n = [a(3)-a(1), a(4)-a(2)]; n = n/norm(n);
+      s = (P(:,1)-a(1))*n(2) - (P(:,2)-a(2))*n(1);
+    case 4
+      s = sqrt((P(:,1)-a(1)).^2+(P(:,2)-a(2)).^2+(P(:,3)-a(3)).^2)-a(4);
+    case 5
+      s = max([a(1)-P(:,1), P(:,1)-a(2), a(3)-P(:,2), P(:,2)-a(4), ...
+               a(5)-P(:,3), P(:,3)-a(6)],[],2);
+    case 11
+      s = min(stack{sp-1},stack{sp});   sp = sp-2;
+    case 12
+      s = max(stack{sp-1},stack{sp});   sp = sp-2;
+    case 13
+      s = max(stack{sp-1},-stack{sp});  sp = sp-2;
+    otherwise
+      error('sdfDistance: unknown instruction %d',tree(i,1));
+  end
+  sp = sp+1;
+  stack{sp} = s;
+end
+d = stack{1};
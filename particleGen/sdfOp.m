@@ -0,0 +1,38 @@
+function tree = sdfOp(op,varargin)
+% Expression tree of a signed distance function, built as the PolyMesher
+% distance functions are composed, for SdfTree (mex), sdfDistance and
+% sdfParticles. The tree is a postfix program, one instruction per row
+% [code p1 .. p6]:
+%
+% sdfOp('circle',xc,yc,r)            dCircle
+% sdfOp('rectangle',x1,x2,y1,y2)     dRectangle
+% sdfOp('line',x1,y1,x2,y2)          dLine (negative on the left hand side)
+% sdfOp('sphere',xc,yc,zc,r)
+% sdfOp('box',x1,x2,y1,y2,z1,z2)
+% sdfOp('union',t1,t2,...)           dUnion     (min)
+% sdfOp('intersect',t1,t2,...)       dIntersect (max)
+% sdfOp('diff',t1,t2)                dDiff      (max(d1,-d2))
+%
+% Example, the MBB beam with a hole:
+% tree = sdfOp('diff',sdfOp('rectangle',0,3,0,1),sdfOp('circle',1.5,0.5,0.2));
+
+codes = {'circle',1; 'rectangle',2; 'line',3; 'sphere',4; 'box',5;
+         'union',11; 'intersect',12; 'diff',13};
+k = find(strcmp(codes(:,1),op));
+if isempty(k), error('sdfOp: unknown operation %s',op); end
+code = codes{k,2};
+
+if code < 10
+  p    = [varargin{:}];
+  tree = zeros(1,7);
+  tree(1,1:numel(p)+1) = [code p];
+else
+  if numel(varargin) < 2 || ( code == 13 && numel(varargin) ~= 2 )
+    error('sdfOp: %s expects two trees (or more for union, intersect)',op);
+  end
+  % left-folded: ((t1 op t2) op t3) ...
+  tree = varargin{1};
+  for i=2:numel(varargin)
+    tree = [tree; varargin{i}; code zeros(1,6)];
+  end
+end
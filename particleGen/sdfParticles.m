@@ -0,0 +1,44 @@
+function [pts,vol,level] = sdfParticles(tree,bbox,h,levels,adaptive)
+% Particles of the domain described by the signed distance expression
+% tree (sdfOp, or the 'Tree' demand of the PolyMesher domain files):
+% centres of the cells of size h (scalar or [hx hy (hz)]) of the grid of
+% origin bbox(1:2:end) that are inside the domain (d < 0).
+% Uses the compiled SdfTree (mex) when it is available: a quadtree (octree
+% in 3D) of depth levels (default: root cells of about 8 particles) is
+% refined only near the boundary, cells inside the domain give their
+% particles without evaluating the distance.
+% Inputs:
+% bbox     : [xmin xmax ymin ymax (zmin zmax)]
+% adaptive : true to give a single particle (volume of the cell) for the
+%            cells of the tree inside the domain (default false)
+%
+% Outputs:
+% pts      : particle positions (np x nsd)
+% vol      : particle volumes (np x 1)
+% level    : tree level of the particle, 0 for the cells of size h
+%
+% Example: particles of the wrench of PolyMesher
+% [pts,vol] = sdfParticles(WrenchDomain('Tree'),WrenchDomain('BdBox'),0.005);
+
+if nargin < 4, levels   = []; end
+if nargin < 5, adaptive = false; end
+
+if exist('SdfTree','file') == 3
+  [pts,vol,level] = SdfTree('sample',tree,bbox,h,levels,adaptive);
+  return
+end
+
+% all cells of the bounding box
+nsd = numel(bbox)/2;
+h   = h(:)'.*ones(1,nsd);
+org = bbox(1:2:end);
+for i=1:nsd
+  x{i} = org(i) + ((1:ceil(( bbox(2*i)-org(i) )/h(i) - 1e-12)) - 0.5)*h(i);
+end
+X   = cell(1,nsd);
+[X{:}] = ndgrid(x{:});
+pts = zeros(numel(X{1}),nsd);
+for i=1:nsd, pts(:,i) = X{i}(:); end
+pts   = pts(sdfDistance(tree,pts) < 0,:);
+vol   = prod(h)*ones(size(pts,1),1);
+level = zeros(size(pts,1),1);
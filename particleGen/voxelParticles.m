@@ -0,0 +1,63 @@
+function [pts,vol,phase] = voxelParticles(img,map,spacing,block,origin)
+% Particles of a 2D image or a 3D voxel stack with their volumes and
+% material (phase) ids. Uses the compiled ImageParticles (mex) when it is
+% available.
+% Inputs:
+% img    : nx x ny image or nx x ny x nz stack, dimension 1 along x
+% map    : intensity -> material map, rows [intensity id] or [lo hi id]
+%          (lo <= intensity <= hi); voxels not in the map are empty
+% spacing: voxel size [dx dy (dz)]
+% block  : voxels per particle in each direction (default 1). A block
+%          gives one particle per phase it contains, at the centroid of
+%          the voxels of that phase. For a background grid of cell size h
+%          and ppc particles per direction, block = h/(ppc*dx).
+% origin : coordinates of the corner of the first voxel (default 0)
+%
+% Outputs:
+% pts    : particle positions (np x nsd)
+% vol    : particle volumes (np x 1)
+% phase  : material ids (np x 1)
+
+if nargin < 4 || isempty(block),  block  = 1; end
+if nargin < 5 || isempty(origin), origin = 0; end
+
+if exist('ImageParticles','file') == 3
+  [pts,vol,phase] = ImageParticles(img,map,spacing,block,origin);
+  return
+end
+
+nsd    = max(ndims(img),2);
+sz     = size(img);
+h      = spacing(min(1:nsd,numel(spacing)));
+block  = round(block(min(1:nsd,numel(block))));
+origin = origin(min(1:nsd,numel(origin)));
+
+% material id of every voxel, the first matching row of map wins
+ph = zeros(sz);
+for m = 1:size(map,1)
+  if size(map,2) == 2
+    ph(img == map(m,1) & ph == 0) = map(m,2);
+  else
+    ph(img >= map(m,1) & img <= map(m,2) & ph == 0) = map(m,3);
+  end
+end
+
+id  = find(ph);
+sub = cell(1,nsd);
+[sub{:}] = ind2sub(sz,id);
+bsub = cell(1,nsd);
+for d = 1:nsd
+  bsub{d} = ceil(sub{d}/block(d));
+end
+nphase = max(map(:,end));
+blk    = sub2ind([ceil(sz./block) 1],bsub{:});
+
+% one particle per (block, phase), ordered by block then phase
+[key,~,g] = unique((blk-1)*nphase + ph(id) - 1);
+cnt   = accumarray(g,1);
+pts   = zeros(length(key),nsd);
+for d = 1:nsd
+  pts(:,d) = origin(d) + (accumarray(g,sub{d})./cnt - 0.5)*h(d);
+end
+vol   = cnt*prod(h);
+phase = mod(key,nphase) + 1;
@@ -0,0 +1,43 @@
+function [pts,vol,phase] = voxelStackParticles(slice,nz,map,spacing,block,origin)
+% Particles of a 3D voxel stack (e.g. micro-CT) read slice by slice, so
+% that only block(3) slices are held in memory at a time.
+% Inputs:
+% slice  : function handle, slice(k) returns slice k (nx x ny), e.g.
+%          @(k) imread(sprintf('ct%04d.tif',k))
+% nz     : number of slices
+% map, spacing, block, origin: see voxelParticles
+%
+% Outputs: see voxelParticles
+
+if nargin < 5 || isempty(block),  block  = 1; end
+if nargin < 6 || isempty(origin), origin = 0; end
+
+block  = round(block(min(1:3,numel(block))));
+origin = origin(min(1:3,numel(origin)));
+dz     = spacing(end);
+
+nslab = ceil(nz/block(3));
+P     = cell(nslab,1);
+V     = cell(nslab,1);
+F     = cell(nslab,1);
+
+for s = 1:nslab
+  k0   = (s-1)*block(3) + 1;
+  k1   = min(s*block(3),nz);
+  slab = slice(k0);
+  slab = repmat(slab,[1 1 k1-k0+1]);
+  for k = k0+1:k1
+    slab(:,:,k-k0+1) = slice(k);
+  end
+  [p,V{s},F{s}] = voxelParticles(slab,map,spacing,block,origin + [0 0 (k0-1)*dz]);
+  % a single slice is a 2D image: add the third coordinate and thickness
+  if size(p,2) == 2
+    p    = [p repmat(origin(3) + (k0-0.5)*dz,size(p,1),1)];
+    V{s} = V{s}*dz;
+  end
+  P{s} = p;
+end
+
+pts   = cat(1,P{:});
+vol   = cat(1,V{:});
+phase = cat(1,F{:});
@@ -24,6 +24,21 @@ if (dim==2)
     x(:,3) = 0;
 end
 
+% binary output with the compiled writer
+
+if exist('WriteVTK','file') == 3
+    pdata.vonMises = sigma(:,4);
+    if (isfield(data,'pstrain')), pdata.pStrain = data.pstrain(:); end
+    pdata.sigmaXX  = sigma(:,1);
+    pdata.sigmaYY  = sigma(:,2);
+    pdata.sigmaXY  = sigma(:,3);
+    if (isfield(data,'velo')),    pdata.velocity = data.velo(:,1:2); end
+    if (isfield(data,'color')),   pdata.color    = data.color(:);    end
+    if (isfield(data,'damage')),  pdata.damage   = data.damage(:);   end
+    WriteVTK(strcat(vtuFile, '.vtp'), x, [], pdata, []);
+    return
+end
+
 % Output files
 
 outfileVTU  = strcat(vtuFile, '.vtp');
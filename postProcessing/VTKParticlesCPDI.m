@@ -22,11 +22,6 @@ if iscell(connect)
   connect = cell2mat(connect);
 end
 
-% Output files
-
-outfileVTU  = strcat(vtuFile, '.vtu');
-results_vtu = fopen(outfileVTU, 'wt');
-
 if(strcmp(etype, 'Q4') || strcmp(etype, 'Quad8') || strcmp(etype, 'Quad9'))
     numVertexesPerCell = 4;
     VTKCellCode = 9;
@@ -43,6 +38,23 @@ else
     error('Element type not known (VTKPostProcess)')
 end
 
+% binary output with the compiled writer
+
+if exist('WriteVTK','file') == 3
+    cells.conn  = connect(:,1:numVertexesPerCell);
+    cells.type  = VTKCellCode;
+    cdata.sigma = data.stress;
+    if (isfield(data,'disp')),  cdata.U     = data.disp;     end
+    if (isfield(data,'color')), cdata.color = data.color(:); end
+    WriteVTK(strcat(vtuFile, '.vtu'), x, cells, [], cdata);
+    return
+end
+
+% Output files
+
+outfileVTU  = strcat(vtuFile, '.vtu');
+results_vtu = fopen(outfileVTU, 'wt');
+
 
 dof_per_vertex = 2;
 
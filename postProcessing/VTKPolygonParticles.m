@@ -24,6 +24,14 @@ if (dim==2)
     x(:,3) = 0;
 end
 
+% binary output with the compiled writer
+
+if exist('WriteVTK','file') == 3
+    cells.conn = elem;
+    WriteVTK(strcat(vtpFile, '.vtp'), x, cells, [], []);
+    return
+end
+
 % Output files
 
 outfileVTU  = strcat(vtpFile, '.vtp');
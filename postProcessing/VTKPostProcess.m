@@ -14,11 +14,6 @@ dof      = ndofs;
 x        = node;
 connect  = elementV;
 
-% Output files
-
-outfileVTU  = strcat(vtuFile, '.vtu');
-results_vtu = fopen(outfileVTU, 'wt');
-
 if(strcmp(etype, 'Quad4') || strcmp(etype, 'Quad8') || strcmp(etype, 'Quad9'))
     numVertexesPerCell = 4;
     VTKCellCode = 9;
@@ -35,6 +30,22 @@ else
     error('Element type not known (VTKPostProcess)')
 end
 
+% binary output with the compiled writer
+
+if exist('WriteVTK','file') == 3
+    cells.conn  = connect(:,1:numVertexesPerCell);
+    cells.type  = VTKCellCode;
+    pdata.sigma = sigma;
+    pdata.U     = disp(:,1:ndofs);
+    WriteVTK(strcat(vtuFile, '.vtu'), x, cells, pdata, []);
+    return
+end
+
+% Output files
+
+outfileVTU  = strcat(vtuFile, '.vtu');
+results_vtu = fopen(outfileVTU, 'wt');
+
 
 dof_per_vertex = 2;
 
@@ -17,11 +17,6 @@ if size(sigma,2) == 6
     sigma = [sigma zeros(size(sigma,1),1)];
 end
 
-% Output files
-
-outfileVTU  = strcat(vtuFile, '.vtu');
-results_vtu = fopen(outfileVTU, 'wt');
-
 if(strcmp(etype, 'B8'))
     numVertexesPerCell = 8;
     VTKCellCode = 12;
@@ -32,6 +27,25 @@ else
     error('Element type not known (VTKPostProcess)')
 end
 
+% binary output with the compiled writer
+
+if exist('WriteVTK','file') == 3
+    cells.conn  = connect(:,1:numVertexesPerCell);
+    cells.type  = VTKCellCode;
+    pdata.sigma = sigma;
+    pdata.U     = disp(:,1:3);
+    if size(disp,2) == 4
+        pdata.dam = disp(:,4);
+    end
+    WriteVTK(strcat(vtuFile, '.vtu'), x, cells, pdata, []);
+    return
+end
+
+% Output files
+
+outfileVTU  = strcat(vtuFile, '.vtu');
+results_vtu = fopen(outfileVTU, 'wt');
+
 
 dof_per_vertex = 3;
 
@@ -0,0 +1,29 @@
+% Write a ParaView collection (.pvd) file that indexes the VTK files of a
+% time series, so that ParaView loads them as one data set with the
+% correct physical times.
+
+function VTKTimeSeries(pvdFile,files,times)
+
+% pvdFile:  collection file to be written (without the .pvd extension)
+% files:    cell array of the VTK file names (with extension)
+% times:    time of every file (default: 0,1,2,...)
+
+if nargin < 3
+    times = 0:length(files)-1;
+end
+
+fid = fopen(strcat(pvdFile, '.pvd'), 'wt');
+
+fprintf(fid,'<?xml version="1.0"?>\n');
+fprintf(fid,'<VTKFile type="Collection" version="0.1" byte_order="LittleEndian">\n');
+fprintf(fid,'<Collection>\n');
+
+for i=1:length(files)
+    fprintf(fid,'<DataSet timestep="%.10g" group="" part="0" file="%s"/>\n',...
+        times(i),files{i});
+end
+
+fprintf(fid,'</Collection>\n');
+fprintf(fid,'</VTKFile>\n');
+
+fclose(fid);
@@ -1,5 +1,13 @@
 function [cellDensity,normals] = computeGridNormal(grid,body) 
 
+% When mex/GridNormalCurvature.c is compiled, the cell densities and the
+% nodal normals come from its quadratic B-spline particle scatter.
+
+if exist('GridNormalCurvature','file') == 3
+  [normals,~,~,cellDensity] = GridNormalCurvature(body,grid);
+  return
+end
+
 %% retrieve grid data
 node      = grid.node;
 element   = grid.element;
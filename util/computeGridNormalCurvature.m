@@ -3,6 +3,22 @@ function [res] = computeGridNormalCurvature(grid,body)
 % Vinh Phu Nguyen
 % The University of Adelaide, SA, Australia
 % 3 September 2015.
+%
+% When mex/GridNormalCurvature.c is compiled, nodal densities, normals and
+% curvatures come from one quadratic B-spline particle scatter; the cell
+% densities are scattered the same way to the cell centres (as below) and
+% the cell curvatures use the cell-centre formula below on those normals.
+
+if exist('GridNormalCurvature','file') == 3
+  [normals,curva,dens,cdens,ccurva] = GridNormalCurvature(body,grid);
+  res.gNormals    = normals;
+  res.gCurvatures = curva;
+  res.nDensities  = dens;
+  res.cDensities  = cdens;
+  res.scDensities = cdens;
+  res.cCurvatures = ccurva;
+  return
+end
 
 %% retrieve grid data
 node      = grid.node;
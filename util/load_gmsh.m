@@ -20,6 +20,14 @@ msh.NODES_PER_TYPE_OF_ELEMENT = [
 % Change the name of OldMatrix and NewMatrix with the name of yours
 % SortColumn by the number of the last column
 
+% The compiled reader (mex/ReadGmsh.c) memory-maps the file and parses it
+% in bulk; it returns the same fields and also reads the binary and 4.1
+% formats, which the loop below does not.
+if exist('ReadGmsh','file') == 3
+  mesh = ReadGmsh(filename);
+  return
+end
+
 mesh = [];    
 mesh.MIN = zeros(3, 1);
 mesh.MAX = zeros(3, 1);
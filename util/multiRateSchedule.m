@@ -0,0 +1,27 @@
+function [dtime,nsub,dtsub] = multiRateSchedule(dtStable,dtMaster,maxSub)
+%
+% Multi-rate time stepping: every subsystem i (a field or a body) of
+% stable time step dtStable(i) is advanced with nsub(i) sub-steps of
+% dtsub(i) = dtime/nsub(i) per master step dtime, nsub(i) the smallest
+% integer such that dtsub(i) <= dtStable(i). The subsystems exchange
+% forces (fluxes) at the end of every master step, the sync points, so a
+% stiff subsystem no longer sets the time step of the others.
+%
+% dtStable : stable time steps of the subsystems (recomputed by the caller
+%            when they change, e.g. every master step)
+% dtMaster : master time step, usually the stable step of the subsystem
+%            that is not sub-cycled (default: max(dtStable))
+% maxSub   : maximum number of sub-steps (default Inf), the master step is
+%            reduced when a subsystem would need more
+%
+% Example: mechanical master step, heat equation sub-cycled
+% [dtime,nsub] = multiRateSchedule([dtMech dtTherm],dtMech);
+%
+
+if nargin < 2 || isempty(dtMaster), dtMaster = max(dtStable); end
+if nargin < 3 || isempty(maxSub),   maxSub   = Inf;           end
+
+dtStable = dtStable(:)';
+dtime    = min(dtMaster, maxSub*min(dtStable));
+nsub     = max(1, ceil(dtime./dtStable - 1e-10));
+dtsub    = dtime./nsub;
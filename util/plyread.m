@@ -24,6 +24,21 @@ function [Elements,varargout] = plyread(Path,Str)
 
 % Pascal Getreuer 2004
 
+if exist('PlyIO','file') == 3
+   % compiled reader (mex/PlyIO.c): memory-mapped, returns the same Elements
+   [Elements,Comments] = PlyIO('read',Path);
+   ElementNames = fieldnames(Elements)';
+   PropertyNames = [];
+
+   for i = 1:length(ElementNames)
+      if isstruct(Elements.(ElementNames{i}))
+         PropertyNames.(ElementNames{i}) = fieldnames(Elements.(ElementNames{i}))';
+      else
+         PropertyNames.(ElementNames{i}) = {};
+      end
+   end
+else
+
 [fid,Msg] = fopen(Path,'rt');	% open file in read text mode
 
 if fid == -1, error(Msg); end
@@ -384,6 +399,7 @@ end
 
 clear Data ListData;
 fclose(fid);
+end
 
 if (nargin > 1 & strcmpi(Str,'Tri')) | nargout > 2   
    % find vertex element field
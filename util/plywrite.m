@@ -76,6 +76,15 @@ function plywrite ( Elements, Path, Format, Str )
 
   end
 
+  if ( exist('PlyIO','file') == 3 )
+%
+%  compiled writer (mex/PlyIO.c), same header and types, binary data
+%  filled in parallel
+%
+    PlyIO('write',Path,Elements,Format,Str);
+    return
+  end
+
   [ fid, Msg ] = fopen ( Path, 'wt' );
 
   if ( fid == -1 )
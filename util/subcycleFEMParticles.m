@@ -0,0 +1,86 @@
+function [nmomentum,nmomentumInt,body,fem,energy] = subcycleFEMParticles(nmass,nmomentum0,nforce,...
+                                                      body,mpmBodies,fem,mesh,dtime,nsub,fixedNodes,tol)
+%
+% Multi-rate update of the grid momenta in the MPM-FEM drivers
+% (mpmFEMDiskWire.m, mpmBubble.m), where the nodes of a FEM wire or
+% membrane are particles of the grid: the nodal forces nforce of the MPM
+% bodies are held over the master step dtime while the FEM (truss) forces
+% are recomputed at each of the nsub sub-steps dtime/nsub (see
+% multiRateSchedule), with the grid basis of all particles at the
+% beginning of the step (coord0).
+%
+% nmass, nmomentum0 : nodal masses and momenta of all bodies (MPM and FEM)
+% nforce            : nodal forces of the MPM bodies
+% body              : FEM particles, fields coord, coord0, mass, velo and fp
+% mpmBodies         : cell array of the MPM bodies, fields coord0 and mass
+% fem               : truss elements, see trussForces
+% fixedNodes        : grid nodes of zero momentum
+%
+% Outputs:
+% nmomentum    : nodal momenta at the end of the master step
+% nmomentumInt : time integral of the nodal momenta over the master step,
+%                the MPM particles move by N*nmomentumInt/nmass
+% body         : FEM particles with the velocity change and displacement
+%                of every sub-step, and their new forces fp
+% energy       : strain energy of the FEM body
+%
+% The grid receives the impulse dtime*nforce + sum_k dtime/nsub*N'*fp_k
+% and hands it back to the particles through the momentum changes, so
+% momentum is exchanged consistently at the sync points. As in the MUSL
+% update of the single rate drivers, the truss strains come from the
+% nodal momenta of the updated particle velocities mapped back to the
+% grid, nmomentum0 + Mc*(nmomentum - nmomentum0)/nmass with Mc the
+% consistent mass matrix of all particles, while the FEM particles move
+% with the nodal momenta. With nsub = 1 this is the single rate update of
+% mpmFEMDiskWire.m.
+
+nodeCount = size(mesh.node,1);
+
+% grid basis of the FEM particles and consistent mass matrix of all
+% particles, fixed over the master step
+Nw = gridBasis(body.coord0,mesh);
+Mc = Nw'*spdiags(body.mass(:),0,size(Nw,1),size(Nw,1))*Nw;
+for ib=1:length(mpmBodies)
+  Nb = gridBasis(mpmBodies{ib}.coord0,mesh);
+  Mc = Mc + Nb'*spdiags(mpmBodies{ib}.mass(:),0,size(Nb,1),size(Nb,1))*Nb;
+end
+
+minv      = zeros(nodeCount,1);
+act       = nmass > tol;
+minv(act) = 1./nmass(act);
+minv      = [minv minv];
+
+dtsub        = dtime/nsub;
+nmomentum    = nmomentum0;
+nmomentumInt = zeros(size(nmomentum0));
+energy       = 0;
+
+for k=1:nsub
+  nmomentumOld = nmomentum;
+  nmomentum    = nmomentum + dtsub*(nforce + Nw'*body.fp);
+  nmomentum(fixedNodes,:) = 0;
+  nmomentumInt = nmomentumInt + dtsub*nmomentum;
+  % FEM particles follow the grid at every sub-step, their displacement
+  % increments from the mapped back momenta
+  nmomentumS   = nmomentum0 + Mc*((nmomentum-nmomentum0).*minv);
+  nmomentumS(fixedNodes,:) = 0;
+  du           = dtsub*Nw*(nmomentumS.*minv);
+  body.velo    = body.velo  + Nw*((nmomentum-nmomentumOld).*minv);
+  body.coord   = body.coord + dtsub*Nw*(nmomentum.*minv);
+  [body.fp,fem,energy] = trussForces(body.coord,du,fem);
+end
+
+function Nw = gridBasis(coord,mesh)
+% linear grid basis of the particles at coord, rows the particles
+np   = size(coord,1);
+rows = zeros(4*np,1); cols = rows; vals = rows;
+for p=1:np
+  e     = point2ElemIndex(coord(p,:),mesh);
+  esctr = mesh.element(e,:);
+  for i=1:length(esctr)
+    [N,~]   = getMPM2D(coord(p,:) - mesh.node(esctr(i),:),mesh.deltax,mesh.deltay);
+    k       = 4*(p-1) + i;
+    rows(k) = p;  cols(k) = esctr(i);  vals(k) = N;
+  end
+end
+Nw = sparse(rows,cols,vals,np,size(mesh.node,1));
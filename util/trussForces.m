@@ -0,0 +1,38 @@
+function [fp,fem,energy] = trussForces(coord,du,fem)
+%
+% Nodal forces of the two-noded, linear elastic truss elements of a wire
+% or membrane modelled with FEM in the MPM-FEM drivers (mpmFEMDiskWire.m,
+% mpmBubble.m), the FEM nodes being particles of the background grid.
+%
+% coord : FEM node (particle) positions at the end of the increment
+% du    : FEM node displacement increments
+% fem   : element (connectivity), estress, estrain, le (current element
+%         lengths), E (Young modulus) and A (cross section area); the
+%         element stresses and strains are updated incrementally
+%
+% energy: strain energy of the truss elements
+%
+
+fp     = zeros(size(coord));
+energy = 0;
+
+for e=1:size(fem.element,1)
+  esctr    = fem.element(e,:);
+  nodes    = coord(esctr,:);
+  ll       = norm(nodes(1,:)-nodes(2,:));
+  cosTheta = (nodes(2,1)-nodes(1,1))/ll;
+  sinTheta = (nodes(2,2)-nodes(1,2))/ll;
+  Q        = [cosTheta  sinTheta;-sinTheta cosTheta];
+  Qinv     = [cosTheta -sinTheta;sinTheta cosTheta];
+  deltaU1  = Q*du(esctr(1),:)';
+  deltaU2  = Q*du(esctr(2),:)';
+  incStrain = (1/ll)*(-deltaU1(1)+deltaU2(1));
+  fem.estrain(e) = fem.estrain(e) + incStrain;
+  sig            = fem.estress(e) + fem.E*incStrain;
+  fem.estress(e) = sig;
+  fem.le(e)      = ll;
+  force          = sig*fem.A;
+  fp(esctr(1),:) = fp(esctr(1),:) + (Qinv*[force;0])';
+  fp(esctr(2),:) = fp(esctr(2),:) - (Qinv*[force;0])';
+  energy         = energy + fem.estrain(e)*sig*0.5*ll;
+end